@@ -0,0 +1,250 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "adaptiveresampler.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <stdexcept>
+
+using namespace Csdrx;
+
+// the ratio is updated every 10ms of input
+static constexpr double CONTROL_INTERVAL = 0.01;
+
+template <typename T>
+static inline float to_float(T sample);
+
+template <>
+inline float to_float(short sample) {
+    return sample;
+}
+
+template <>
+inline float to_float(float sample) {
+    return sample;
+}
+
+template <typename T>
+static inline T from_float(float sample);
+
+template <>
+inline short from_float(float sample) {
+    return (short) lrintf(std::min(std::max(sample, -32768.0f), 32767.0f));
+}
+
+template <>
+inline float from_float(float sample) {
+    return sample;
+}
+
+// 4-point, 3rd order Hermite interpolation between x[0] and x[s] (s is the
+// distance between the samples of a channel)
+static inline float cubic(const float* x, ptrdiff_t s, float t) {
+    float c1 = 0.5f * (x[s] - x[-s]);
+    float c2 = x[-s] - 2.5f * x[0] + 2.0f * x[s] - 0.5f * x[2 * s];
+    float c3 = 0.5f * (x[2 * s] - x[-s]) + 1.5f * (x[0] - x[s]);
+    return ((c3 * t + c2) * t + c1) * t + x[0];
+}
+
+template <typename T>
+AdaptiveResampler<T>::AdaptiveResampler(Csdr::Writer<T>* writer, double samplerate,
+                                        std::function<double()> latency_callback,
+                                        double target_latency, double time_constant,
+                                        double max_correction, size_t buffer_size,
+                                        unsigned int channels):
+    writer(writer),
+    samplerate(samplerate),
+    latency_callback(latency_callback),
+    buffer_size(buffer_size * std::max(channels, 1u)),
+    channels(std::max(channels, 1u)),
+    buffer(new T[this->buffer_size]),
+    work(new float[this->buffer_size + 3 * this->channels]()),
+    control_interval(std::max(size_t(samplerate * CONTROL_INTERVAL), (size_t) 1)),
+    target_latency(target_latency),
+    time_constant(time_constant),
+    max_correction(max_correction),
+    latency(-1),
+    ratio(1),
+    input_samples(0),
+    output_samples(0),
+    dropped_samples(0)
+{
+    if (time_constant <= 0)
+        throw std::runtime_error("invalid time constant");
+}
+
+template <typename T>
+AdaptiveResampler<T>::~AdaptiveResampler() {
+    delete[] work;
+    delete[] buffer;
+}
+
+template <typename T>
+size_t AdaptiveResampler<T>::writeable() {
+    return buffer_size - partial;
+}
+
+template <typename T>
+T* AdaptiveResampler<T>::getWritePointer() {
+    return buffer + partial;
+}
+
+template <typename T>
+void AdaptiveResampler<T>::advance(size_t how_much) {
+    if (how_much == 0)
+        return;
+    input_samples += how_much;
+    // only whole frames are resampled
+    size_t available = partial + how_much;
+    size_t frames = available / channels;
+    partial = available - frames * channels;
+    if (frames == 0)
+        return;
+    resample(frames);
+    std::copy(buffer + frames * channels, buffer + available, buffer);
+    control_count += frames;
+    if (control_count >= control_interval)
+        update_ratio();
+}
+
+template <typename T>
+void AdaptiveResampler<T>::resample(size_t frames) {
+    size_t n = channels;
+    for (size_t i = 0; i < frames * n; i++)
+        work[3 * n + i] = to_float(buffer[i]);
+    // each output frame is interpolated between frames i and i + 1 of work,
+    // with i = floor(position); frames i - 1 and i + 2 are needed too
+    size_t end = frames + 3;
+    while ((size_t) position + 2 < end) {
+        size_t space = writer->writeable() / n;
+        if (space == 0) {
+            // never wait for the sink
+            while ((size_t) position + 2 < end) {
+                position += step;
+                dropped_samples += n;
+            }
+            break;
+        }
+        T* out = writer->getWritePointer();
+        size_t count = 0;
+        while (count < space) {
+            size_t i = (size_t) position;
+            if (i + 2 >= end)
+                break;
+            float t = float(position - i);
+            for (size_t c = 0; c < n; c++)
+                out[count * n + c] = from_float<T>(cubic(work + i * n + c, n, t));
+            count++;
+            position += step;
+        }
+        writer->advance(count * n);
+        output_samples += count * n;
+    }
+    memmove(work, work + (end - 3) * n, 3 * n * sizeof(float));
+    position -= end - 3;
+}
+
+// critically damped PI loop (natural frequency 1/time_constant) on the
+// latency, low pass filtered to smooth out the steps of the sink buffer
+template <typename T>
+void AdaptiveResampler<T>::update_ratio() {
+    double dt = control_count / samplerate;
+    control_count = 0;
+    double reading = latency_callback();
+    if (reading < 0)
+        return;
+    double tc = time_constant;
+    double filtered = latency;
+    if (filtered < 0)
+        filtered = reading;
+    else
+        filtered += std::min(dt / (0.1 * tc), 1.0) * (reading - filtered);
+    latency = filtered;
+
+    double error = filtered - target_latency;
+    double kp = 2 / tc;
+    double ki = 1 / (tc * tc);
+    double max = max_correction * 1e-6;
+    // anti-windup: the integral alone never asks for more than the limit
+    integral = std::min(std::max(integral + error * dt, -max / ki), max / ki);
+    double correction = std::min(std::max(-(kp * error + ki * integral), -max), max);
+    ratio = 1 + correction;
+    step = 1 / (1 + correction);
+}
+
+// setters
+template <typename T>
+void AdaptiveResampler<T>::setTargetLatency(double target_latency) {
+    this->target_latency = target_latency;
+}
+
+template <typename T>
+void AdaptiveResampler<T>::setTimeConstant(double time_constant) {
+    if (time_constant <= 0)
+        throw std::runtime_error("invalid time constant");
+    this->time_constant = time_constant;
+}
+
+template <typename T>
+void AdaptiveResampler<T>::setMaxCorrection(double max_correction) {
+    this->max_correction = max_correction;
+}
+
+// getters
+template <typename T>
+double AdaptiveResampler<T>::getTargetLatency() const {
+    return target_latency;
+}
+
+template <typename T>
+double AdaptiveResampler<T>::getLatency() const {
+    return latency;
+}
+
+template <typename T>
+double AdaptiveResampler<T>::getLatencyError() const {
+    double latency = this->latency;
+    return latency < 0 ? 0 : latency - target_latency;
+}
+
+template <typename T>
+double AdaptiveResampler<T>::getRatio() const {
+    return ratio;
+}
+
+template <typename T>
+double AdaptiveResampler<T>::getCorrection() const {
+    return (ratio - 1) * 1e6;
+}
+
+template <typename T>
+unsigned int AdaptiveResampler<T>::getChannels() const {
+    return channels;
+}
+
+template <typename T>
+size_t AdaptiveResampler<T>::getInputSamples() const {
+    return input_samples;
+}
+
+template <typename T>
+size_t AdaptiveResampler<T>::getOutputSamples() const {
+    return output_samples;
+}
+
+template <typename T>
+size_t AdaptiveResampler<T>::getDroppedSamples() const {
+    return dropped_samples;
+}
+
+namespace Csdrx {
+    template class AdaptiveResampler<short>;
+    template class AdaptiveResampler<float>;
+}
@@ -0,0 +1,91 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <csdr/writer.hpp>
+#include <atomic>
+#include <functional>
+
+namespace Csdrx {
+
+    // fractional resampler in front of an audio writer that follows the
+    // clock of the sound card: the sample clock of the SDR and the clock of
+    // the sound card never agree, so the audio buffered in the sink slowly
+    // grows (latency) or runs out (clicks). The resampling ratio is steered
+    // by a PI loop that keeps the sink latency (read with the callback, for
+    // instance PulseAudioWriter::getTotalLatency()) at the target; the loop
+    // is critically damped with the given time constant (seconds), and the
+    // correction is limited to 'max_correction' ppm.
+    // With more than one channel the samples are interleaved, and each
+    // channel is interpolated at the same positions; 'samplerate' and
+    // 'buffer_size' are in frames (one sample per channel).
+    // The downstream writer is not owned by the resampler
+    template <typename T>
+    class AdaptiveResampler: public Csdr::Writer<T> {
+        public:
+            AdaptiveResampler(Csdr::Writer<T>* writer, double samplerate,
+                              std::function<double()> latency_callback,
+                              double target_latency, double time_constant = 20,
+                              double max_correction = 1000,
+                              size_t buffer_size = 10240,
+                              unsigned int channels = 1);
+            ~AdaptiveResampler();
+            size_t writeable() override;
+            T* getWritePointer() override;
+            void advance(size_t how_much) override;
+            // setters
+            void setTargetLatency(double target_latency);   // seconds
+            void setTimeConstant(double time_constant);     // seconds
+            void setMaxCorrection(double max_correction);   // ppm
+            // getters
+            double getTargetLatency() const;
+            // filtered latency, -1 before the first reading
+            double getLatency() const;
+            double getLatencyError() const;
+            // output samples per input sample
+            double getRatio() const;
+            // ratio - 1 in ppm
+            double getCorrection() const;
+            unsigned int getChannels() const;
+            // samples of all the channels
+            size_t getInputSamples() const;
+            size_t getOutputSamples() const;
+            // output samples the downstream writer had no room for
+            size_t getDroppedSamples() const;
+        private:
+            void resample(size_t how_much);
+            void update_ratio();
+
+            Csdr::Writer<T>* writer;
+            double samplerate;
+            std::function<double()> latency_callback;
+            size_t buffer_size;
+            unsigned int channels;
+            T* buffer;
+            // samples of an incomplete frame, kept at the start of buffer
+            size_t partial = 0;
+            // the last 3 input frames are kept in front of the new ones for
+            // the cubic interpolator
+            float* work;
+            double position = 1;
+            double step = 1;
+            // control loop
+            size_t control_interval;
+            size_t control_count = 0;
+            double integral = 0;
+            std::atomic<double> target_latency;
+            std::atomic<double> time_constant;
+            std::atomic<double> max_correction;
+            std::atomic<double> latency;
+            std::atomic<double> ratio;
+            // statistics
+            std::atomic<size_t> input_samples;
+            std::atomic<size_t> output_samples;
+            std::atomic<size_t> dropped_samples;
+    };
+}
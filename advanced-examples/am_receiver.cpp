@@ -115,9 +115,17 @@ int main(int argc, char *argv[])
 
     p.run();
 
+    p.setFlushOnRetune(true);
+
     // set IF AGC
     rspdx->setIFGainReduction(0);
     
+    // frequency and gain changes are applied asynchronously (only the last
+    // of a burst of changes is sent to the device), so the command loop
+    // never waits for the SDRplay API; the errors are printed by the
+    // callback (the other advanced examples do the same)
+    auto report_error = ControlQueue::logErrors("errore: ");
+
     while (true) {
         std::string command;
 
@@ -133,9 +141,9 @@ int main(int argc, char *argv[])
         } else if (command == "") {    // ignore empty lines
             continue;
         } else if (sscanf(command.c_str(), "F%lf", &d_value) == 1) {
-            rspdx->setFrequency(d_value + offset);
+            rspdx->setFrequencyAsync(d_value + offset, report_error);
         } else if (sscanf(command.c_str(), "R%lf", &d_value) == 1) {
-            rspdx->setRFLnaState(d_value);
+            rspdx->setRFLnaStateAsync(d_value, report_error);
         } else if (command == "r") {
             std::cout << std::to_string(rspdx->getRFLnaState()) << std::endl;
         } else if (command == "f") {
@@ -127,10 +127,15 @@ int main(int argc, char *argv[])
       | new PulseAudioWriter<short>(8000, 10240, "ysf_receiver");
 
     p.run();
+
+    p.setFlushOnRetune(true);
     
     // set IF AGC
     rspdx->setIFGainReduction(0);
 
+    // asynchronous settings, see am_receiver.cpp
+    auto report_error = ControlQueue::logErrors("errore: ");
+
     while (true) {
         std::string command;
 
@@ -146,9 +151,9 @@ int main(int argc, char *argv[])
         } else if (command == "") {    // ignore empty lines
             continue;
         } else if (sscanf(command.c_str(), "F%lf", &d_value) == 1) {
-            rspdx->setFrequency(d_value + offset);
+            rspdx->setFrequencyAsync(d_value + offset, report_error);
         } else if (sscanf(command.c_str(), "R%lf", &d_value) == 1) {
-            rspdx->setRFLnaState(d_value);
+            rspdx->setRFLnaStateAsync(d_value, report_error);
         } else if (command == "r") {
             std::cout << std::to_string(rspdx->getRFLnaState()) << std::endl;
         } else if (command == "f") {
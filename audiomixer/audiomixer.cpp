@@ -0,0 +1,365 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "audiomixer.hpp"
+
+#include <csdr/complex.hpp>
+#include <csdrx/kernels.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+using namespace Csdrx;
+
+// each input queue holds this much audio, at least
+static constexpr double INPUT_QUEUE_DURATION = 1.0;
+static constexpr size_t INPUT_BUFFER_SIZE = 10240;
+
+template <typename T>
+static void mix_stereo(const T* x, float gain_left, float gain_right, float* y, size_t n);
+
+template <>
+void mix_stereo(const short* x, float gain_left, float gain_right, float* y, size_t n) {
+    mix_stereo_s16(x, gain_left, gain_right, y, n);
+}
+
+template <>
+void mix_stereo(const float* x, float gain_left, float gain_right, float* y, size_t n) {
+    mix_stereo_f32(x, gain_left, gain_right, y, n);
+}
+
+template <typename T>
+static void accumulate_sums(const T* x, size_t n, SignalSums& sums);
+
+template <>
+void accumulate_sums(const short* x, size_t n, SignalSums& sums) {
+    accumulate_sums_s16(x, n, 1.0f, sums);
+}
+
+template <>
+void accumulate_sums(const float* x, size_t n, SignalSums& sums) {
+    accumulate_sums_f32(x, n, 1.0f, sums);
+}
+
+// interleaved left/right floats to the output format (one frame is a pair,
+// like a complex sample)
+template <typename T>
+static void convert_output(const float* x, T* out, size_t frames);
+
+template <>
+void convert_output(const float* x, short* out, size_t frames) {
+    convert_cf32_to_cs16(reinterpret_cast<const Csdr::complex<float>*>(x),
+                         reinterpret_cast<Csdr::complex<short>*>(out), frames);
+}
+
+template <>
+void convert_output(const float* x, float* out, size_t frames) {
+    memcpy(out, x, 2 * frames * sizeof(float));
+}
+
+template <typename T>
+AudioMixer<T>::AudioMixer(Csdr::Writer<T>* writer, double samplerate,
+                          double block_duration, double idle_timeout):
+    writer(writer),
+    samplerate(samplerate),
+    block_size(std::max(size_t(samplerate * block_duration), (size_t) 1)),
+    late_timeout(block_size / samplerate),
+    idle_timeout(idle_timeout)
+{
+    mix = new float[2 * block_size];
+    thread = new std::thread([this] { loop(); });
+}
+
+template <typename T>
+AudioMixer<T>::~AudioMixer() {
+    stop();
+    for (auto input: inputs)
+        delete input;
+    delete[] mix;
+}
+
+template <typename T>
+AudioMixerInput<T>* AudioMixer<T>::addInput(double gain, double pan) {
+    // the queue must hold the samples of an input while the mixer waits
+    // for the others
+    size_t queue_size = std::max(size_t(samplerate * std::max(INPUT_QUEUE_DURATION,
+                                                              2 * idle_timeout.count())),
+                                 2 * std::max(INPUT_BUFFER_SIZE, block_size));
+    auto input = new AudioMixerInput<T>(queue_size, INPUT_BUFFER_SIZE, gain, pan);
+    std::lock_guard<std::mutex> lock(inputs_mutex);
+    inputs.push_back(input);
+    return input;
+}
+
+template <typename T>
+size_t AudioMixer<T>::getNumInputs() {
+    std::lock_guard<std::mutex> lock(inputs_mutex);
+    return inputs.size();
+}
+
+template <typename T>
+AudioMixerInput<T>* AudioMixer<T>::getInput(size_t index) {
+    std::lock_guard<std::mutex> lock(inputs_mutex);
+    if (index >= inputs.size())
+        throw std::runtime_error("invalid mixer input");
+    return inputs[index];
+}
+
+template <typename T>
+void AudioMixer<T>::stop() {
+    run = false;
+    if (thread != nullptr) {
+        thread->join();
+        delete thread;
+        thread = nullptr;
+    }
+}
+
+template <typename T>
+bool AudioMixer<T>::isRunning() const {
+    return run;
+}
+
+// the pipelines never wake up the mixer (they never wait for anything):
+// when there is nothing to mix the thread sleeps for a fraction of a block
+template <typename T>
+void AudioMixer<T>::loop() {
+    auto pause = std::chrono::duration<double>(block_size / samplerate / 4);
+    while (run) {
+        bool mixed;
+        {
+            std::lock_guard<std::mutex> lock(inputs_mutex);
+            mixed = mix_block();
+        }
+        if (!mixed)
+            std::this_thread::sleep_for(pause);
+    }
+}
+
+template <typename T>
+bool AudioMixer<T>::mix_block() {
+    size_t ready = 0;
+    size_t late = 0;
+    for (auto input: inputs) {
+        auto queue = input->queue;
+        size_t queued = queue->getSize() - queue->freeSpace();
+        if (queued >= block_size)
+            ready++;
+        // an input already mixed as late doesn't hold up the next blocks
+        else if (input->active && !input->late)
+            late++;
+    }
+    if (ready == 0) {
+        waiting = false;
+        return false;
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (late > 0) {
+        if (!waiting) {
+            waiting = true;
+            waiting_since = now;
+        }
+        // wait at most one block for the late inputs, well within the
+        // latency of the sink, so the other inputs never underrun
+        if (now - waiting_since < late_timeout)
+            return false;
+    }
+    waiting = false;
+
+    std::fill(mix, mix + 2 * block_size, 0.0f);
+    size_t active = 0;
+    for (auto input: inputs) {
+        auto queue = input->queue;
+        size_t queued = queue->getSize() - queue->freeSpace();
+        size_t samples = block_size;
+        if (queued < block_size) {
+            if (!input->active)
+                continue;
+            // a late input: what it has is mixed, the rest of the block
+            // is silence; after 'idle_timeout' it becomes idle
+            if (!input->late) {
+                input->late = true;
+                input->late_since = now;
+            } else if (now - input->late_since >= idle_timeout) {
+                input->set_idle();
+                continue;
+            }
+            samples = queued;
+        } else {
+            input->late = false;
+        }
+        input->active = true;
+        active++;
+        double gain = input->mute ? 0 : (double) input->gain;
+        // constant power panning
+        double angle = (std::min(std::max((double) input->pan, -1.0), 1.0) + 1) * M_PI / 4;
+        float gain_left = gain * cos(angle);
+        float gain_right = gain * sin(angle);
+        SignalSums sums;
+        // the block may wrap around the end of the queue
+        for (size_t done = 0; done < samples; ) {
+            size_t n = std::min(queue->available(), samples - done);
+            const T* x = queue->getReadPointer();
+            accumulate_sums(x, n, sums);
+            // silent (squelched) or muted samples are not mixed
+            if (sums.peak > 0 && gain != 0)
+                mix_stereo(x, gain_left, gain_right, mix + 2 * done, n);
+            queue->advanceRead(n);
+            done += n;
+        }
+        input->level = 10 * log10(sums.sum_squares / block_size);
+        input->peak = 20 * log10(sums.peak);
+    }
+    active_inputs = active;
+    write_output();
+    mixed_frames += block_size;
+    return true;
+}
+
+template <typename T>
+void AudioMixer<T>::write_output() {
+    for (size_t done = 0; done < block_size; ) {
+        // never wait for the writer
+        size_t frames = std::min(writer->writeable() / 2, block_size - done);
+        if (frames == 0) {
+            dropped_frames += block_size - done;
+            return;
+        }
+        convert_output(mix + 2 * done, writer->getWritePointer(), frames);
+        writer->advance(2 * frames);
+        done += frames;
+    }
+}
+
+// getters
+template <typename T>
+double AudioMixer<T>::getSamplerate() const {
+    return samplerate;
+}
+
+template <typename T>
+size_t AudioMixer<T>::getActiveInputs() const {
+    return active_inputs;
+}
+
+template <typename T>
+size_t AudioMixer<T>::getMixedFrames() const {
+    return mixed_frames;
+}
+
+template <typename T>
+size_t AudioMixer<T>::getDroppedFrames() const {
+    return dropped_frames;
+}
+
+// AudioMixerInput
+template <typename T>
+AudioMixerInput<T>::AudioMixerInput(size_t queue_size, size_t buffer_size,
+                                    double gain, double pan):
+    queue(new StagingBuffer<T>(queue_size)),
+    buffer_size(buffer_size),
+    overflow_buffer(new T[buffer_size]),
+    gain(gain),
+    pan(pan),
+    level(-INFINITY),
+    peak(-INFINITY)
+{
+}
+
+template <typename T>
+AudioMixerInput<T>::~AudioMixerInput() {
+    delete[] overflow_buffer;
+    delete queue;
+}
+
+template <typename T>
+size_t AudioMixerInput<T>::writeable() {
+    size_t available = queue->writeable();
+    write_to_queue = available > 0;
+    return write_to_queue ? available : buffer_size;
+}
+
+template <typename T>
+T* AudioMixerInput<T>::getWritePointer() {
+    return write_to_queue ? queue->getWritePointer() : overflow_buffer;
+}
+
+template <typename T>
+void AudioMixerInput<T>::advance(size_t how_much) {
+    if (write_to_queue)
+        queue->advanceWrite(how_much);
+    else
+        dropped_samples += how_much;
+}
+
+template <typename T>
+void AudioMixerInput<T>::set_idle() {
+    active = false;
+    late = false;
+    level = -INFINITY;
+    peak = -INFINITY;
+}
+
+// setters
+template <typename T>
+void AudioMixerInput<T>::setGain(double gain) {
+    this->gain = gain;
+}
+
+template <typename T>
+void AudioMixerInput<T>::setPan(double pan) {
+    this->pan = pan;
+}
+
+template <typename T>
+void AudioMixerInput<T>::setMute(bool mute) {
+    this->mute = mute;
+}
+
+// getters
+template <typename T>
+double AudioMixerInput<T>::getGain() const {
+    return gain;
+}
+
+template <typename T>
+double AudioMixerInput<T>::getPan() const {
+    return pan;
+}
+
+template <typename T>
+bool AudioMixerInput<T>::getMute() const {
+    return mute;
+}
+
+template <typename T>
+bool AudioMixerInput<T>::isActive() const {
+    return active;
+}
+
+template <typename T>
+double AudioMixerInput<T>::getLevel() const {
+    return level;
+}
+
+template <typename T>
+double AudioMixerInput<T>::getPeak() const {
+    return peak;
+}
+
+template <typename T>
+size_t AudioMixerInput<T>::getDroppedSamples() const {
+    return dropped_samples;
+}
+
+namespace Csdrx {
+    template class AudioMixer<short>;
+    template class AudioMixer<float>;
+    template class AudioMixerInput<short>;
+    template class AudioMixerInput<float>;
+}
@@ -0,0 +1,119 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <csdr/writer.hpp>
+#include <csdrx/stagingbuffer.hpp>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Csdrx {
+
+    template <typename T>
+    class AudioMixerInput;
+
+    // mixes the mono audio of several pipelines (see addInput()) into one
+    // stereo stream, written as interleaved left/right samples to 'writer'
+    // (not owned by the mixer). All the inputs must have the same sample
+    // rate. The inputs are mixed by a background thread in blocks of
+    // 'block_duration' seconds, aligned by sample count: a block is mixed
+    // when every active input has one, or one block duration later with
+    // silence in place of the missing samples of the late inputs; an input
+    // that is late for 'idle_timeout' seconds (for instance a squelched
+    // pipeline that stopped writing) becomes idle and is left out until it
+    // has a block again, so idle inputs cost nothing, and silent blocks are
+    // only measured
+    template <typename T>
+    class AudioMixer {
+        public:
+            AudioMixer(Csdr::Writer<T>* writer, double samplerate,
+                       double block_duration = 0.01, double idle_timeout = 0.2);
+            ~AudioMixer();
+            // 'gain' is linear, 'pan' goes from -1 (left) to 1 (right)
+            AudioMixerInput<T>* addInput(double gain = 1.0, double pan = 0.0);
+            size_t getNumInputs();
+            AudioMixerInput<T>* getInput(size_t index);
+            void stop();
+            bool isRunning() const;
+            // getters
+            double getSamplerate() const;
+            size_t getActiveInputs() const;
+            size_t getMixedFrames() const;
+            // output frames the writer had no room for
+            size_t getDroppedFrames() const;
+        private:
+            void loop();
+            bool mix_block();
+            void write_output();
+
+            Csdr::Writer<T>* writer;
+            double samplerate;
+            size_t block_size;
+            std::chrono::duration<double> late_timeout;
+            std::chrono::duration<double> idle_timeout;
+            std::vector<AudioMixerInput<T>*> inputs;
+            std::mutex inputs_mutex;
+            // interleaved left/right mix of one block
+            float* mix;
+            // time since the mixer is waiting for a late input
+            bool waiting = false;
+            std::chrono::steady_clock::time_point waiting_since;
+            std::atomic<bool> run{true};
+            std::thread* thread;
+            std::atomic<size_t> active_inputs{0};
+            std::atomic<size_t> mixed_frames{0};
+            std::atomic<size_t> dropped_frames{0};
+    };
+
+    // one input of an AudioMixer; it is owned by the AudioMixer. The
+    // pipeline writes into a lock-free queue and never waits for the mixer:
+    // when the queue is full the samples are dropped (and counted)
+    template <typename T>
+    class AudioMixerInput: public Csdr::Writer<T> {
+        public:
+            ~AudioMixerInput();
+            size_t writeable() override;
+            T* getWritePointer() override;
+            void advance(size_t how_much) override;
+            // setters
+            void setGain(double gain);
+            void setPan(double pan);
+            void setMute(bool mute);
+            // getters
+            double getGain() const;
+            double getPan() const;
+            bool getMute() const;
+            bool isActive() const;
+            // level of the last block in dBFS (-inf when idle)
+            double getLevel() const;     // RMS
+            double getPeak() const;
+            size_t getDroppedSamples() const;
+        private:
+            AudioMixerInput(size_t queue_size, size_t buffer_size, double gain, double pan);
+            void set_idle();
+            StagingBuffer<T>* queue;
+            size_t buffer_size;
+            T* overflow_buffer;
+            bool write_to_queue = true;
+            std::atomic<double> gain;
+            std::atomic<double> pan;
+            std::atomic<bool> mute{false};
+            std::atomic<bool> active{false};
+            // mixer thread only: since when the input has no full block
+            bool late = false;
+            std::chrono::steady_clock::time_point late_since;
+            std::atomic<double> level;
+            std::atomic<double> peak;
+            std::atomic<size_t> dropped_samples{0};
+
+            friend class AudioMixer<T>;
+    };
+}
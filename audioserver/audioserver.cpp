@@ -0,0 +1,822 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "audioserver.hpp"
+
+#include <csdr/complex.hpp>
+#include <csdrx/kernels.hpp>
+#include <algorithm>
+#include <arpa/inet.h>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#ifdef HAVE_OPUS
+#include <opus/opus.h>
+#endif
+
+using namespace Csdrx;
+
+static constexpr size_t MAX_REQUEST_SIZE = 8192;
+static constexpr size_t MAX_WEBSOCKET_MESSAGE = 65536;
+static constexpr size_t MAX_OPUS_PACKET = 4000;
+// frames per sendmsg() call
+static constexpr int MAX_IOV_FRAMES = 32;
+// the socket buffer of a client holds about this much PCM audio, so that
+// the lag of a slow client shows up in its queue instead of in the kernel
+static constexpr double SOCKET_BUFFER_DURATION = 0.25;
+
+static const char* INDEX_PAGE =
+    "<!DOCTYPE html>\n"
+    "<html><head><title>csdrx audio</title></head>\n"
+    "<body><audio controls autoplay src=\"/audio.wav\"></audio></body></html>\n";
+
+// one encoded frame, shared by all the clients; the WebSocket header is the
+// same for every client (server messages are not masked)
+template <typename T>
+struct AudioServer<T>::Frame {
+    std::vector<unsigned char> pcm;           // S16LE (HTTP clients)
+    std::vector<unsigned char> packet;        // Opus packet
+    unsigned char ws_header[10];
+    size_t ws_header_size;
+};
+
+template <typename T>
+struct AudioServer<T>::Client {
+    int fd;
+    std::string address;
+    std::chrono::steady_clock::time_point since;
+    bool streaming = false;
+    bool websocket = false;
+    bool writing = false;            // waiting for EPOLLOUT
+    bool close_after_header = false;
+    std::string request;
+    std::string incoming;            // WebSocket messages from the client
+    // response header (and WAV header or WebSocket format message)
+    std::string header;
+    size_t header_sent = 0;
+    std::deque<std::shared_ptr<const Frame>> queue;
+    size_t offset = 0;               // bytes of queue.front() already sent
+    size_t sent_bytes = 0;
+};
+
+// SHA-1 and base64, for the WebSocket handshake only
+static inline uint32_t rol(uint32_t x, int n) {
+    return (x << n) | (x >> (32 - n));
+}
+
+static void sha1(const std::string& data, unsigned char digest[20]) {
+    uint32_t h[5] = { 0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0 };
+    std::vector<unsigned char> message(data.begin(), data.end());
+    uint64_t bits = (uint64_t) data.size() * 8;
+    message.push_back(0x80);
+    while (message.size() % 64 != 56)
+        message.push_back(0);
+    for (int i = 7; i >= 0; i--)
+        message.push_back(bits >> (8 * i));
+    for (size_t chunk = 0; chunk < message.size(); chunk += 64) {
+        uint32_t w[80];
+        for (int i = 0; i < 16; i++) {
+            const unsigned char* p = message.data() + chunk + 4 * i;
+            w[i] = (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | p[3];
+        }
+        for (int i = 16; i < 80; i++)
+            w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; i++) {
+            uint32_t f, k;
+            if (i < 20) {
+                f = (b & c) | (~b & d);
+                k = 0x5a827999;
+            } else if (i < 40) {
+                f = b ^ c ^ d;
+                k = 0x6ed9eba1;
+            } else if (i < 60) {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8f1bbcdc;
+            } else {
+                f = b ^ c ^ d;
+                k = 0xca62c1d6;
+            }
+            uint32_t t = rol(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rol(b, 30);
+            b = a;
+            a = t;
+        }
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+    for (int i = 0; i < 20; i++)
+        digest[i] = h[i / 4] >> (24 - 8 * (i % 4));
+}
+
+static std::string base64(const unsigned char* data, size_t size) {
+    static const char* table = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out;
+    for (size_t i = 0; i < size; i += 3) {
+        uint32_t v = data[i] << 16;
+        if (i + 1 < size)
+            v |= data[i + 1] << 8;
+        if (i + 2 < size)
+            v |= data[i + 2];
+        out += table[(v >> 18) & 0x3f];
+        out += table[(v >> 12) & 0x3f];
+        out += i + 1 < size ? table[(v >> 6) & 0x3f] : '=';
+        out += i + 2 < size ? table[v & 0x3f] : '=';
+    }
+    return out;
+}
+
+static std::string websocket_accept(const std::string& key) {
+    unsigned char digest[20];
+    sha1(key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11", digest);
+    return base64(digest, sizeof(digest));
+}
+
+// header of an unmasked final WebSocket message
+static size_t websocket_header(unsigned char opcode, size_t size, unsigned char* header) {
+    header[0] = 0x80 | opcode;
+    if (size < 126) {
+        header[1] = size;
+        return 2;
+    }
+    if (size <= 0xffff) {
+        header[1] = 126;
+        header[2] = size >> 8;
+        header[3] = size;
+        return 4;
+    }
+    header[1] = 127;
+    for (int i = 0; i < 8; i++)
+        header[2 + i] = (uint64_t) size >> (56 - 8 * i);
+    return 10;
+}
+
+// endless stream: the RIFF and data sizes are the largest possible
+static std::string wav_header(unsigned int samplerate, unsigned int channels) {
+    unsigned char h[44];
+    auto put16 = [&h](int offset, uint16_t v) {
+        h[offset] = v;
+        h[offset + 1] = v >> 8;
+    };
+    auto put32 = [&h](int offset, uint32_t v) {
+        for (int i = 0; i < 4; i++)
+            h[offset + i] = v >> (8 * i);
+    };
+    memcpy(h, "RIFF", 4);
+    put32(4, 0xffffffff);
+    memcpy(h + 8, "WAVEfmt ", 8);
+    put32(16, 16);
+    put16(20, 1);
+    put16(22, channels);
+    put32(24, samplerate);
+    put32(28, samplerate * channels * 2);
+    put16(32, channels * 2);
+    put16(34, 16);
+    memcpy(h + 36, "data", 4);
+    put32(40, 0xffffffff);
+    return std::string((const char*) h, sizeof(h));
+}
+
+static std::string lowercase(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), ::tolower);
+    return s;
+}
+
+// value of a request header (the name is lowercase), or an empty string
+static std::string header_value(const std::string& request, const std::string& name) {
+    std::string lower = lowercase(request);
+    size_t pos = lower.find("\r\n" + name + ":");
+    if (pos == std::string::npos)
+        return "";
+    pos += name.size() + 3;
+    size_t end = request.find("\r\n", pos);
+    std::string value = request.substr(pos, end - pos);
+    size_t first = value.find_first_not_of(" \t");
+    size_t last = value.find_last_not_of(" \t");
+    return first == std::string::npos ? "" : value.substr(first, last - first + 1);
+}
+
+// 16 bit little endian PCM (x86 and ARM are little endian)
+static void encode_pcm(const short* samples, size_t n, unsigned char* out) {
+    memcpy(out, samples, n * sizeof(short));
+}
+
+// the vectorized conversion kernel takes pairs of samples (like a complex
+// sample); an odd last sample goes through a padded pair
+static void encode_pcm(const float* samples, size_t n, unsigned char* out) {
+    auto o = reinterpret_cast<Csdr::complex<short>*>(out);
+    convert_cf32_to_cs16(reinterpret_cast<const Csdr::complex<float>*>(samples), o, n / 2);
+    if (n % 2 != 0) {
+        Csdr::complex<float> last(samples[n - 1], 0.0f);
+        Csdr::complex<short> converted;
+        convert_cf32_to_cs16(&last, &converted, 1);
+        memcpy(out + (n - 1) * sizeof(short), &converted, sizeof(short));
+    }
+}
+
+#ifdef HAVE_OPUS
+static int encode_opus(OpusEncoder* encoder, const short* samples, int frame_size,
+                       unsigned char* out, int max_size) {
+    return opus_encode(encoder, samples, frame_size, out, max_size);
+}
+
+static int encode_opus(OpusEncoder* encoder, const float* samples, int frame_size,
+                       unsigned char* out, int max_size) {
+    return opus_encode_float(encoder, samples, frame_size, out, max_size);
+}
+#endif
+
+template <typename T>
+AudioServer<T>::AudioServer(unsigned int samplerate, unsigned short port,
+                            unsigned int channels, AudioCodec codec,
+                            const char* address, double frame_duration):
+    samplerate(samplerate),
+    channels(channels),
+    codec(codec),
+    frame_samples(std::max(size_t(samplerate * frame_duration), (size_t) 1)),
+    frame_duration((double) frame_samples / samplerate),
+    frame_buffer(frame_samples * channels)
+{
+    if (samplerate == 0 || channels == 0)
+        throw AudioServerException("invalid sample rate or number of channels");
+    if (codec == AudioCodec::Opus) {
+#ifdef HAVE_OPUS
+        int error;
+        encoder = opus_encoder_create(samplerate, channels, OPUS_APPLICATION_AUDIO, &error);
+        if (encoder == nullptr)
+            throw AudioServerException(std::string("opus_encoder_create() failed: ") +
+                                       opus_strerror(error));
+        // check the frame size now, instead of at the first frame
+        std::vector<T> silence(frame_buffer.size());
+        unsigned char packet[MAX_OPUS_PACKET];
+        if (encode_opus(encoder, silence.data(), frame_samples, packet, sizeof(packet)) < 0) {
+            opus_encoder_destroy(encoder);
+            throw AudioServerException("invalid frame duration for Opus");
+        }
+#else
+        throw AudioServerException("csdrx was built without Opus support");
+#endif
+    }
+    try {
+        open_socket(address, port);
+    } catch (const AudioServerException&) {
+#ifdef HAVE_OPUS
+        if (encoder != nullptr)
+            opus_encoder_destroy(encoder);
+#endif
+        throw;
+    }
+    thread = new std::thread([this] { loop(); });
+}
+
+template <typename T>
+AudioServer<T>::~AudioServer() {
+    stop();
+#ifdef HAVE_OPUS
+    if (encoder != nullptr)
+        opus_encoder_destroy(encoder);
+#endif
+}
+
+template <typename T>
+void AudioServer<T>::open_socket(const char* address, unsigned short port) {
+    struct addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE | AI_NUMERICHOST | AI_NUMERICSERV;
+    struct addrinfo* info;
+    int error = getaddrinfo(address, std::to_string(port).c_str(), &hints, &info);
+    if (error != 0)
+        throw AudioServerException(std::string("invalid address: ") + gai_strerror(error));
+    listen_fd = socket(info->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        freeaddrinfo(info);
+        throw AudioServerException(std::string("socket() failed: ") + strerror(errno));
+    }
+    int one = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(listen_fd, info->ai_addr, info->ai_addrlen) < 0 || listen(listen_fd, 16) < 0) {
+        std::string reason = strerror(errno);
+        freeaddrinfo(info);
+        close(listen_fd);
+        throw AudioServerException("cannot listen on " + std::string(address) + ":" +
+                                   std::to_string(port) + ": " + reason);
+    }
+    freeaddrinfo(info);
+    struct sockaddr_storage bound;
+    socklen_t length = sizeof(bound);
+    getsockname(listen_fd, (struct sockaddr*) &bound, &length);
+    this->port = ntohs(bound.ss_family == AF_INET6 ?
+                       ((struct sockaddr_in6*) &bound)->sin6_port :
+                       ((struct sockaddr_in*) &bound)->sin_port);
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epoll_fd < 0 || event_fd < 0) {
+        close(listen_fd);
+        if (epoll_fd >= 0)
+            close(epoll_fd);
+        throw AudioServerException(std::string("cannot create the event loop: ") + strerror(errno));
+    }
+    struct epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.ptr = &listen_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event);
+    event.data.ptr = &event_fd;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, event_fd, &event);
+}
+
+template <typename T>
+void AudioServer<T>::stop() {
+    if (thread == nullptr)
+        return;
+    run = false;
+    uint64_t one = 1;
+    if (write(event_fd, &one, sizeof(one)) < 0) {
+        // the event loop also wakes up on its own every 100ms
+    }
+    thread->join();
+    delete thread;
+    thread = nullptr;
+    for (auto client: clients) {
+        close(client->fd);
+        delete client;
+    }
+    clients.clear();
+    close(listen_fd);
+    close(epoll_fd);
+    close(event_fd);
+}
+
+template <typename T>
+bool AudioServer<T>::isRunning() const {
+    return run;
+}
+
+// pipeline side: the samples go straight into the frame being filled
+template <typename T>
+size_t AudioServer<T>::writeable() {
+    return frame_buffer.size() - frame_fill;
+}
+
+template <typename T>
+T* AudioServer<T>::getWritePointer() {
+    return frame_buffer.data() + frame_fill;
+}
+
+template <typename T>
+void AudioServer<T>::advance(size_t how_much) {
+    frame_fill += how_much;
+    if (frame_fill >= frame_buffer.size()) {
+        encode_frame();
+        frame_fill = 0;
+    }
+}
+
+// encoded once here, in the pipeline thread, and then only referenced
+template <typename T>
+void AudioServer<T>::encode_frame() {
+    auto frame = std::make_shared<Frame>();
+    frame->pcm.resize(frame_buffer.size() * sizeof(short));
+    encode_pcm(frame_buffer.data(), frame_buffer.size(), frame->pcm.data());
+    size_t payload = frame->pcm.size();
+#ifdef HAVE_OPUS
+    if (encoder != nullptr) {
+        frame->packet.resize(MAX_OPUS_PACKET);
+        int size = encode_opus(encoder, frame_buffer.data(), frame_samples,
+                               frame->packet.data(), frame->packet.size());
+        if (size < 0) {
+            std::cerr << "AudioServer: opus_encode() failed: " << opus_strerror(size) << std::endl;
+            size = 0;
+        }
+        frame->packet.resize(size);
+        payload = size;
+    }
+#endif
+    frame->ws_header_size = websocket_header(0x2, payload, frame->ws_header);
+    {
+        std::lock_guard<std::mutex> lock(frames_mutex);
+        pending.push_back(std::move(frame));
+    }
+    encoded_frames++;
+    uint64_t one = 1;
+    if (write(event_fd, &one, sizeof(one)) < 0) {
+        // the counter is already non zero: the event loop will wake up
+    }
+}
+
+// event loop
+template <typename T>
+void AudioServer<T>::loop() {
+    struct epoll_event events[64];
+    while (run) {
+        int n = epoll_wait(epoll_fd, events, 64, 100);
+        if (n < 0 && errno != EINTR) {
+            std::cerr << "AudioServer: epoll_wait() failed: " << strerror(errno) << std::endl;
+            break;
+        }
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        for (int i = 0; i < n; i++) {
+            void* ptr = events[i].data.ptr;
+            if (ptr == &listen_fd) {
+                accept_clients();
+            } else if (ptr == &event_fd) {
+                uint64_t count;
+                if (read(event_fd, &count, sizeof(count)) < 0) {
+                    // spurious wakeup
+                }
+                broadcast();
+            } else {
+                auto client = static_cast<Client*>(ptr);
+                if (client->fd < 0)
+                    continue;
+                if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                    close_client(client);
+                    continue;
+                }
+                if (events[i].events & EPOLLIN)
+                    read_client(client);
+                if (client->fd >= 0 && (events[i].events & EPOLLOUT) && !flush(client))
+                    close_client(client);
+            }
+        }
+        // freed only now, since later events of this batch may refer to them
+        for (auto client: closed_clients)
+            delete client;
+        closed_clients.clear();
+    }
+}
+
+template <typename T>
+void AudioServer<T>::accept_clients() {
+    while (true) {
+        struct sockaddr_storage address;
+        socklen_t length = sizeof(address);
+        int fd = accept4(listen_fd, (struct sockaddr*) &address, &length,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0)
+            return;
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        int buffer_size = std::max(int(SOCKET_BUFFER_DURATION * samplerate * channels * sizeof(short)), 16384);
+        setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &buffer_size, sizeof(buffer_size));
+        auto client = new Client();
+        client->fd = fd;
+        char host[INET6_ADDRSTRLEN] = "";
+        unsigned short client_port;
+        if (address.ss_family == AF_INET6) {
+            auto a = (struct sockaddr_in6*) &address;
+            inet_ntop(AF_INET6, &a->sin6_addr, host, sizeof(host));
+            client_port = ntohs(a->sin6_port);
+        } else {
+            auto a = (struct sockaddr_in*) &address;
+            inet_ntop(AF_INET, &a->sin_addr, host, sizeof(host));
+            client_port = ntohs(a->sin_port);
+        }
+        client->address = std::string(host) + ":" + std::to_string(client_port);
+        client->since = std::chrono::steady_clock::now();
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.ptr = client;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+        clients.push_back(client);
+        total_clients++;
+    }
+}
+
+template <typename T>
+void AudioServer<T>::read_client(Client* client) {
+    char buffer[4096];
+    while (true) {
+        ssize_t n = recv(client->fd, buffer, sizeof(buffer), 0);
+        if (n == 0) {
+            close_client(client);
+            return;
+        }
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            if (errno == EINTR)
+                continue;
+            close_client(client);
+            return;
+        }
+        if (!client->streaming) {
+            client->request.append(buffer, n);
+            if (client->request.find("\r\n\r\n") != std::string::npos) {
+                handle_request(client);
+                if (client->fd < 0)
+                    return;
+            } else if (client->request.size() > MAX_REQUEST_SIZE) {
+                close_client(client);
+                return;
+            }
+        } else if (client->websocket) {
+            client->incoming.append(buffer, n);
+        }
+        // anything else from an HTTP client is ignored
+    }
+    // the only message from a WebSocket client that matters is Close
+    std::string& in = client->incoming;
+    while (in.size() >= 2) {
+        auto b = reinterpret_cast<const unsigned char*>(in.data());
+        size_t length = b[1] & 0x7f;
+        size_t header = 2 + ((b[1] & 0x80) ? 4 : 0);
+        if (length == 126) {
+            if (in.size() < 4)
+                break;
+            length = (size_t) b[2] << 8 | b[3];
+            header += 2;
+        } else if (length == 127) {
+            if (in.size() < 10)
+                break;
+            length = 0;
+            for (int i = 0; i < 8; i++)
+                length = length << 8 | b[2 + i];
+            header += 8;
+        }
+        if (length > MAX_WEBSOCKET_MESSAGE) {
+            close_client(client, "message too large");
+            return;
+        }
+        if (in.size() < header + length)
+            break;
+        if ((b[0] & 0x0f) == 0x8) {
+            close_client(client);
+            return;
+        }
+        in.erase(0, header + length);
+    }
+}
+
+template <typename T>
+void AudioServer<T>::handle_request(Client* client) {
+    const std::string& request = client->request;
+    size_t end = request.find("\r\n");
+    std::string line = request.substr(0, end);
+    size_t space = line.find(' ');
+    std::string method = line.substr(0, space);
+    std::string path = space == std::string::npos ? "" :
+                       line.substr(space + 1, line.find(' ', space + 1) - space - 1);
+    std::string key = header_value(request, "sec-websocket-key");
+    bool upgrade = lowercase(header_value(request, "upgrade")) == "websocket";
+
+    if (method != "GET") {
+        client->header = "HTTP/1.1 405 Method Not Allowed\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+        client->close_after_header = true;
+    } else if (upgrade && !key.empty()) {
+        client->header = "HTTP/1.1 101 Switching Protocols\r\n"
+                         "Upgrade: websocket\r\n"
+                         "Connection: Upgrade\r\n"
+                         "Sec-WebSocket-Accept: " + websocket_accept(key) + "\r\n\r\n";
+        std::string format = std::string("{\"codec\":\"") +
+                             (codec == AudioCodec::Opus ? "opus" : "pcm") + "\"," +
+                             "\"samplerate\":" + std::to_string(samplerate) + "," +
+                             "\"channels\":" + std::to_string(channels) + "," +
+                             "\"frameSamples\":" + std::to_string(frame_samples) + "}";
+        unsigned char header[10];
+        size_t size = websocket_header(0x1, format.size(), header);
+        client->header.append((const char*) header, size);
+        client->header += format;
+        client->websocket = true;
+        client->streaming = true;
+    } else if (path == "/audio.wav") {
+        client->header = "HTTP/1.0 200 OK\r\n"
+                         "Content-Type: audio/wav\r\n"
+                         "Cache-Control: no-cache\r\n"
+                         "Connection: close\r\n\r\n" + wav_header(samplerate, channels);
+        client->streaming = true;
+    } else if (path == "/") {
+        client->header = "HTTP/1.1 200 OK\r\n"
+                         "Content-Type: text/html\r\n"
+                         "Connection: close\r\n"
+                         "Content-Length: " + std::to_string(strlen(INDEX_PAGE)) + "\r\n\r\n" +
+                         INDEX_PAGE;
+        client->close_after_header = true;
+    } else {
+        client->header = "HTTP/1.1 404 Not Found\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+        client->close_after_header = true;
+    }
+    client->request.clear();
+    if (!flush(client))
+        close_client(client);
+}
+
+// hands the new frames to every streaming client (a reference each)
+template <typename T>
+void AudioServer<T>::broadcast() {
+    std::vector<std::shared_ptr<const Frame>> frames;
+    {
+        std::lock_guard<std::mutex> lock(frames_mutex);
+        frames.swap(pending);
+    }
+    if (frames.empty())
+        return;
+    size_t max_frames = std::max(size_t(max_lag / frame_duration), (size_t) 1);
+    for (auto client: std::vector<Client*>(clients)) {
+        if (client->fd < 0 || !client->streaming)
+            continue;
+        for (auto& frame: frames)
+            client->queue.push_back(frame);
+        if (client->queue.size() > max_frames) {
+            dropped_clients++;
+            close_client(client, "too slow");
+            continue;
+        }
+        // a client waiting for EPOLLOUT is flushed when its socket has room
+        if (!client->writing && !flush(client))
+            close_client(client);
+    }
+}
+
+// sends as much as the socket takes, straight from the shared frames;
+// returns false when the client must be closed
+template <typename T>
+bool AudioServer<T>::flush(Client* client) {
+    while (true) {
+        struct iovec iov[2 * MAX_IOV_FRAMES + 1];
+        int count = 0;
+        size_t total = 0;
+        if (client->header_sent < client->header.size()) {
+            iov[count].iov_base = (void*) (client->header.data() + client->header_sent);
+            iov[count].iov_len = client->header.size() - client->header_sent;
+            total += iov[count++].iov_len;
+        } else {
+            size_t skip = client->offset;
+            int frames = 0;
+            for (auto& frame: client->queue) {
+                if (frames++ == MAX_IOV_FRAMES)
+                    break;
+                const unsigned char* parts[2];
+                size_t sizes[2];
+                int n = 0;
+                if (client->websocket) {
+                    parts[n] = frame->ws_header;
+                    sizes[n++] = frame->ws_header_size;
+                    const std::vector<unsigned char>& payload =
+                        codec == AudioCodec::Opus ? frame->packet : frame->pcm;
+                    parts[n] = payload.data();
+                    sizes[n++] = payload.size();
+                } else {
+                    parts[n] = frame->pcm.data();
+                    sizes[n++] = frame->pcm.size();
+                }
+                for (int k = 0; k < n; k++) {
+                    if (skip >= sizes[k]) {
+                        skip -= sizes[k];
+                        continue;
+                    }
+                    iov[count].iov_base = (void*) (parts[k] + skip);
+                    iov[count].iov_len = sizes[k] - skip;
+                    total += iov[count++].iov_len;
+                    skip = 0;
+                }
+            }
+        }
+        if (count == 0)
+            break;
+        struct msghdr message = {};
+        message.msg_iov = iov;
+        message.msg_iovlen = count;
+        ssize_t sent = sendmsg(client->fd, &message, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (sent < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                watch_writes(client, true);
+                return true;
+            }
+            return false;
+        }
+        client->sent_bytes += sent;
+        size_t done = sent;
+        if (client->header_sent < client->header.size()) {
+            client->header_sent += done;
+        } else {
+            while (done > 0) {
+                auto& frame = client->queue.front();
+                size_t size = client->websocket ?
+                              frame->ws_header_size + (codec == AudioCodec::Opus ?
+                                                       frame->packet.size() : frame->pcm.size()) :
+                              frame->pcm.size();
+                size_t n = std::min(done, size - client->offset);
+                client->offset += n;
+                done -= n;
+                if (client->offset == size) {
+                    client->queue.pop_front();
+                    client->offset = 0;
+                }
+            }
+        }
+        if ((size_t) sent < total) {
+            watch_writes(client, true);
+            return true;
+        }
+    }
+    watch_writes(client, false);
+    return !client->close_after_header;
+}
+
+template <typename T>
+void AudioServer<T>::watch_writes(Client* client, bool enable) {
+    if (client->writing == enable)
+        return;
+    client->writing = enable;
+    struct epoll_event event = {};
+    event.events = EPOLLIN | (enable ? (uint32_t) EPOLLOUT : 0u);
+    event.data.ptr = client;
+    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client->fd, &event);
+}
+
+template <typename T>
+void AudioServer<T>::close_client(Client* client, const char* reason) {
+    if (client->fd < 0)
+        return;
+    if (reason != nullptr)
+        std::cerr << "AudioServer: closing client " << client->address << ": " << reason << std::endl;
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, client->fd, nullptr);
+    close(client->fd);
+    client->fd = -1;
+    client->queue.clear();
+    clients.erase(std::remove(clients.begin(), clients.end(), client), clients.end());
+    closed_clients.push_back(client);
+}
+
+// setters
+template <typename T>
+void AudioServer<T>::setMaxLag(double max_lag) {
+    this->max_lag = max_lag;
+}
+
+// getters
+template <typename T>
+unsigned short AudioServer<T>::getPort() const {
+    return port;
+}
+
+template <typename T>
+AudioCodec AudioServer<T>::getCodec() const {
+    return codec;
+}
+
+template <typename T>
+double AudioServer<T>::getMaxLag() const {
+    return max_lag;
+}
+
+template <typename T>
+std::vector<AudioClientInfo> AudioServer<T>::getClients() {
+    std::vector<AudioClientInfo> result;
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(clients_mutex);
+    for (auto client: clients) {
+        if (!client->streaming)
+            continue;
+        AudioClientInfo info;
+        info.address = client->address;
+        info.websocket = client->websocket;
+        info.lag = client->queue.size() * frame_duration;
+        info.sentBytes = client->sent_bytes;
+        info.connected = std::chrono::duration<double>(now - client->since).count();
+        result.push_back(info);
+    }
+    return result;
+}
+
+template <typename T>
+size_t AudioServer<T>::getEncodedFrames() const {
+    return encoded_frames;
+}
+
+template <typename T>
+size_t AudioServer<T>::getTotalClients() const {
+    return total_clients;
+}
+
+template <typename T>
+size_t AudioServer<T>::getDroppedClients() const {
+    return dropped_clients;
+}
+
+namespace Csdrx {
+    template class AudioServer<short>;
+    template class AudioServer<float>;
+}
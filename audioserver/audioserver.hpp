@@ -0,0 +1,119 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <csdr/writer.hpp>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct OpusEncoder;
+
+namespace Csdrx {
+
+    class AudioServerException: public std::runtime_error {
+        public:
+            AudioServerException(const std::string& reason): std::runtime_error(reason) {}
+    };
+
+    // Opus is only available when csdrx is built with libopus
+    enum class AudioCodec { PCM, Opus };
+
+    struct AudioClientInfo {
+        std::string address;          // "address:port"
+        bool websocket = false;
+        double lag = 0;               // seconds of audio waiting to be sent
+        size_t sentBytes = 0;
+        double connected = 0;         // seconds since the client connected
+    };
+
+    // serves the audio of a pipeline to many listeners over HTTP from a
+    // single event loop thread:
+    //   - GET /audio.wav: an endless 16 bit PCM WAV stream (for instance
+    //     'curl http://127.0.0.1:8073/audio.wav | aplay', or a media player)
+    //   - WebSocket upgrade on any path: a text message with the format
+    //     ({"codec": ..., "samplerate": ..., "channels": ..., "frameSamples":
+    //     ...}), then one binary message per frame (PCM S16LE, or an Opus
+    //     packet)
+    //   - GET /: a small page with an audio player
+    // Each frame of 'frame_duration' seconds is encoded once in the pipeline
+    // thread, and the same buffer is queued to all the clients (no copies).
+    // The pipeline never waits for the clients: a client with more than
+    // getMaxLag() seconds of audio queued is disconnected.
+    // The samples are interleaved with more than one channel; with Opus the
+    // sample rate must be 8000, 12000, 16000, 24000, or 48000, and the frame
+    // duration 2.5, 5, 10, 20, 40, or 60ms
+    template <typename T>
+    class AudioServer: public Csdr::Writer<T> {
+        public:
+            AudioServer(unsigned int samplerate, unsigned short port = 8073,
+                         unsigned int channels = 1, AudioCodec codec = AudioCodec::PCM,
+                         const char* address = "127.0.0.1", double frame_duration = 0.02);
+            ~AudioServer();
+            size_t writeable() override;
+            T* getWritePointer() override;
+            void advance(size_t how_much) override;
+            void stop();
+            bool isRunning() const;
+            // setters
+            void setMaxLag(double max_lag);     // seconds
+            // getters
+            unsigned short getPort() const;     // the actual port with port 0
+            AudioCodec getCodec() const;
+            double getMaxLag() const;
+            std::vector<AudioClientInfo> getClients();
+            size_t getEncodedFrames() const;
+            size_t getTotalClients() const;
+            // clients disconnected because they were too slow
+            size_t getDroppedClients() const;
+        private:
+            struct Frame;
+            struct Client;
+            void open_socket(const char* address, unsigned short port);
+            void encode_frame();
+            void loop();
+            void accept_clients();
+            void read_client(Client* client);
+            void handle_request(Client* client);
+            void broadcast();
+            bool flush(Client* client);
+            void watch_writes(Client* client, bool enable);
+            void close_client(Client* client, const char* reason = nullptr);
+
+            unsigned int samplerate;
+            unsigned int channels;
+            AudioCodec codec;
+            size_t frame_samples;               // per channel
+            double frame_duration;
+            unsigned short port;
+            OpusEncoder* encoder = nullptr;
+            // frame being filled by the pipeline
+            std::vector<T> frame_buffer;
+            size_t frame_fill = 0;
+            // frames handed over to the event loop
+            std::mutex frames_mutex;
+            std::vector<std::shared_ptr<const Frame>> pending;
+            // event loop
+            int listen_fd = -1;
+            int epoll_fd = -1;
+            int event_fd = -1;
+            std::mutex clients_mutex;
+            std::vector<Client*> clients;
+            std::vector<Client*> closed_clients;
+            std::atomic<bool> run{true};
+            std::thread* thread = nullptr;
+            std::atomic<double> max_lag{2.0};
+            std::atomic<size_t> encoded_frames{0};
+            std::atomic<size_t> total_clients{0};
+            std::atomic<size_t> dropped_clients{0};
+    };
+}
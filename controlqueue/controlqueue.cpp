@@ -0,0 +1,156 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "controlqueue.hpp"
+
+#include <iostream>
+
+using namespace Csdrx;
+
+ControlQueue::~ControlQueue() {
+    stop();
+}
+
+std::shared_future<void> ControlQueue::submit(const std::string& key,
+                                              std::function<void()> command,
+                                              Callback callback)
+{
+    std::vector<Waiter> waiters(1);
+    waiters[0].callback = callback;
+    std::shared_future<void> future = waiters[0].promise.get_future().share();
+
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        if (run) {
+            // the new command replaces the pending command with the same
+            // key in its place in the queue, and takes over its waiters
+            auto it = pending.begin();
+            while (it != pending.end() && it->key != key)
+                ++it;
+            if (it != pending.end()) {
+                it->command = command;
+                it->waiters.push_back(std::move(waiters[0]));
+                coalesced++;
+            } else {
+                Command entry;
+                entry.key = key;
+                entry.command = command;
+                entry.waiters.push_back(std::move(waiters[0]));
+                pending.push_back(std::move(entry));
+            }
+            if (thread == nullptr)
+                thread = new std::thread([this] () { loop(); });
+            queue_cv.notify_one();
+            return future;
+        }
+    }
+
+    complete(waiters, std::make_exception_ptr(ControlQueueException("control queue stopped")));
+    return future;
+}
+
+void ControlQueue::flush() {
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    idle_cv.wait(lock, [this] () { return (pending.empty() && !busy) || !run; });
+}
+
+ControlQueue::Callback ControlQueue::logErrors(const std::string& prefix) {
+    return [prefix] (std::exception_ptr error) {
+        if (error) {
+            try {
+                std::rethrow_exception(error);
+            } catch (const std::exception& e) {
+                std::cerr << prefix << e.what() << std::endl;
+            } catch (...) {
+                std::cerr << prefix << "unknown exception" << std::endl;
+            }
+        }
+    };
+}
+
+void ControlQueue::stop() {
+    std::list<Command> cancelled;
+    std::thread* worker;
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        run = false;
+        cancelled.swap(pending);
+        worker = thread;
+        thread = nullptr;
+        queue_cv.notify_all();
+        idle_cv.notify_all();
+    }
+    if (worker != nullptr) {
+        worker->join();
+        delete worker;
+    }
+    auto error = std::make_exception_ptr(ControlQueueException("control queue stopped"));
+    for (auto& entry : cancelled)
+        complete(entry.waiters, error);
+}
+
+size_t ControlQueue::getPending() const {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    return pending.size();
+}
+
+size_t ControlQueue::getExecuted() const {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    return executed;
+}
+
+size_t ControlQueue::getCoalesced() const {
+    std::lock_guard<std::mutex> lock(queue_mutex);
+    return coalesced;
+}
+
+void ControlQueue::loop() {
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    while (true) {
+        queue_cv.wait(lock, [this] () { return !pending.empty() || !run; });
+        if (!run)
+            break;
+        Command entry = std::move(pending.front());
+        pending.pop_front();
+        busy = true;
+        lock.unlock();
+
+        std::exception_ptr error = nullptr;
+        try {
+            entry.command();
+        } catch (...) {
+            error = std::current_exception();
+        }
+        complete(entry.waiters, error);
+
+        lock.lock();
+        busy = false;
+        executed++;
+        if (pending.empty())
+            idle_cv.notify_all();
+    }
+}
+
+void ControlQueue::complete(std::vector<Waiter>& waiters,
+                            std::exception_ptr error)
+{
+    for (auto& waiter : waiters) {
+        if (error)
+            waiter.promise.set_exception(error);
+        else
+            waiter.promise.set_value();
+        if (waiter.callback) {
+            try {
+                waiter.callback(error);
+            } catch (const std::exception& e) {
+                std::cerr << "ControlQueue: callback failed: " << e.what() << std::endl;
+            } catch (...) {
+                std::cerr << "ControlQueue: callback failed: unknown exception" << std::endl;
+            }
+        }
+    }
+}
@@ -0,0 +1,79 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <future>
+#include <list>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Csdrx {
+
+    class ControlQueueException: public std::runtime_error {
+        public:
+            ControlQueueException(const std::string& reason): std::runtime_error(reason) {}
+    };
+
+    // non-blocking command queue for the device settings: commands run one
+    // at a time on a worker thread, in the order they were submitted. A
+    // command replaces the pending command with the same key, in its place
+    // in the queue (for instance only the last of a burst of frequency
+    // changes is sent to the device);
+    // the callers of the superseded command get the result of the command
+    // that replaced it. The callback gets nullptr if the command succeeded,
+    // or the exception it threw, and it runs on the worker thread
+    class ControlQueue {
+        public:
+            typedef std::function<void(std::exception_ptr)> Callback;
+            ControlQueue() = default;
+            ~ControlQueue();
+            std::shared_future<void> submit(const std::string& key,
+                                            std::function<void()> command,
+                                            Callback callback = nullptr);
+            // wait until all the commands submitted so far have completed
+            void flush();
+            // a callback that prints the errors (prefixed with 'prefix') to
+            // std::cerr, for the callers that don't wait for the result
+            static Callback logErrors(const std::string& prefix = "error: ");
+            // stop the worker thread; pending commands are cancelled
+            void stop();
+            // getters
+            size_t getPending() const;
+            size_t getExecuted() const;
+            size_t getCoalesced() const;
+        private:
+            struct Waiter {
+                std::promise<void> promise;
+                Callback callback;
+            };
+            struct Command {
+                std::string key;
+                std::function<void()> command;
+                std::vector<Waiter> waiters;
+            };
+            void loop();
+            static void complete(std::vector<Waiter>& waiters,
+                                 std::exception_ptr error);
+
+            mutable std::mutex queue_mutex;
+            std::condition_variable queue_cv;
+            std::condition_variable idle_cv;
+            std::list<Command> pending;
+            bool busy = false;
+            bool run = true;
+            std::thread* thread = nullptr;
+            size_t executed = 0;
+            size_t coalesced = 0;
+    };
+}
@@ -0,0 +1,272 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "decimationplanner.hpp"
+
+#include <csdr/complex.hpp>
+#include <csdr/firdecimate.hpp>
+#include <csdr/fractionaldecimator.hpp>
+#include <csdr/shift.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+using namespace Csdrx;
+
+// SDRplay ADC rates and hardware decimation (see SDRplaySource::setSamplerate())
+static constexpr double SDRPLAY_ADC_MIN = 2e6;
+static constexpr double SDRPLAY_ADC_MAX = 10.66e6;
+static constexpr unsigned int SDRPLAY_MAX_DECIMATION = 32;
+// part of the device rate (on each side of the LO) that is still clean
+// after the hardware decimation filters
+static constexpr double USABLE_FRACTION = 0.4;
+// cost (multiply-accumulates) per sample of the sample conversion, of the
+// shift, and per output sample of the fractional decimator
+static constexpr double CONVERT_COST = 1;
+static constexpr double SHIFT_COST = 4;
+static constexpr double FRACTIONAL_COST = 12;
+static constexpr int MAX_STAGES = 4;
+
+// same rule as SDRplaySource::setSamplerate()
+static unsigned int hw_decimation_for(double device_rate) {
+    unsigned int decimation = 1;
+    while (device_rate * decimation < SDRPLAY_ADC_MIN && decimation < SDRPLAY_MAX_DECIMATION)
+        decimation *= 2;
+    return decimation;
+}
+
+DecimationPlanner::DecimationPlanner(double channel_bandwidth,
+                                     double output_rate, double adc_rate):
+    channel_bandwidth(channel_bandwidth),
+    output_rate(output_rate)
+{
+    if (channel_bandwidth <= 0 || output_rate <= channel_bandwidth)
+        throw DecimationPlannerException("the output rate must be larger than the channel bandwidth");
+
+    bool found = false;
+    if (adc_rate == 0) {
+        // an integer multiple of the output rate, so there's no need for
+        // a fractional decimator
+        for (unsigned int n = 1; output_rate * n <= SDRPLAY_ADC_MAX; n++) {
+            double rate = output_rate * n;
+            unsigned int decimation = hw_decimation_for(rate);
+            if (rate * decimation < SDRPLAY_ADC_MIN)
+                continue;
+            found = plan_device_rate(rate, decimation) || found;
+        }
+    } else {
+        if (adc_rate < SDRPLAY_ADC_MIN || adc_rate > SDRPLAY_ADC_MAX)
+            throw DecimationPlannerException("invalid ADC rate");
+        for (unsigned int decimation = 1; decimation <= SDRPLAY_MAX_DECIMATION; decimation *= 2) {
+            double rate = adc_rate / decimation;
+            if (hw_decimation_for(rate) != decimation)
+                continue;
+            found = plan_device_rate(rate, decimation) || found;
+        }
+    }
+    if (!found)
+        throw DecimationPlannerException("the channel doesn't fit in any device samplerate");
+}
+
+template <typename T>
+void DecimationPlanner::configure(SDRplaySource<T>* source, double frequency) const
+{
+    // the IF filter must pass the channel at its offset
+    static const double if_bandwidths[] = { 200e3, 300e3, 600e3, 1536e3, 5e6, 6e6, 7e6, 8e6 };
+    double edge = 2 * (std::fabs(if_offset) + channel_bandwidth / 2);
+    double if_bandwidth = if_bandwidths[7];
+    for (auto bw : if_bandwidths) {
+        if (bw >= edge) {
+            if_bandwidth = bw;
+            break;
+        }
+    }
+    source->setSamplerate(device_rate);
+    source->setBandwidth(if_bandwidth);
+    source->setFrequency(getTunerFrequency(frequency));
+}
+
+void DecimationPlanner::addStages(Pipeline& pipeline, Csdr::Window* window) const
+{
+    pipeline | new Csdr::ShiftAddfast(getShiftRate());
+    for (auto& stage : stages)
+        pipeline | new Csdr::FirDecimate(stage.decimation, stage.transitionBandwidth,
+                                         window, stage.cutoffRate);
+    if (fractional_rate > 1)
+        pipeline | new Csdr::FractionalDecimator<Csdr::complex<float>>(fractional_rate, 12, nullptr);
+}
+
+double DecimationPlanner::getTunerFrequency(double frequency) const
+{
+    // the channel ends up at -if_offset, and the shift brings it back to 0
+    return frequency + if_offset;
+}
+
+// getters
+double DecimationPlanner::getChannelBandwidth() const
+{
+    return channel_bandwidth;
+}
+
+double DecimationPlanner::getOutputRate() const
+{
+    return output_rate;
+}
+
+double DecimationPlanner::getAdcRate() const
+{
+    return adc_rate;
+}
+
+unsigned int DecimationPlanner::getHwDecimation() const
+{
+    return hw_decimation;
+}
+
+double DecimationPlanner::getDeviceRate() const
+{
+    return device_rate;
+}
+
+double DecimationPlanner::getIFOffset() const
+{
+    return if_offset;
+}
+
+double DecimationPlanner::getShiftRate() const
+{
+    return if_offset / device_rate;
+}
+
+const std::vector<DecimationPlanner::Stage>& DecimationPlanner::getStages() const
+{
+    return stages;
+}
+
+double DecimationPlanner::getFractionalRate() const
+{
+    return fractional_rate;
+}
+
+double DecimationPlanner::getCost() const
+{
+    return cost;
+}
+
+void DecimationPlanner::show() const
+{
+    std::cerr << "# Decimation plan:" << std::endl;
+    std::cerr << "    channel bandwidth=" << channel_bandwidth << " output rate=" << output_rate << std::endl;
+    std::cerr << "    ADC rate=" << adc_rate << " hardware decimation=" << hw_decimation << " device rate=" << device_rate << std::endl;
+    std::cerr << "    IF offset=" << if_offset << " shift rate=" << getShiftRate() << std::endl;
+    for (auto& stage : stages)
+        std::cerr << "    FirDecimate(" << stage.decimation << ", " << stage.transitionBandwidth << ", window, " << stage.cutoffRate << ") input rate=" << stage.inputRate << " taps=" << stage.taps << std::endl;
+    if (fractional_rate > 1)
+        std::cerr << "    FractionalDecimator(" << fractional_rate << ")" << std::endl;
+    std::cerr << "    cost=" << cost / 1e6 << "M MAC/s" << std::endl;
+}
+
+// internal functions
+double DecimationPlanner::min_offset() const
+{
+    // keep the whole channel away from the DC spike at the LO
+    return channel_bandwidth / 2 + std::max(channel_bandwidth / 4, 5e3);
+}
+
+bool DecimationPlanner::plan_device_rate(double rate, unsigned int decimation)
+{
+    double offset = min_offset();
+    if (offset + channel_bandwidth / 2 > USABLE_FRACTION * rate)
+        return false;
+    unsigned int n = (unsigned int) floor(rate / output_rate + 1e-9);
+    if (n == 0)
+        return false;
+    double final_rate = rate / n;
+    Chain chain = plan_chain(rate, n, final_rate);
+    double total = rate * (CONVERT_COST + SHIFT_COST) + chain.cost;
+    double fractional = final_rate / output_rate;
+    if (fractional > 1 + 1e-9)
+        total += output_rate * FRACTIONAL_COST;
+    else
+        fractional = 1;
+    if (device_rate != 0 && total >= cost)
+        return true;
+    adc_rate = rate * decimation;
+    hw_decimation = decimation;
+    device_rate = rate;
+    if_offset = offset;
+    stages = chain.stages;
+    fractional_rate = fractional;
+    cost = total;
+    return true;
+}
+
+DecimationPlanner::Chain DecimationPlanner::plan_chain(double rate,
+                                                       unsigned int decimation,
+                                                       double final_rate) const
+{
+    Chain best = { {}, 0 };
+    if (decimation == 1)
+        return best;
+    best.cost = INFINITY;
+    std::vector<Stage> chain;
+    plan_factors(rate, decimation, final_rate, chain, 0, best);
+    return best;
+}
+
+// tries all the ordered factorizations of the decimation
+void DecimationPlanner::plan_factors(double rate, unsigned int decimation,
+                                     double final_rate, std::vector<Stage>& chain,
+                                     double chain_cost, Chain& best) const
+{
+    for (unsigned int d = 2; d <= decimation; d++) {
+        if (decimation % d != 0)
+            continue;
+        if (d != decimation && chain.size() + 1 == MAX_STAGES)
+            continue;
+        Stage stage = make_stage(rate, d, d == decimation ? final_rate : 0);
+        double stage_cost = chain_cost + rate / d * stage.taps;
+        if (stage_cost >= best.cost)
+            continue;
+        chain.push_back(stage);
+        if (d == decimation) {
+            best.stages = chain;
+            best.cost = stage_cost;
+        } else {
+            plan_factors(rate / d, decimation / d, final_rate, chain, stage_cost, best);
+        }
+        chain.pop_back();
+    }
+}
+
+// final_rate == 0 -> intermediate stage
+DecimationPlanner::Stage DecimationPlanner::make_stage(double rate,
+                                                       unsigned int decimation,
+                                                       double final_rate) const
+{
+    double out_rate = rate / decimation;
+    Stage stage;
+    stage.decimation = decimation;
+    stage.inputRate = rate;
+    if (final_rate == 0) {
+        // only keep what aliases into the output band clean
+        stage.transitionBandwidth = (out_rate - output_rate) / rate;
+        stage.cutoffRate = 0.5;
+    } else {
+        // keep what aliases into the channel clean (also after the
+        // fractional decimator)
+        stage.transitionBandwidth = (output_rate - channel_bandwidth) / rate;
+        stage.cutoffRate = output_rate / (2 * out_rate);
+    }
+    stage.taps = (unsigned int) ceil(4.0 / stage.transitionBandwidth) | 1;
+    return stage;
+}
+
+namespace Csdrx {
+    template void DecimationPlanner::configure(SDRplaySource<Csdr::complex<short>>* source, double frequency) const;
+    template void DecimationPlanner::configure(SDRplaySource<Csdr::complex<float>>* source, double frequency) const;
+}
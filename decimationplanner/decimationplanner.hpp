@@ -0,0 +1,87 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <csdr/window.hpp>
+#include <csdrx/pipeline.hpp>
+#include <csdrx/sdrplaysource.hpp>
+#include <stdexcept>
+#include <vector>
+
+namespace Csdrx {
+
+    class DecimationPlannerException: public std::runtime_error {
+        public:
+            DecimationPlannerException(const std::string& reason): std::runtime_error(reason) {}
+    };
+
+    // plans the receiver front end for a channel: the ADC rate and hardware
+    // decimation of the SDRplay device, the IF offset that keeps the channel
+    // away from the DC spike, and the cheapest chain of FIR decimators (plus
+    // a fractional decimator when the ADC rate is fixed) down to the output
+    // rate. The cost is estimated in multiply-accumulates per second, with
+    // the length of the filters computed as 4 / transition bandwidth
+    class DecimationPlanner {
+        public:
+            struct Stage {
+                unsigned int decimation;
+                float transitionBandwidth;    // relative to the input rate
+                float cutoffRate;             // as in Csdr::FirDecimate
+                double inputRate;
+                unsigned int taps;
+            };
+            // adc_rate == 0 -> choose the ADC rate too (an RSPduo in dual
+            // tuner mode needs adc_rate = 2e6)
+            DecimationPlanner(double channel_bandwidth, double output_rate,
+                              double adc_rate = 0);
+            // set samplerate, IF bandwidth, and frequency (of the channel)
+            template <typename T>
+            void configure(SDRplaySource<T>* source, double frequency) const;
+            // append the shift and the decimation stages to the pipeline
+            // (the window is not owned by the stages)
+            void addStages(Pipeline& pipeline, Csdr::Window* window) const;
+            // frequency to tune the device to for a channel frequency
+            double getTunerFrequency(double frequency) const;
+            // getters
+            double getChannelBandwidth() const;
+            double getOutputRate() const;
+            double getAdcRate() const;
+            unsigned int getHwDecimation() const;
+            double getDeviceRate() const;
+            double getIFOffset() const;
+            double getShiftRate() const;
+            const std::vector<Stage>& getStages() const;
+            double getFractionalRate() const;     // 1 -> no fractional decimator
+            double getCost() const;
+            void show() const;
+        private:
+            struct Chain {
+                std::vector<Stage> stages;
+                double cost;
+            };
+            double min_offset() const;
+            bool plan_device_rate(double device_rate, unsigned int hw_decimation);
+            Chain plan_chain(double device_rate, unsigned int decimation,
+                             double final_rate) const;
+            void plan_factors(double rate, unsigned int decimation,
+                              double final_rate, std::vector<Stage>& stages,
+                              double cost, Chain& best) const;
+            Stage make_stage(double rate, unsigned int decimation,
+                             double final_rate) const;
+
+            double channel_bandwidth;
+            double output_rate;
+            double adc_rate = 0;
+            unsigned int hw_decimation = 1;
+            double device_rate = 0;
+            double if_offset = 0;
+            std::vector<Stage> stages;
+            double fractional_rate = 1;
+            double cost = 0;
+    };
+}
@@ -36,6 +36,10 @@ void DsdDecoder::process() {
     auto samples = reader->getReadPointer();
     for (nbSamples = 0; nbSamples < available; nbSamples++) {
         dsdDecoder.run(samples[nbSamples]);
+        bool sync = dsdDecoder.getSyncType() != DSDcc::DSDDecoder::DSDSyncNone;
+        if (sync && !synced)
+            emitTag(TagType::Trigger, processedSamples + nbSamples, 0, (double) dsdDecoder.getSyncType());
+        synced = sync;
         if (slots & 1) {
             audioSamples1 = dsdDecoder.getAudio1(nbAudioSamples1);
         }
@@ -73,6 +77,14 @@ void DsdDecoder::process() {
         }
     }
     reader->advance(available);
+    processedSamples += available;
+}
+
+void DsdDecoder::reset() {
+    std::lock_guard<std::mutex> lock(processMutex);
+    dsdDecoder.resetAudio1();
+    dsdDecoder.resetAudio2();
+    synced = false;
 }
 
 bool DsdDecoder::canProcess() {
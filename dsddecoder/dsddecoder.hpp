@@ -8,6 +8,7 @@
 #pragma once
 
 #include <csdr/module.hpp>
+#include <csdrx/tags.hpp>
 
 #include <dsdcc/dsd_decoder.h>
 #include <dsdcc/dsd_upsample.h>
@@ -19,12 +20,16 @@ namespace Csdrx {
             DSDException(const std::string& reason): std::runtime_error(reason) {}
     };
 
-    class DsdDecoder: public Csdr::Module<short, short> {
+    // emits a Trigger tag at the input sample where a sync is acquired
+    // (value is the DSDcc sync type), for instance for a TimeMachine
+    class DsdDecoder: public Csdr::Module<short, short>, public Resettable, public TagEmitter {
         public:
             DsdDecoder(const char *mode = "auto", FILE* formatTextFile = nullptr, bool upsample = false);
             ~DsdDecoder() override;
             bool canProcess() override;
             void process() override;
+            // drop the partially decoded audio (e.g. after a retune)
+            void reset() override;
             // setters
             void setSlots(int slots) { this->slots = slots; }
             void setFormatTextFile(FILE* formatTextFile) { this->formatTextFile = formatTextFile; }
@@ -64,6 +69,8 @@ namespace Csdrx {
             FILE* formatTextFile;
             float formatTextRefresh;
             int nbFormatTextSamplesLeft;
+            size_t processedSamples = 0;
+            bool synced = false;
     };
 
 }
@@ -0,0 +1,74 @@
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <csdr/deemphasis.hpp>
+#include <csdr/filter.hpp>
+#include <csdr/fir.hpp>
+#include <csdr/firdecimate.hpp>
+#include <csdr/fmdemod.hpp>
+#include <csdr/fractionaldecimator.hpp>
+#include <csdr/shift.hpp>
+#include <csdrx/audioserver.hpp>
+#include <csdrx/pipeline.hpp>
+#include <csdrx/signalgenerator.hpp>
+
+// FM BC receiver fed by the signal generator (in real time), with the audio
+// served on http://127.0.0.1:8073/ (or the port given as first argument);
+// for instance:
+//   curl -s http://127.0.0.1:8073/audio.wav | aplay
+
+bool terminate = false;
+
+void sigint_handler(int sig)
+{
+    terminate = true;
+}
+
+
+using namespace Csdr;
+using namespace Csdrx;
+
+int main(int argc, char** argv)
+{
+    typedef complex<float> CF32;
+
+    unsigned short port = argc > 1 ? atoi(argv[1]) : 8073;
+
+    auto generator = new SignalGeneratorSource<CF32>(2e6, true);
+    generator->addModulatedTone(SignalGenerator::Modulation::FM, 500e3, 0.3, 1000, 75000);
+    generator->addNoise(0.01);
+
+    auto hamming = new HammingWindow();
+    auto prefilter = new LowPassFilter<float>(0.5 / (4.166666666666667 - 0.03), 0.03, hamming);
+    auto server = new AudioServer<float>(48000, port);
+    std::cerr << "listening on http://127.0.0.1:" << server->getPort() << "/" << std::endl;
+
+    Pipeline p(generator, true);
+    p | new ShiftAddfast(-0.25)
+      | new FirDecimate(10, 0.015, hamming)
+      | new FilterModule<CF32>(new BandPassFilter<CF32>(-0.375, 0.375, 0.0016, hamming))
+      | new FmDemod()
+      | new FractionalDecimator<float>(4.166666666666667, 12, prefilter)
+      | new WfmDeemphasis(48000, 7.5e-05)
+      | server;
+
+    // handle Ctrl-C
+    signal(SIGINT, sigint_handler);
+
+    p.run();
+    struct timespec delay = { 5, 0 };
+    while (!terminate) {
+        nanosleep(&delay, nullptr);
+        for (auto& client: server->getClients())
+            std::cerr << client.address << (client.websocket ? " (WebSocket)" : " (HTTP)")
+                      << ": lag " << client.lag * 1000 << "ms, "
+                      << client.sentBytes << " bytes sent" << std::endl;
+    }
+    p.stop();
+    std::cerr << server->getTotalClients() << " clients, "
+              << server->getDroppedClients() << " dropped" << std::endl;
+
+    delete server;
+
+    return 0;
+}
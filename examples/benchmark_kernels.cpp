@@ -0,0 +1,74 @@
+#include <csdrx/kernels.hpp>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+using namespace Csdrx;
+
+// SDRplay API callbacks usually deliver a few hundred to a few thousand
+// samples at a time
+static const size_t BLOCK_SIZE = 2016;
+static const int ITERATIONS = 20000;
+
+template <typename T>
+static double run(void (*convert)(const short*, const short*, T*, size_t),
+                  const std::vector<short>& xi, const std::vector<short>& xq,
+                  std::vector<T>& out) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ITERATIONS; i++)
+        convert(xi.data(), xq.data(), out.data(), BLOCK_SIZE);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    // nanoseconds per sample
+    return elapsed.count() * 1e9 / ((double) BLOCK_SIZE * ITERATIONS);
+}
+
+// interleaved native formats of the SoapySDR drivers
+template <typename S, typename T>
+static double run_native(void (*convert)(const S*, T*, size_t),
+                         const std::vector<unsigned char>& in, std::vector<T>& out) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ITERATIONS; i++)
+        convert(reinterpret_cast<const S*>(in.data()), out.data(), BLOCK_SIZE);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() * 1e9 / ((double) BLOCK_SIZE * ITERATIONS);
+}
+
+int main() {
+    std::vector<short> xi(BLOCK_SIZE);
+    std::vector<short> xq(BLOCK_SIZE);
+    for (size_t i = 0; i < BLOCK_SIZE; i++) {
+        xi[i] = rand();
+        xq[i] = rand();
+    }
+    std::vector<Csdr::complex<float>> out_cf32(BLOCK_SIZE);
+    std::vector<Csdr::complex<short>> out_cs16(BLOCK_SIZE);
+    std::vector<unsigned char> native(BLOCK_SIZE * 4);
+    for (auto& x : native)
+        x = rand();
+
+    std::cerr << "default kernels: " << get_kernels_isa() << std::endl;
+    for (auto isa : { "scalar", "sse2", "avx2", "neon" }) {
+        if (!set_kernels_isa(isa))
+            continue;
+        double cf32 = run(convert_planar_s16_to_cf32, xi, xq, out_cf32);
+        double cs16 = run(convert_planar_s16_to_cs16, xi, xq, out_cs16);
+        std::cout << isa << ": planar s16 -> cf32 " << cf32 << " ns/sample ("
+                  << 1e3 / cf32 << " MS/s), planar s16 -> cs16 " << cs16
+                  << " ns/sample (" << 1e3 / cs16 << " MS/s)" << std::endl;
+        // the scale is a default argument, so it can't go through a pointer
+        double cs8 = run_native<signed char, Csdr::complex<float>>(
+            [] (const signed char* in, Csdr::complex<float>* out, size_t n) { convert_cs8_to_cf32(in, out, n); },
+            native, out_cf32);
+        double cu8 = run_native<unsigned char, Csdr::complex<float>>(
+            [] (const unsigned char* in, Csdr::complex<float>* out, size_t n) { convert_cu8_to_cf32(in, out, n); },
+            native, out_cf32);
+        double cs12 = run_native<unsigned char, Csdr::complex<float>>(
+            [] (const unsigned char* in, Csdr::complex<float>* out, size_t n) { convert_cs12_to_cf32(in, out, n); },
+            native, out_cf32);
+        std::cout << isa << ": cs8 -> cf32 " << cs8 << " ns/sample, cu8 -> cf32 " << cu8
+                  << " ns/sample, cs12 -> cf32 " << cs12 << " ns/sample" << std::endl;
+    }
+
+    return 0;
+}
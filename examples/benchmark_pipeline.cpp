@@ -0,0 +1,91 @@
+#include <atomic>
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <csdr/converter.hpp>
+#include <csdr/deemphasis.hpp>
+#include <csdr/filter.hpp>
+#include <csdr/fir.hpp>
+#include <csdr/firdecimate.hpp>
+#include <csdr/fmdemod.hpp>
+#include <csdr/fractionaldecimator.hpp>
+#include <csdr/shift.hpp>
+#include <csdrx/pipeline.hpp>
+#include <csdrx/signalgenerator.hpp>
+
+// throughput of the FM BC receiver chain, without a radio: the signal
+// generator writes the samples as fast as the pipeline takes them, and
+// the audio is counted and discarded
+
+bool terminate = false;
+
+void sigint_handler(int sig)
+{
+    terminate = true;
+}
+
+
+using namespace Csdr;
+using namespace Csdrx;
+
+template <typename T>
+class CountingWriter: public Writer<T> {
+    public:
+        size_t writeable() override { return buffer.size(); }
+        T* getWritePointer() override { return buffer.data(); }
+        void advance(size_t how_much) override { samples += how_much; }
+        size_t getSamples() const { return samples; }
+    private:
+        std::vector<T> buffer = std::vector<T>(10240);
+        std::atomic<size_t> samples{0};
+};
+
+int main(int argc, char** argv)
+{
+    typedef complex<float> CF32;
+
+    int seconds = argc > 1 ? atoi(argv[1]) : 10;
+
+    auto generator = new SignalGeneratorSource<CF32>(2e6);
+    // a station at +500kHz, another one at -500kHz, and some noise
+    generator->addModulatedTone(SignalGenerator::Modulation::FM, 500e3, 0.3, 1000, 75000);
+    generator->addModulatedTone(SignalGenerator::Modulation::FM, -500e3, 0.1, 400, 75000);
+    generator->addNoise(0.01);
+
+    auto hamming = new HammingWindow();
+    auto prefilter = new LowPassFilter<float>(0.5 / (4.166666666666667 - 0.03), 0.03, hamming);
+    auto audio = new CountingWriter<short>();
+
+    Pipeline p(generator, true);
+    p | new ShiftAddfast(-0.25)
+      | new FirDecimate(10, 0.015, hamming)
+      | new FilterModule<CF32>(new BandPassFilter<CF32>(-0.375, 0.375, 0.0016, hamming))
+      | new FmDemod()
+      | new FractionalDecimator<float>(4.166666666666667, 12, prefilter)
+      | new WfmDeemphasis(48000, 7.5e-05)
+      | new Converter<float, short>()
+      | audio;
+
+    // handle Ctrl-C
+    signal(SIGINT, sigint_handler);
+
+    p.run();
+    struct timespec delay = { 1, 0 };
+    size_t previous = 0;
+    int elapsed = 0;
+    for (; elapsed < seconds && !terminate; elapsed++) {
+        nanosleep(&delay, nullptr);
+        size_t total = generator->getTotalSamples();
+        std::cerr << (total - previous) / 1e6 << " MS/s I/Q in, "
+                  << audio->getSamples() << " audio samples out" << std::endl;
+        previous = total;
+    }
+    p.stop();
+    std::cerr << "average: " << generator->getTotalSamples() / (elapsed * 1e6)
+              << " MS/s" << std::endl;
+
+    delete audio;
+
+    return 0;
+}
@@ -0,0 +1,84 @@
+#include <csignal>
+#include <iostream>
+#include <string>
+#include <csdr/converter.hpp>
+#include <csdr/deemphasis.hpp>
+#include <csdr/filter.hpp>
+#include <csdr/fir.hpp>
+#include <csdr/firdecimate.hpp>
+#include <csdr/fmdemod.hpp>
+#include <csdr/fractionaldecimator.hpp>
+#include <csdr/shift.hpp>
+#include <csdrx/pipeline.hpp>
+#include <csdrx/pulseaudiowriter.hpp>
+#include <csdrx/sdrplaysource.hpp>
+
+
+bool terminate = false;
+
+void sigint_handler(int sig)
+{
+    terminate = true;
+}
+
+
+using namespace Csdr;
+using namespace Csdrx;
+
+// FM BC receiver chain (2Msps in, 48ksps audio out)
+static void fm_receiver(Pipeline& p, Window* window, const char* stream_name)
+{
+    typedef complex<float> CF32;
+
+    auto prefilter = new LowPassFilter<float>(0.5 / (4.166666666666667 - 0.03), 0.03, window);
+
+    p | new ShiftAddfast(0.25)
+      | new FirDecimate(10, 0.015, window)
+      | new FilterModule<CF32>(new BandPassFilter<CF32>(-0.375, 0.375, 0.0016, window))
+      | new FmDemod()
+      | new FractionalDecimator<float>(4.166666666666667, 12, prefilter)
+      | new WfmDeemphasis(48000, 7.5e-05)
+      | new Converter<float, short>()
+      | new PulseAudioWriter<short>(48000, 10240, stream_name);
+}
+
+int main(int argc, char** argv)
+{
+    typedef complex<float> CF32;
+
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " <RSPduo serial number>" << std::endl;
+        return 1;
+    }
+    // '/D' selects the RSPduo dual tuner mode
+    std::string serial = std::string(argv[1]) + "/D";
+
+    auto hamming = new HammingWindow();
+
+    auto rspduo = new SDRplaySource<CF32>(serial.c_str(), 2000000, 90.4e6, nullptr, 1);
+    auto tuner_b = rspduo->getTunerB();
+    tuner_b->setFrequency(94.4e6);
+
+    Pipeline pa(rspduo, true);
+    fm_receiver(pa, hamming, "fm_receiver_rspduo_tuner_a");
+    Pipeline pb(tuner_b, true);
+    fm_receiver(pb, hamming, "fm_receiver_rspduo_tuner_b");
+
+    struct timespec delay = { 0, 100000000 };   // 100ms delay
+
+    // Tuner B first, so both outputs have a writer when streaming starts
+    pb.run();
+    pa.run();
+
+    // handle Ctrl-C
+    signal(SIGINT, sigint_handler);
+    while (!terminate && pa.isRunning() && pb.isRunning())
+        nanosleep(&delay, nullptr);
+    pa.stop();
+    pb.stop();
+
+    std::cerr << "tuner A samples: " << rspduo->getTotalSamples()
+              << " - tuner B samples: " << tuner_b->getTotalSamples() << std::endl;
+
+    return 0;
+}
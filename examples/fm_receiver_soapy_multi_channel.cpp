@@ -0,0 +1,86 @@
+#include <csignal>
+#include <iostream>
+#include <string>
+#include <csdr/converter.hpp>
+#include <csdr/deemphasis.hpp>
+#include <csdr/filter.hpp>
+#include <csdr/fir.hpp>
+#include <csdr/firdecimate.hpp>
+#include <csdr/fmdemod.hpp>
+#include <csdr/fractionaldecimator.hpp>
+#include <csdr/shift.hpp>
+#include <csdrx/pipeline.hpp>
+#include <csdrx/pulseaudiowriter.hpp>
+#include <csdrx/soapymultisource.hpp>
+
+
+bool terminate = false;
+
+void sigint_handler(int sig)
+{
+    terminate = true;
+}
+
+
+using namespace Csdr;
+using namespace Csdrx;
+
+// FM BC receiver chain (2Msps in, 48ksps audio out)
+static void fm_receiver(Pipeline& p, Window* window, const char* stream_name)
+{
+    typedef complex<float> CF32;
+
+    auto prefilter = new LowPassFilter<float>(0.5 / (4.166666666666667 - 0.03), 0.03, window);
+
+    p | new ShiftAddfast(0.25)
+      | new FirDecimate(10, 0.015, window)
+      | new FilterModule<CF32>(new BandPassFilter<CF32>(-0.375, 0.375, 0.0016, window))
+      | new FmDemod()
+      | new FractionalDecimator<float>(4.166666666666667, 12, prefilter)
+      | new WfmDeemphasis(48000, 7.5e-05)
+      | new Converter<float, short>()
+      | new PulseAudioWriter<short>(48000, 10240, stream_name);
+}
+
+int main(int argc, char** argv)
+{
+    typedef complex<float> CF32;
+
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " <SoapySDR device args (for instance 'driver=lime')>" << std::endl;
+        return 1;
+    }
+
+    auto hamming = new HammingWindow();
+
+    // channels 0 and 1 in a single sample aligned stream
+    auto soapysdr = new SoapyMultiSource<CF32>(argv[1], {0, 1}, 2000000, 90.4e6);
+    auto channel0 = soapysdr->getChannelSource(0);
+    auto channel1 = soapysdr->getChannelSource(1);
+    channel0->setAGC(true);
+    channel1->setAGC(true);
+    channel1->setFrequency(94.4e6);
+
+    Pipeline p0(channel0, true);
+    fm_receiver(p0, hamming, "fm_receiver_soapy_channel_0");
+    Pipeline p1(channel1, true);
+    fm_receiver(p1, hamming, "fm_receiver_soapy_channel_1");
+
+    struct timespec delay = { 0, 100000000 };   // 100ms delay
+
+    // streaming starts when both channels have a writer
+    p1.run();
+    p0.run();
+
+    // handle Ctrl-C
+    signal(SIGINT, sigint_handler);
+    while (!terminate && p0.isRunning() && p1.isRunning())
+        nanosleep(&delay, nullptr);
+    p0.stop();
+    p1.stop();
+
+    std::cerr << "samples per channel: " << soapysdr->getTotalSamples()
+              << " - overflows: " << soapysdr->getOverflows() << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,55 @@
+// I/Q recorder: writes the samples from an SDRplay RSP to disk in 1GB files
+// with SigMF metadata
+
+#include <csignal>
+#include <iostream>
+#include <csdrx/filewriter.hpp>
+#include <csdrx/pipeline.hpp>
+#include <csdrx/sdrplaysource.hpp>
+
+
+bool terminate = false;
+
+void sigint_handler(int sig)
+{
+    terminate = true;
+}
+
+
+using namespace Csdr;
+using namespace Csdrx;
+
+int main()
+{
+    typedef complex<float> CF32;
+
+    double samplerate = 2000000;
+    double frequency = 144.8e6;
+
+    auto rspdx = new SDRplaySource<CF32>("", samplerate, frequency, "Antenna C", 1);
+    auto recorder = new FileWriter<CF32>("iq-%Y%m%dT%H%M%SZ.sigmf-data");
+    recorder->setRotateSize(1024 * 1024 * 1024);
+    recorder->setPreallocate(true);
+    recorder->setSigMF(samplerate, "csdrx I/Q recorder");
+    recorder->setFrequency(frequency);
+
+    Pipeline p(rspdx, true);
+    p | recorder;
+
+    struct timespec delay = { 0, 100000000 };   // 100ms delay
+
+    p.run();
+
+    // handle Ctrl-C
+    signal(SIGINT, sigint_handler);
+    while (!terminate && p.isRunning())
+        nanosleep(&delay, nullptr);
+    p.stop();
+
+    std::cerr << "bytes written: " << recorder->getBytesWritten() << std::endl;
+    std::cerr << "files written: " << recorder->getFilesWritten() << std::endl;
+    std::cerr << "dropped samples: " << recorder->getDroppedSamples() << std::endl;
+    delete recorder;
+
+    return 0;
+}
@@ -0,0 +1,59 @@
+#include <csignal>
+#include <iostream>
+#include <csdr/agc.hpp>
+#include <csdr/converter.hpp>
+#include <csdr/deemphasis.hpp>
+#include <csdr/fmdemod.hpp>
+#include <csdr/limit.hpp>
+#include <csdr/window.hpp>
+#include <csdrx/decimationplanner.hpp>
+#include <csdrx/pipeline.hpp>
+#include <csdrx/pulseaudiowriter.hpp>
+#include <csdrx/sdrplaysource.hpp>
+
+bool terminate = false;
+
+void sigint_handler(int sig)
+{
+    terminate = true;
+}
+
+
+using namespace Csdr;
+using namespace Csdrx;
+
+int main()
+{
+    typedef complex<float> CF32;
+
+    // 12.5kHz NBFM channel, demodulated at 48kHz; the planner picks the ADC
+    // rate, the hardware decimation, the IF offset, and the decimation stages
+    DecimationPlanner plan(12500, 48000);
+    plan.show();
+
+    auto hamming = new HammingWindow();
+
+    auto rspdx = new SDRplaySource<CF32>();
+    plan.configure(rspdx, 144.800e6);
+
+    Pipeline p(rspdx, true);
+    plan.addStages(p, hamming);
+    p | new FmDemod()
+      | new NfmDeephasis(48000)
+      | new Agc<float>()
+      | new Limit(1.0)
+      | new Converter<float, short>()
+      | new PulseAudioWriter<short>(48000, 10240, "nbfm_receiver");
+
+    p.run();
+
+    struct timespec delay = { 0, 100000000 };   // 100ms delay
+
+    // handle Ctrl-C
+    signal(SIGINT, sigint_handler);
+    while (!terminate && p.isRunning())
+        nanosleep(&delay, nullptr);
+    p.stop();
+
+    return 0;
+}
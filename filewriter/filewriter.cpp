@@ -0,0 +1,495 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "filewriter.hpp"
+
+#include <csdr/complex.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace Csdrx;
+
+// O_DIRECT requires buffers, sizes, and file offsets aligned to the logical
+// block size of the filesystem; 4096 covers all the common cases
+static constexpr size_t IO_ALIGNMENT = 4096;
+// when preallocating without a rotation size, grow the file by this many chunks
+static constexpr size_t PREALLOCATE_CHUNKS = 64;
+
+// SigMF helpers
+namespace Csdrx {
+    template <>
+    const char* sigmf_datatype<unsigned char>() { return "ru8"; }
+    template <>
+    const char* sigmf_datatype<short>() { return "ri16_le"; }
+    template <>
+    const char* sigmf_datatype<float>() { return "rf32_le"; }
+    template <>
+    const char* sigmf_datatype<Csdr::complex<short>>() { return "ci16_le"; }
+    template <>
+    const char* sigmf_datatype<Csdr::complex<float>>() { return "cf32_le"; }
+}
+
+static std::string json_escape(const char* s) {
+    std::string escaped;
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            escaped += '\\';
+            escaped += *s;
+        } else if (static_cast<unsigned char>(*s) < 0x20) {
+            escaped += ' ';
+        } else {
+            escaped += *s;
+        }
+    }
+    return escaped;
+}
+
+void Csdrx::write_sigmf_meta(const std::string& data_filename, const char* datatype,
+                             double samplerate, double frequency,
+                             const struct timespec& start_time,
+                             const char* description)
+{
+    static const std::string data_ext = ".sigmf-data";
+    std::string meta_filename = data_filename;
+    if (meta_filename.size() > data_ext.size() &&
+        meta_filename.compare(meta_filename.size() - data_ext.size(), data_ext.size(), data_ext) == 0)
+        meta_filename.erase(meta_filename.size() - data_ext.size());
+    meta_filename += ".sigmf-meta";
+
+    FILE* meta = fopen(meta_filename.c_str(), "w");
+    if (meta == nullptr) {
+        std::cerr << "unable to open SigMF metadata file " << meta_filename << std::endl;
+        return;
+    }
+
+    struct tm tm;
+    gmtime_r(&start_time.tv_sec, &tm);
+    char datetime[32];
+    strftime(datetime, sizeof(datetime), "%Y-%m-%dT%H:%M:%S", &tm);
+
+    fprintf(meta, "{\n");
+    fprintf(meta, "    \"global\": {\n");
+    fprintf(meta, "        \"core:datatype\": \"%s\",\n", datatype);
+    if (samplerate > 0)
+        fprintf(meta, "        \"core:sample_rate\": %.17g,\n", samplerate);
+    if (description != nullptr && description[0] != '\0')
+        fprintf(meta, "        \"core:description\": \"%s\",\n", json_escape(description).c_str());
+    fprintf(meta, "        \"core:recorder\": \"csdrx\",\n");
+    fprintf(meta, "        \"core:version\": \"1.0.0\"\n");
+    fprintf(meta, "    },\n");
+    fprintf(meta, "    \"captures\": [\n");
+    fprintf(meta, "        {\n");
+    fprintf(meta, "            \"core:sample_start\": 0,\n");
+    if (frequency > 0)
+        fprintf(meta, "            \"core:frequency\": %.17g,\n", frequency);
+    fprintf(meta, "            \"core:datetime\": \"%s.%06ldZ\"\n", datetime, start_time.tv_nsec / 1000);
+    fprintf(meta, "        }\n");
+    fprintf(meta, "    ],\n");
+    fprintf(meta, "    \"annotations\": []\n");
+    fprintf(meta, "}\n");
+    fclose(meta);
+}
+
+std::string Csdrx::format_filename(const std::string& pattern,
+                                   const struct timespec& start_time,
+                                   double frequency, unsigned int sequence,
+                                   bool add_sequence)
+{
+    std::string filename = pattern;
+    if (pattern.find('%') != std::string::npos) {
+        struct tm tm;
+        gmtime_r(&start_time.tv_sec, &tm);
+        char buffer[4096];
+        if (strftime(buffer, sizeof(buffer), pattern.c_str(), &tm) > 0)
+            filename = buffer;
+    }
+    static const std::string frequency_placeholder = "{frequency}";
+    size_t pos = filename.find(frequency_placeholder);
+    if (pos != std::string::npos) {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%.0f", frequency);
+        filename.replace(pos, frequency_placeholder.size(), buffer);
+    }
+    if (add_sequence) {
+        char suffix[16];
+        snprintf(suffix, sizeof(suffix), "-%04u", sequence);
+        size_t slash = filename.rfind('/');
+        size_t dot = filename.rfind('.');
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+            filename += suffix;
+        else
+            filename.insert(dot, suffix);
+    }
+    return filename;
+}
+
+template <typename T>
+FileWriter<T>::FileWriter(const char* filename, size_t chunk_size, size_t nchunks):
+    filename(filename),
+    nchunks(std::max(nchunks, (size_t) 2)),
+    frequency(0),
+    head(0),
+    tail(0),
+    bytes_written(0),
+    dropped_samples(0),
+    files_written(0),
+    errors(false)
+{
+    if (filename == nullptr || strcmp(filename, "") == 0)
+        throw FileWriterException("invalid filename");
+
+    // round the chunk size up to the I/O alignment
+    size_t chunk_bytes = (std::max(chunk_size, IO_ALIGNMENT) + IO_ALIGNMENT - 1) / IO_ALIGNMENT * IO_ALIGNMENT;
+    chunk_samples = chunk_bytes / sizeof(T);
+
+    chunks = new Chunk[this->nchunks];
+    for (size_t i = 0; i < this->nchunks; i++) {
+        void* data;
+        if (posix_memalign(&data, IO_ALIGNMENT, chunk_bytes) != 0)
+            throw FileWriterException("unable to allocate chunk buffers");
+        chunks[i].data = (T*) data;
+    }
+    void* data;
+    if (posix_memalign(&data, IO_ALIGNMENT, chunk_bytes) != 0)
+        throw FileWriterException("unable to allocate chunk buffers");
+    discard = (T*) data;
+
+    thread = new std::thread( [this] () { loop(); });
+}
+
+template <typename T>
+FileWriter<T>::~FileWriter() {
+    // flush whatever is left in the current chunk and close the file
+    if (!discarding && (used > 0 || file_samples > 0))
+        submit(true);
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        run = false;
+    }
+    queue_cv.notify_one();
+    thread->join();
+    delete thread;
+    for (size_t i = 0; i < nchunks; i++)
+        free(chunks[i].data);
+    delete[] chunks;
+    free(discard);
+}
+
+template <typename T>
+size_t FileWriter<T>::writeable() {
+    if (discarding)
+        return chunk_samples;
+    size_t samples = chunk_samples - used;
+    size_t rotate_size = this->rotate_size;
+    if (rotate_size > 0) {
+        size_t file_max_samples = std::max(rotate_size / sizeof(T), (size_t) 1);
+        samples = std::min(samples, file_max_samples - file_samples);
+    }
+    return samples;
+}
+
+template <typename T>
+T* FileWriter<T>::getWritePointer() {
+    return discarding ? discard : current_chunk()->data + used;
+}
+
+template <typename T>
+void FileWriter<T>::advance(size_t how_much) {
+    if (discarding) {
+        dropped_samples += how_much;
+        acquire();
+        return;
+    }
+    if (how_much == 0)
+        return;
+
+    if (file_samples == 0) {
+        if (next_start_time_set) {
+            file_start_time = next_start_time;
+            next_start_time_set = false;
+        } else {
+            clock_gettime(CLOCK_REALTIME, &file_start_time);
+        }
+        file_frequency = frequency;
+    }
+    used += how_much;
+    file_samples += how_much;
+
+    bool last = false;
+    size_t rotate_size = this->rotate_size;
+    double rotate_time = this->rotate_time;
+    if (rotate_size > 0 && file_samples >= std::max(rotate_size / sizeof(T), (size_t) 1))
+        last = true;
+    if (rotate_time > 0) {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        double elapsed = (now.tv_sec - file_start_time.tv_sec) +
+                         (now.tv_nsec - file_start_time.tv_nsec) * 1e-9;
+        if (elapsed >= rotate_time)
+            last = true;
+    }
+    if (last || used == chunk_samples)
+        submit(last);
+}
+
+template <typename T>
+void FileWriter<T>::rotate(const struct timespec* start_time) {
+    if (start_time != nullptr) {
+        next_start_time = *start_time;
+        next_start_time_set = true;
+    }
+    if (file_samples == 0)
+        return;
+    if (discarding) {
+        // no free chunk to mark the end of the file; do it as soon as possible
+        rotate_pending = true;
+        return;
+    }
+    submit(true);
+}
+
+template <typename T>
+typename FileWriter<T>::Chunk* FileWriter<T>::current_chunk() {
+    return &chunks[head.load(std::memory_order_relaxed) % nchunks];
+}
+
+template <typename T>
+void FileWriter<T>::submit(bool last) {
+    size_t h = head.load(std::memory_order_relaxed);
+    Chunk& chunk = chunks[h % nchunks];
+    chunk.used = used;
+    chunk.first = new_file;
+    chunk.last = last;
+    chunk.start_time = file_start_time;
+    chunk.frequency = file_frequency;
+    {
+        // once per chunk: cheap enough, and no wakeup of the writer
+        // thread is ever missed
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        head.store(h + 1, std::memory_order_release);
+        queue_cv.notify_one();
+    }
+
+    used = 0;
+    new_file = last;
+    if (last)
+        file_samples = 0;
+    acquire();
+}
+
+template <typename T>
+void FileWriter<T>::acquire() {
+    discarding = head.load(std::memory_order_relaxed) -
+                 tail.load(std::memory_order_acquire) >= nchunks;
+    if (!discarding && rotate_pending) {
+        rotate_pending = false;
+        if (file_samples > 0)
+            submit(true);
+    }
+}
+
+// background thread
+template <typename T>
+void FileWriter<T>::loop() {
+    size_t t = tail.load(std::memory_order_relaxed);
+    while (true) {
+        size_t h;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            while ((h = head.load(std::memory_order_acquire)) == t && run)
+                queue_cv.wait(lock);
+        }
+        if (h == t)
+            break;
+        for (; t != h; t++) {
+            write_chunk(chunks[t % nchunks]);
+            tail.store(t + 1, std::memory_order_release);
+        }
+    }
+    close_file();
+}
+
+static bool write_all(int fd, const char* data, size_t bytes) {
+    while (bytes > 0) {
+        ssize_t written = ::write(fd, data, bytes);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        data += written;
+        bytes -= written;
+    }
+    return true;
+}
+
+template <typename T>
+void FileWriter<T>::write_chunk(Chunk& chunk) {
+    if (chunk.first) {
+        close_file();
+        open_file(chunk);
+    }
+    if (fd >= 0 && chunk.used > 0) {
+        const char* data = (const char*) chunk.data;
+        size_t bytes = chunk.used * sizeof(T);
+        size_t aligned = fd_direct ? bytes - bytes % IO_ALIGNMENT : bytes;
+        bool ok = true;
+        if (preallocate) {
+            off_t offset = bytes_in_file;
+            if (offset + (off_t) bytes > preallocated) {
+                size_t rotate_size = this->rotate_size;
+                off_t length = rotate_size > 0 ? (off_t) rotate_size :
+                               (off_t) (PREALLOCATE_CHUNKS * chunk_samples * sizeof(T));
+                if (fallocate(fd, FALLOC_FL_KEEP_SIZE, preallocated, length) == 0)
+                    preallocated += length;
+            }
+        }
+        if (aligned > 0)
+            ok = write_all(fd, data, aligned);
+        if (ok && aligned < bytes) {
+            // the tail of the last chunk of a file is not aligned
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+            fd_direct = false;
+            ok = write_all(fd, data + aligned, bytes - aligned);
+        }
+        if (ok) {
+            bytes_written += bytes;
+            bytes_in_file += bytes;
+        } else if (!errors.exchange(true)) {
+            std::cerr << "FileWriter: write to " << current_filename << " failed: " << strerror(errno) << std::endl;
+        }
+    }
+    if (chunk.last)
+        close_file();
+}
+
+template <typename T>
+void FileWriter<T>::open_file(const Chunk& chunk) {
+    bool add_sequence = filename.find('%') == std::string::npos &&
+                        (rotate_size > 0 || rotate_time > 0 || sequence > 0);
+    current_filename = format_filename(filename, chunk.start_time,
+                                       chunk.frequency, sequence, add_sequence);
+    // don't overwrite the previous files (for instance short files with a
+    // strftime() pattern)
+    if (sequence > 0 && !add_sequence && access(current_filename.c_str(), F_OK) == 0)
+        current_filename = format_filename(filename, chunk.start_time,
+                                           chunk.frequency, sequence, true);
+    sequence++;
+
+    int flags = O_WRONLY | O_CREAT | O_TRUNC;
+    fd_direct = direct_io;
+    fd = open(current_filename.c_str(), flags | (fd_direct ? O_DIRECT : 0), 0644);
+    if (fd < 0 && fd_direct && errno == EINVAL) {
+        // filesystem does not support O_DIRECT (tmpfs for instance)
+        fd_direct = false;
+        fd = open(current_filename.c_str(), flags, 0644);
+    }
+    if (fd < 0) {
+        if (!errors.exchange(true))
+            std::cerr << "FileWriter: unable to open " << current_filename << " for writing: " << strerror(errno) << std::endl;
+        return;
+    }
+    bytes_in_file = 0;
+    preallocated = 0;
+    files_written++;
+
+    if (sigmf) {
+        double samplerate;
+        std::string description;
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            samplerate = this->samplerate;
+            description = this->description;
+        }
+        write_sigmf_meta(current_filename, sigmf_datatype<T>(), samplerate,
+                         chunk.frequency, chunk.start_time,
+                         description.c_str());
+    }
+}
+
+template <typename T>
+void FileWriter<T>::close_file() {
+    if (fd < 0)
+        return;
+    // release the preallocated blocks past the end of the data
+    if (preallocated > bytes_in_file)
+        if (ftruncate(fd, bytes_in_file) != 0)
+            std::cerr << "FileWriter: ftruncate() failed" << std::endl;
+    ::close(fd);
+    fd = -1;
+}
+
+// setters
+template <typename T>
+void FileWriter<T>::setDirectIO(bool enable) {
+    direct_io = enable;
+}
+
+template <typename T>
+void FileWriter<T>::setPreallocate(bool enable) {
+    preallocate = enable;
+}
+
+template <typename T>
+void FileWriter<T>::setRotateSize(size_t bytes) {
+    rotate_size = bytes;
+}
+
+template <typename T>
+void FileWriter<T>::setRotateTime(double seconds) {
+    rotate_time = seconds;
+}
+
+template <typename T>
+void FileWriter<T>::setSigMF(double samplerate, const char* description) {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        this->samplerate = samplerate;
+        this->description = description == nullptr ? "" : description;
+    }
+    sigmf = true;
+}
+
+template <typename T>
+void FileWriter<T>::setFrequency(double frequency) {
+    this->frequency = frequency;
+}
+
+// getters
+template <typename T>
+size_t FileWriter<T>::getBytesWritten() const {
+    return bytes_written;
+}
+
+template <typename T>
+size_t FileWriter<T>::getDroppedSamples() const {
+    return dropped_samples;
+}
+
+template <typename T>
+unsigned int FileWriter<T>::getFilesWritten() const {
+    return files_written;
+}
+
+template <typename T>
+bool FileWriter<T>::hasErrors() const {
+    return errors;
+}
+
+namespace Csdrx {
+    template class FileWriter<unsigned char>;
+    template class FileWriter<short>;
+    template class FileWriter<float>;
+    template class FileWriter<Csdr::complex<short>>;
+    template class FileWriter<Csdr::complex<float>>;
+}
@@ -0,0 +1,132 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <csdr/writer.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <sys/types.h>
+#include <time.h>
+
+namespace Csdrx {
+
+    class FileWriterException: public std::runtime_error {
+        public:
+            FileWriterException(const std::string& reason): std::runtime_error(reason) {}
+    };
+
+    // SigMF helpers (also used by the other recorders)
+    template <typename T>
+    const char* sigmf_datatype();
+    void write_sigmf_meta(const std::string& data_filename, const char* datatype,
+                          double samplerate, double frequency,
+                          const struct timespec& start_time,
+                          const char* description);
+    // expands strftime() conversions (in UTC) and '{frequency}' (in Hz)
+    std::string format_filename(const std::string& pattern,
+                                const struct timespec& start_time,
+                                double frequency, unsigned int sequence,
+                                bool add_sequence);
+
+    // High throughput recorder: samples are collected in large aligned chunks
+    // that are written to disk by a background thread; when the disk can't
+    // keep up, samples are dropped (and counted) instead of blocking the caller
+    template <typename T>
+    class FileWriter: public Csdr::Writer<T> {
+        public:
+            // filename can contain strftime() conversions (expanded in UTC
+            // with the time of the first sample in the file) and '{frequency}'
+            FileWriter(const char* filename, size_t chunk_size = 4 * 1024 * 1024,
+                       size_t nchunks = 4);
+            ~FileWriter();
+            size_t writeable() override;
+            T* getWritePointer() override;
+            void advance(size_t how_much) override;
+            // start a new file with the next sample; must be called from the
+            // thread that writes the samples
+            void rotate(const struct timespec* start_time = nullptr);
+            // setters (O_DIRECT, preallocation and SigMF only affect the files
+            // opened after the call)
+            void setDirectIO(bool enable);
+            void setPreallocate(bool enable);
+            void setRotateSize(size_t bytes);     // 0 -> no rotation by size
+            void setRotateTime(double seconds);   // 0 -> no rotation by time
+            void setSigMF(double samplerate, const char* description = nullptr);
+            void setFrequency(double frequency);
+            // getters
+            size_t getBytesWritten() const;
+            size_t getDroppedSamples() const;
+            unsigned int getFilesWritten() const;
+            bool hasErrors() const;
+        private:
+            struct Chunk {
+                T* data;
+                size_t used;          // number of samples
+                bool first;           // first chunk of a new file
+                bool last;            // close the file after this chunk
+                struct timespec start_time;
+                double frequency;
+            };
+            Chunk* current_chunk();
+            void submit(bool last);
+            void acquire();
+            void loop();
+            void write_chunk(Chunk& chunk);
+            void open_file(const Chunk& chunk);
+            void close_file();
+
+            std::string filename;
+            size_t chunk_samples;
+            size_t nchunks;
+            Chunk* chunks;
+            T* discard;
+            // producer state
+            size_t used = 0;
+            bool discarding = false;
+            bool new_file = true;
+            bool rotate_pending = false;
+            size_t file_samples = 0;
+            struct timespec file_start_time = { 0, 0 };
+            double file_frequency = 0;
+            struct timespec next_start_time = { 0, 0 };
+            bool next_start_time_set = false;
+            // settings (set from any thread; samplerate and description are
+            // protected by queue_mutex)
+            std::atomic<bool> direct_io{false};
+            std::atomic<bool> preallocate{false};
+            std::atomic<size_t> rotate_size{0};
+            std::atomic<double> rotate_time{0};
+            std::atomic<bool> sigmf{false};
+            double samplerate = 0;
+            std::string description;
+            std::atomic<double> frequency;
+            // chunk queue (single producer, single consumer)
+            std::atomic<size_t> head;
+            std::atomic<size_t> tail;
+            std::mutex queue_mutex;
+            std::condition_variable queue_cv;
+            bool run = true;
+            std::thread* thread = nullptr;
+            // background thread state
+            int fd = -1;
+            bool fd_direct = false;
+            off_t bytes_in_file = 0;
+            off_t preallocated = 0;
+            unsigned int sequence = 0;
+            std::string current_filename;
+            // statistics
+            std::atomic<size_t> bytes_written;
+            std::atomic<size_t> dropped_samples;
+            std::atomic<unsigned int> files_written;
+            std::atomic<bool> errors;
+    };
+}
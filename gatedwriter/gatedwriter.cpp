@@ -0,0 +1,247 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "gatedwriter.hpp"
+
+#include <csdr/complex.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+using namespace Csdrx;
+
+// the squelch decision is taken every 10ms
+static constexpr double DETECTOR_WINDOW = 0.01;
+
+template <typename T>
+GatedWriter<T>::GatedWriter(const char* filename, double samplerate,
+                            double threshold, double hysteresis,
+                            double pre, double post, size_t buffer_size):
+    recorder(filename),
+    samplerate(samplerate),
+    threshold(threshold),
+    hysteresis(hysteresis),
+    window(std::max(size_t(samplerate * DETECTOR_WINDOW), (size_t) 1)),
+    post_samples(post * samplerate),
+    buffer_size(buffer_size),
+    buffer((T*) malloc(sizeof(T) * buffer_size)),
+    level(-INFINITY),
+    active(false),
+    bursts(0),
+    total_samples(0),
+    recorded_samples(0)
+{
+    // the pre-roll always covers at least the detector window, since the
+    // decision is taken at the end of the window
+    preroll_capacity = std::max(size_t(pre * samplerate), window);
+    preroll = new T[preroll_capacity];
+}
+
+template <typename T>
+GatedWriter<T>::~GatedWriter() {
+    delete[] preroll;
+    free(buffer);
+}
+
+template <typename T>
+size_t GatedWriter<T>::writeable() {
+    return buffer_size;
+}
+
+template <typename T>
+T* GatedWriter<T>::getWritePointer() {
+    return buffer;
+}
+
+template <typename T>
+void GatedWriter<T>::advance(size_t how_much) {
+    const T* samples = buffer;
+    total_samples += how_much;
+    while (how_much > 0) {
+        size_t n = std::min(how_much, window - window_count);
+        window_power += power(samples, n);
+        window_count += n;
+        if (active)
+            record(samples, n);
+        else
+            preroll_append(samples, n);
+        samples += n;
+        how_much -= n;
+        if (window_count == window) {
+            update_state(10 * log10(window_power / window + 1e-20));
+            window_power = 0;
+            window_count = 0;
+        }
+    }
+}
+
+template <>
+float GatedWriter<Csdr::complex<float>>::power(const Csdr::complex<float>* samples, size_t how_much) const {
+    const float* s = (const float*) samples;
+    float sum = 0;
+    for (size_t i = 0; i < 2 * how_much; i++)
+        sum += s[i] * s[i];
+    return sum;
+}
+
+template <>
+float GatedWriter<Csdr::complex<short>>::power(const Csdr::complex<short>* samples, size_t how_much) const {
+    const short* s = (const short*) samples;
+    float sum = 0;
+    for (size_t i = 0; i < 2 * how_much; i++)
+        sum += float(s[i]) * float(s[i]);
+    return sum * (1.0f / (32768.0f * 32768.0f));
+}
+
+template <>
+float GatedWriter<float>::power(const float* samples, size_t how_much) const {
+    float sum = 0;
+    for (size_t i = 0; i < how_much; i++)
+        sum += samples[i] * samples[i];
+    return sum;
+}
+
+template <>
+float GatedWriter<short>::power(const short* samples, size_t how_much) const {
+    float sum = 0;
+    for (size_t i = 0; i < how_much; i++)
+        sum += float(samples[i]) * float(samples[i]);
+    return sum * (1.0f / (32768.0f * 32768.0f));
+}
+
+template <typename T>
+void GatedWriter<T>::update_state(double level) {
+    this->level = level;
+    if (!active) {
+        if (level >= threshold)
+            start_burst();
+    } else if (level >= threshold - hysteresis) {
+        hang = 0;
+    } else {
+        hang += window;
+        if (hang >= post_samples)
+            end_burst();
+    }
+}
+
+template <typename T>
+void GatedWriter<T>::start_burst() {
+    // the burst file starts with the oldest sample in the pre-roll
+    struct timespec start_time;
+    clock_gettime(CLOCK_REALTIME, &start_time);
+    long long offset_ns = (long long) (preroll_count / samplerate * 1e9);
+    long long start_ns = start_time.tv_sec * 1000000000LL + start_time.tv_nsec - offset_ns;
+    start_time.tv_sec = start_ns / 1000000000LL;
+    start_time.tv_nsec = start_ns % 1000000000LL;
+    if (frequency_callback)
+        recorder.setFrequency(frequency_callback());
+    recorder.rotate(&start_time);
+
+    active = true;
+    hang = 0;
+    bursts++;
+
+    size_t oldest = (preroll_pos + preroll_capacity - preroll_count) % preroll_capacity;
+    size_t first = std::min(preroll_count, preroll_capacity - oldest);
+    record(preroll + oldest, first);
+    record(preroll, preroll_count - first);
+    preroll_pos = 0;
+    preroll_count = 0;
+}
+
+template <typename T>
+void GatedWriter<T>::end_burst() {
+    active = false;
+    hang = 0;
+    recorder.rotate();
+}
+
+template <typename T>
+void GatedWriter<T>::record(const T* samples, size_t how_much) {
+    recorded_samples += how_much;
+    while (how_much > 0) {
+        size_t n = std::min(how_much, recorder.writeable());
+        memcpy(recorder.getWritePointer(), samples, n * sizeof(T));
+        recorder.advance(n);
+        samples += n;
+        how_much -= n;
+    }
+}
+
+template <typename T>
+void GatedWriter<T>::preroll_append(const T* samples, size_t how_much) {
+    if (how_much >= preroll_capacity) {
+        memcpy(preroll, samples + how_much - preroll_capacity, preroll_capacity * sizeof(T));
+        preroll_pos = 0;
+        preroll_count = preroll_capacity;
+        return;
+    }
+    size_t first = std::min(how_much, preroll_capacity - preroll_pos);
+    memcpy(preroll + preroll_pos, samples, first * sizeof(T));
+    memcpy(preroll, samples + first, (how_much - first) * sizeof(T));
+    preroll_pos = (preroll_pos + how_much) % preroll_capacity;
+    preroll_count = std::min(preroll_count + how_much, preroll_capacity);
+}
+
+// setters
+template <typename T>
+void GatedWriter<T>::setThreshold(double threshold) {
+    this->threshold = threshold;
+}
+
+template <typename T>
+void GatedWriter<T>::setHysteresis(double hysteresis) {
+    this->hysteresis = hysteresis;
+}
+
+template <typename T>
+void GatedWriter<T>::setSigMF(const char* description) {
+    recorder.setSigMF(samplerate, description);
+}
+
+template <typename T>
+void GatedWriter<T>::setFrequencyCallback(std::function<double()> callback) {
+    frequency_callback = callback;
+}
+
+// getters
+template <typename T>
+double GatedWriter<T>::getLevel() const {
+    return level;
+}
+
+template <typename T>
+bool GatedWriter<T>::isActive() const {
+    return active;
+}
+
+template <typename T>
+unsigned int GatedWriter<T>::getBursts() const {
+    return bursts;
+}
+
+template <typename T>
+size_t GatedWriter<T>::getTotalSamples() const {
+    return total_samples;
+}
+
+template <typename T>
+size_t GatedWriter<T>::getRecordedSamples() const {
+    return recorded_samples;
+}
+
+template <typename T>
+FileWriter<T>* GatedWriter<T>::getFileWriter() {
+    return &recorder;
+}
+
+namespace Csdrx {
+    template class GatedWriter<short>;
+    template class GatedWriter<float>;
+    template class GatedWriter<Csdr::complex<short>>;
+    template class GatedWriter<Csdr::complex<float>>;
+}
@@ -0,0 +1,81 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <csdr/writer.hpp>
+#include <csdrx/filewriter.hpp>
+#include <atomic>
+#include <functional>
+#include <string>
+
+namespace Csdrx {
+
+    // recorder that writes only while the signal is above a power threshold
+    // (squelch with hysteresis), one file per burst, including 'pre' seconds
+    // of signal before the squelch opened and 'post' seconds after it closed
+    template <typename T>
+    class GatedWriter: public Csdr::Writer<T> {
+        public:
+            // filename is the FileWriter pattern (strftime() conversions and
+            // '{frequency}' are expanded at the start of each burst)
+            GatedWriter(const char* filename, double samplerate,
+                        double threshold = -40, double hysteresis = 3,
+                        double pre = 0.5, double post = 1.0,
+                        size_t buffer_size = 65536);
+            ~GatedWriter();
+            size_t writeable() override;
+            T* getWritePointer() override;
+            void advance(size_t how_much) override;
+            // setters
+            void setThreshold(double threshold);     // dBFS
+            void setHysteresis(double hysteresis);   // dB
+            void setSigMF(const char* description = nullptr);
+            // the frequency of each burst is read from the callback (usually
+            // the getFrequency() method of the source) when the burst starts
+            void setFrequencyCallback(std::function<double()> callback);
+            // getters
+            double getLevel() const;                 // dBFS
+            bool isActive() const;
+            unsigned int getBursts() const;
+            size_t getTotalSamples() const;
+            size_t getRecordedSamples() const;
+            FileWriter<T>* getFileWriter();
+        private:
+            float power(const T* samples, size_t how_much) const;
+            void update_state(double level);
+            void start_burst();
+            void end_burst();
+            void record(const T* samples, size_t how_much);
+            void preroll_append(const T* samples, size_t how_much);
+
+            FileWriter<T> recorder;
+            double samplerate;
+            std::atomic<double> threshold;
+            std::atomic<double> hysteresis;
+            size_t window;
+            size_t post_samples;
+            size_t buffer_size;
+            T* buffer;
+            std::function<double()> frequency_callback;
+            // detector state
+            double window_power = 0;
+            size_t window_count = 0;
+            size_t hang = 0;
+            std::atomic<double> level;
+            std::atomic<bool> active;
+            // pre-roll buffer
+            T* preroll;
+            size_t preroll_capacity;
+            size_t preroll_pos = 0;
+            size_t preroll_count = 0;
+            // statistics
+            std::atomic<unsigned int> bursts;
+            std::atomic<size_t> total_samples;
+            std::atomic<size_t> recorded_samples;
+    };
+}
@@ -0,0 +1,1227 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "kernels.hpp"
+
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KERNELS_X86
+#endif
+#if defined(__ARM_NEON) || defined(__aarch64__)
+#include <arm_neon.h>
+#define KERNELS_NEON
+#endif
+
+using namespace Csdrx;
+
+static constexpr float S16_SCALE = 1.0f / 32768.0f;
+static constexpr float F32_TO_S16 = 32768.0f;
+
+// dispatch table
+struct Kernels {
+    const char* isa;
+    void (*planar_s16_to_cf32)(const short*, const short*, Csdr::complex<float>*, size_t);
+    void (*planar_s16_to_cs16)(const short*, const short*, Csdr::complex<short>*, size_t);
+    void (*cs8_to_cf32)(const signed char*, Csdr::complex<float>*, size_t, float);
+    void (*cu8_to_cf32)(const unsigned char*, Csdr::complex<float>*, size_t, float);
+    void (*cs12_to_cf32)(const unsigned char*, Csdr::complex<float>*, size_t, float);
+    void (*cs16_to_cf32)(const Csdr::complex<short>*, Csdr::complex<float>*, size_t, float);
+    void (*cs8_to_cs16)(const signed char*, Csdr::complex<short>*, size_t);
+    void (*cu8_to_cs16)(const unsigned char*, Csdr::complex<short>*, size_t);
+    void (*cs12_to_cs16)(const unsigned char*, Csdr::complex<short>*, size_t);
+    void (*cf32_to_cs16)(const Csdr::complex<float>*, Csdr::complex<short>*, size_t);
+    void (*scaled_cf32)(const Csdr::complex<float>*, Csdr::complex<float>, Csdr::complex<float>*, size_t);
+    void (*product_cf32)(const Csdr::complex<float>*, const Csdr::complex<float>*,
+                         Csdr::complex<float>, Csdr::complex<float>*, size_t);
+    void (*mix_stereo_s16)(const short*, float, float, float*, size_t);
+    void (*mix_stereo_f32)(const float*, float, float, float*, size_t);
+    void (*sums_s16)(const short*, size_t, float, SignalSums&);
+    void (*sums_f32)(const float*, size_t, float, SignalSums&);
+};
+
+// scalar kernels (also used for the tails of the vectorized ones)
+static void planar_s16_to_cf32_scalar(const short* xi, const short* xq,
+                                      Csdr::complex<float>* out, size_t n) {
+    float* o = reinterpret_cast<float*>(out);
+    for (size_t i = 0; i < n; i++) {
+        o[2 * i] = xi[i] * S16_SCALE;
+        o[2 * i + 1] = xq[i] * S16_SCALE;
+    }
+}
+
+static void planar_s16_to_cs16_scalar(const short* xi, const short* xq,
+                                      Csdr::complex<short>* out, size_t n) {
+    short* o = reinterpret_cast<short*>(out);
+    for (size_t i = 0; i < n; i++) {
+        o[2 * i] = xi[i];
+        o[2 * i + 1] = xq[i];
+    }
+}
+
+// interleaved native formats (n complex samples, i.e. 2 * n values)
+static void cs8_to_cf32_scalar(const signed char* in, Csdr::complex<float>* out,
+                               size_t n, float scale) {
+    float* o = reinterpret_cast<float*>(out);
+    for (size_t i = 0; i < 2 * n; i++)
+        o[i] = in[i] * scale;
+}
+
+static void cu8_to_cf32_scalar(const unsigned char* in, Csdr::complex<float>* out,
+                               size_t n, float scale) {
+    float* o = reinterpret_cast<float*>(out);
+    for (size_t i = 0; i < 2 * n; i++)
+        o[i] = (in[i] - 128) * scale;
+}
+
+// CS12 packs a complex sample in 3 bytes (I in the low 12 bits, Q in the
+// high 12 bits); same bit layout as the SoapySDR converters
+static inline void unpack_cs12(const unsigned char* in, short& i, short& q) {
+    i = (short) (unsigned short) ((in[1] << 12) | (in[0] << 4));
+    q = (short) (unsigned short) ((in[2] << 8) | (in[1] & 0xf0));
+}
+
+static void cs12_to_cf32_scalar(const unsigned char* in, Csdr::complex<float>* out,
+                                size_t n, float scale) {
+    float* o = reinterpret_cast<float*>(out);
+    for (size_t k = 0; k < n; k++) {
+        short i, q;
+        unpack_cs12(in + 3 * k, i, q);
+        o[2 * k] = i * scale;
+        o[2 * k + 1] = q * scale;
+    }
+}
+
+static void cs16_to_cf32_scalar(const Csdr::complex<short>* in, Csdr::complex<float>* out,
+                                size_t n, float scale) {
+    const short* x = reinterpret_cast<const short*>(in);
+    float* o = reinterpret_cast<float*>(out);
+    for (size_t i = 0; i < 2 * n; i++)
+        o[i] = x[i] * scale;
+}
+
+static void cs8_to_cs16_scalar(const signed char* in, Csdr::complex<short>* out, size_t n) {
+    short* o = reinterpret_cast<short*>(out);
+    for (size_t i = 0; i < 2 * n; i++)
+        o[i] = (short) (in[i] * 256);
+}
+
+static void cu8_to_cs16_scalar(const unsigned char* in, Csdr::complex<short>* out, size_t n) {
+    short* o = reinterpret_cast<short*>(out);
+    for (size_t i = 0; i < 2 * n; i++)
+        o[i] = (short) ((in[i] - 128) * 256);
+}
+
+static void cs12_to_cs16_scalar(const unsigned char* in, Csdr::complex<short>* out, size_t n) {
+    short* o = reinterpret_cast<short*>(out);
+    for (size_t k = 0; k < n; k++)
+        unpack_cs12(in + 3 * k, o[2 * k], o[2 * k + 1]);
+}
+
+// rounds to nearest (like the vector conversions with the default MXCSR)
+static void cf32_to_cs16_scalar(const Csdr::complex<float>* in, Csdr::complex<short>* out, size_t n) {
+    const float* x = reinterpret_cast<const float*>(in);
+    short* o = reinterpret_cast<short*>(out);
+    for (size_t i = 0; i < 2 * n; i++) {
+        float v = x[i] * F32_TO_S16;
+        v = v < -32768.0f ? -32768.0f : (v > 32767.0f ? 32767.0f : v);
+        o[i] = (short) lrintf(v);
+    }
+}
+
+// complex multiply-accumulate
+static void scaled_cf32_scalar(const Csdr::complex<float>* x, Csdr::complex<float> scale,
+                               Csdr::complex<float>* y, size_t n) {
+    const float* xf = reinterpret_cast<const float*>(x);
+    float* yf = reinterpret_cast<float*>(y);
+    float sr = scale.i();
+    float si = scale.q();
+    for (size_t k = 0; k < n; k++) {
+        float xr = xf[2 * k];
+        float xi = xf[2 * k + 1];
+        yf[2 * k] += xr * sr - xi * si;
+        yf[2 * k + 1] += xi * sr + xr * si;
+    }
+}
+
+static void product_cf32_scalar(const Csdr::complex<float>* a, const Csdr::complex<float>* b,
+                                Csdr::complex<float> scale, Csdr::complex<float>* y, size_t n) {
+    const float* af = reinterpret_cast<const float*>(a);
+    const float* bf = reinterpret_cast<const float*>(b);
+    float* yf = reinterpret_cast<float*>(y);
+    float sr = scale.i();
+    float si = scale.q();
+    for (size_t k = 0; k < n; k++) {
+        float pr = af[2 * k] * bf[2 * k] - af[2 * k + 1] * bf[2 * k + 1];
+        float pi = af[2 * k + 1] * bf[2 * k] + af[2 * k] * bf[2 * k + 1];
+        yf[2 * k] += pr * sr - pi * si;
+        yf[2 * k + 1] += pi * sr + pr * si;
+    }
+}
+
+// stereo mix-accumulate
+static void mix_stereo_s16_scalar(const short* x, float gain_left, float gain_right,
+                                  float* y, size_t n) {
+    float gl = gain_left * S16_SCALE;
+    float gr = gain_right * S16_SCALE;
+    for (size_t k = 0; k < n; k++) {
+        y[2 * k] += gl * x[k];
+        y[2 * k + 1] += gr * x[k];
+    }
+}
+
+static void mix_stereo_f32_scalar(const float* x, float gain_left, float gain_right,
+                                  float* y, size_t n) {
+    for (size_t k = 0; k < n; k++) {
+        y[2 * k] += gain_left * x[k];
+        y[2 * k + 1] += gain_right * x[k];
+    }
+}
+
+// the tails start at an even index, so the parity of i is the same as in
+// the whole array
+static inline void accumulate_scalar(float v, size_t i, float clip, SignalSums& sums) {
+    if (i & 1)
+        sums.sum_odd += v;
+    else
+        sums.sum_even += v;
+    sums.sum_squares += v * v;
+    float a = fabsf(v);
+    if (a > sums.peak)
+        sums.peak = a;
+    if (a >= clip)
+        sums.clipped++;
+}
+
+static void sums_s16_scalar(const short* x, size_t n, float clip, SignalSums& sums) {
+    for (size_t i = 0; i < n; i++)
+        accumulate_scalar(x[i] * S16_SCALE, i, clip, sums);
+}
+
+static void sums_f32_scalar(const float* x, size_t n, float clip, SignalSums& sums) {
+    for (size_t i = 0; i < n; i++)
+        accumulate_scalar(x[i], i, clip, sums);
+}
+
+// the vectorized reductions keep their partial sums in float lanes (one
+// block at a time), and add them to the double precision sums at the end;
+// with an even number of lanes the even lanes hold the even elements
+static void add_lanes(const float* sum, const float* sumsq, const float* peak,
+                      const int* clipped, int lanes, SignalSums& sums) {
+    for (int k = 0; k < lanes; k++) {
+        if (k & 1)
+            sums.sum_odd += sum[k];
+        else
+            sums.sum_even += sum[k];
+        sums.sum_squares += sumsq[k];
+        if (peak[k] > sums.peak)
+            sums.peak = peak[k];
+        sums.clipped += clipped[k];
+    }
+}
+
+static const Kernels kernels_scalar = {
+    "scalar",
+    planar_s16_to_cf32_scalar,
+    planar_s16_to_cs16_scalar,
+    cs8_to_cf32_scalar,
+    cu8_to_cf32_scalar,
+    cs12_to_cf32_scalar,
+    cs16_to_cf32_scalar,
+    cs8_to_cs16_scalar,
+    cu8_to_cs16_scalar,
+    cs12_to_cs16_scalar,
+    cf32_to_cs16_scalar,
+    scaled_cf32_scalar,
+    product_cf32_scalar,
+    mix_stereo_s16_scalar,
+    mix_stereo_f32_scalar,
+    sums_s16_scalar,
+    sums_f32_scalar,
+};
+
+#ifdef KERNELS_X86
+// SSE2 kernels (8 samples per iteration)
+__attribute__((target("sse2")))
+static void planar_s16_to_cf32_sse2(const short* xi, const short* xq,
+                                    Csdr::complex<float>* out, size_t n) {
+    float* o = reinterpret_cast<float*>(out);
+    const __m128 scale = _mm_set1_ps(S16_SCALE);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i vi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(xi + i));
+        __m128i vq = _mm_loadu_si128(reinterpret_cast<const __m128i*>(xq + i));
+        __m128i lo = _mm_unpacklo_epi16(vi, vq);
+        __m128i hi = _mm_unpackhi_epi16(vi, vq);
+        // sign extend to 32 bits (SSE2 has no pmovsxwd)
+        __m128i lo0 = _mm_srai_epi32(_mm_unpacklo_epi16(lo, lo), 16);
+        __m128i lo1 = _mm_srai_epi32(_mm_unpackhi_epi16(lo, lo), 16);
+        __m128i hi0 = _mm_srai_epi32(_mm_unpacklo_epi16(hi, hi), 16);
+        __m128i hi1 = _mm_srai_epi32(_mm_unpackhi_epi16(hi, hi), 16);
+        _mm_storeu_ps(o + 2 * i,      _mm_mul_ps(_mm_cvtepi32_ps(lo0), scale));
+        _mm_storeu_ps(o + 2 * i + 4,  _mm_mul_ps(_mm_cvtepi32_ps(lo1), scale));
+        _mm_storeu_ps(o + 2 * i + 8,  _mm_mul_ps(_mm_cvtepi32_ps(hi0), scale));
+        _mm_storeu_ps(o + 2 * i + 12, _mm_mul_ps(_mm_cvtepi32_ps(hi1), scale));
+    }
+    planar_s16_to_cf32_scalar(xi + i, xq + i, out + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void planar_s16_to_cs16_sse2(const short* xi, const short* xq,
+                                    Csdr::complex<short>* out, size_t n) {
+    short* o = reinterpret_cast<short*>(out);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i vi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(xi + i));
+        __m128i vq = _mm_loadu_si128(reinterpret_cast<const __m128i*>(xq + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(o + 2 * i), _mm_unpacklo_epi16(vi, vq));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(o + 2 * i + 8), _mm_unpackhi_epi16(vi, vq));
+    }
+    planar_s16_to_cs16_scalar(xi + i, xq + i, out + i, n - i);
+}
+
+// 16 signed bytes to 16 floats: each byte is replicated to the whole 32 bit
+// lane and shifted back down (SSE2 has no pmovsxbd)
+__attribute__((target("sse2")))
+static inline void s8_to_f32_sse2(__m128i v, __m128 scale, float* o) {
+    __m128i lo = _mm_unpacklo_epi8(v, v);
+    __m128i hi = _mm_unpackhi_epi8(v, v);
+    _mm_storeu_ps(o,      _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(lo, lo), 24)), scale));
+    _mm_storeu_ps(o + 4,  _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(lo, lo), 24)), scale));
+    _mm_storeu_ps(o + 8,  _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(hi, hi), 24)), scale));
+    _mm_storeu_ps(o + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(hi, hi), 24)), scale));
+}
+
+__attribute__((target("sse2")))
+static void cs8_to_cf32_sse2(const signed char* in, Csdr::complex<float>* out,
+                             size_t n, float scale) {
+    float* o = reinterpret_cast<float*>(out);
+    const __m128 vscale = _mm_set1_ps(scale);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        s8_to_f32_sse2(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i)), vscale, o + 2 * i);
+    cs8_to_cf32_scalar(in + 2 * i, out + i, n - i, scale);
+}
+
+// flipping the sign bit of an unsigned byte is the same as subtracting 128
+__attribute__((target("sse2")))
+static void cu8_to_cf32_sse2(const unsigned char* in, Csdr::complex<float>* out,
+                             size_t n, float scale) {
+    float* o = reinterpret_cast<float*>(out);
+    const __m128 vscale = _mm_set1_ps(scale);
+    const __m128i sign = _mm_set1_epi8((char) 0x80);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i));
+        s8_to_f32_sse2(_mm_xor_si128(v, sign), vscale, o + 2 * i);
+    }
+    cu8_to_cf32_scalar(in + 2 * i, out + i, n - i, scale);
+}
+
+__attribute__((target("sse2")))
+static void cs16_to_cf32_sse2(const Csdr::complex<short>* in, Csdr::complex<float>* out,
+                              size_t n, float scale) {
+    const short* x = reinterpret_cast<const short*>(in);
+    float* o = reinterpret_cast<float*>(out);
+    const __m128 vscale = _mm_set1_ps(scale);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + 2 * i));
+        __m128i v0 = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i v1 = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(o + 2 * i,     _mm_mul_ps(_mm_cvtepi32_ps(v0), vscale));
+        _mm_storeu_ps(o + 2 * i + 4, _mm_mul_ps(_mm_cvtepi32_ps(v1), vscale));
+    }
+    cs16_to_cf32_scalar(in + i, out + i, n - i, scale);
+}
+
+// interleaving with zeros puts each byte in the high half of a 16 bit lane
+__attribute__((target("sse2")))
+static void cs8_to_cs16_sse2(const signed char* in, Csdr::complex<short>* out, size_t n) {
+    short* o = reinterpret_cast<short*>(out);
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(o + 2 * i), _mm_unpacklo_epi8(zero, v));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(o + 2 * i + 8), _mm_unpackhi_epi8(zero, v));
+    }
+    cs8_to_cs16_scalar(in + 2 * i, out + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static void cu8_to_cs16_sse2(const unsigned char* in, Csdr::complex<short>* out, size_t n) {
+    short* o = reinterpret_cast<short*>(out);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i sign = _mm_set1_epi8((char) 0x80);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i v = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i)), sign);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(o + 2 * i), _mm_unpacklo_epi8(zero, v));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(o + 2 * i + 8), _mm_unpackhi_epi8(zero, v));
+    }
+    cu8_to_cs16_scalar(in + 2 * i, out + i, n - i);
+}
+
+// the floats are clamped first, since out of range conversions to 32 bits
+// return INT_MIN (also for large positive values)
+__attribute__((target("sse2")))
+static void cf32_to_cs16_sse2(const Csdr::complex<float>* in, Csdr::complex<short>* out, size_t n) {
+    const float* x = reinterpret_cast<const float*>(in);
+    short* o = reinterpret_cast<short*>(out);
+    const __m128 scale = _mm_set1_ps(F32_TO_S16);
+    const __m128 vmin = _mm_set1_ps(-32768.0f);
+    const __m128 vmax = _mm_set1_ps(32767.0f);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 v0 = _mm_mul_ps(_mm_loadu_ps(x + 2 * i), scale);
+        __m128 v1 = _mm_mul_ps(_mm_loadu_ps(x + 2 * i + 4), scale);
+        v0 = _mm_min_ps(_mm_max_ps(v0, vmin), vmax);
+        v1 = _mm_min_ps(_mm_max_ps(v1, vmin), vmax);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(o + 2 * i),
+                         _mm_packs_epi32(_mm_cvtps_epi32(v0), _mm_cvtps_epi32(v1)));
+    }
+    cf32_to_cs16_scalar(in + i, out + i, n - i);
+}
+
+// complex products of interleaved pairs: (ar br - ai bi, ai br + ar bi)
+__attribute__((target("sse2")))
+static inline __m128 cmul_sse2(__m128 a, __m128 b) {
+    const __m128 sign = _mm_castsi128_ps(_mm_set_epi32(0, (int) 0x80000000, 0, (int) 0x80000000));
+    __m128 br = _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 2, 0, 0));
+    __m128 bi = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 3, 1, 1));
+    __m128 as = _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 3, 0, 1));
+    return _mm_add_ps(_mm_mul_ps(a, br), _mm_xor_ps(_mm_mul_ps(as, bi), sign));
+}
+
+__attribute__((target("sse2")))
+static void scaled_cf32_sse2(const Csdr::complex<float>* x, Csdr::complex<float> scale,
+                             Csdr::complex<float>* y, size_t n) {
+    const float* xf = reinterpret_cast<const float*>(x);
+    float* yf = reinterpret_cast<float*>(y);
+    const __m128 s = _mm_setr_ps(scale.i(), scale.q(), scale.i(), scale.q());
+    size_t k = 0;
+    for (; k + 2 <= n; k += 2) {
+        __m128 v = cmul_sse2(_mm_loadu_ps(xf + 2 * k), s);
+        _mm_storeu_ps(yf + 2 * k, _mm_add_ps(_mm_loadu_ps(yf + 2 * k), v));
+    }
+    scaled_cf32_scalar(x + k, scale, y + k, n - k);
+}
+
+__attribute__((target("sse2")))
+static void product_cf32_sse2(const Csdr::complex<float>* a, const Csdr::complex<float>* b,
+                              Csdr::complex<float> scale, Csdr::complex<float>* y, size_t n) {
+    const float* af = reinterpret_cast<const float*>(a);
+    const float* bf = reinterpret_cast<const float*>(b);
+    float* yf = reinterpret_cast<float*>(y);
+    const __m128 s = _mm_setr_ps(scale.i(), scale.q(), scale.i(), scale.q());
+    size_t k = 0;
+    for (; k + 2 <= n; k += 2) {
+        __m128 p = cmul_sse2(_mm_loadu_ps(af + 2 * k), _mm_loadu_ps(bf + 2 * k));
+        _mm_storeu_ps(yf + 2 * k, _mm_add_ps(_mm_loadu_ps(yf + 2 * k), cmul_sse2(p, s)));
+    }
+    product_cf32_scalar(a + k, b + k, scale, y + k, n - k);
+}
+
+// each sample is duplicated into a (left, right) pair and multiplied by
+// (gain_left, gain_right)
+__attribute__((target("sse2")))
+static inline void mix_stereo_sse2(__m128 v, __m128 g, float* y) {
+    _mm_storeu_ps(y, _mm_add_ps(_mm_loadu_ps(y), _mm_mul_ps(_mm_unpacklo_ps(v, v), g)));
+    _mm_storeu_ps(y + 4, _mm_add_ps(_mm_loadu_ps(y + 4), _mm_mul_ps(_mm_unpackhi_ps(v, v), g)));
+}
+
+__attribute__((target("sse2")))
+static void mix_stereo_s16_sse2(const short* x, float gain_left, float gain_right,
+                                float* y, size_t n) {
+    const __m128 g = _mm_setr_ps(gain_left * S16_SCALE, gain_right * S16_SCALE,
+                                 gain_left * S16_SCALE, gain_right * S16_SCALE);
+    size_t k = 0;
+    for (; k + 8 <= n; k += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + k));
+        __m128i v0 = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i v1 = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        mix_stereo_sse2(_mm_cvtepi32_ps(v0), g, y + 2 * k);
+        mix_stereo_sse2(_mm_cvtepi32_ps(v1), g, y + 2 * k + 8);
+    }
+    mix_stereo_s16_scalar(x + k, gain_left, gain_right, y + 2 * k, n - k);
+}
+
+__attribute__((target("sse2")))
+static void mix_stereo_f32_sse2(const float* x, float gain_left, float gain_right,
+                                float* y, size_t n) {
+    const __m128 g = _mm_setr_ps(gain_left, gain_right, gain_left, gain_right);
+    size_t k = 0;
+    for (; k + 4 <= n; k += 4)
+        mix_stereo_sse2(_mm_loadu_ps(x + k), g, y + 2 * k);
+    mix_stereo_f32_scalar(x + k, gain_left, gain_right, y + 2 * k, n - k);
+}
+
+struct SumsSSE2 {
+    __m128 sum;
+    __m128 sumsq;
+    __m128 peak;
+    __m128i clipped;
+};
+
+__attribute__((target("sse2")))
+static inline void accumulate_sse2(__m128 v, __m128 clip, SumsSSE2& acc) {
+    __m128 a = _mm_andnot_ps(_mm_set1_ps(-0.0f), v);
+    acc.sum = _mm_add_ps(acc.sum, v);
+    acc.sumsq = _mm_add_ps(acc.sumsq, _mm_mul_ps(v, v));
+    acc.peak = _mm_max_ps(acc.peak, a);
+    // the comparison mask is -1 in the lanes at or above the clip level
+    acc.clipped = _mm_sub_epi32(acc.clipped, _mm_castps_si128(_mm_cmpge_ps(a, clip)));
+}
+
+__attribute__((target("sse2")))
+static inline void add_lanes_sse2(const SumsSSE2& acc, SignalSums& sums) {
+    float sum[4], sumsq[4], peak[4];
+    int clipped[4];
+    _mm_storeu_ps(sum, acc.sum);
+    _mm_storeu_ps(sumsq, acc.sumsq);
+    _mm_storeu_ps(peak, acc.peak);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(clipped), acc.clipped);
+    add_lanes(sum, sumsq, peak, clipped, 4, sums);
+}
+
+__attribute__((target("sse2")))
+static void sums_s16_sse2(const short* x, size_t n, float clip, SignalSums& sums) {
+    const __m128 scale = _mm_set1_ps(S16_SCALE);
+    const __m128 vclip = _mm_set1_ps(clip);
+    SumsSSE2 acc = { _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_si128() };
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i));
+        __m128i v0 = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i v1 = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        accumulate_sse2(_mm_mul_ps(_mm_cvtepi32_ps(v0), scale), vclip, acc);
+        accumulate_sse2(_mm_mul_ps(_mm_cvtepi32_ps(v1), scale), vclip, acc);
+    }
+    add_lanes_sse2(acc, sums);
+    sums_s16_scalar(x + i, n - i, clip, sums);
+}
+
+__attribute__((target("sse2")))
+static void sums_f32_sse2(const float* x, size_t n, float clip, SignalSums& sums) {
+    const __m128 vclip = _mm_set1_ps(clip);
+    SumsSSE2 acc = { _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_si128() };
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        accumulate_sse2(_mm_loadu_ps(x + i), vclip, acc);
+    add_lanes_sse2(acc, sums);
+    sums_f32_scalar(x + i, n - i, clip, sums);
+}
+
+static const Kernels kernels_sse2 = {
+    "sse2",
+    planar_s16_to_cf32_sse2,
+    planar_s16_to_cs16_sse2,
+    cs8_to_cf32_sse2,
+    cu8_to_cf32_sse2,
+    cs12_to_cf32_scalar,
+    cs16_to_cf32_sse2,
+    cs8_to_cs16_sse2,
+    cu8_to_cs16_sse2,
+    cs12_to_cs16_scalar,
+    cf32_to_cs16_sse2,
+    scaled_cf32_sse2,
+    product_cf32_sse2,
+    mix_stereo_s16_sse2,
+    mix_stereo_f32_sse2,
+    sums_s16_sse2,
+    sums_f32_sse2,
+};
+
+// AVX2 kernels (16 samples per iteration)
+__attribute__((target("avx2")))
+static inline void interleave_s16_avx2(const short* xi, const short* xq,
+                                       __m256i& out0, __m256i& out1) {
+    __m256i vi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(xi));
+    __m256i vq = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(xq));
+    // unpack works within each 128 bit lane: put the lanes back in order
+    __m256i lo = _mm256_unpacklo_epi16(vi, vq);
+    __m256i hi = _mm256_unpackhi_epi16(vi, vq);
+    out0 = _mm256_permute2x128_si256(lo, hi, 0x20);
+    out1 = _mm256_permute2x128_si256(lo, hi, 0x31);
+}
+
+__attribute__((target("avx2")))
+static void planar_s16_to_cf32_avx2(const short* xi, const short* xq,
+                                    Csdr::complex<float>* out, size_t n) {
+    float* o = reinterpret_cast<float*>(out);
+    const __m256 scale = _mm256_set1_ps(S16_SCALE);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i iq0, iq1;
+        interleave_s16_avx2(xi + i, xq + i, iq0, iq1);
+        __m256 f0 = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(iq0)));
+        __m256 f1 = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(iq0, 1)));
+        __m256 f2 = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(iq1)));
+        __m256 f3 = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(iq1, 1)));
+        _mm256_storeu_ps(o + 2 * i,      _mm256_mul_ps(f0, scale));
+        _mm256_storeu_ps(o + 2 * i + 8,  _mm256_mul_ps(f1, scale));
+        _mm256_storeu_ps(o + 2 * i + 16, _mm256_mul_ps(f2, scale));
+        _mm256_storeu_ps(o + 2 * i + 24, _mm256_mul_ps(f3, scale));
+    }
+    planar_s16_to_cf32_sse2(xi + i, xq + i, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void planar_s16_to_cs16_avx2(const short* xi, const short* xq,
+                                    Csdr::complex<short>* out, size_t n) {
+    short* o = reinterpret_cast<short*>(out);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i iq0, iq1;
+        interleave_s16_avx2(xi + i, xq + i, iq0, iq1);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(o + 2 * i), iq0);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(o + 2 * i + 16), iq1);
+    }
+    planar_s16_to_cs16_sse2(xi + i, xq + i, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void cs8_to_cf32_avx2(const signed char* in, Csdr::complex<float>* out,
+                             size_t n, float scale) {
+    float* o = reinterpret_cast<float*>(out);
+    const __m256 vscale = _mm256_set1_ps(scale);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        for (int k = 0; k < 32; k += 8) {
+            __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + 2 * i + k));
+            __m256 f = _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(v));
+            _mm256_storeu_ps(o + 2 * i + k, _mm256_mul_ps(f, vscale));
+        }
+    }
+    cs8_to_cf32_sse2(in + 2 * i, out + i, n - i, scale);
+}
+
+__attribute__((target("avx2")))
+static void cu8_to_cf32_avx2(const unsigned char* in, Csdr::complex<float>* out,
+                             size_t n, float scale) {
+    float* o = reinterpret_cast<float*>(out);
+    const __m256 vscale = _mm256_set1_ps(scale);
+    const __m256i offset = _mm256_set1_epi32(128);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        for (int k = 0; k < 32; k += 8) {
+            __m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + 2 * i + k));
+            __m256 f = _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_cvtepu8_epi32(v), offset));
+            _mm256_storeu_ps(o + 2 * i + k, _mm256_mul_ps(f, vscale));
+        }
+    }
+    cu8_to_cf32_sse2(in + 2 * i, out + i, n - i, scale);
+}
+
+__attribute__((target("avx2")))
+static void cs16_to_cf32_avx2(const Csdr::complex<short>* in, Csdr::complex<float>* out,
+                              size_t n, float scale) {
+    const short* x = reinterpret_cast<const short*>(in);
+    float* o = reinterpret_cast<float*>(out);
+    const __m256 vscale = _mm256_set1_ps(scale);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + 2 * i));
+        __m256 f0 = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(v)));
+        __m256 f1 = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(v, 1)));
+        _mm256_storeu_ps(o + 2 * i,     _mm256_mul_ps(f0, vscale));
+        _mm256_storeu_ps(o + 2 * i + 8, _mm256_mul_ps(f1, vscale));
+    }
+    cs16_to_cf32_sse2(in + i, out + i, n - i, scale);
+}
+
+__attribute__((target("avx2")))
+static void cs8_to_cs16_avx2(const signed char* in, Csdr::complex<short>* out, size_t n) {
+    short* o = reinterpret_cast<short*>(out);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i));
+        __m128i v1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i + 16));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(o + 2 * i),
+                            _mm256_slli_epi16(_mm256_cvtepi8_epi16(v0), 8));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(o + 2 * i + 16),
+                            _mm256_slli_epi16(_mm256_cvtepi8_epi16(v1), 8));
+    }
+    cs8_to_cs16_sse2(in + 2 * i, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void cu8_to_cs16_avx2(const unsigned char* in, Csdr::complex<short>* out, size_t n) {
+    short* o = reinterpret_cast<short*>(out);
+    const __m128i sign = _mm_set1_epi8((char) 0x80);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i v0 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i)), sign);
+        __m128i v1 = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + 2 * i + 16)), sign);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(o + 2 * i),
+                            _mm256_slli_epi16(_mm256_cvtepi8_epi16(v0), 8));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(o + 2 * i + 16),
+                            _mm256_slli_epi16(_mm256_cvtepi8_epi16(v1), 8));
+    }
+    cu8_to_cs16_sse2(in + 2 * i, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void cf32_to_cs16_avx2(const Csdr::complex<float>* in, Csdr::complex<short>* out, size_t n) {
+    const float* x = reinterpret_cast<const float*>(in);
+    short* o = reinterpret_cast<short*>(out);
+    const __m256 scale = _mm256_set1_ps(F32_TO_S16);
+    const __m256 vmin = _mm256_set1_ps(-32768.0f);
+    const __m256 vmax = _mm256_set1_ps(32767.0f);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 v0 = _mm256_mul_ps(_mm256_loadu_ps(x + 2 * i), scale);
+        __m256 v1 = _mm256_mul_ps(_mm256_loadu_ps(x + 2 * i + 8), scale);
+        v0 = _mm256_min_ps(_mm256_max_ps(v0, vmin), vmax);
+        v1 = _mm256_min_ps(_mm256_max_ps(v1, vmin), vmax);
+        // pack works within each 128 bit lane: put the quadwords back in order
+        __m256i v = _mm256_packs_epi32(_mm256_cvtps_epi32(v0), _mm256_cvtps_epi32(v1));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(o + 2 * i), _mm256_permute4x64_epi64(v, 0xd8));
+    }
+    cf32_to_cs16_sse2(in + i, out + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static inline __m256 cmul_avx2(__m256 a, __m256 b) {
+    __m256 br = _mm256_moveldup_ps(b);
+    __m256 bi = _mm256_movehdup_ps(b);
+    __m256 as = _mm256_permute_ps(a, _MM_SHUFFLE(2, 3, 0, 1));
+    // subtract in the even lanes, add in the odd ones
+    return _mm256_addsub_ps(_mm256_mul_ps(a, br), _mm256_mul_ps(as, bi));
+}
+
+__attribute__((target("avx2")))
+static void scaled_cf32_avx2(const Csdr::complex<float>* x, Csdr::complex<float> scale,
+                             Csdr::complex<float>* y, size_t n) {
+    const float* xf = reinterpret_cast<const float*>(x);
+    float* yf = reinterpret_cast<float*>(y);
+    const __m256 s = _mm256_setr_ps(scale.i(), scale.q(), scale.i(), scale.q(),
+                                    scale.i(), scale.q(), scale.i(), scale.q());
+    size_t k = 0;
+    for (; k + 4 <= n; k += 4) {
+        __m256 v = cmul_avx2(_mm256_loadu_ps(xf + 2 * k), s);
+        _mm256_storeu_ps(yf + 2 * k, _mm256_add_ps(_mm256_loadu_ps(yf + 2 * k), v));
+    }
+    scaled_cf32_sse2(x + k, scale, y + k, n - k);
+}
+
+__attribute__((target("avx2")))
+static void product_cf32_avx2(const Csdr::complex<float>* a, const Csdr::complex<float>* b,
+                              Csdr::complex<float> scale, Csdr::complex<float>* y, size_t n) {
+    const float* af = reinterpret_cast<const float*>(a);
+    const float* bf = reinterpret_cast<const float*>(b);
+    float* yf = reinterpret_cast<float*>(y);
+    const __m256 s = _mm256_setr_ps(scale.i(), scale.q(), scale.i(), scale.q(),
+                                    scale.i(), scale.q(), scale.i(), scale.q());
+    size_t k = 0;
+    for (; k + 4 <= n; k += 4) {
+        __m256 p = cmul_avx2(_mm256_loadu_ps(af + 2 * k), _mm256_loadu_ps(bf + 2 * k));
+        _mm256_storeu_ps(yf + 2 * k, _mm256_add_ps(_mm256_loadu_ps(yf + 2 * k), cmul_avx2(p, s)));
+    }
+    product_cf32_sse2(a + k, b + k, scale, y + k, n - k);
+}
+
+// unpack works within each 128 bit lane: put the pairs back in order
+__attribute__((target("avx2")))
+static inline void mix_stereo_avx2(__m256 v, __m256 g, float* y) {
+    __m256 lo = _mm256_unpacklo_ps(v, v);
+    __m256 hi = _mm256_unpackhi_ps(v, v);
+    __m256 y0 = _mm256_permute2f128_ps(lo, hi, 0x20);
+    __m256 y1 = _mm256_permute2f128_ps(lo, hi, 0x31);
+    _mm256_storeu_ps(y, _mm256_add_ps(_mm256_loadu_ps(y), _mm256_mul_ps(y0, g)));
+    _mm256_storeu_ps(y + 8, _mm256_add_ps(_mm256_loadu_ps(y + 8), _mm256_mul_ps(y1, g)));
+}
+
+__attribute__((target("avx2")))
+static void mix_stereo_s16_avx2(const short* x, float gain_left, float gain_right,
+                                float* y, size_t n) {
+    const float gl = gain_left * S16_SCALE;
+    const float gr = gain_right * S16_SCALE;
+    const __m256 g = _mm256_setr_ps(gl, gr, gl, gr, gl, gr, gl, gr);
+    size_t k = 0;
+    for (; k + 16 <= n; k += 16) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + k));
+        __m256 f0 = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(v)));
+        __m256 f1 = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(v, 1)));
+        mix_stereo_avx2(f0, g, y + 2 * k);
+        mix_stereo_avx2(f1, g, y + 2 * k + 16);
+    }
+    mix_stereo_s16_sse2(x + k, gain_left, gain_right, y + 2 * k, n - k);
+}
+
+__attribute__((target("avx2")))
+static void mix_stereo_f32_avx2(const float* x, float gain_left, float gain_right,
+                                float* y, size_t n) {
+    const __m256 g = _mm256_setr_ps(gain_left, gain_right, gain_left, gain_right,
+                                    gain_left, gain_right, gain_left, gain_right);
+    size_t k = 0;
+    for (; k + 8 <= n; k += 8)
+        mix_stereo_avx2(_mm256_loadu_ps(x + k), g, y + 2 * k);
+    mix_stereo_f32_sse2(x + k, gain_left, gain_right, y + 2 * k, n - k);
+}
+
+struct SumsAVX2 {
+    __m256 sum;
+    __m256 sumsq;
+    __m256 peak;
+    __m256i clipped;
+};
+
+__attribute__((target("avx2")))
+static inline void accumulate_avx2(__m256 v, __m256 clip, SumsAVX2& acc) {
+    __m256 a = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), v);
+    acc.sum = _mm256_add_ps(acc.sum, v);
+    acc.sumsq = _mm256_add_ps(acc.sumsq, _mm256_mul_ps(v, v));
+    acc.peak = _mm256_max_ps(acc.peak, a);
+    acc.clipped = _mm256_sub_epi32(acc.clipped, _mm256_castps_si256(_mm256_cmp_ps(a, clip, _CMP_GE_OQ)));
+}
+
+__attribute__((target("avx2")))
+static inline void add_lanes_avx2(const SumsAVX2& acc, SignalSums& sums) {
+    float sum[8], sumsq[8], peak[8];
+    int clipped[8];
+    _mm256_storeu_ps(sum, acc.sum);
+    _mm256_storeu_ps(sumsq, acc.sumsq);
+    _mm256_storeu_ps(peak, acc.peak);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(clipped), acc.clipped);
+    add_lanes(sum, sumsq, peak, clipped, 8, sums);
+}
+
+__attribute__((target("avx2")))
+static void sums_s16_avx2(const short* x, size_t n, float clip, SignalSums& sums) {
+    const __m256 scale = _mm256_set1_ps(S16_SCALE);
+    const __m256 vclip = _mm256_set1_ps(clip);
+    SumsAVX2 acc = { _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_si256() };
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x + i));
+        __m256 f0 = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(v)));
+        __m256 f1 = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(v, 1)));
+        accumulate_avx2(_mm256_mul_ps(f0, scale), vclip, acc);
+        accumulate_avx2(_mm256_mul_ps(f1, scale), vclip, acc);
+    }
+    add_lanes_avx2(acc, sums);
+    sums_s16_sse2(x + i, n - i, clip, sums);
+}
+
+__attribute__((target("avx2")))
+static void sums_f32_avx2(const float* x, size_t n, float clip, SignalSums& sums) {
+    const __m256 vclip = _mm256_set1_ps(clip);
+    SumsAVX2 acc = { _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_si256() };
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        accumulate_avx2(_mm256_loadu_ps(x + i), vclip, acc);
+    add_lanes_avx2(acc, sums);
+    sums_f32_sse2(x + i, n - i, clip, sums);
+}
+
+static const Kernels kernels_avx2 = {
+    "avx2",
+    planar_s16_to_cf32_avx2,
+    planar_s16_to_cs16_avx2,
+    cs8_to_cf32_avx2,
+    cu8_to_cf32_avx2,
+    cs12_to_cf32_scalar,
+    cs16_to_cf32_avx2,
+    cs8_to_cs16_avx2,
+    cu8_to_cs16_avx2,
+    cs12_to_cs16_scalar,
+    cf32_to_cs16_avx2,
+    scaled_cf32_avx2,
+    product_cf32_avx2,
+    mix_stereo_s16_avx2,
+    mix_stereo_f32_avx2,
+    sums_s16_avx2,
+    sums_f32_avx2,
+};
+#endif
+
+#ifdef KERNELS_NEON
+// NEON kernels (8 samples per iteration)
+static void planar_s16_to_cf32_neon(const short* xi, const short* xq,
+                                    Csdr::complex<float>* out, size_t n) {
+    float* o = reinterpret_cast<float*>(out);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        int16x8_t vi = vld1q_s16(xi + i);
+        int16x8_t vq = vld1q_s16(xq + i);
+        // fixed point conversion with 15 fractional bits == divide by 32768
+        float32x4x2_t lo = {{ vcvtq_n_f32_s32(vmovl_s16(vget_low_s16(vi)), 15),
+                              vcvtq_n_f32_s32(vmovl_s16(vget_low_s16(vq)), 15) }};
+        float32x4x2_t hi = {{ vcvtq_n_f32_s32(vmovl_s16(vget_high_s16(vi)), 15),
+                              vcvtq_n_f32_s32(vmovl_s16(vget_high_s16(vq)), 15) }};
+        vst2q_f32(o + 2 * i, lo);
+        vst2q_f32(o + 2 * i + 8, hi);
+    }
+    planar_s16_to_cf32_scalar(xi + i, xq + i, out + i, n - i);
+}
+
+static void planar_s16_to_cs16_neon(const short* xi, const short* xq,
+                                    Csdr::complex<short>* out, size_t n) {
+    short* o = reinterpret_cast<short*>(out);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        int16x8x2_t iq = {{ vld1q_s16(xi + i), vld1q_s16(xq + i) }};
+        vst2q_s16(o + 2 * i, iq);
+    }
+    planar_s16_to_cs16_scalar(xi + i, xq + i, out + i, n - i);
+}
+
+static inline void s8_to_f32_neon(int8x16_t v, float32x4_t scale, float* o) {
+    int16x8_t lo = vmovl_s8(vget_low_s8(v));
+    int16x8_t hi = vmovl_s8(vget_high_s8(v));
+    vst1q_f32(o,      vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(lo))), scale));
+    vst1q_f32(o + 4,  vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(lo))), scale));
+    vst1q_f32(o + 8,  vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(hi))), scale));
+    vst1q_f32(o + 12, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(hi))), scale));
+}
+
+static void cs8_to_cf32_neon(const signed char* in, Csdr::complex<float>* out,
+                             size_t n, float scale) {
+    float* o = reinterpret_cast<float*>(out);
+    const float32x4_t vscale = vdupq_n_f32(scale);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+        s8_to_f32_neon(vld1q_s8(reinterpret_cast<const int8_t*>(in + 2 * i)), vscale, o + 2 * i);
+    cs8_to_cf32_scalar(in + 2 * i, out + i, n - i, scale);
+}
+
+// flipping the sign bit of an unsigned byte is the same as subtracting 128
+static void cu8_to_cf32_neon(const unsigned char* in, Csdr::complex<float>* out,
+                             size_t n, float scale) {
+    float* o = reinterpret_cast<float*>(out);
+    const float32x4_t vscale = vdupq_n_f32(scale);
+    const uint8x16_t sign = vdupq_n_u8(0x80);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint8x16_t v = veorq_u8(vld1q_u8(in + 2 * i), sign);
+        s8_to_f32_neon(vreinterpretq_s8_u8(v), vscale, o + 2 * i);
+    }
+    cu8_to_cf32_scalar(in + 2 * i, out + i, n - i, scale);
+}
+
+static void cs16_to_cf32_neon(const Csdr::complex<short>* in, Csdr::complex<float>* out,
+                              size_t n, float scale) {
+    const short* x = reinterpret_cast<const short*>(in);
+    float* o = reinterpret_cast<float*>(out);
+    const float32x4_t vscale = vdupq_n_f32(scale);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        int16x8_t v = vld1q_s16(x + 2 * i);
+        vst1q_f32(o + 2 * i,     vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), vscale));
+        vst1q_f32(o + 2 * i + 4, vmulq_f32(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), vscale));
+    }
+    cs16_to_cf32_scalar(in + i, out + i, n - i, scale);
+}
+
+static void cs8_to_cs16_neon(const signed char* in, Csdr::complex<short>* out, size_t n) {
+    short* o = reinterpret_cast<short*>(out);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        int8x16_t v = vld1q_s8(reinterpret_cast<const int8_t*>(in + 2 * i));
+        vst1q_s16(o + 2 * i,     vshll_n_s8(vget_low_s8(v), 8));
+        vst1q_s16(o + 2 * i + 8, vshll_n_s8(vget_high_s8(v), 8));
+    }
+    cs8_to_cs16_scalar(in + 2 * i, out + i, n - i);
+}
+
+static void cu8_to_cs16_neon(const unsigned char* in, Csdr::complex<short>* out, size_t n) {
+    short* o = reinterpret_cast<short*>(out);
+    const uint8x16_t sign = vdupq_n_u8(0x80);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        int8x16_t v = vreinterpretq_s8_u8(veorq_u8(vld1q_u8(in + 2 * i), sign));
+        vst1q_s16(o + 2 * i,     vshll_n_s8(vget_low_s8(v), 8));
+        vst1q_s16(o + 2 * i + 8, vshll_n_s8(vget_high_s8(v), 8));
+    }
+    cu8_to_cs16_scalar(in + 2 * i, out + i, n - i);
+}
+
+// ARMv7 only has conversions that round toward zero; the narrowing saturates
+static void cf32_to_cs16_neon(const Csdr::complex<float>* in, Csdr::complex<short>* out, size_t n) {
+    const float* x = reinterpret_cast<const float*>(in);
+    short* o = reinterpret_cast<short*>(out);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        float32x4_t v0 = vmulq_n_f32(vld1q_f32(x + 2 * i), F32_TO_S16);
+        float32x4_t v1 = vmulq_n_f32(vld1q_f32(x + 2 * i + 4), F32_TO_S16);
+#ifdef __aarch64__
+        int32x4_t i0 = vcvtnq_s32_f32(v0);
+        int32x4_t i1 = vcvtnq_s32_f32(v1);
+#else
+        int32x4_t i0 = vcvtq_s32_f32(v0);
+        int32x4_t i1 = vcvtq_s32_f32(v1);
+#endif
+        vst1q_s16(o + 2 * i, vcombine_s16(vqmovn_s32(i0), vqmovn_s32(i1)));
+    }
+    cf32_to_cs16_scalar(in + i, out + i, n - i);
+}
+
+// vld2 splits the real and imaginary parts, so there is no shuffling
+static inline float32x4x2_t cmul_neon(float32x4x2_t a, float32x4x2_t b) {
+    float32x4x2_t p;
+    p.val[0] = vmlsq_f32(vmulq_f32(a.val[0], b.val[0]), a.val[1], b.val[1]);
+    p.val[1] = vmlaq_f32(vmulq_f32(a.val[1], b.val[0]), a.val[0], b.val[1]);
+    return p;
+}
+
+static void scaled_cf32_neon(const Csdr::complex<float>* x, Csdr::complex<float> scale,
+                             Csdr::complex<float>* y, size_t n) {
+    const float* xf = reinterpret_cast<const float*>(x);
+    float* yf = reinterpret_cast<float*>(y);
+    const float32x4x2_t s = {{ vdupq_n_f32(scale.i()), vdupq_n_f32(scale.q()) }};
+    size_t k = 0;
+    for (; k + 4 <= n; k += 4) {
+        float32x4x2_t v = cmul_neon(vld2q_f32(xf + 2 * k), s);
+        float32x4x2_t acc = vld2q_f32(yf + 2 * k);
+        acc.val[0] = vaddq_f32(acc.val[0], v.val[0]);
+        acc.val[1] = vaddq_f32(acc.val[1], v.val[1]);
+        vst2q_f32(yf + 2 * k, acc);
+    }
+    scaled_cf32_scalar(x + k, scale, y + k, n - k);
+}
+
+static void product_cf32_neon(const Csdr::complex<float>* a, const Csdr::complex<float>* b,
+                              Csdr::complex<float> scale, Csdr::complex<float>* y, size_t n) {
+    const float* af = reinterpret_cast<const float*>(a);
+    const float* bf = reinterpret_cast<const float*>(b);
+    float* yf = reinterpret_cast<float*>(y);
+    const float32x4x2_t s = {{ vdupq_n_f32(scale.i()), vdupq_n_f32(scale.q()) }};
+    size_t k = 0;
+    for (; k + 4 <= n; k += 4) {
+        float32x4x2_t v = cmul_neon(cmul_neon(vld2q_f32(af + 2 * k), vld2q_f32(bf + 2 * k)), s);
+        float32x4x2_t acc = vld2q_f32(yf + 2 * k);
+        acc.val[0] = vaddq_f32(acc.val[0], v.val[0]);
+        acc.val[1] = vaddq_f32(acc.val[1], v.val[1]);
+        vst2q_f32(yf + 2 * k, acc);
+    }
+    product_cf32_scalar(a + k, b + k, scale, y + k, n - k);
+}
+
+// vld2/vst2 split the left and right channels, so there is no shuffling
+static inline void mix_stereo_neon(float32x4_t v, float gain_left, float gain_right, float* y) {
+    float32x4x2_t acc = vld2q_f32(y);
+    acc.val[0] = vmlaq_n_f32(acc.val[0], v, gain_left);
+    acc.val[1] = vmlaq_n_f32(acc.val[1], v, gain_right);
+    vst2q_f32(y, acc);
+}
+
+static void mix_stereo_s16_neon(const short* x, float gain_left, float gain_right,
+                                float* y, size_t n) {
+    size_t k = 0;
+    for (; k + 8 <= n; k += 8) {
+        int16x8_t v = vld1q_s16(x + k);
+        mix_stereo_neon(vcvtq_n_f32_s32(vmovl_s16(vget_low_s16(v)), 15), gain_left, gain_right, y + 2 * k);
+        mix_stereo_neon(vcvtq_n_f32_s32(vmovl_s16(vget_high_s16(v)), 15), gain_left, gain_right, y + 2 * k + 8);
+    }
+    mix_stereo_s16_scalar(x + k, gain_left, gain_right, y + 2 * k, n - k);
+}
+
+static void mix_stereo_f32_neon(const float* x, float gain_left, float gain_right,
+                                float* y, size_t n) {
+    size_t k = 0;
+    for (; k + 4 <= n; k += 4)
+        mix_stereo_neon(vld1q_f32(x + k), gain_left, gain_right, y + 2 * k);
+    mix_stereo_f32_scalar(x + k, gain_left, gain_right, y + 2 * k, n - k);
+}
+
+struct SumsNEON {
+    float32x4_t sum;
+    float32x4_t sumsq;
+    float32x4_t peak;
+    uint32x4_t clipped;
+};
+
+static inline void accumulate_neon(float32x4_t v, float32x4_t clip, SumsNEON& acc) {
+    float32x4_t a = vabsq_f32(v);
+    acc.sum = vaddq_f32(acc.sum, v);
+    acc.sumsq = vmlaq_f32(acc.sumsq, v, v);
+    acc.peak = vmaxq_f32(acc.peak, a);
+    // the comparison mask is all ones (-1) in the lanes at or above the clip level
+    acc.clipped = vsubq_u32(acc.clipped, vcgeq_f32(a, clip));
+}
+
+static inline void add_lanes_neon(const SumsNEON& acc, SignalSums& sums) {
+    float sum[4], sumsq[4], peak[4];
+    int clipped[4];
+    vst1q_f32(sum, acc.sum);
+    vst1q_f32(sumsq, acc.sumsq);
+    vst1q_f32(peak, acc.peak);
+    vst1q_s32(clipped, vreinterpretq_s32_u32(acc.clipped));
+    add_lanes(sum, sumsq, peak, clipped, 4, sums);
+}
+
+static void sums_s16_neon(const short* x, size_t n, float clip, SignalSums& sums) {
+    const float32x4_t vclip = vdupq_n_f32(clip);
+    SumsNEON acc = { vdupq_n_f32(0), vdupq_n_f32(0), vdupq_n_f32(0), vdupq_n_u32(0) };
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        int16x8_t v = vld1q_s16(x + i);
+        accumulate_neon(vcvtq_n_f32_s32(vmovl_s16(vget_low_s16(v)), 15), vclip, acc);
+        accumulate_neon(vcvtq_n_f32_s32(vmovl_s16(vget_high_s16(v)), 15), vclip, acc);
+    }
+    add_lanes_neon(acc, sums);
+    sums_s16_scalar(x + i, n - i, clip, sums);
+}
+
+static void sums_f32_neon(const float* x, size_t n, float clip, SignalSums& sums) {
+    const float32x4_t vclip = vdupq_n_f32(clip);
+    SumsNEON acc = { vdupq_n_f32(0), vdupq_n_f32(0), vdupq_n_f32(0), vdupq_n_u32(0) };
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+        accumulate_neon(vld1q_f32(x + i), vclip, acc);
+    add_lanes_neon(acc, sums);
+    sums_f32_scalar(x + i, n - i, clip, sums);
+}
+
+static const Kernels kernels_neon = {
+    "neon",
+    planar_s16_to_cf32_neon,
+    planar_s16_to_cs16_neon,
+    cs8_to_cf32_neon,
+    cu8_to_cf32_neon,
+    cs12_to_cf32_scalar,
+    cs16_to_cf32_neon,
+    cs8_to_cs16_neon,
+    cu8_to_cs16_neon,
+    cs12_to_cs16_scalar,
+    cf32_to_cs16_neon,
+    scaled_cf32_neon,
+    product_cf32_neon,
+    mix_stereo_s16_neon,
+    mix_stereo_f32_neon,
+    sums_s16_neon,
+    sums_f32_neon,
+};
+#endif
+
+static const Kernels* select_kernels() {
+#ifdef KERNELS_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return &kernels_avx2;
+    if (__builtin_cpu_supports("sse2"))
+        return &kernels_sse2;
+#endif
+#ifdef KERNELS_NEON
+    return &kernels_neon;
+#endif
+    return &kernels_scalar;
+}
+
+// set_kernels_isa() can switch the table while other threads call kernels
+// (each call uses the table it loaded)
+static std::atomic<const Kernels*> kernels{select_kernels()};
+
+static inline const Kernels* active_kernels() {
+    return kernels.load(std::memory_order_acquire);
+}
+
+// public API
+void Csdrx::convert_planar_s16_to_cf32(const short* xi, const short* xq,
+                                       Csdr::complex<float>* out, size_t n) {
+    active_kernels()->planar_s16_to_cf32(xi, xq, out, n);
+}
+
+void Csdrx::convert_planar_s16_to_cs16(const short* xi, const short* xq,
+                                       Csdr::complex<short>* out, size_t n) {
+    active_kernels()->planar_s16_to_cs16(xi, xq, out, n);
+}
+
+void Csdrx::convert_cs8_to_cf32(const signed char* in, Csdr::complex<float>* out,
+                                size_t n, float scale) {
+    active_kernels()->cs8_to_cf32(in, out, n, scale);
+}
+
+void Csdrx::convert_cu8_to_cf32(const unsigned char* in, Csdr::complex<float>* out,
+                                size_t n, float scale) {
+    active_kernels()->cu8_to_cf32(in, out, n, scale);
+}
+
+void Csdrx::convert_cs12_to_cf32(const unsigned char* in, Csdr::complex<float>* out,
+                                 size_t n, float scale) {
+    active_kernels()->cs12_to_cf32(in, out, n, scale);
+}
+
+void Csdrx::convert_cs16_to_cf32(const Csdr::complex<short>* in, Csdr::complex<float>* out,
+                                 size_t n, float scale) {
+    active_kernels()->cs16_to_cf32(in, out, n, scale);
+}
+
+void Csdrx::convert_cs8_to_cs16(const signed char* in, Csdr::complex<short>* out, size_t n) {
+    active_kernels()->cs8_to_cs16(in, out, n);
+}
+
+void Csdrx::convert_cu8_to_cs16(const unsigned char* in, Csdr::complex<short>* out, size_t n) {
+    active_kernels()->cu8_to_cs16(in, out, n);
+}
+
+void Csdrx::convert_cs12_to_cs16(const unsigned char* in, Csdr::complex<short>* out, size_t n) {
+    active_kernels()->cs12_to_cs16(in, out, n);
+}
+
+void Csdrx::convert_cf32_to_cs16(const Csdr::complex<float>* in, Csdr::complex<short>* out, size_t n) {
+    active_kernels()->cf32_to_cs16(in, out, n);
+}
+
+void Csdrx::accumulate_scaled_cf32(const Csdr::complex<float>* x, Csdr::complex<float> scale,
+                                   Csdr::complex<float>* y, size_t n) {
+    active_kernels()->scaled_cf32(x, scale, y, n);
+}
+
+void Csdrx::accumulate_product_cf32(const Csdr::complex<float>* a, const Csdr::complex<float>* b,
+                                    Csdr::complex<float> scale, Csdr::complex<float>* y, size_t n) {
+    active_kernels()->product_cf32(a, b, scale, y, n);
+}
+
+void Csdrx::mix_stereo_s16(const short* x, float gain_left, float gain_right, float* y, size_t n) {
+    active_kernels()->mix_stereo_s16(x, gain_left, gain_right, y, n);
+}
+
+void Csdrx::mix_stereo_f32(const float* x, float gain_left, float gain_right, float* y, size_t n) {
+    active_kernels()->mix_stereo_f32(x, gain_left, gain_right, y, n);
+}
+
+void Csdrx::accumulate_sums_s16(const short* x, size_t n, float clip, SignalSums& sums) {
+    active_kernels()->sums_s16(x, n, clip, sums);
+}
+
+void Csdrx::accumulate_sums_f32(const float* x, size_t n, float clip, SignalSums& sums) {
+    active_kernels()->sums_f32(x, n, clip, sums);
+}
+
+const char* Csdrx::get_kernels_isa() {
+    return active_kernels()->isa;
+}
+
+bool Csdrx::set_kernels_isa(const char* isa) {
+    if (strcmp(isa, "scalar") == 0) {
+        kernels.store(&kernels_scalar, std::memory_order_release);
+        return true;
+    }
+#ifdef KERNELS_X86
+    if (strcmp(isa, "sse2") == 0 && __builtin_cpu_supports("sse2")) {
+        kernels.store(&kernels_sse2, std::memory_order_release);
+        return true;
+    }
+    if (strcmp(isa, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+        kernels.store(&kernels_avx2, std::memory_order_release);
+        return true;
+    }
+#endif
+#ifdef KERNELS_NEON
+    if (strcmp(isa, "neon") == 0) {
+        kernels.store(&kernels_neon, std::memory_order_release);
+        return true;
+    }
+#endif
+    return false;
+}
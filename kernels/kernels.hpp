@@ -0,0 +1,80 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <csdr/complex.hpp>
+#include <cstddef>
+
+namespace Csdrx {
+
+    // vectorized sample conversion kernels; the implementation (SSE2, AVX2,
+    // NEON, or plain C++) is selected at run time based on the CPU features
+
+    // planar 16 bit I/Q (SDRplay API) to interleaved complex samples;
+    // floats are scaled to [-1, 1)
+    void convert_planar_s16_to_cf32(const short* xi, const short* xq,
+                                    Csdr::complex<float>* out, size_t n);
+    void convert_planar_s16_to_cs16(const short* xi, const short* xq,
+                                    Csdr::complex<short>* out, size_t n);
+
+    // interleaved native formats of the SDR drivers (SoapySDR CS8, CU8, CS12,
+    // CS16, and CF32) to interleaved complex samples; n is the number of
+    // complex samples. The conversions to floats multiply the integer values
+    // by scale (CU8 values are centered on 128 first, and CS12 values are
+    // left aligned to 16 bits like SoapySDR does); the conversions to 16 bits
+    // left align the values
+    void convert_cs8_to_cf32(const signed char* in, Csdr::complex<float>* out,
+                             size_t n, float scale = 1.0f / 128.0f);
+    void convert_cu8_to_cf32(const unsigned char* in, Csdr::complex<float>* out,
+                             size_t n, float scale = 1.0f / 128.0f);
+    void convert_cs12_to_cf32(const unsigned char* in, Csdr::complex<float>* out,
+                              size_t n, float scale = 1.0f / 32768.0f);
+    void convert_cs16_to_cf32(const Csdr::complex<short>* in, Csdr::complex<float>* out,
+                              size_t n, float scale = 1.0f / 32768.0f);
+    void convert_cs8_to_cs16(const signed char* in, Csdr::complex<short>* out, size_t n);
+    void convert_cu8_to_cs16(const unsigned char* in, Csdr::complex<short>* out, size_t n);
+    void convert_cs12_to_cs16(const unsigned char* in, Csdr::complex<short>* out, size_t n);
+    // floats are multiplied by 32768, rounded, and saturated
+    void convert_cf32_to_cs16(const Csdr::complex<float>* in, Csdr::complex<short>* out, size_t n);
+
+    // complex multiply-accumulate (for the signal generator):
+    // y[k] += scale * x[k], and y[k] += scale * a[k] * b[k]
+    void accumulate_scaled_cf32(const Csdr::complex<float>* x, Csdr::complex<float> scale,
+                                Csdr::complex<float>* y, size_t n);
+    void accumulate_product_cf32(const Csdr::complex<float>* a, const Csdr::complex<float>* b,
+                                 Csdr::complex<float> scale, Csdr::complex<float>* y, size_t n);
+
+    // stereo mix-accumulate (for the audio mixer): y[2k] += gain_left * x[k]
+    // and y[2k + 1] += gain_right * x[k] into interleaved left/right floats;
+    // 16 bit values are scaled to [-1, 1) first
+    void mix_stereo_s16(const short* x, float gain_left, float gain_right, float* y, size_t n);
+    void mix_stereo_f32(const float* x, float gain_left, float gain_right, float* y, size_t n);
+
+    // running sums for the signal statistics; the values are normalized to
+    // full scale (1.0), and the even and odd elements are summed separately,
+    // so for interleaved I/Q samples they are the I and Q sums
+    struct SignalSums {
+        double sum_even = 0;
+        double sum_odd = 0;
+        double sum_squares = 0;
+        float peak = 0;           // largest absolute value
+        size_t clipped = 0;       // values with absolute value >= clip
+    };
+
+    // add n values to the sums (n must be even for interleaved samples);
+    // 16 bit values are scaled to [-1, 1) like in the conversions above
+    void accumulate_sums_s16(const short* x, size_t n, float clip, SignalSums& sums);
+    void accumulate_sums_f32(const float* x, size_t n, float clip, SignalSums& sums);
+
+    // name of the instruction set used by the kernels ("avx2", "sse2",
+    // "neon", or "scalar")
+    const char* get_kernels_isa();
+    // force a specific instruction set (for benchmarks and testing); returns
+    // false if it is not supported by this CPU
+    bool set_kernels_isa(const char* isa);
+}
@@ -16,6 +16,24 @@ typedef Csdr::complex<float> CF32;
 
 using namespace Csdrx;
 
+// the ring buffers between the stages count the samples written to them,
+// so a tag from the source can be located in the first buffer
+template <typename T>
+class Pipeline::Buffer: public Csdr::Ringbuffer<T> {
+    public:
+        explicit Buffer(size_t size):
+            Csdr::Ringbuffer<T>(size),
+            written(0)
+        {}
+        void advance(size_t how_much) override {
+            Csdr::Ringbuffer<T>::advance(how_much);
+            written += how_much;
+        }
+        size_t getWritten() const { return written; }
+    private:
+        std::atomic<size_t> written;
+};
+
 Pipeline::Pipeline(Csdr::UntypedSource* source, bool deleteUnusedModules):
     source(source),
     deleteUnusedModules(deleteUnusedModules),
@@ -24,6 +42,7 @@ Pipeline::Pipeline(Csdr::UntypedSource* source, bool deleteUnusedModules):
 {}
 
 Pipeline::~Pipeline() {
+    setFlushOnRetune(false);
     for (auto stage: stages) {
         delete stage->buffer;
         stage->buffer = nullptr;
@@ -155,8 +174,12 @@ void Pipeline::run()
     std::sort(sortedStages.begin(), sortedStages.end(), [](Stage* a, Stage* b) {
         return a->distanceFromSource > b->distanceFromSource;
     });
-    for (auto stage: sortedStages)
-        stage->runner = new Csdr::AsyncRunner(stage->module);
+    {
+        std::lock_guard<std::mutex> lock(runMutex);
+        for (auto stage: sortedStages)
+            stage->runner = new Csdr::AsyncRunner(stage->module);
+        running = true;
+    }
 
     // finally start the source
     untypedToTyped2<Csdr::Source, Csdr::UntypedSource,
@@ -183,7 +206,19 @@ void Pipeline::stop(double delay)
         [](auto s){
             s->stop();
         }) ||
+    untypedToTyped1complex<Csdrx::SDRplayTunerBSource, Csdr::UntypedSource>(source,
+        [](auto s){
+            s->stop();
+        }) ||
     untypedToTyped1complex<Csdrx::SoapySource, Csdr::UntypedSource>(source,
+        [](auto s){
+            s->stop();
+        }) ||
+    untypedToTyped1complex<Csdrx::SoapyChannelSource, Csdr::UntypedSource>(source,
+        [](auto s){
+            s->stop();
+        }) ||
+    untypedToTyped1complex<Csdrx::SignalGeneratorSource, Csdr::UntypedSource>(source,
         [](auto s){
             s->stop();
         });
@@ -196,6 +231,40 @@ void Pipeline::stop(double delay)
         nanosleep(&request_time, nullptr);
     }
 
+    // stop the stages in forward order
+    std::lock_guard<std::mutex> lock(runMutex);
+    std::vector<Stage*> sortedStages = stages;
+    std::sort(sortedStages.begin(), sortedStages.end(), [](Stage* a, Stage* b) {
+        return b->distanceFromSource > a->distanceFromSource;
+    });
+    for (auto stage: sortedStages) {
+        stage->runner->stop();
+        delete stage->runner;
+        stage->runner = nullptr;
+    }
+    running = false;
+    {
+        std::lock_guard<std::mutex> flushLock(flushMutex);
+        flushPending = false;
+    }
+
+    return;
+}
+
+void Pipeline::flush(size_t keep)
+{
+    flushStages([keep]() { return keep; });
+}
+
+// 'keep' is called after the stages have been stopped, right after the
+// samples available in the first buffer have been counted (the source may
+// still be writing)
+void Pipeline::flushStages(std::function<size_t()> keep)
+{
+    std::lock_guard<std::mutex> lock(runMutex);
+    if (!running)
+        return;
+
     // stop the stages in forward order
     std::vector<Stage*> sortedStages = stages;
     std::sort(sortedStages.begin(), sortedStages.end(), [](Stage* a, Stage* b) {
@@ -207,9 +276,106 @@ void Pipeline::stop(double delay)
         stage->runner = nullptr;
     }
 
+    // empty the input buffer of each stage and reset its module (and the
+    // writers at the end of the pipeline)
+    for (auto stage: sortedStages) {
+        bool first = stage->distanceFromSource == 1;
+        untypedToTyped1<Csdr::Sink, Csdr::UntypedModule>(stage->module,
+            [first, &keep](auto sink){
+                auto reader = sink->getReader();
+                size_t available = reader->available();
+                size_t keepSamples = first ? keep() : 0;
+                if (available > keepSamples)
+                    reader->advance(available - keepSamples);
+            });
+        if (auto resettable = dynamic_cast<Resettable*>(stage->module))
+            resettable->reset();
+        if (stage->buffer == nullptr) {
+            untypedToTyped1<Csdr::Source, Csdr::UntypedModule>(stage->module,
+                [](auto source){
+                    if (auto resettable = dynamic_cast<Resettable*>(source->getWriter()))
+                        resettable->reset();
+                });
+        }
+    }
+
+    // restart the stages in reverse order
+    std::reverse(sortedStages.begin(), sortedStages.end());
+    for (auto stage: sortedStages)
+        stage->runner = new Csdr::AsyncRunner(stage->module);
+    flushes++;
+
     return;
 }
 
+void Pipeline::setFlushOnRetune(bool enable)
+{
+    if (enable == flushOnRetune)
+        return;
+    auto emitter = dynamic_cast<TagEmitter*>(source);
+    if (emitter == nullptr)
+        throw std::runtime_error("pipeline source does not emit tags");
+    if (enable) {
+        {
+            std::lock_guard<std::mutex> lock(flushMutex);
+            flushRun = true;
+            flushPending = false;
+        }
+        flushThread = new std::thread([this] () { flushLoop(); });
+        emitter->addTagListener(this);
+    } else {
+        emitter->removeTagListener(this);
+        {
+            std::lock_guard<std::mutex> lock(flushMutex);
+            flushRun = false;
+        }
+        flushCv.notify_one();
+        flushThread->join();
+        delete flushThread;
+        flushThread = nullptr;
+    }
+    flushOnRetune = enable;
+}
+
+// called from the source thread with the listeners of the source locked, so
+// it only records the tagged sample; a later tag replaces a pending one
+void Pipeline::onTag(const Tag& tag)
+{
+    if (tag.type != TagType::Retune && tag.type != TagType::Reset)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(flushMutex);
+        flushSample = tag.sample;
+        flushPending = true;
+    }
+    flushCv.notify_one();
+}
+
+// the samples written after the tagged one are kept in the first buffer
+// (those the first stage has already read are not recovered)
+void Pipeline::flushLoop()
+{
+    std::unique_lock<std::mutex> lock(flushMutex);
+    while (true) {
+        flushCv.wait(lock, [this] () { return flushPending || !flushRun; });
+        if (!flushRun)
+            break;
+        size_t sample = flushSample;
+        flushPending = false;
+        lock.unlock();
+        flushStages([this, sample]() {
+            size_t written = getSourceSamples();
+            return written > sample ? written - sample : 0;
+        });
+        lock.lock();
+    }
+}
+
+size_t Pipeline::getFlushes() const
+{
+    return flushes;
+}
+
 bool Pipeline::isRunning()
 {
     bool isRunning = true;
@@ -246,6 +412,16 @@ Pipeline::Stage::Stage(Csdr::UntypedModule* module,
 Pipeline::Stage::~Stage() {}
 
 // internal functions
+size_t Pipeline::getSourceSamples()
+{
+    size_t written = 0;
+    untypedToTyped1<Buffer, Csdr::UntypedWriter>(sourceWriter,
+        [&written](auto buffer){
+            written = buffer->getWritten();
+        });
+    return written;
+}
+
 Pipeline::Stage* Pipeline::getStage(int stageNum) const
 {
     int stgnum = stageNum >= 0 ? stageNum : stages.size() + stageNum + 1;
@@ -305,14 +481,14 @@ void Pipeline::connectStagesTyped(Csdr::Source<T>* source, Csdr::Sink<T>* sink,
     Csdr::Ringbuffer<T>* buffer;
     if (previousStage == nullptr) {
         if (sourceWriter == nullptr) {
-            buffer = new Csdr::Ringbuffer<T>(T_BUFSIZE);
+            buffer = new Buffer<T>(T_BUFSIZE);
             sourceWriter = buffer;
         } else {
             buffer = dynamic_cast<Csdr::Ringbuffer<T>*>(sourceWriter);
         }
     } else {
         if (previousStage->buffer == nullptr) {
-            buffer = new Csdr::Ringbuffer<T>(T_BUFSIZE);
+            buffer = new Buffer<T>(T_BUFSIZE);
             previousStage->buffer = buffer;
         } else {
             buffer = dynamic_cast<Csdr::Ringbuffer<T>*>(previousStage->buffer);
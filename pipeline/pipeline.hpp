@@ -8,6 +8,11 @@
 #pragma once
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <csdr/async.hpp>
 #include <csdr/module.hpp>
@@ -16,13 +21,18 @@
 #include <csdr/writer.hpp>
 #include <csdrx/filesource.hpp>
 #include <csdrx/sdrplaysource.hpp>
+#include <csdrx/signalgenerator.hpp>
 #include <csdrx/soapysource.hpp>
+#include <csdrx/soapymultisource.hpp>
+#include <csdrx/tags.hpp>
 
 namespace Csdrx {
 
-    class Pipeline {
+    class Pipeline: public TagListener {
 
         class Stage;
+        template <typename T>
+        class Buffer;
 
         public:
             Pipeline(Csdr::UntypedSource* source, bool deleteUnusedModules=false);
@@ -36,6 +46,22 @@ namespace Csdrx {
             void run();
             void stop(double delay=0);
             bool isRunning();
+            // discard the samples in all the ring buffers (except the last
+            // 'keep' samples written by the source) and reset the modules
+            // that implement Resettable; the stages are stopped and
+            // restarted in order
+            void flush(size_t keep = 0);
+            // flush the pipeline when the source (a TagEmitter) emits a
+            // Retune or Reset tag: without it, after a change of frequency
+            // the samples of the old frequency still buffered in the stages
+            // are played first (up to the latency of the pipeline). The
+            // samples from the tagged one on are kept. The flush runs on a
+            // thread owned by the pipeline, since the tags are delivered
+            // from the source thread; it throws if the source doesn't emit
+            // tags
+            void setFlushOnRetune(bool enable);
+            void onTag(const Tag& tag) override;
+            size_t getFlushes() const;
             Csdr::UntypedSource* getSource();
             Csdr::UntypedModule* getModule(int stagenum);
         private:
@@ -43,10 +69,24 @@ namespace Csdrx {
             bool deleteUnusedModules;
             Csdr::UntypedWriter* sourceWriter;
             std::vector<Stage*> stages;
+            std::mutex runMutex;
+            bool running = false;
+            bool flushOnRetune = false;
+            std::atomic<size_t> flushes{0};
+            // flush requests from onTag() to the flush thread
+            std::thread* flushThread = nullptr;
+            std::mutex flushMutex;
+            std::condition_variable flushCv;
+            bool flushRun = false;
+            bool flushPending = false;
+            size_t flushSample = 0;
 
             // internal functions
             Stage* getStage(int stageNum) const;
             void connectStagesUntyped(Stage* previousStage, Csdr::UntypedModule* module);
+            size_t getSourceSamples();
+            void flushStages(std::function<size_t()> keep);
+            void flushLoop();
             template <typename T>
             void connectStagesTyped(Csdr::Source<T>* source, Csdr::Sink<T>* sink, Stage* previousStage);
 
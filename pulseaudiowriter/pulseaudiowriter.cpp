@@ -7,55 +7,314 @@
 
 #include "pulseaudiowriter.hpp"
 
-#include <unistd.h>
-#include <pulse/error.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <thread>
 
 using namespace Csdrx;
 
+template <typename T>
+static pa_sample_format_t sample_format();
+
+template<>
+pa_sample_format_t sample_format<short>() {
+    return PA_SAMPLE_S16NE;
+}
+
+template<>
+pa_sample_format_t sample_format<float>() {
+    return PA_SAMPLE_FLOAT32NE;
+}
+
 template <typename T>
 PulseAudioWriter<T>::PulseAudioWriter(unsigned int samplerate, size_t buffer_size,
-                             const char* app_name, const char* stream_name):
-    buffer_size(buffer_size),
-    buffer((T*) malloc(sizeof(T) * buffer_size))
+                                      const char* app_name, const char* stream_name,
+                                      double target_latency, unsigned int channels):
+    target_latency(target_latency)
 {
-    static const pa_sample_spec sample_spec = {
-        .format = PA_SAMPLE_S16LE,
-        .rate = samplerate,
-        .channels = 1
-    };
-
-    int error;
-    if (!(pa = pa_simple_new(nullptr, app_name == nullptr ? "csdr" : app_name,
-                             PA_STREAM_PLAYBACK, nullptr,
-                             stream_name == nullptr ? "pawriter0" : stream_name,
-                             &sample_spec, nullptr, nullptr, &error)))
-        throw std::runtime_error(std::string("pa_simple_new() failed: ") + pa_strerror(error));
+    sample_spec.format = sample_format<T>();
+    sample_spec.rate = samplerate;
+    sample_spec.channels = channels;
+    if (!pa_sample_spec_valid(&sample_spec))
+        throw PulseAudioException("invalid sample rate or number of channels");
+    if (target_latency <= 0)
+        throw PulseAudioException("invalid target latency");
+    // room for a few times the target latency, so the queue only fills up
+    // when the sound server is stuck; the sizes are whole frames, so the
+    // queue never wraps around in the middle of a frame
+    size_t latency_frames = samplerate * target_latency;
+    size_t buffer_frames = std::max(buffer_size / channels, (size_t) 1);
+    queue = new StagingBuffer<T>(4 * std::max(buffer_frames, latency_frames) * channels);
+    this->buffer_size = buffer_frames * channels;
+    overflow_buffer = new T[this->buffer_size];
+    // the timer tops up the stream when the queue was empty at the last
+    // write request
+    timer_interval = std::min(std::max(target_latency / 4, 0.005), 0.05) * 1e6;
+    try {
+        connect(app_name, stream_name);
+    } catch (const PulseAudioException&) {
+        disconnect();
+        delete queue;
+        delete[] overflow_buffer;
+        throw;
+    }
 }
 
 template <typename T>
 PulseAudioWriter<T>::~PulseAudioWriter() {
-    int error;
-    pa_simple_drain(pa, &error);
-    pa_simple_free(pa);
-    free(buffer);
+    drain();
+    disconnect();
+    delete queue;
+    delete[] overflow_buffer;
+}
+
+template <typename T>
+void PulseAudioWriter<T>::connect(const char* app_name, const char* stream_name) {
+    mainloop = pa_threaded_mainloop_new();
+    if (mainloop == nullptr)
+        throw PulseAudioException("pa_threaded_mainloop_new() failed");
+    pa_mainloop_api* api = pa_threaded_mainloop_get_api(mainloop);
+    context = pa_context_new(api, app_name == nullptr ? "csdr" : app_name);
+    if (context == nullptr)
+        throw PulseAudioException("pa_context_new() failed");
+    pa_context_set_state_callback(context, context_state_callback, this);
+    if (pa_context_connect(context, nullptr, PA_CONTEXT_NOFLAGS, nullptr) < 0)
+        throw PulseAudioException(std::string("pa_context_connect() failed: ") +
+                                  pa_strerror(pa_context_errno(context)));
+
+    pa_threaded_mainloop_lock(mainloop);
+    if (pa_threaded_mainloop_start(mainloop) < 0) {
+        pa_threaded_mainloop_unlock(mainloop);
+        throw PulseAudioException("pa_threaded_mainloop_start() failed");
+    }
+    pa_context_state_t context_state;
+    while ((context_state = pa_context_get_state(context)) != PA_CONTEXT_READY) {
+        if (!PA_CONTEXT_IS_GOOD(context_state)) {
+            pa_threaded_mainloop_unlock(mainloop);
+            throw PulseAudioException(std::string("PulseAudio connection failed: ") +
+                                      pa_strerror(pa_context_errno(context)));
+        }
+        pa_threaded_mainloop_wait(mainloop);
+    }
+
+    pa_channel_map channel_map;
+    pa_channel_map_init_extend(&channel_map, sample_spec.channels, PA_CHANNEL_MAP_DEFAULT);
+    stream = pa_stream_new(context, stream_name == nullptr ? "pawriter0" : stream_name,
+                           &sample_spec, &channel_map);
+    if (stream == nullptr) {
+        pa_threaded_mainloop_unlock(mainloop);
+        throw PulseAudioException(std::string("pa_stream_new() failed: ") +
+                                  pa_strerror(pa_context_errno(context)));
+    }
+    pa_stream_set_state_callback(stream, stream_state_callback, this);
+    pa_stream_set_write_callback(stream, stream_write_callback, this);
+    pa_stream_set_underflow_callback(stream, stream_underflow_callback, this);
+
+    // the server keeps about 'target_latency' of audio in the stream buffer
+    pa_buffer_attr buffer_attr;
+    buffer_attr.maxlength = (uint32_t) -1;
+    buffer_attr.tlength = pa_usec_to_bytes(target_latency * 1e6, &sample_spec);
+    buffer_attr.prebuf = (uint32_t) -1;
+    buffer_attr.minreq = (uint32_t) -1;
+    buffer_attr.fragsize = (uint32_t) -1;
+    pa_stream_flags_t flags = (pa_stream_flags_t) (PA_STREAM_ADJUST_LATENCY |
+                                                   PA_STREAM_AUTO_TIMING_UPDATE |
+                                                   PA_STREAM_INTERPOLATE_TIMING);
+    if (pa_stream_connect_playback(stream, nullptr, &buffer_attr, flags, nullptr, nullptr) < 0) {
+        pa_threaded_mainloop_unlock(mainloop);
+        throw PulseAudioException(std::string("pa_stream_connect_playback() failed: ") +
+                                  pa_strerror(pa_context_errno(context)));
+    }
+    pa_stream_state_t stream_state;
+    while ((stream_state = pa_stream_get_state(stream)) != PA_STREAM_READY) {
+        if (!PA_STREAM_IS_GOOD(stream_state)) {
+            pa_threaded_mainloop_unlock(mainloop);
+            throw PulseAudioException(std::string("PulseAudio stream failed: ") +
+                                      pa_strerror(pa_context_errno(context)));
+        }
+        pa_threaded_mainloop_wait(mainloop);
+    }
+    timer = pa_context_rttime_new(context, pa_rtclock_now() + timer_interval,
+                                  timer_callback, this);
+    pa_threaded_mainloop_unlock(mainloop);
+}
+
+template <typename T>
+void PulseAudioWriter<T>::disconnect() {
+    if (mainloop != nullptr)
+        pa_threaded_mainloop_stop(mainloop);
+    if (timer != nullptr) {
+        pa_threaded_mainloop_get_api(mainloop)->time_free(timer);
+        timer = nullptr;
+    }
+    if (stream != nullptr) {
+        pa_stream_disconnect(stream);
+        pa_stream_unref(stream);
+        stream = nullptr;
+    }
+    if (context != nullptr) {
+        pa_context_disconnect(context);
+        pa_context_unref(context);
+        context = nullptr;
+    }
+    if (mainloop != nullptr) {
+        pa_threaded_mainloop_free(mainloop);
+        mainloop = nullptr;
+    }
 }
 
+// play what is left in the queue before closing the stream
+template <typename T>
+void PulseAudioWriter<T>::drain() {
+    double queued = (double) getQueuedSamples() / sample_spec.rate;
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::duration<double>(queued + target_latency + 1.0);
+    while (queue->available() > 0 && std::chrono::steady_clock::now() < deadline)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    pa_threaded_mainloop_lock(mainloop);
+    pa_operation* operation = pa_stream_drain(stream, drain_callback, this);
+    if (operation != nullptr) {
+        while (pa_operation_get_state(operation) == PA_OPERATION_RUNNING)
+            pa_threaded_mainloop_wait(mainloop);
+        pa_operation_unref(operation);
+    }
+    pa_threaded_mainloop_unlock(mainloop);
+}
+
+// the module writes straight into the queue; when the queue is full the
+// samples go to the overflow buffer and are dropped, so the pipeline never
+// stops because of the sound server
 template <typename T>
 size_t PulseAudioWriter<T>::writeable() {
-    return buffer_size;
+    size_t available = queue->writeable();
+    write_to_queue = available > 0;
+    return write_to_queue ? available : buffer_size;
 }
 
 template <typename T>
 T* PulseAudioWriter<T>::getWritePointer() {
-    return buffer;
+    return write_to_queue ? queue->getWritePointer() : overflow_buffer;
 }
 
 template <typename T>
 void PulseAudioWriter<T>::advance(size_t how_much) {
-    int error;
-    pa_simple_write(pa, (const uint8_t*) buffer, sizeof(T) * how_much, &error);
+    if (write_to_queue)
+        queue->advanceWrite(how_much);
+    else
+        dropped_samples += how_much / sample_spec.channels;
+}
+
+// mainloop thread: the only copy, from the queue into the stream buffer;
+// only whole frames are written
+template <typename T>
+void PulseAudioWriter<T>::write_to_stream(size_t nbytes) {
+    size_t channels = sample_spec.channels;
+    while (nbytes >= channels * sizeof(T)) {
+        size_t available = queue->available();
+        if (available == 0)
+            break;
+        void* data;
+        size_t bytes = nbytes;
+        if (pa_stream_begin_write(stream, &data, &bytes) < 0 || data == nullptr)
+            break;
+        size_t samples = std::min(available, bytes / sizeof(T));
+        samples -= samples % channels;
+        if (samples == 0) {
+            pa_stream_cancel_write(stream);
+            break;
+        }
+        memcpy(data, queue->getReadPointer(), samples * sizeof(T));
+        pa_stream_write(stream, data, samples * sizeof(T), nullptr, 0, PA_SEEK_RELATIVE);
+        queue->advanceRead(samples);
+        nbytes -= samples * sizeof(T);
+    }
+}
+
+template <typename T>
+void PulseAudioWriter<T>::context_state_callback(pa_context* context, void* userdata) {
+    auto writer = static_cast<PulseAudioWriter<T>*>(userdata);
+    pa_threaded_mainloop_signal(writer->mainloop, 0);
+}
+
+template <typename T>
+void PulseAudioWriter<T>::stream_state_callback(pa_stream* stream, void* userdata) {
+    auto writer = static_cast<PulseAudioWriter<T>*>(userdata);
+    pa_threaded_mainloop_signal(writer->mainloop, 0);
+}
+
+template <typename T>
+void PulseAudioWriter<T>::stream_write_callback(pa_stream* stream, size_t nbytes, void* userdata) {
+    auto writer = static_cast<PulseAudioWriter<T>*>(userdata);
+    writer->write_to_stream(nbytes);
+}
+
+template <typename T>
+void PulseAudioWriter<T>::stream_underflow_callback(pa_stream* stream, void* userdata) {
+    auto writer = static_cast<PulseAudioWriter<T>*>(userdata);
+    writer->underruns++;
+}
+
+template <typename T>
+void PulseAudioWriter<T>::timer_callback(pa_mainloop_api* api, pa_time_event* event,
+                                         const struct timeval* tv, void* userdata) {
+    auto writer = static_cast<PulseAudioWriter<T>*>(userdata);
+    pa_stream* stream = writer->stream;
+    if (pa_stream_get_state(stream) == PA_STREAM_READY) {
+        size_t nbytes = pa_stream_writable_size(stream);
+        if (nbytes != (size_t) -1 && nbytes > 0)
+            writer->write_to_stream(nbytes);
+        pa_usec_t usec;
+        int negative;
+        if (pa_stream_get_latency(stream, &usec, &negative) == 0)
+            writer->latency = negative ? 0 : usec * 1e-6;
+    }
+    pa_context_rttime_restart(writer->context, event, pa_rtclock_now() + writer->timer_interval);
+}
+
+template <typename T>
+void PulseAudioWriter<T>::drain_callback(pa_stream* stream, int success, void* userdata) {
+    auto writer = static_cast<PulseAudioWriter<T>*>(userdata);
+    pa_threaded_mainloop_signal(writer->mainloop, 0);
+}
+
+template <typename T>
+unsigned int PulseAudioWriter<T>::getChannels() const {
+    return sample_spec.channels;
+}
+
+template <typename T>
+double PulseAudioWriter<T>::getTargetLatency() const {
+    return target_latency;
+}
+
+template <typename T>
+double PulseAudioWriter<T>::getLatency() const {
+    return latency;
+}
+
+template <typename T>
+size_t PulseAudioWriter<T>::getQueuedSamples() const {
+    return (queue->getSize() - queue->freeSpace()) / sample_spec.channels;
+}
+
+template <typename T>
+double PulseAudioWriter<T>::getTotalLatency() const {
+    double latency = this->latency;
+    return latency < 0 ? -1 : latency + (double) getQueuedSamples() / sample_spec.rate;
+}
+
+template <typename T>
+size_t PulseAudioWriter<T>::getUnderruns() const {
+    return underruns;
+}
+
+template <typename T>
+size_t PulseAudioWriter<T>::getDroppedSamples() const {
+    return dropped_samples;
 }
 
 namespace Csdrx {
     template class PulseAudioWriter<short>;
+    template class PulseAudioWriter<float>;
 }
@@ -8,23 +8,80 @@
 #pragma once
 
 #include <csdr/writer.hpp>
-#include <pulse/simple.h>
+#include <csdrx/stagingbuffer.hpp>
+#include <pulse/pulseaudio.h>
+#include <atomic>
+#include <stdexcept>
+#include <string>
 
 namespace Csdrx {
 
+    class PulseAudioException: public std::runtime_error {
+        public:
+            PulseAudioException(const std::string& reason): std::runtime_error(reason) {}
+    };
+
+    // the pipeline writes the audio straight into a lock-free queue, and the
+    // PulseAudio threaded mainloop copies it into the stream buffer when the
+    // server asks for more; the pipeline never waits for the sound server:
+    // when the queue is full the samples are dropped (and counted).
+    // 'target_latency' (seconds) is the amount of audio PulseAudio keeps
+    // buffered (tlength).
+    // The sample format follows T (short: S16, float: FLOAT32 in [-1, 1]);
+    // with more than one channel the samples are interleaved (one frame is
+    // one sample per channel), and the channels follow the default PulseAudio
+    // order (front left, front right, ...)
     template <typename T>
     class PulseAudioWriter: public Csdr::Writer<T> {
         public:
             PulseAudioWriter(unsigned int samplerate, size_t buffer_size = 10240,
                              const char* app_name = nullptr,
-                             const char* stream_name = nullptr);
+                             const char* stream_name = nullptr,
+                             double target_latency = 0.1,
+                             unsigned int channels = 1);
             ~PulseAudioWriter();
             size_t writeable() override;
             T* getWritePointer() override;
             void advance(size_t how_much) override;
+            unsigned int getChannels() const;
+            double getTargetLatency() const;
+            // latency reported by the server (stream buffer plus sink), in
+            // seconds; -1 until the first timing update
+            double getLatency() const;
+            // frames waiting in the queue
+            size_t getQueuedSamples() const;
+            // server latency plus the queue, in seconds (-1 like getLatency())
+            double getTotalLatency() const;
+            size_t getUnderruns() const;
+            // frames dropped because the queue was full
+            size_t getDroppedSamples() const;
         private:
+            static void context_state_callback(pa_context* context, void* userdata);
+            static void stream_state_callback(pa_stream* stream, void* userdata);
+            static void stream_write_callback(pa_stream* stream, size_t nbytes, void* userdata);
+            static void stream_underflow_callback(pa_stream* stream, void* userdata);
+            static void timer_callback(pa_mainloop_api* api, pa_time_event* event,
+                                       const struct timeval* tv, void* userdata);
+            static void drain_callback(pa_stream* stream, int success, void* userdata);
+            void connect(const char* app_name, const char* stream_name);
+            void write_to_stream(size_t nbytes);
+            void drain();
+            void disconnect();
+
+            pa_sample_spec sample_spec;
+            double target_latency;
+            pa_threaded_mainloop* mainloop = nullptr;
+            pa_context* context = nullptr;
+            pa_stream* stream = nullptr;
+            pa_time_event* timer = nullptr;
+            pa_usec_t timer_interval;
+            StagingBuffer<T>* queue;
+            // where the samples go when the queue is full
             size_t buffer_size;
-            T* buffer;
-            pa_simple *pa;
+            T* overflow_buffer;
+            bool write_to_queue = true;
+            std::atomic<double> latency{-1};
+            std::atomic<size_t> underruns{0};
+            std::atomic<size_t> dropped_samples{0};
     };
 }
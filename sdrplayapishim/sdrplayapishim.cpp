@@ -0,0 +1,549 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// A stand-in for libsdrplay_api.so.3 for tests and benchmarks without an
+// RSP: it implements the sdrplay_api_* entry points used by SDRplaySource
+// and calls the stream callbacks from its own thread with a synthetic
+// signal (a tone and some noise), at the sample rate set through the device
+// parameters, or as fast as the callbacks return.
+// Run a program with the shim instead of the real library with:
+//     LD_LIBRARY_PATH=<build dir>/sdrplayapishim ./fm_receiver_sdrplay_source
+//
+// It is configured with these environment variables (read by
+// sdrplay_api_Open()):
+//   SDRPLAY_SHIM_HWVER             hardware version of the device (default: RSP1A);
+//                                  an RSPduo (3) also supports dual tuner and master mode
+//   SDRPLAY_SHIM_SERIAL            serial number (default: SHIM0001)
+//   SDRPLAY_SHIM_SAMPLERATE        output sample rate of the callbacks (default: from
+//                                  the device parameters, fsHz / decimation)
+//   SDRPLAY_SHIM_REALTIME          0 -> call the callbacks back to back (default: 1)
+//   SDRPLAY_SHIM_BLOCK_SIZE        samples per callback (default: 2016)
+//   SDRPLAY_SHIM_AMPLITUDE         tone amplitude, relative to full scale (default: 0.1)
+//   SDRPLAY_SHIM_MAX_LATENCY_MS    how late the callbacks can fall behind real time
+//                                  before samples are lost, like the USB buffers of a
+//                                  real device (default: 100)
+//   SDRPLAY_SHIM_GAP_INTERVAL      every N callbacks skip SDRPLAY_SHIM_GAP_SAMPLES
+//                                  sample numbers (default: never, block size)
+//   SDRPLAY_SHIM_RESET_INTERVAL    every N callbacks set 'reset' (default: never)
+//   SDRPLAY_SHIM_CHANGED_INTERVAL  every N callbacks set grChanged, rfChanged and
+//                                  fsChanged (default: never)
+//   SDRPLAY_SHIM_CHANGE_LATENCY    callbacks between sdrplay_api_Update() and the
+//                                  matching *Changed flag (default: 2)
+// At sdrplay_api_Uninit() the shim prints the number of callbacks, the
+// samples per second, and the time spent in the callbacks to stderr.
+
+#include <sdrplay_api.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <time.h>
+
+namespace {
+
+    struct ShimConfig {
+        unsigned char hwVer;
+        std::string serial;
+        double samplerate;
+        bool realtime;
+        size_t block_size;
+        double amplitude;
+        long long max_latency_ns;
+        unsigned long gap_interval;
+        unsigned int gap_samples;
+        unsigned long reset_interval;
+        unsigned long changed_interval;
+        unsigned long change_latency;
+    };
+
+    struct ShimDevice {
+        sdrplay_api_DeviceT device;
+        bool selected = false;
+        sdrplay_api_DevParamsT dev_params;
+        sdrplay_api_RxChannelParamsT rx_channel_a;
+        sdrplay_api_RxChannelParamsT rx_channel_b;
+        sdrplay_api_DeviceParamsT device_params;
+        sdrplay_api_CallbackFnsT callbacks;
+        void* context = nullptr;
+        std::thread* thread = nullptr;
+        std::atomic<bool> run{false};
+        std::atomic<double> samplerate{0};
+        std::atomic<bool> samplerate_changed{false};
+        // callback number at which the change is reported (0 -> none), by
+        // output
+        std::atomic<unsigned long> gr_changed_due[2];
+        std::atomic<unsigned long> rf_changed_due[2];
+        std::atomic<unsigned long> fs_changed_due[2];
+        std::atomic<bool> reset_pending{false};
+        std::atomic<unsigned long> callback_count{0};
+        // statistics
+        unsigned long long total_samples = 0;
+        unsigned long late_blocks = 0;
+        unsigned long long lost_samples = 0;
+        long long callback_ns = 0;
+        long long max_callback_ns = 0;
+        long long start_ns = 0;
+        long long stop_ns = 0;
+    };
+
+}
+
+static constexpr size_t TABLE_SIZE = 65536;
+
+static std::mutex api_mutex;
+static std::mutex device_api_mutex;
+static int open_count = 0;
+static ShimConfig config;
+static ShimDevice* shim_device = nullptr;
+static std::vector<short> table_i;
+static std::vector<short> table_q;
+
+static double env_double(const char* name, double default_value) {
+    const char* value = getenv(name);
+    return value != nullptr && *value != '\0' ? atof(value) : default_value;
+}
+
+static long long monotonic_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static void read_config() {
+    config.hwVer = env_double("SDRPLAY_SHIM_HWVER", SDRPLAY_RSP1A_ID);
+    const char* serial = getenv("SDRPLAY_SHIM_SERIAL");
+    config.serial = serial != nullptr && *serial != '\0' ? serial : "SHIM0001";
+    config.samplerate = env_double("SDRPLAY_SHIM_SAMPLERATE", 0);
+    config.realtime = env_double("SDRPLAY_SHIM_REALTIME", 1) != 0;
+    config.block_size = std::max(env_double("SDRPLAY_SHIM_BLOCK_SIZE", 2016), 1.0);
+    config.amplitude = env_double("SDRPLAY_SHIM_AMPLITUDE", 0.1);
+    config.max_latency_ns = env_double("SDRPLAY_SHIM_MAX_LATENCY_MS", 100) * 1e6;
+    config.gap_interval = env_double("SDRPLAY_SHIM_GAP_INTERVAL", 0);
+    config.gap_samples = env_double("SDRPLAY_SHIM_GAP_SAMPLES", config.block_size);
+    config.reset_interval = env_double("SDRPLAY_SHIM_RESET_INTERVAL", 0);
+    config.changed_interval = env_double("SDRPLAY_SHIM_CHANGED_INTERVAL", 0);
+    config.change_latency = env_double("SDRPLAY_SHIM_CHANGE_LATENCY", 2);
+}
+
+// a tone at 1/16 of the sample rate plus some noise; the tables are
+// longer than TABLE_SIZE by one block, so a block never wraps around
+static void fill_tables() {
+    table_i.resize(TABLE_SIZE + config.block_size);
+    table_q.resize(TABLE_SIZE + config.block_size);
+    double amplitude = config.amplitude * 32767;
+    unsigned int random = 1;
+    for (size_t k = 0; k < TABLE_SIZE; k++) {
+        random = random * 1664525 + 1013904223;
+        double noise_i = ((random >> 16) & 0xff) - 127.5;
+        double noise_q = ((random >> 8) & 0xff) - 127.5;
+        table_i[k] = lrint(amplitude * cos(2 * M_PI * k / 16) + noise_i);
+        table_q[k] = lrint(amplitude * sin(2 * M_PI * k / 16) + noise_q);
+    }
+    for (size_t k = TABLE_SIZE; k < table_i.size(); k++) {
+        table_i[k] = table_i[k % TABLE_SIZE];
+        table_q[k] = table_q[k % TABLE_SIZE];
+    }
+}
+
+static void default_rx_channel_params(sdrplay_api_RxChannelParamsT& rx) {
+    memset(&rx, 0, sizeof(rx));
+    rx.tunerParams.bwType = sdrplay_api_BW_0_200;
+    rx.tunerParams.ifType = sdrplay_api_IF_Zero;
+    rx.tunerParams.loMode = sdrplay_api_LO_Auto;
+    rx.tunerParams.gain.gRdB = 50;
+    rx.tunerParams.gain.minGr = sdrplay_api_NORMAL_MIN_GR;
+    rx.tunerParams.rfFreq.rfHz = 200e6;
+    rx.ctrlParams.dcOffset.DCenable = 1;
+    rx.ctrlParams.dcOffset.IQenable = 1;
+    rx.ctrlParams.decimation.decimationFactor = 1;
+    rx.ctrlParams.agc.enable = sdrplay_api_AGC_50HZ;
+    rx.ctrlParams.agc.setPoint_dBfs = -60;
+}
+
+static void init_device(ShimDevice* d) {
+    memset(&d->device, 0, sizeof(d->device));
+    strncpy(d->device.SerNo, config.serial.c_str(), SDRPLAY_MAX_SER_NO_LEN - 1);
+    d->device.hwVer = config.hwVer;
+    d->device.valid = 1;
+    d->device.dev = d;
+    if (config.hwVer == SDRPLAY_RSPduo_ID) {
+        d->device.tuner = sdrplay_api_Tuner_Both;
+        d->device.rspDuoMode = (sdrplay_api_RspDuoModeT) (sdrplay_api_RspDuoMode_Single_Tuner |
+                                                          sdrplay_api_RspDuoMode_Dual_Tuner |
+                                                          sdrplay_api_RspDuoMode_Master);
+    } else {
+        d->device.tuner = sdrplay_api_Tuner_A;
+        d->device.rspDuoMode = sdrplay_api_RspDuoMode_Unknown;
+    }
+    for (int output = 0; output < 2; output++) {
+        d->gr_changed_due[output] = 0;
+        d->rf_changed_due[output] = 0;
+        d->fs_changed_due[output] = 0;
+    }
+}
+
+static bool dual_tuner(const ShimDevice* d) {
+    return d->device.hwVer == SDRPLAY_RSPduo_ID &&
+           d->device.rspDuoMode == sdrplay_api_RspDuoMode_Dual_Tuner;
+}
+
+// the rate of the samples in the callbacks; in dual tuner and master mode
+// the RSPduo always delivers 2MHz, before the decimation
+static double output_samplerate(const ShimDevice* d) {
+    if (config.samplerate > 0)
+        return config.samplerate;
+    double samplerate = d->dev_params.fsFreq.fsHz;
+    if (d->device.hwVer == SDRPLAY_RSPduo_ID &&
+        d->device.rspDuoMode != sdrplay_api_RspDuoMode_Single_Tuner)
+        samplerate = 2e6;
+    const sdrplay_api_DecimationT& decimation = d->device.tuner != sdrplay_api_Tuner_B ?
+                                                d->rx_channel_a.ctrlParams.decimation :
+                                                d->rx_channel_b.ctrlParams.decimation;
+    if (decimation.enable && decimation.decimationFactor > 1)
+        samplerate /= decimation.decimationFactor;
+    return samplerate;
+}
+
+// reports a change that is due at this callback, and clears it
+static int take_change(std::atomic<unsigned long>& due, unsigned long callback) {
+    unsigned long when = due;
+    if (when == 0 || callback < when)
+        return 0;
+    due.compare_exchange_strong(when, 0);
+    return 1;
+}
+
+static void schedule_change(std::atomic<unsigned long> (&due)[2], ShimDevice* d,
+                            sdrplay_api_TunerSelectT tuner) {
+    unsigned long when = d->callback_count + config.change_latency + 1;
+    if (!dual_tuner(d) || tuner != sdrplay_api_Tuner_B)
+        due[0] = when;
+    if (dual_tuner(d) && tuner != sdrplay_api_Tuner_A)
+        due[1] = when;
+}
+
+static void stream_loop(ShimDevice* d) {
+    size_t block_size = config.block_size;
+    int noutputs = dual_tuner(d) ? 2 : 1;
+    std::vector<short> xi[2];
+    std::vector<short> xq[2];
+    for (int output = 0; output < noutputs; output++) {
+        xi[output].resize(block_size);
+        xq[output].resize(block_size);
+    }
+    sdrplay_api_StreamCallback_t stream_callbacks[2] = { d->callbacks.StreamACbFn,
+                                                         d->callbacks.StreamBCbFn };
+    unsigned int sample_num = 0;
+    size_t table_index = 0;
+    double samplerate = d->samplerate;
+    long long start_ns = monotonic_ns();
+    double sent = 0;   // samples since start_ns
+
+    while (d->run) {
+        if (d->samplerate_changed.exchange(false)) {
+            samplerate = d->samplerate;
+            start_ns = monotonic_ns();
+            sent = 0;
+        }
+
+        // real time pacing; when the callbacks are too slow the samples that
+        // don't fit in the buffers of the device are lost
+        if (config.realtime) {
+            long long due_ns = start_ns + (long long) (sent * 1e9 / samplerate);
+            long long now_ns = monotonic_ns();
+            if (now_ns - due_ns > config.max_latency_ns) {
+                unsigned int lost = (now_ns - due_ns) * 1e-9 * samplerate;
+                sample_num += lost;
+                d->late_blocks++;
+                d->lost_samples += lost;
+                start_ns = now_ns;
+                sent = 0;
+            } else if (due_ns > now_ns) {
+                struct timespec request_time = { time_t(due_ns / 1000000000), long(due_ns % 1000000000) };
+                clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &request_time, nullptr);
+            }
+        }
+
+        unsigned long callback = ++d->callback_count;
+        unsigned int reset = d->reset_pending.exchange(false) ? 1 : 0;
+        if (config.reset_interval > 0 && callback % config.reset_interval == 0)
+            reset = 1;
+        if (config.gap_interval > 0 && callback % config.gap_interval == 0)
+            sample_num += config.gap_samples;
+        bool changed = config.changed_interval > 0 && callback % config.changed_interval == 0;
+
+        for (int output = 0; output < noutputs; output++) {
+            std::copy(table_i.begin() + table_index, table_i.begin() + table_index + block_size,
+                      xi[output].begin());
+            std::copy(table_q.begin() + table_index, table_q.begin() + table_index + block_size,
+                      xq[output].begin());
+        }
+
+        long long callback_start_ns = monotonic_ns();
+        for (int output = 0; output < noutputs; output++) {
+            sdrplay_api_StreamCbParamsT params;
+            params.firstSampleNum = sample_num;
+            params.grChanged = take_change(d->gr_changed_due[output], callback) || changed;
+            params.rfChanged = take_change(d->rf_changed_due[output], callback) || changed;
+            params.fsChanged = take_change(d->fs_changed_due[output], callback) || changed;
+            params.numSamples = block_size;
+            if (params.grChanged && d->callbacks.EventCbFn != nullptr) {
+                const sdrplay_api_RxChannelParamsT& rx = output == 0 && d->device.tuner != sdrplay_api_Tuner_B ?
+                                                         d->rx_channel_a : d->rx_channel_b;
+                sdrplay_api_EventParamsT event_params;
+                memset(&event_params, 0, sizeof(event_params));
+                event_params.gainParams.gRdB = rx.tunerParams.gain.gRdB;
+                event_params.gainParams.currGain = -rx.tunerParams.gain.gRdB;
+                d->callbacks.EventCbFn(sdrplay_api_GainChange,
+                                       output == 0 ? sdrplay_api_Tuner_A : sdrplay_api_Tuner_B,
+                                       &event_params, d->context);
+            }
+            stream_callbacks[output](xi[output].data(), xq[output].data(), &params,
+                                     block_size, reset, d->context);
+        }
+        long long elapsed_ns = monotonic_ns() - callback_start_ns;
+        d->callback_ns += elapsed_ns;
+        d->max_callback_ns = std::max(d->max_callback_ns, elapsed_ns);
+
+        sample_num += block_size;
+        sent += block_size;
+        d->total_samples += block_size;
+        table_index = (table_index + block_size) % TABLE_SIZE;
+    }
+}
+
+static void print_stats(const ShimDevice* d) {
+    double seconds = (d->stop_ns - d->start_ns) * 1e-9;
+    unsigned long callbacks = d->callback_count;
+    std::cerr << "sdrplay_api shim: " << callbacks << " callbacks, "
+              << d->total_samples << " samples in " << seconds << "s ("
+              << (seconds > 0 ? d->total_samples / seconds / 1e6 : 0) << " MS/s)";
+    if (callbacks > 0)
+        std::cerr << ", callback time avg " << d->callback_ns / callbacks / 1e3
+                  << "us max " << d->max_callback_ns / 1e3 << "us";
+    std::cerr << ", " << d->late_blocks << " late (" << d->lost_samples
+              << " samples lost)" << std::endl;
+}
+
+extern "C" {
+
+sdrplay_api_ErrT sdrplay_api_Open(void) {
+    std::lock_guard<std::mutex> lock(api_mutex);
+    if (open_count++ == 0) {
+        read_config();
+        fill_tables();
+        shim_device = new ShimDevice();
+        init_device(shim_device);
+    }
+    return sdrplay_api_Success;
+}
+
+sdrplay_api_ErrT sdrplay_api_Close(void) {
+    std::lock_guard<std::mutex> lock(api_mutex);
+    if (open_count == 0)
+        return sdrplay_api_NotInitialised;
+    if (--open_count == 0) {
+        delete shim_device;
+        shim_device = nullptr;
+    }
+    return sdrplay_api_Success;
+}
+
+sdrplay_api_ErrT sdrplay_api_ApiVersion(float *apiVer) {
+    *apiVer = SDRPLAY_API_VERSION;
+    return sdrplay_api_Success;
+}
+
+sdrplay_api_ErrT sdrplay_api_LockDeviceApi(void) {
+    device_api_mutex.lock();
+    return sdrplay_api_Success;
+}
+
+sdrplay_api_ErrT sdrplay_api_UnlockDeviceApi(void) {
+    device_api_mutex.unlock();
+    return sdrplay_api_Success;
+}
+
+sdrplay_api_ErrT sdrplay_api_GetDevices(sdrplay_api_DeviceT *devices, unsigned int *numDevs,
+                                        unsigned int maxDevs) {
+    std::lock_guard<std::mutex> lock(api_mutex);
+    if (shim_device == nullptr)
+        return sdrplay_api_NotInitialised;
+    *numDevs = 0;
+    if (!shim_device->selected && maxDevs > 0)
+        devices[(*numDevs)++] = shim_device->device;
+    return sdrplay_api_Success;
+}
+
+sdrplay_api_ErrT sdrplay_api_SelectDevice(sdrplay_api_DeviceT *device) {
+    std::lock_guard<std::mutex> lock(api_mutex);
+    ShimDevice* d = shim_device;
+    if (d == nullptr)
+        return sdrplay_api_NotInitialised;
+    if (d->selected || strcmp(device->SerNo, d->device.SerNo) != 0)
+        return sdrplay_api_Fail;
+    d->selected = true;
+    d->device.tuner = device->tuner;
+    d->device.rspDuoMode = device->rspDuoMode;
+    d->device.rspDuoSampleFreq = device->rspDuoSampleFreq;
+    device->dev = d;
+
+    memset(&d->dev_params, 0, sizeof(d->dev_params));
+    d->dev_params.fsFreq.fsHz = 2e6;
+    if (d->device.hwVer == SDRPLAY_RSPduo_ID &&
+        d->device.rspDuoMode != sdrplay_api_RspDuoMode_Single_Tuner)
+        d->dev_params.fsFreq.fsHz = d->device.rspDuoSampleFreq;
+    default_rx_channel_params(d->rx_channel_a);
+    default_rx_channel_params(d->rx_channel_b);
+    d->device_params.devParams = &d->dev_params;
+    d->device_params.rxChannelA = &d->rx_channel_a;
+    d->device_params.rxChannelB = d->device.hwVer == SDRPLAY_RSPduo_ID ? &d->rx_channel_b : nullptr;
+    return sdrplay_api_Success;
+}
+
+sdrplay_api_ErrT sdrplay_api_ReleaseDevice(sdrplay_api_DeviceT *device) {
+    std::lock_guard<std::mutex> lock(api_mutex);
+    ShimDevice* d = static_cast<ShimDevice*>(device->dev);
+    if (d == nullptr || d != shim_device || !d->selected)
+        return sdrplay_api_InvalidParam;
+    if (d->run)
+        return sdrplay_api_StopPending;
+    init_device(d);
+    return sdrplay_api_Success;
+}
+
+const char* sdrplay_api_GetErrorString(sdrplay_api_ErrT err) {
+    switch (err) {
+    case sdrplay_api_Success:          return "sdrplay_api_Success";
+    case sdrplay_api_Fail:             return "sdrplay_api_Fail";
+    case sdrplay_api_InvalidParam:     return "sdrplay_api_InvalidParam";
+    case sdrplay_api_NotInitialised:   return "sdrplay_api_NotInitialised";
+    case sdrplay_api_AlreadyInitialised: return "sdrplay_api_AlreadyInitialised";
+    case sdrplay_api_StopPending:      return "sdrplay_api_StopPending";
+    case sdrplay_api_InvalidMode:      return "sdrplay_api_InvalidMode";
+    default:                           return "sdrplay_api error (shim)";
+    }
+}
+
+sdrplay_api_ErrT sdrplay_api_DebugEnable(HANDLE dev, sdrplay_api_DbgLvl_t enable) {
+    return sdrplay_api_Success;
+}
+
+sdrplay_api_ErrT sdrplay_api_GetDeviceParams(HANDLE dev, sdrplay_api_DeviceParamsT **deviceParams) {
+    ShimDevice* d = static_cast<ShimDevice*>(dev);
+    if (d == nullptr || !d->selected)
+        return sdrplay_api_InvalidParam;
+    *deviceParams = &d->device_params;
+    return sdrplay_api_Success;
+}
+
+sdrplay_api_ErrT sdrplay_api_Init(HANDLE dev, sdrplay_api_CallbackFnsT *callbackFns, void *cbContext) {
+    ShimDevice* d = static_cast<ShimDevice*>(dev);
+    if (d == nullptr || !d->selected)
+        return sdrplay_api_InvalidParam;
+    if (d->run)
+        return sdrplay_api_AlreadyInitialised;
+    if (callbackFns->StreamACbFn == nullptr ||
+        (dual_tuner(d) && callbackFns->StreamBCbFn == nullptr))
+        return sdrplay_api_InvalidParam;
+    d->callbacks = *callbackFns;
+    d->context = cbContext;
+    d->samplerate = output_samplerate(d);
+    d->samplerate_changed = false;
+    d->reset_pending = false;
+    d->callback_count = 0;
+    d->total_samples = 0;
+    d->late_blocks = 0;
+    d->lost_samples = 0;
+    d->callback_ns = 0;
+    d->max_callback_ns = 0;
+    d->start_ns = monotonic_ns();
+    d->run = true;
+    d->thread = new std::thread( [d] () { stream_loop(d); });
+    return sdrplay_api_Success;
+}
+
+sdrplay_api_ErrT sdrplay_api_Uninit(HANDLE dev) {
+    ShimDevice* d = static_cast<ShimDevice*>(dev);
+    if (d == nullptr || !d->run)
+        return sdrplay_api_NotInitialised;
+    d->run = false;
+    if (d->thread != nullptr) {
+        d->thread->join();
+        delete d->thread;
+        d->thread = nullptr;
+    }
+    d->stop_ns = monotonic_ns();
+    print_stats(d);
+    return sdrplay_api_Success;
+}
+
+sdrplay_api_ErrT sdrplay_api_Update(HANDLE dev, sdrplay_api_TunerSelectT tuner,
+                                    sdrplay_api_ReasonForUpdateT reasonForUpdate,
+                                    sdrplay_api_ReasonForUpdateExtension1T reasonForUpdateExt1) {
+    ShimDevice* d = static_cast<ShimDevice*>(dev);
+    if (d == nullptr || !d->run)
+        return sdrplay_api_NotInitialised;
+    if (reasonForUpdate & (sdrplay_api_Update_Dev_Fs | sdrplay_api_Update_Ctrl_Decimation)) {
+        // the sample rate changes at once; the stream restarts with a reset
+        d->samplerate = output_samplerate(d);
+        d->samplerate_changed = true;
+        d->reset_pending = true;
+        schedule_change(d->fs_changed_due, d, sdrplay_api_Tuner_Both);
+    }
+    if (reasonForUpdate & sdrplay_api_Update_Tuner_Frf)
+        schedule_change(d->rf_changed_due, d, tuner);
+    if (reasonForUpdate & sdrplay_api_Update_Tuner_Gr)
+        schedule_change(d->gr_changed_due, d, tuner);
+    return sdrplay_api_Success;
+}
+
+sdrplay_api_ErrT sdrplay_api_SwapRspDuoActiveTuner(HANDLE dev, sdrplay_api_TunerSelectT *currentTuner,
+                                                   sdrplay_api_RspDuo_AmPortSelectT tuner1AmPortSel) {
+    ShimDevice* d = static_cast<ShimDevice*>(dev);
+    if (d == nullptr || d->device.hwVer != SDRPLAY_RSPduo_ID ||
+        d->device.rspDuoMode != sdrplay_api_RspDuoMode_Single_Tuner)
+        return sdrplay_api_InvalidMode;
+    d->device.tuner = d->device.tuner == sdrplay_api_Tuner_A ? sdrplay_api_Tuner_B :
+                                                               sdrplay_api_Tuner_A;
+    *currentTuner = d->device.tuner;
+    if (d->run) {
+        d->samplerate = output_samplerate(d);
+        d->samplerate_changed = true;
+        d->reset_pending = true;
+    }
+    return sdrplay_api_Success;
+}
+
+sdrplay_api_ErrT sdrplay_api_SwapRspDuoDualTunerModeSampleRate(HANDLE dev, double *currentSampleRate,
+                                                               double newSampleRate) {
+    ShimDevice* d = static_cast<ShimDevice*>(dev);
+    if (d == nullptr || !dual_tuner(d) || (newSampleRate != 6e6 && newSampleRate != 8e6))
+        return sdrplay_api_InvalidParam;
+    *currentSampleRate = d->device.rspDuoSampleFreq;
+    d->device.rspDuoSampleFreq = newSampleRate;
+    d->dev_params.fsFreq.fsHz = newSampleRate;
+    return sdrplay_api_Success;
+}
+
+sdrplay_api_ErrT sdrplay_api_SwapRspDuoMode(sdrplay_api_DeviceT *currDevice,
+                                            sdrplay_api_DeviceParamsT **deviceParams,
+                                            sdrplay_api_RspDuoModeT rspDuoMode, double sampleRate,
+                                            sdrplay_api_TunerSelectT tuner,
+                                            sdrplay_api_Bw_MHzT bwType, sdrplay_api_If_kHzT ifType,
+                                            sdrplay_api_RspDuo_AmPortSelectT tuner1AmPortSel) {
+    // not emulated
+    return sdrplay_api_InvalidMode;
+}
+
+}
@@ -0,0 +1,148 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "sdrplayapi.hpp"
+#include "sdrplaysource.hpp"
+
+#include <algorithm>
+#include <iostream>
+
+using namespace Csdrx;
+
+std::shared_ptr<SDRplayApi> SDRplayApi::getInstance() {
+    static std::mutex instance_mutex;
+    static std::weak_ptr<SDRplayApi> instance;
+
+    std::lock_guard<std::mutex> lock(instance_mutex);
+    auto api = instance.lock();
+    if (!api) {
+        api = std::shared_ptr<SDRplayApi>(new SDRplayApi());
+        instance = api;
+    }
+    return api;
+}
+
+SDRplayApi::SDRplayApi() {
+    auto err = sdrplay_api_Open();
+    if (err != sdrplay_api_Success)
+        throw SDRplayException("sdrplay_api_Open() failed");
+    err = sdrplay_api_ApiVersion(&version);
+    if (err != sdrplay_api_Success) {
+        sdrplay_api_Close();
+        throw SDRplayException("sdrplay_api_ApiVersion() failed");
+    }
+    if (version != SDRPLAY_API_VERSION) {
+        sdrplay_api_Close();
+        throw SDRplayException("SDRplay API version mismatch");
+    }
+}
+
+SDRplayApi::~SDRplayApi() {
+    auto err = sdrplay_api_Close();
+    if (err != sdrplay_api_Success)
+        std::cerr << "sdrplay_api_Close() failed" << std::endl;
+}
+
+std::vector<sdrplay_api_DeviceT> SDRplayApi::getDevices(bool refresh) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (refresh || !enumerated)
+        enumerate();
+    std::vector<sdrplay_api_DeviceT> available;
+    for (auto& device : devices) {
+        if (std::find(in_use.begin(), in_use.end(), device_key(device)) == in_use.end())
+            available.push_back(device);
+    }
+    return available;
+}
+
+bool SDRplayApi::selectDevice(sdrplay_api_DeviceT& device,
+                              const std::function<bool(sdrplay_api_DeviceT&)>& match) {
+    std::lock_guard<std::mutex> lock(mutex);
+    // the device API stays locked from the enumeration through the
+    // selection, so another process can't select the device in between
+    auto err = sdrplay_api_LockDeviceApi();
+    if (err != sdrplay_api_Success)
+        throw SDRplayException("sdrplay_api_LockDeviceApi() failed");
+    err = get_devices();
+    if (err != sdrplay_api_Success) {
+        sdrplay_api_UnlockDeviceApi();
+        throw SDRplayException("sdrplay_api_GetDevices() failed");
+    }
+    bool found = false;
+    for (auto& candidate : devices) {
+        if (std::find(in_use.begin(), in_use.end(), device_key(candidate)) != in_use.end())
+            continue;
+        if (match(candidate)) {
+            found = true;
+            break;
+        }
+    }
+    if (found)
+        err = sdrplay_api_SelectDevice(&device);
+    sdrplay_api_UnlockDeviceApi();
+    if (err != sdrplay_api_Success)
+        throw SDRplayException("sdrplay_api_SelectDevice() failed");
+    if (!found)
+        return false;
+    in_use.push_back(device_key(device));
+    // selecting an RSPduo as master makes its slave available
+    if (device.hwVer == SDRPLAY_RSPduo_ID)
+        enumerated = false;
+    return true;
+}
+
+void SDRplayApi::releaseDevice(sdrplay_api_DeviceT& device) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto err = sdrplay_api_ReleaseDevice(&device);
+    if (err != sdrplay_api_Success)
+        std::cerr << "sdrplay_api_ReleaseDevice() failed" << std::endl;
+    auto key = std::find(in_use.begin(), in_use.end(), device_key(device));
+    if (key != in_use.end())
+        in_use.erase(key);
+    if (device.hwVer == SDRPLAY_RSPduo_ID)
+        enumerated = false;
+}
+
+float SDRplayApi::getVersion() const {
+    return version;
+}
+
+// must be called with the mutex held
+void SDRplayApi::enumerate() {
+    auto err = sdrplay_api_LockDeviceApi();
+    if (err != sdrplay_api_Success)
+        throw SDRplayException("sdrplay_api_LockDeviceApi() failed");
+    err = get_devices();
+    sdrplay_api_UnlockDeviceApi();
+    if (err != sdrplay_api_Success)
+        throw SDRplayException("sdrplay_api_GetDevices() failed");
+}
+
+// must be called with the mutex held and the device API locked
+sdrplay_api_ErrT SDRplayApi::get_devices() {
+    unsigned int ndevices = SDRPLAY_MAX_DEVICES;
+    sdrplay_api_DeviceT api_devices[SDRPLAY_MAX_DEVICES];
+    auto err = sdrplay_api_GetDevices(api_devices, &ndevices, ndevices);
+    if (err != sdrplay_api_Success)
+        return err;
+    devices.clear();
+    for (unsigned int i = 0; i < ndevices; i++) {
+        if (api_devices[i].valid)
+            devices.push_back(api_devices[i]);
+    }
+    enumerated = true;
+    return err;
+}
+
+// the master and the slave of an RSPduo are different devices
+std::string SDRplayApi::device_key(const sdrplay_api_DeviceT& device) {
+    std::string key = device.SerNo;
+    if (device.hwVer == SDRPLAY_RSPduo_ID &&
+        device.rspDuoMode == sdrplay_api_RspDuoMode_Slave)
+        key += "/S";
+    return key;
+}
@@ -0,0 +1,53 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <sdrplay_api.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Csdrx {
+
+    // process-wide SDRplay API session: the API is opened when the first
+    // user gets the instance, and closed when the last one releases it.
+    // getDevices() caches the device list, selectDevice() always asks the
+    // API again; each device can be selected by only one user at a time
+    class SDRplayApi {
+        public:
+            static std::shared_ptr<SDRplayApi> getInstance();
+            ~SDRplayApi();
+            SDRplayApi(const SDRplayApi&) = delete;
+            SDRplayApi& operator=(const SDRplayApi&) = delete;
+            // devices that are not in use by this process; refresh -> ask
+            // the API again instead of using the cached list
+            std::vector<sdrplay_api_DeviceT> getDevices(bool refresh = false);
+            // asks the API for the devices, and selects 'device' after the
+            // first device not in use for which 'match' returns true ('match'
+            // sets 'device', for instance with the RSPduo mode); returns
+            // false if no device matched. The device API stays locked until
+            // the device is selected
+            bool selectDevice(sdrplay_api_DeviceT& device,
+                              const std::function<bool(sdrplay_api_DeviceT&)>& match);
+            void releaseDevice(sdrplay_api_DeviceT& device);
+            float getVersion() const;
+        private:
+            SDRplayApi();
+            void enumerate();
+            sdrplay_api_ErrT get_devices();
+            static std::string device_key(const sdrplay_api_DeviceT& device);
+
+            std::mutex mutex;
+            float version;
+            bool enumerated = false;
+            std::vector<sdrplay_api_DeviceT> devices;
+            std::vector<std::string> in_use;
+    };
+}
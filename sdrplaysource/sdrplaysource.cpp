@@ -7,37 +7,27 @@
 
 #include "sdrplaysource.hpp"
 
+#include <csdrx/kernels.hpp>
+#include <algorithm>
+#include <chrono>
 #include <cstring>
 #include <iostream>
+#include <time.h>
 
 using namespace Csdrx;
 
 template<typename T>
 SDRplaySource<T>::~SDRplaySource() {
-    if (device_selected) {
-        auto err = sdrplay_api_ReleaseDevice(&device);
-        if (err != sdrplay_api_Success)
-            std::cerr << "sdrplay_api_ReleaseDevice() failed" << std::endl;
-    }
-    auto err = sdrplay_api_Close();
-    if (err != sdrplay_api_Success)
-        std::cerr << "sdrplay_api_Close() failed" << std::endl;
-}
-
-static void open_sdrplay_api() {
-    auto err = sdrplay_api_Open();
-    if (err != sdrplay_api_Success)
-        throw SDRplayException("sdrplay_api_Open() failed");
-    float ver;
-    err = sdrplay_api_ApiVersion(&ver);
-    if (err != sdrplay_api_Success) {
-        sdrplay_api_Close();
-        throw SDRplayException("sdrplay_api_ApiVersion() failed");
-    }
-    if (ver != SDRPLAY_API_VERSION) {
-        sdrplay_api_Close();
-        throw SDRplayException("SDRplay API version mismatch");
-    }
+    control.stop();
+    stopScan();
+    release_device();
+    stop_pump(0);
+    stop_pump(1);
+    delete outputs[0].staging;
+    delete outputs[1].staging;
+    delete outputs[0].tags;
+    delete outputs[1].tags;
+    delete tuner_b;
 }
 
 template <typename T>
@@ -46,67 +36,53 @@ SDRplaySource<T>::SDRplaySource(const char* serial,
                                 double frequency,
                                 const char* antenna,
                                 int loglevel):
+    api(SDRplayApi::getInstance()),
     loglevel(loglevel)
 {
-    open_sdrplay_api();
-    select_device(serial, antenna);
-    setSamplerate(samplerate);
-    setBandwidth(samplerate);
-    setFrequency(frequency);
-    setAntenna(antenna);
+    try {
+        select_device(serial, antenna);
+        if (dual_tuner)
+            tuner_b = new SDRplayTunerBSource<T>(this);
+        setSamplerate(samplerate);
+        setBandwidth(samplerate);
+        setFrequency(frequency);
+        setAntenna(antenna);
+    } catch (...) {
+        // the destructor won't run, so give the device back now
+        release_device();
+        delete tuner_b;
+        throw;
+    }
 }
 
 template <typename T>
 void SDRplaySource<T>::select_device(const char* serial,
                                      const char* antenna)
 {
-    auto err = sdrplay_api_LockDeviceApi();
-    if (err != sdrplay_api_Success)
-        throw SDRplayException("sdrplay_api_LockDeviceApi() failed");
-
-    unsigned int ndevices = SDRPLAY_MAX_DEVICES;
-    sdrplay_api_DeviceT devices[SDRPLAY_MAX_DEVICES];
-    err = sdrplay_api_GetDevices(devices, &ndevices, ndevices);
-    if (err != sdrplay_api_Success)
-        throw SDRplayException("sdrplay_api_GetDevices() failed");
-
-    bool found = false;
-    for (int i = 0; i < ndevices; i++) {
-        if (!devices[i].valid) {
-            continue;
-        }
-        if (devices[i].hwVer == SDRPLAY_RSPduo_ID) {
-            if (select_device_rspduo(devices[i], serial, antenna)) {
-                found = true;
-                break;
-            }
-        } else {
-            if (serial == nullptr || strlen(serial) == 0 ||
-                strcmp(devices[i].SerNo, serial) == 0) {
-                found = true;
-                device = devices[i];
-                break;
-            }
+    // select the device and get its parameters
+    bool found = api->selectDevice(device, [this, serial, antenna] (sdrplay_api_DeviceT& candidate) {
+        if (candidate.hwVer == SDRPLAY_RSPduo_ID)
+            return select_device_rspduo(candidate, serial, antenna);
+        if (serial == nullptr || strlen(serial) == 0 ||
+            strcmp(candidate.SerNo, serial) == 0) {
+            device = candidate;
+            return true;
         }
-    }
-
+        return false;
+    });
     if (!found)
         throw SDRplayException("SDRplay device not found");
-
-    // select the device and get its parameters
-    err = sdrplay_api_SelectDevice(&device);
-    if (err != sdrplay_api_Success)
-        throw SDRplayException("sdrplay_api_SelectDevice() failed");
     device_selected = true;
-    err = sdrplay_api_UnlockDeviceApi();
-    if (err != sdrplay_api_Success)
-        throw SDRplayException("sdrplay_api_UnlockDeviceApi() failed");
-    err = sdrplay_api_GetDeviceParams(device.dev, &device_params);
+    auto err = sdrplay_api_GetDeviceParams(device.dev, &device_params);
     if (err != sdrplay_api_Success)
         throw SDRplayException("sdrplay_api_GetDeviceParams() failed");
     rx_channel_params = device.tuner != sdrplay_api_Tuner_B ?
                                         device_params->rxChannelA :
                                         device_params->rxChannelB;
+    // in dual tuner mode the settings apply to Tuner A, unless they are
+    // changed through getTunerB()
+    if (dual_tuner)
+        device.tuner = sdrplay_api_Tuner_A;
     samplerate = device_params->devParams->fsFreq.fsHz;
     if (device.hwVer == SDRPLAY_RSPduo_ID &&
         device.rspDuoMode != sdrplay_api_RspDuoMode_Single_Tuner)
@@ -117,12 +93,34 @@ void SDRplaySource<T>::select_device(const char* serial,
     return;
 }
 
+template <typename T>
+void SDRplaySource<T>::release_device()
+{
+    if (!device_selected)
+        return;
+    if (dual_tuner)
+        device.tuner = sdrplay_api_Tuner_Both;
+    api->releaseDevice(device);
+    device_selected = false;
+}
+
 template <typename T>
 bool SDRplaySource<T>::select_device_rspduo(sdrplay_api_DeviceT& device_rspduo,
                                             const char* serial,
                                             const char* antenna) {
     bool found = false;
-    if (device_rspduo.rspDuoMode & sdrplay_api_RspDuoMode_Single_Tuner) {
+    size_t serial_len = strlen(device_rspduo.SerNo);
+    if ((device_rspduo.rspDuoMode & sdrplay_api_RspDuoMode_Dual_Tuner) &&
+        serial != nullptr && strncmp(device_rspduo.SerNo, serial, serial_len) == 0 &&
+        (strcmp("/D", serial + serial_len) == 0 || strcmp("/D8", serial + serial_len) == 0)) {
+        found = true;
+        device = device_rspduo;
+        device.rspDuoMode = sdrplay_api_RspDuoMode_Dual_Tuner;
+        device.rspDuoSampleFreq = strcmp("/D8", serial + serial_len) == 0 ? 8e6 : 6e6;
+        device.tuner = sdrplay_api_Tuner_Both;
+        dual_tuner = true;
+        return found;
+    } else if (device_rspduo.rspDuoMode & sdrplay_api_RspDuoMode_Single_Tuner) {
         if (serial == nullptr || strlen(serial) == 0 ||
             strcmp(device_rspduo.SerNo, serial) == 0) {
             found = true;
@@ -162,74 +160,157 @@ bool SDRplaySource<T>::select_device_rspduo(sdrplay_api_DeviceT& device_rspduo,
     return found;
 }
 
-static constexpr int MAX_WRITE_TRIES = 3;
-
-template<>
-void SDRplaySource<Csdr::complex<float>>::stream_callback(short *xi, short *xq,
-                  sdrplay_api_StreamCbParamsT *params, unsigned int numSamples,
-                  unsigned int reset) {
-    if (!run)
-        return;
-
-    int xidx = 0;
-    for (int i = 0; i < MAX_WRITE_TRIES; i++) {
-        int samples = std::min((int) writer->writeable(), (int) numSamples - xidx);
-        auto writer_pointer = writer->getWritePointer();
-        for (int k = 0; k < samples; k++, xidx++) {
-            writer_pointer[k].real(static_cast<float>(xi[xidx]) / 32768.0f);
-            writer_pointer[k].imag(static_cast<float>(xq[xidx]) / 32768.0f);
-        }
-        writer->advance(samples);
-        total_samples += samples;
-        if (xidx == numSamples)
-            return;
-    }
-
-    std::cerr << "stream_callback() - dropped " << (numSamples - xidx) << " samples" << std::endl;
-
-    return;
+static inline void convert_planar(const short* xi, const short* xq,
+                                  Csdr::complex<float>* out, size_t n) {
+    convert_planar_s16_to_cf32(xi, xq, out, n);
 }
 
-static void unqualified_stream_callback_fc32(short *xi, short *xq,
-                                             sdrplay_api_StreamCbParamsT *params,
-                                             unsigned int numSamples,
-                                             unsigned int reset, void *cbContext) {
-    auto sdrplay_source = static_cast<SDRplaySource<Csdr::complex<float>> *>(cbContext);
-    sdrplay_source->stream_callback(xi, xq, params, numSamples, reset);
-    return;
+static inline void convert_planar(const short* xi, const short* xq,
+                                  Csdr::complex<short>* out, size_t n) {
+    convert_planar_s16_to_cs16(xi, xq, out, n);
 }
 
-template<>
-void SDRplaySource<Csdr::complex<short>>::stream_callback(short *xi, short *xq,
+// runs on the SDRplay API thread: it only converts the samples into the
+// staging buffer and never waits for the pipeline
+template <typename T>
+void SDRplaySource<T>::stream_callback(short *xi, short *xq,
                   sdrplay_api_StreamCbParamsT *params, unsigned int numSamples,
-                  unsigned int reset) {
+                  unsigned int reset, int output) {
     if (!run)
         return;
 
-    int xidx = 0;
-    for (int i = 0; i < MAX_WRITE_TRIES; i++) {
-        int samples = std::min((int) writer->writeable(), (int) numSamples - xidx);
-        auto writer_pointer = writer->getWritePointer();
-        for (int k = 0; k < samples; k++, xidx++) {
-            writer_pointer[k].real(xi[xidx]);
-            writer_pointer[k].imag(xq[xidx]);
+    Output& out = outputs[output];
+    out.total_samples.fetch_add(numSamples, std::memory_order_relaxed);
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long timeNs = now.tv_sec * 1000000000LL + now.tv_nsec;
+
+    // continuity of the hardware sample numbers
+    if (reset) {
+        out.sample_num_valid = false;
+        queue_tag(out, TagType::Reset, out.output_samples, timeNs, 0);
+    }
+    if (out.sample_num_valid && params->firstSampleNum != out.next_sample_num &&
+        params->firstSampleNum - out.next_sample_num < 0x80000000u) {
+        // (a jump backwards means the counter was restarted, not a gap)
+        unsigned int lost = params->firstSampleNum - out.next_sample_num;
+        out.gaps.fetch_add(1, std::memory_order_relaxed);
+        out.lost_samples.fetch_add(lost, std::memory_order_relaxed);
+        queue_tag(out, TagType::Gap, out.output_samples, timeNs, lost);
+    }
+    out.next_sample_num = params->firstSampleNum + numSamples;
+    out.sample_num_valid = true;
+    if (timeNs >= out.next_timestamp_ns) {
+        queue_tag(out, TagType::Timestamp, out.output_samples, timeNs,
+                  params->firstSampleNum);
+        out.next_timestamp_ns = timeNs + timestamp_interval_ns;
+    }
+    if (signal_stats)
+        out.stats.measure(xi, xq, numSamples, timeNs);
+
+    // retunes and scanner; only the samples in [first, last) are kept
+    size_t first = 0;
+    size_t last = numSamples;
+    if (params->rfChanged) {
+        if (scan_phase == ScanPhase::Retuning) {
+            hops.fetch_add(1, std::memory_order_relaxed);
+            settle_time_ns.fetch_add(timeNs - retune_time_ns, std::memory_order_relaxed);
+            settle_remaining = scan_settle_samples;
+            scan_phase = ScanPhase::Settling;
+        } else {
+            queue_tag(out, TagType::Retune, out.output_samples, timeNs,
+                      out.frequency);
+        }
+    }
+    ScanPhase phase = scan_phase;
+    if (phase != ScanPhase::Idle) {
+        if (phase == ScanPhase::Retuning)
+            first = numSamples;
+        if (phase == ScanPhase::Settling) {
+            first = std::min(settle_remaining.load(), (size_t) numSamples);
+            settle_remaining -= first;
+            if (settle_remaining == 0) {
+                queue_tag(out, TagType::Retune, out.output_samples, timeNs,
+                          out.frequency);
+                phase = ScanPhase::Dwelling;
+                scan_phase = phase;
+            }
+        }
+        if (phase == ScanPhase::Dwelling) {
+            size_t dwell = std::min(dwell_remaining.load(), (size_t) numSamples - first);
+            dwell_remaining -= dwell;
+            last = first + dwell;
+            if (dwell_remaining == 0) {
+                // discard everything until the next frequency has settled
+                scan_phase = ScanPhase::Retuning;
+                hop_due = true;
+                scan_cv.notify_one();
+            }
+        }
+        settle_discarded.fetch_add(numSamples - (last - first), std::memory_order_relaxed);
+    }
+
+    // both stream callbacks run on the same API thread; the first one for
+    // each block decides whether the block fits in both staging buffers
+    if (dual_tuner) {
+        if (!block_pending || params->firstSampleNum != pending_block) {
+            block_pending = true;
+            pending_block = params->firstSampleNum;
+            drop_pending_block = outputs[0].staging->freeSpace() < numSamples ||
+                                 outputs[1].staging->freeSpace() < numSamples;
+        } else {
+            block_pending = false;
         }
-        writer->advance(samples);
-        if (xidx == numSamples)
+        if (drop_pending_block) {
+            out.dropped_samples.fetch_add(numSamples, std::memory_order_relaxed);
+            queue_tag(out, TagType::Gap, out.output_samples, timeNs, numSamples);
             return;
+        }
     }
 
-    std::cerr << "stream_callback() - dropped " << (numSamples - xidx) << " samples" << std::endl;
+    // two writes at most, when the staging buffer wraps around
+    StagingBuffer<T>* staging = out.staging;
+    size_t xidx = first;
+    for (int i = 0; i < 2 && xidx < last; i++) {
+        size_t samples = std::min(staging->writeable(), last - xidx);
+        if (samples == 0)
+            break;
+        convert_planar(xi + xidx, xq + xidx, staging->getWritePointer(), samples);
+        staging->advanceWrite(samples);
+        xidx += samples;
+    }
+    out.output_samples += xidx - first;
+    if (xidx < last) {
+        out.dropped_samples.fetch_add(last - xidx, std::memory_order_relaxed);
+        queue_tag(out, TagType::Gap, out.output_samples, timeNs, last - xidx);
+    }
 
+    out.pump_cv.notify_one();
     return;
 }
 
-static void unqualified_stream_callback_sc16(short *xi, short *xq,
-                                             sdrplay_api_StreamCbParamsT *params,
-                                             unsigned int numSamples,
-                                             unsigned int reset, void *cbContext) {
-    auto sdrplay_source = static_cast<SDRplaySource<Csdr::complex<short>> *>(cbContext);
-    sdrplay_source->stream_callback(xi, xq, params, numSamples, reset);
+// tags are queued without blocking too; if the queue is full they are lost
+template <typename T>
+void SDRplaySource<T>::queue_tag(Output& out, TagType type, size_t sample,
+                                 long long timeNs, double value) {
+    if (out.tags->writeable() == 0)
+        return;
+    Tag* tag = out.tags->getWritePointer();
+    tag->type = type;
+    tag->sample = sample;
+    tag->timeNs = timeNs;
+    tag->value = value;
+    out.tags->advanceWrite(1);
+}
+
+template <typename T, int output>
+static void unqualified_stream_callback(short *xi, short *xq,
+                                        sdrplay_api_StreamCbParamsT *params,
+                                        unsigned int numSamples,
+                                        unsigned int reset, void *cbContext) {
+    auto sdrplay_source = static_cast<SDRplaySource<T> *>(cbContext);
+    sdrplay_source->stream_callback(xi, xq, params, numSamples, reset, output);
     return;
 }
 
@@ -240,42 +321,171 @@ static void event_callback(sdrplay_api_EventT eventId,
     return;
 }
 
-template<>
-sdrplay_api_StreamCallback_t SDRplaySource<Csdr::complex<float>>::get_unqualified_stream_callback() const {
-    return unqualified_stream_callback_fc32;
+template <typename T>
+sdrplay_api_StreamCallback_t SDRplaySource<T>::get_unqualified_stream_callback(int output) const {
+    return output == 0 ? unqualified_stream_callback<T, 0> :
+                         unqualified_stream_callback<T, 1>;
 }
 
-template<>
-sdrplay_api_StreamCallback_t SDRplaySource<Csdr::complex<short>>::get_unqualified_stream_callback() const {
-    return unqualified_stream_callback_sc16;
-}
+static constexpr size_t TAG_QUEUE_SIZE = 4096;
 
 template <typename T>
 void SDRplaySource<T>::setWriter(Csdr::Writer<T> *writer) {
     Csdr::Source<T>::setWriter(writer);
+    {
+        std::lock_guard<std::mutex> lock(outputs[0].writer_mutex);
+        outputs[0].writer = writer;
+    }
+    size_t staging_size = std::max((size_t) (staging_time * samplerate), (size_t) 65536);
+    int noutputs = dual_tuner ? 2 : 1;
+    for (int output = 0; output < noutputs; output++) {
+        Output& out = outputs[output];
+        if (out.staging == nullptr || out.staging->getSize() != staging_size) {
+            delete out.staging;
+            out.staging = new StagingBuffer<T>(staging_size);
+        }
+        if (out.tags == nullptr)
+            out.tags = new StagingBuffer<Tag>(TAG_QUEUE_SIZE);
+        out.total_samples = 0;
+        out.dropped_samples = 0;
+        out.gaps = 0;
+        out.lost_samples = 0;
+        out.output_samples = 0;
+        out.sample_num_valid = false;
+        out.next_timestamp_ns = 0;
+        start_pump(output);
+    }
+    {
+        std::lock_guard<std::mutex> lock(device_mutex);
+        outputs[0].frequency = dual_tuner ? device_params->rxChannelA->tunerParams.rfFreq.rfHz :
+                                            rx_channel_params->tunerParams.rfFreq.rfHz;
+        if (dual_tuner)
+            outputs[1].frequency = device_params->rxChannelB->tunerParams.rfFreq.rfHz;
+    }
+    block_pending = false;
     sdrplay_api_CallbackFnsT callbackFns = {
-        get_unqualified_stream_callback(),
-        nullptr,
+        get_unqualified_stream_callback(0),
+        dual_tuner ? get_unqualified_stream_callback(1) : nullptr,
         event_callback,
     };
     //show_device_config();
+    run = true;
     auto err = sdrplay_api_Init(device.dev, &callbackFns, this);
-    if (err != sdrplay_api_Success)
+    if (err != sdrplay_api_Success) {
+        run = false;
+        stop_pump(0);
+        stop_pump(1);
         throw SDRplayException("sdrplay_api_Init() failed");
-    total_samples = 0;
-    run = true;
+    }
 }
 
 template <typename T>
 void SDRplaySource<T>::stop() {
+    stopScan();
     if (run) {
         auto err = sdrplay_api_Uninit(device.dev);
         if (err != sdrplay_api_Success)
             throw SDRplayException("sdrplay_api_Uninit() failed");
     }
     run = false;
-    if (loglevel >= 1)
-        std::cerr << "total_samples: " << total_samples << std::endl;
+    stop_pump(0);
+    stop_pump(1);
+    if (loglevel >= 1) {
+        std::cerr << "total_samples: " << outputs[0].total_samples << std::endl;
+        std::cerr << "dropped_samples: " << outputs[0].dropped_samples << std::endl;
+        std::cerr << "gaps: " << outputs[0].gaps << " (lost_samples: " << outputs[0].lost_samples << ")" << std::endl;
+        if (dual_tuner) {
+            std::cerr << "tuner B total_samples: " << outputs[1].total_samples << std::endl;
+            std::cerr << "tuner B dropped_samples: " << outputs[1].dropped_samples << std::endl;
+            std::cerr << "tuner B gaps: " << outputs[1].gaps << " (lost_samples: " << outputs[1].lost_samples << ")" << std::endl;
+        }
+    }
+}
+
+// the pump threads move the samples from the staging buffers to the pipelines
+template <typename T>
+void SDRplaySource<T>::start_pump(int output) {
+    stop_pump(output);
+    Output& out = outputs[output];
+    out.pumping = true;
+    out.pump_thread = new std::thread( [this, output] () { pump(output); });
+}
+
+template <typename T>
+void SDRplaySource<T>::stop_pump(int output) {
+    Output& out = outputs[output];
+    if (out.pump_thread == nullptr)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(out.pump_mutex);
+        out.pumping = false;
+    }
+    out.pump_cv.notify_one();
+    out.pump_thread->join();
+    delete out.pump_thread;
+    out.pump_thread = nullptr;
+}
+
+template <typename T>
+void SDRplaySource<T>::pump(int output) {
+    Output& out = outputs[output];
+    StagingBuffer<T>* staging = out.staging;
+    TagEmitter* emitter = output == 0 ? static_cast<TagEmitter*>(this) :
+                                        static_cast<TagEmitter*>(tuner_b);
+    const char* tuner_name = !dual_tuner ? "" : (output == 0 ? " (tuner A)" : " (tuner B)");
+    size_t reported_drops = 0;
+    size_t reported_lost = 0;
+    size_t pumped = 0;
+    while (out.pumping) {
+        size_t dropped = out.dropped_samples.load(std::memory_order_relaxed);
+        if (dropped != reported_drops) {
+            std::cerr << "SDRplaySource: staging buffer full - dropped " << (dropped - reported_drops) << " samples" << tuner_name << std::endl;
+            reported_drops = dropped;
+        }
+        size_t lost = out.lost_samples.load(std::memory_order_relaxed);
+        if (lost != reported_lost) {
+            std::cerr << "SDRplaySource: gap in the sample numbers - lost " << (lost - reported_lost) << " samples" << tuner_name << std::endl;
+            reported_lost = lost;
+        }
+        // tags are emitted once the sample they refer to has been delivered
+        while (out.tags->available() > 0 && out.tags->getReadPointer()->sample < pumped) {
+            emitter->emitTag(*out.tags->getReadPointer());
+            out.tags->advanceRead(1);
+        }
+        size_t available = staging->available();
+        if (available == 0) {
+            // the callback doesn't take the lock when it notifies, so a
+            // wakeup can be missed; the timeout bounds the extra latency
+            std::unique_lock<std::mutex> lock(out.pump_mutex);
+            if (out.pumping)
+                out.pump_cv.wait_for(lock, std::chrono::milliseconds(10));
+            continue;
+        }
+        size_t samples;
+        {
+            std::lock_guard<std::mutex> lock(out.writer_mutex);
+            Csdr::Writer<T>* writer = out.writer;
+            if (writer == nullptr) {
+                // nobody is reading this output (yet); discard the samples,
+                // so they don't cause drops on the other output
+                staging->advanceRead(available);
+                pumped += available;
+                continue;
+            }
+            samples = std::min(available, writer->writeable());
+            if (samples > 0) {
+                memcpy(writer->getWritePointer(), staging->getReadPointer(),
+                       samples * sizeof(T));
+                writer->advance(samples);
+                staging->advanceRead(samples);
+                pumped += samples;
+            }
+        }
+        if (samples == 0) {
+            // the pipeline is behind; the staging buffer absorbs the backlog
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
 }
 
 template <typename T>
@@ -283,10 +493,129 @@ bool SDRplaySource<T>::isRunning() const {
     return run;
 }
 
+template <typename T>
+bool SDRplaySource<T>::isDualTuner() const {
+    return dual_tuner;
+}
+
+template <typename T>
+SDRplayTunerBSource<T>* SDRplaySource<T>::getTunerB() {
+    return tuner_b;
+}
+
+// scanner
+template <typename T>
+void SDRplaySource<T>::startScan(const std::vector<double>& frequencies,
+                                 const std::vector<double>& dwell_times,
+                                 double settle) {
+    if (dual_tuner)
+        throw SDRplayException("scanning is not available in dual tuner mode");
+    if (frequencies.empty() || (dwell_times.size() != 1 &&
+                                dwell_times.size() != frequencies.size()))
+        throw SDRplayException("invalid scan frequencies or dwell times");
+    for (auto dwell_time : dwell_times) {
+        if (dwell_time <= 0)
+            throw SDRplayException("invalid scan dwell time");
+    }
+    if (settle < 0)
+        throw SDRplayException("invalid scan settle time");
+    stopScan();
+
+    scan_frequencies = frequencies;
+    scan_dwell_samples.clear();
+    for (auto dwell_time : dwell_times)
+        scan_dwell_samples.push_back(std::max((size_t) (dwell_time * samplerate), (size_t) 1));
+    scan_settle_samples = settle * samplerate;
+    hops = 0;
+    settle_time_ns = 0;
+    settle_discarded = 0;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    scan_start_ns = now.tv_sec * 1000000000LL + now.tv_nsec;
+    scanning = true;
+    scan_thread = new std::thread( [this] () { scan_loop(); });
+}
+
+template <typename T>
+void SDRplaySource<T>::stopScan() {
+    if (scan_thread == nullptr)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(scan_mutex);
+        scanning = false;
+    }
+    scan_cv.notify_one();
+    scan_thread->join();
+    delete scan_thread;
+    scan_thread = nullptr;
+    scan_phase = ScanPhase::Idle;
+}
+
+template <typename T>
+bool SDRplaySource<T>::isScanning() const {
+    return scanning;
+}
+
+// if the tuner doesn't report the retune within this time, the samples
+// are kept anyway (the scanner must not stall)
+static constexpr long long RETUNE_TIMEOUT_NS = 500000000LL;
+
+// control thread: the stream callback counts the dwell time in samples, and
+// wakes up this thread when it is time to move to the next frequency
+template <typename T>
+void SDRplaySource<T>::scan_loop() {
+    size_t index = 0;
+    while (scanning) {
+        double frequency = scan_frequencies[index];
+        dwell_remaining = scan_dwell_samples[scan_dwell_samples.size() == 1 ? 0 : index];
+        hop_due = false;
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        retune_time_ns = now.tv_sec * 1000000000LL + now.tv_nsec;
+        bool retune;
+        {
+            std::lock_guard<std::mutex> device_lock(device_mutex);
+            retune = frequency != rx_channel_params->tunerParams.rfFreq.rfHz;
+            if (retune) {
+                scan_phase = ScanPhase::Retuning;
+                rx_channel_params->tunerParams.rfFreq.rfHz = frequency;
+                outputs[0].frequency = frequency;
+                if (run) {
+                    auto err = sdrplay_api_Update(device.dev, device.tuner,
+                                                  sdrplay_api_Update_Tuner_Frf,
+                                                  sdrplay_api_Update_Ext1_None);
+                    if (err != sdrplay_api_Success)
+                        std::cerr << "SDRplaySource: sdrplay_api_Update(Tuner_Frf) failed" << std::endl;
+                }
+            }
+        }
+        if (!retune) {
+            // no retune (for instance a single frequency scan)
+            settle_remaining = 0;
+            scan_phase = ScanPhase::Settling;
+        }
+
+        std::unique_lock<std::mutex> lock(scan_mutex);
+        while (scanning && !hop_due) {
+            scan_cv.wait_for(lock, std::chrono::milliseconds(10));
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            long long elapsed = now.tv_sec * 1000000000LL + now.tv_nsec - retune_time_ns;
+            if (scan_phase == ScanPhase::Retuning && !hop_due &&
+                elapsed > RETUNE_TIMEOUT_NS) {
+                std::cerr << "SDRplaySource: no rfChanged after retuning to " << frequency << "Hz" << std::endl;
+                settle_remaining = scan_settle_samples;
+                scan_phase = ScanPhase::Settling;
+            }
+        }
+        index = (index + 1) % scan_frequencies.size();
+    }
+}
+
 // setters
 template <typename T>
 void SDRplaySource<T>::setSamplerate(double samplerate)
 {
+    std::lock_guard<std::mutex> lock(device_mutex);
     double fsHz = samplerate;
     unsigned char decimationFactor = 1;
     while (fsHz < 2e6 && decimationFactor <= 32) {
@@ -301,17 +630,23 @@ void SDRplaySource<T>::setSamplerate(double samplerate)
         device_params->devParams->fsFreq.fsHz = fsHz;
         reason = (sdrplay_api_ReasonForUpdateT)(reason | sdrplay_api_Update_Dev_Fs);
     }
-    sdrplay_api_DecimationT *decimation_params = &rx_channel_params->ctrlParams.decimation;
-    if (decimationFactor != decimation_params->decimationFactor) {
-        decimation_params->decimationFactor = decimationFactor;
-        decimation_params->enable = decimationFactor > 1;
-        reason = (sdrplay_api_ReasonForUpdateT)(reason | sdrplay_api_Update_Ctrl_Decimation);
-    }
-    if (run && reason != sdrplay_api_Update_None) {
-        auto err = sdrplay_api_Update(device.dev, device.tuner, reason,
-                                      sdrplay_api_Update_Ext1_None);
-        if (err != sdrplay_api_Success)
-            throw SDRplayException("sdrplay_api_Update(Dev_Fs|Ctrl_Decimation) failed");
+    // in dual tuner mode both tuners have the same decimation
+    sdrplay_api_TunerSelectT tuners[] = { device.tuner, sdrplay_api_Tuner_B };
+    sdrplay_api_RxChannelParamsT* params[] = { rx_channel_params, device_params->rxChannelB };
+    for (int i = 0; i < (dual_tuner ? 2 : 1); i++) {
+        sdrplay_api_DecimationT *decimation_params = &params[i]->ctrlParams.decimation;
+        if (decimationFactor != decimation_params->decimationFactor) {
+            decimation_params->decimationFactor = decimationFactor;
+            decimation_params->enable = decimationFactor > 1;
+            reason = (sdrplay_api_ReasonForUpdateT)(reason | sdrplay_api_Update_Ctrl_Decimation);
+        }
+        if (run && reason != sdrplay_api_Update_None) {
+            auto err = sdrplay_api_Update(device.dev, tuners[i], reason,
+                                          sdrplay_api_Update_Ext1_None);
+            if (err != sdrplay_api_Success)
+                throw SDRplayException("sdrplay_api_Update(Dev_Fs|Ctrl_Decimation) failed");
+        }
+        reason = sdrplay_api_Update_None;
     }
 
     this->samplerate = samplerate;
@@ -322,6 +657,7 @@ void SDRplaySource<T>::setSamplerate(double samplerate)
 template <typename T>
 void SDRplaySource<T>::setBandwidth(double samplerate)
 {
+    std::lock_guard<std::mutex> lock(device_mutex);
     sdrplay_api_Bw_MHzT bwType = sdrplay_api_BW_Undefined;
     if      (samplerate <  300e3) { bwType = sdrplay_api_BW_0_200; }
     else if (samplerate <  600e3) { bwType = sdrplay_api_BW_0_300; }
@@ -331,14 +667,19 @@ void SDRplaySource<T>::setBandwidth(double samplerate)
     else if (samplerate < 7000e3) { bwType = sdrplay_api_BW_6_000; }
     else if (samplerate < 8000e3) { bwType = sdrplay_api_BW_7_000; }
     else                          { bwType = sdrplay_api_BW_8_000; }
-    if (bwType != rx_channel_params->tunerParams.bwType) {
-        rx_channel_params->tunerParams.bwType = bwType;
-        if (run) {
-            auto err = sdrplay_api_Update(device.dev, device.tuner,
-                                          sdrplay_api_Update_Tuner_BwType,
-                                          sdrplay_api_Update_Ext1_None);
-            if (err != sdrplay_api_Success)
-                throw SDRplayException("sdrplay_api_Update(Tuner_BwType) failed");
+    // in dual tuner mode both tuners have the same bandwidth
+    sdrplay_api_TunerSelectT tuners[] = { device.tuner, sdrplay_api_Tuner_B };
+    sdrplay_api_RxChannelParamsT* params[] = { rx_channel_params, device_params->rxChannelB };
+    for (int i = 0; i < (dual_tuner ? 2 : 1); i++) {
+        if (bwType != params[i]->tunerParams.bwType) {
+            params[i]->tunerParams.bwType = bwType;
+            if (run) {
+                auto err = sdrplay_api_Update(device.dev, tuners[i],
+                                              sdrplay_api_Update_Tuner_BwType,
+                                              sdrplay_api_Update_Ext1_None);
+                if (err != sdrplay_api_Success)
+                    throw SDRplayException("sdrplay_api_Update(Tuner_BwType) failed");
+            }
         }
     }
 
@@ -347,16 +688,26 @@ void SDRplaySource<T>::setBandwidth(double samplerate)
 
 template <typename T>
 void SDRplaySource<T>::setFrequency(double frequency)
+{
+    std::lock_guard<std::mutex> lock(device_mutex);
+    set_frequency(device.tuner, rx_channel_params, frequency);
+}
+
+template <typename T>
+void SDRplaySource<T>::set_frequency(sdrplay_api_TunerSelectT tuner,
+                                     sdrplay_api_RxChannelParamsT* params,
+                                     double frequency)
 {
     constexpr double SDRPLAY_FREQ_MIN = 1e3;
     constexpr double SDRPLAY_FREQ_MAX = 2000e6;
 
     if (frequency < SDRPLAY_FREQ_MIN || frequency > SDRPLAY_FREQ_MAX)
         throw SDRplayException("invalid frequency");
-    if (frequency != rx_channel_params->tunerParams.rfFreq.rfHz) {
-        rx_channel_params->tunerParams.rfFreq.rfHz = frequency;
+    if (frequency != params->tunerParams.rfFreq.rfHz) {
+        params->tunerParams.rfFreq.rfHz = frequency;
+        outputs[dual_tuner && tuner == sdrplay_api_Tuner_B ? 1 : 0].frequency = frequency;
         if (run) {
-            auto err = sdrplay_api_Update(device.dev, device.tuner,
+            auto err = sdrplay_api_Update(device.dev, tuner,
                                           sdrplay_api_Update_Tuner_Frf,
                                           sdrplay_api_Update_Ext1_None);
             if (err != sdrplay_api_Success)
@@ -370,6 +721,7 @@ void SDRplaySource<T>::setFrequency(double frequency)
 template <typename T>
 void SDRplaySource<T>::setAntenna(const char* antenna)
 {
+    std::lock_guard<std::mutex> lock(device_mutex);
     if (antenna == nullptr)
         return;
 
@@ -480,12 +832,21 @@ void SDRplaySource<T>::setAntenna(const char* antenna)
 
 template <typename T>
 void SDRplaySource<T>::setIFGainReduction(int gRdB)
+{
+    std::lock_guard<std::mutex> lock(device_mutex);
+    set_if_gain_reduction(device.tuner, rx_channel_params, gRdB);
+}
+
+template <typename T>
+void SDRplaySource<T>::set_if_gain_reduction(sdrplay_api_TunerSelectT tuner,
+                                             sdrplay_api_RxChannelParamsT* params,
+                                             int gRdB)
 {
     if (gRdB == 0) {
-        if (rx_channel_params->ctrlParams.agc.enable != sdrplay_api_AGC_CTRL_EN) {
-            rx_channel_params->ctrlParams.agc.enable = sdrplay_api_AGC_CTRL_EN;
+        if (params->ctrlParams.agc.enable != sdrplay_api_AGC_CTRL_EN) {
+            params->ctrlParams.agc.enable = sdrplay_api_AGC_CTRL_EN;
             if (run) {
-                auto err = sdrplay_api_Update(device.dev, device.tuner,
+                auto err = sdrplay_api_Update(device.dev, tuner,
                                               sdrplay_api_Update_Ctrl_Agc,
                                               sdrplay_api_Update_Ext1_None);
                 if (err != sdrplay_api_Success)
@@ -494,16 +855,16 @@ void SDRplaySource<T>::setIFGainReduction(int gRdB)
         }
     } else if (gRdB >= sdrplay_api_NORMAL_MIN_GR && gRdB <= MAX_BB_GR) {
         sdrplay_api_ReasonForUpdateT reason = sdrplay_api_Update_None;
-        if (rx_channel_params->ctrlParams.agc.enable != sdrplay_api_AGC_DISABLE) {
-            rx_channel_params->ctrlParams.agc.enable = sdrplay_api_AGC_DISABLE;
+        if (params->ctrlParams.agc.enable != sdrplay_api_AGC_DISABLE) {
+            params->ctrlParams.agc.enable = sdrplay_api_AGC_DISABLE;
             reason = (sdrplay_api_ReasonForUpdateT)(reason | sdrplay_api_Update_Ctrl_Agc);
         }
-        if (gRdB != rx_channel_params->tunerParams.gain.gRdB) {
-            rx_channel_params->tunerParams.gain.gRdB = gRdB;
+        if (gRdB != params->tunerParams.gain.gRdB) {
+            params->tunerParams.gain.gRdB = gRdB;
             reason = (sdrplay_api_ReasonForUpdateT)(reason | sdrplay_api_Update_Tuner_Gr);
         }
         if (run && reason != sdrplay_api_Update_None) {
-            auto err = sdrplay_api_Update(device.dev, device.tuner, reason,
+            auto err = sdrplay_api_Update(device.dev, tuner, reason,
                                           sdrplay_api_Update_Ext1_None);
             if (err != sdrplay_api_Success)
                 throw SDRplayException("sdrplay_api_Update(Ctrl_Agc|Tuner_Gr) failed");
@@ -516,14 +877,23 @@ void SDRplaySource<T>::setIFGainReduction(int gRdB)
 
 template <typename T>
 void SDRplaySource<T>::setRFLnaState(unsigned char LNAstate)
+{
+    std::lock_guard<std::mutex> lock(device_mutex);
+    set_rf_lna_state(device.tuner, rx_channel_params, LNAstate);
+}
+
+template <typename T>
+void SDRplaySource<T>::set_rf_lna_state(sdrplay_api_TunerSelectT tuner,
+                                        sdrplay_api_RxChannelParamsT* params,
+                                        unsigned char LNAstate)
 {
     // checking for a valid RF LNA state is too complicated since it depends
     // on many factors like the device model, the frequency, etc
     // so I'll assume the user knows what they are doing
-    if (LNAstate != rx_channel_params->tunerParams.gain.LNAstate) {
-        rx_channel_params->tunerParams.gain.LNAstate = LNAstate;
+    if (LNAstate != params->tunerParams.gain.LNAstate) {
+        params->tunerParams.gain.LNAstate = LNAstate;
         if (run) {
-            auto err = sdrplay_api_Update(device.dev, device.tuner,
+            auto err = sdrplay_api_Update(device.dev, tuner,
                                           sdrplay_api_Update_Tuner_Gr,
                                           sdrplay_api_Update_Ext1_None);
             if (err != sdrplay_api_Success)
@@ -537,6 +907,7 @@ void SDRplaySource<T>::setRFLnaState(unsigned char LNAstate)
 template <typename T>
 void SDRplaySource<T>::setIFType(int if_type)
 {
+    std::lock_guard<std::mutex> lock(device_mutex);
     sdrplay_api_If_kHzT ifType = sdrplay_api_IF_Undefined;
     if      (if_type ==    0) { ifType = sdrplay_api_IF_Zero; }
     else if (if_type ==  450) { ifType = sdrplay_api_IF_0_450; }
@@ -564,6 +935,7 @@ void SDRplaySource<T>::setIFType(int if_type)
 template <typename T>
 void SDRplaySource<T>::setPPM(double ppm)
 {
+    std::lock_guard<std::mutex> lock(device_mutex);
     if (device_params->devParams && ppm != device_params->devParams->ppm) {
         device_params->devParams->ppm = ppm;
         if (run) {
@@ -581,6 +953,7 @@ void SDRplaySource<T>::setPPM(double ppm)
 template <typename T>
 void SDRplaySource<T>::setDCOffset(bool enable)
 {
+    std::lock_guard<std::mutex> lock(device_mutex);
     unsigned char DCenable = enable ? 1 : 0;
     if (DCenable != rx_channel_params->ctrlParams.dcOffset.DCenable) {
         rx_channel_params->ctrlParams.dcOffset.DCenable = DCenable;
@@ -599,6 +972,7 @@ void SDRplaySource<T>::setDCOffset(bool enable)
 template <typename T>
 void SDRplaySource<T>::setIQBalance(bool enable)
 {
+    std::lock_guard<std::mutex> lock(device_mutex);
     unsigned char IQenable = enable ? 1 : 0;
     if (IQenable != rx_channel_params->ctrlParams.dcOffset.IQenable) {
         rx_channel_params->ctrlParams.dcOffset.DCenable = 1;
@@ -618,6 +992,7 @@ void SDRplaySource<T>::setIQBalance(bool enable)
 template <typename T>
 void SDRplaySource<T>::setBulkTransferMode(bool enable)
 {
+    std::lock_guard<std::mutex> lock(device_mutex);
     sdrplay_api_TransferModeT mode = enable ? sdrplay_api_BULK :
                                               sdrplay_api_ISOCH;
     if (device_params->devParams && mode != device_params->devParams->mode)
@@ -626,7 +1001,60 @@ void SDRplaySource<T>::setBulkTransferMode(bool enable)
     return;
 }
 
+template <typename T>
+void SDRplaySource<T>::setStagingTime(double seconds)
+{
+    if (seconds <= 0)
+        throw SDRplayException("invalid staging buffer time");
+    staging_time = seconds;
+    return;
+}
+
+template <typename T>
+void SDRplaySource<T>::setTimestampInterval(double seconds)
+{
+    if (seconds < 0)
+        throw SDRplayException("invalid timestamp interval");
+    timestamp_interval_ns = seconds * 1e9;
+    return;
+}
+
 // getters
+template <typename T>
+void SDRplaySource<T>::setSignalStats(bool enable, double clip_level)
+{
+    outputs[0].stats.setClipLevel(clip_level);
+    outputs[1].stats.setClipLevel(clip_level);
+    signal_stats = enable;
+}
+
+template <typename T>
+std::shared_future<void> SDRplaySource<T>::setFrequencyAsync(double frequency,
+                                                             ControlQueue::Callback callback)
+{
+    return control.submit("frequency", [=] () { setFrequency(frequency); }, callback);
+}
+
+template <typename T>
+std::shared_future<void> SDRplaySource<T>::setIFGainReductionAsync(int gRdB,
+                                                                   ControlQueue::Callback callback)
+{
+    return control.submit("gRdB", [=] () { setIFGainReduction(gRdB); }, callback);
+}
+
+template <typename T>
+std::shared_future<void> SDRplaySource<T>::setRFLnaStateAsync(unsigned char LNAstate,
+                                                              ControlQueue::Callback callback)
+{
+    return control.submit("LNAstate", [=] () { setRFLnaState(LNAstate); }, callback);
+}
+
+template <typename T>
+ControlQueue& SDRplaySource<T>::getControlQueue()
+{
+    return control;
+}
+
 template <typename T>
 double SDRplaySource<T>::getSamplerate() const
 {
@@ -636,6 +1064,7 @@ double SDRplaySource<T>::getSamplerate() const
 template <typename T>
 double SDRplaySource<T>::getBandwidth() const
 {
+    std::lock_guard<std::mutex> lock(device_mutex);
     sdrplay_api_Bw_MHzT bwType = rx_channel_params->tunerParams.bwType;
     if      (bwType == sdrplay_api_BW_0_200) { return  200e3; }
     else if (bwType == sdrplay_api_BW_0_300) { return  300e3; }
@@ -651,12 +1080,14 @@ double SDRplaySource<T>::getBandwidth() const
 template <typename T>
 double SDRplaySource<T>::getFrequency() const
 {
+    std::lock_guard<std::mutex> lock(device_mutex);
     return rx_channel_params->tunerParams.rfFreq.rfHz;
 }
 
 template <typename T>
 const char* SDRplaySource<T>::getAntenna() const
 {
+    std::lock_guard<std::mutex> lock(device_mutex);
     if (device.hwVer == SDRPLAY_RSP1_ID || device.hwVer == SDRPLAY_RSP1A_ID || device.hwVer == SDRPLAY_RSP1B_ID) {
         static const char* antenna = "";
         return antenna;
@@ -714,25 +1145,33 @@ const char* SDRplaySource<T>::getAntenna() const
     return unknown;
 }
 
-template <typename T>
-int SDRplaySource<T>::getIFGainReduction() const
+static int if_gain_reduction(const sdrplay_api_RxChannelParamsT* params)
 {
-    if (rx_channel_params->ctrlParams.agc.enable != sdrplay_api_AGC_DISABLE) {
+    if (params->ctrlParams.agc.enable != sdrplay_api_AGC_DISABLE) {
         return 0;
     } else {
-        return rx_channel_params->tunerParams.gain.gRdB;
+        return params->tunerParams.gain.gRdB;
     }
 }
 
+template <typename T>
+int SDRplaySource<T>::getIFGainReduction() const
+{
+    std::lock_guard<std::mutex> lock(device_mutex);
+    return if_gain_reduction(rx_channel_params);
+}
+
 template <typename T>
 unsigned char SDRplaySource<T>::getRFLnaState() const
 {
+    std::lock_guard<std::mutex> lock(device_mutex);
     return rx_channel_params->tunerParams.gain.LNAstate;
 }
 
 template <typename T>
 int SDRplaySource<T>::getIFType() const
 {
+    std::lock_guard<std::mutex> lock(device_mutex);
     sdrplay_api_If_kHzT ifType = rx_channel_params->tunerParams.ifType;
     if      (ifType == sdrplay_api_IF_Zero)  { return    0; }
     else if (ifType == sdrplay_api_IF_0_450) { return  450; }
@@ -744,28 +1183,104 @@ int SDRplaySource<T>::getIFType() const
 template <typename T>
 double SDRplaySource<T>::getPPM() const
 {
+    std::lock_guard<std::mutex> lock(device_mutex);
     return device_params->devParams->ppm;
 }
 
 template <typename T>
 bool SDRplaySource<T>::getDCOffset() const
 {
+    std::lock_guard<std::mutex> lock(device_mutex);
     return (bool) rx_channel_params->ctrlParams.dcOffset.DCenable;
 }
 
 template <typename T>
 bool SDRplaySource<T>::getIQBalance() const
 {
+    std::lock_guard<std::mutex> lock(device_mutex);
     return (bool) rx_channel_params->ctrlParams.dcOffset.IQenable;
 }
 
 template <typename T>
 bool SDRplaySource<T>::getBulkTransferMode() const
 {
+    std::lock_guard<std::mutex> lock(device_mutex);
     return device_params->devParams &&
            device_params->devParams->mode == sdrplay_api_BULK;
 }
 
+template <typename T>
+double SDRplaySource<T>::getStagingTime() const
+{
+    return staging_time;
+}
+
+template <typename T>
+double SDRplaySource<T>::getTimestampInterval() const
+{
+    return timestamp_interval_ns / 1e9;
+}
+
+template <typename T>
+size_t SDRplaySource<T>::getTotalSamples() const
+{
+    return outputs[0].total_samples;
+}
+
+template <typename T>
+size_t SDRplaySource<T>::getDroppedSamples() const
+{
+    return outputs[0].dropped_samples;
+}
+
+template <typename T>
+size_t SDRplaySource<T>::getGaps() const
+{
+    return outputs[0].gaps;
+}
+
+template <typename T>
+size_t SDRplaySource<T>::getLostSamples() const
+{
+    return outputs[0].lost_samples;
+}
+
+template <typename T>
+size_t SDRplaySource<T>::getHops() const
+{
+    return hops;
+}
+
+template <typename T>
+double SDRplaySource<T>::getHopRate() const
+{
+    if (scan_start_ns == 0)
+        return 0;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double elapsed = (now.tv_sec * 1000000000LL + now.tv_nsec - scan_start_ns) / 1e9;
+    return elapsed > 0 ? hops / elapsed : 0;
+}
+
+template <typename T>
+double SDRplaySource<T>::getSettleTime() const
+{
+    size_t n = hops;
+    return n > 0 ? settle_time_ns / 1e9 / n : 0;
+}
+
+template <typename T>
+size_t SDRplaySource<T>::getSettleDiscardedSamples() const
+{
+    return settle_discarded;
+}
+
+template <typename T>
+SignalStats SDRplaySource<T>::getSignalStats() const
+{
+    return outputs[0].stats.getSnapshot();
+}
+
 template <typename T>
 void SDRplaySource<T>::show_device_config() const
 {
@@ -808,7 +1323,113 @@ void SDRplaySource<T>::show_device_config() const
     return;
 }
 
+// Tuner B source (RSPduo dual tuner mode)
+template <typename T>
+SDRplayTunerBSource<T>::SDRplayTunerBSource(SDRplaySource<T>* source):
+    source(source)
+{
+}
+
+template <typename T>
+void SDRplayTunerBSource<T>::setWriter(Csdr::Writer<T>* writer) {
+    Csdr::Source<T>::setWriter(writer);
+    std::lock_guard<std::mutex> lock(source->outputs[1].writer_mutex);
+    source->outputs[1].writer = writer;
+}
+
+// once the lock is taken the pump thread is done with the old writer, so the
+// pipeline can delete it as soon as this returns
+template <typename T>
+void SDRplayTunerBSource<T>::stop() {
+    std::lock_guard<std::mutex> lock(source->outputs[1].writer_mutex);
+    source->outputs[1].writer = nullptr;
+}
+
+template <typename T>
+void SDRplayTunerBSource<T>::setFrequency(double frequency) {
+    std::lock_guard<std::mutex> lock(source->device_mutex);
+    source->set_frequency(sdrplay_api_Tuner_B, source->device_params->rxChannelB, frequency);
+}
+
+template <typename T>
+void SDRplayTunerBSource<T>::setIFGainReduction(int gRdB) {
+    std::lock_guard<std::mutex> lock(source->device_mutex);
+    source->set_if_gain_reduction(sdrplay_api_Tuner_B, source->device_params->rxChannelB, gRdB);
+}
+
+template <typename T>
+void SDRplayTunerBSource<T>::setRFLnaState(unsigned char LNAstate) {
+    std::lock_guard<std::mutex> lock(source->device_mutex);
+    source->set_rf_lna_state(sdrplay_api_Tuner_B, source->device_params->rxChannelB, LNAstate);
+}
+
+template <typename T>
+std::shared_future<void> SDRplayTunerBSource<T>::setFrequencyAsync(double frequency,
+                                                                   ControlQueue::Callback callback)
+{
+    return source->control.submit("B/frequency", [=] () { setFrequency(frequency); }, callback);
+}
+
+template <typename T>
+std::shared_future<void> SDRplayTunerBSource<T>::setIFGainReductionAsync(int gRdB,
+                                                                         ControlQueue::Callback callback)
+{
+    return source->control.submit("B/gRdB", [=] () { setIFGainReduction(gRdB); }, callback);
+}
+
+template <typename T>
+std::shared_future<void> SDRplayTunerBSource<T>::setRFLnaStateAsync(unsigned char LNAstate,
+                                                                    ControlQueue::Callback callback)
+{
+    return source->control.submit("B/LNAstate", [=] () { setRFLnaState(LNAstate); }, callback);
+}
+
+template <typename T>
+double SDRplayTunerBSource<T>::getFrequency() const {
+    std::lock_guard<std::mutex> lock(source->device_mutex);
+    return source->device_params->rxChannelB->tunerParams.rfFreq.rfHz;
+}
+
+template <typename T>
+int SDRplayTunerBSource<T>::getIFGainReduction() const {
+    std::lock_guard<std::mutex> lock(source->device_mutex);
+    return if_gain_reduction(source->device_params->rxChannelB);
+}
+
+template <typename T>
+unsigned char SDRplayTunerBSource<T>::getRFLnaState() const {
+    std::lock_guard<std::mutex> lock(source->device_mutex);
+    return source->device_params->rxChannelB->tunerParams.gain.LNAstate;
+}
+
+template <typename T>
+size_t SDRplayTunerBSource<T>::getTotalSamples() const {
+    return source->outputs[1].total_samples;
+}
+
+template <typename T>
+size_t SDRplayTunerBSource<T>::getDroppedSamples() const {
+    return source->outputs[1].dropped_samples;
+}
+
+template <typename T>
+size_t SDRplayTunerBSource<T>::getGaps() const {
+    return source->outputs[1].gaps;
+}
+
+template <typename T>
+size_t SDRplayTunerBSource<T>::getLostSamples() const {
+    return source->outputs[1].lost_samples;
+}
+
+template <typename T>
+SignalStats SDRplayTunerBSource<T>::getSignalStats() const {
+    return source->outputs[1].stats.getSnapshot();
+}
+
 namespace Csdrx {
     template class SDRplaySource<Csdr::complex<short>>;
     template class SDRplaySource<Csdr::complex<float>>;
+    template class SDRplayTunerBSource<Csdr::complex<short>>;
+    template class SDRplayTunerBSource<Csdr::complex<float>>;
 }
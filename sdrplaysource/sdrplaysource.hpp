@@ -8,8 +8,19 @@
 #pragma once
 
 #include <csdr/source.hpp>
+#include <csdrx/controlqueue.hpp>
+#include <csdrx/sdrplayapi.hpp>
+#include <csdrx/signalstats.hpp>
+#include <csdrx/stagingbuffer.hpp>
+#include <csdrx/tags.hpp>
 #include <sdrplay_api.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
+#include <thread>
+#include <vector>
 
 namespace Csdrx {
 
@@ -19,7 +30,18 @@ namespace Csdrx {
     };
 
     template <typename T>
-    class SDRplaySource: public Csdr::Source<T> {
+    class SDRplayTunerBSource;
+
+    // an RSPduo can be used in single tuner mode (serial number, antenna
+    // 'Tuner 1 50ohm', 'Tuner 2 50ohm', or 'High Z'), as master ('<serial>/M'
+    // or '<serial>/M8'), as slave, or in dual tuner mode ('<serial>/D' or
+    // '<serial>/D8'); in dual tuner mode this source streams Tuner A, and
+    // Tuner B is streamed by the source returned by getTunerB().
+    // Timestamp, Gap (hardware or USB gaps, and samples dropped because the
+    // staging buffer was full), and Reset tags are emitted from the pump
+    // thread after the tagged sample has been written to the pipeline
+    template <typename T>
+    class SDRplaySource: public Csdr::Source<T>, public TagEmitter {
         public:
             SDRplaySource(const char* serial = nullptr,
                           double samplerate = 2e6,
@@ -30,6 +52,19 @@ namespace Csdrx {
             void setWriter(Csdr::Writer<T>* writer) override;
             void stop();
             bool isRunning() const;
+            bool isDualTuner() const;
+            SDRplayTunerBSource<T>* getTunerB();
+            // scanner: a control thread hops through 'frequencies' staying
+            // on each one for its dwell time (one value for all of them, or
+            // one per frequency); after each retune the samples are discarded
+            // until the tuner reports the change (rfChanged) plus 'settle'
+            // seconds, and a Retune tag marks the first sample kept.
+            // Not available in RSPduo dual tuner mode
+            void startScan(const std::vector<double>& frequencies,
+                           const std::vector<double>& dwell_times,
+                           double settle = 0);
+            void stopScan();
+            bool isScanning() const;
             // setters
             void setSamplerate(double samplerate);
             void setBandwidth(double samplerate);
@@ -42,6 +77,24 @@ namespace Csdrx {
             void setDCOffset(bool enable);
             void setIQBalance(bool enable);
             void setBulkTransferMode(bool enable);
+            // size of the staging buffer between the SDRplay API callback
+            // and the pipeline (takes effect with the next setWriter())
+            void setStagingTime(double seconds);
+            // minimum time between Timestamp tags (0 -> every block)
+            void setTimestampInterval(double seconds);
+            // measure peak, RMS, DC and clipped samples of each block of raw
+            // samples in the API callback (see getSignalStats())
+            void setSignalStats(bool enable, double clip_level = 0.99);
+            // asynchronous setters: the change is queued to the control
+            // thread and the call returns immediately; a change still in the
+            // queue is replaced by a newer one of the same kind
+            std::shared_future<void> setFrequencyAsync(double frequency,
+                                                       ControlQueue::Callback callback = nullptr);
+            std::shared_future<void> setIFGainReductionAsync(int gRdB,
+                                                             ControlQueue::Callback callback = nullptr);
+            std::shared_future<void> setRFLnaStateAsync(unsigned char LNAstate,
+                                                        ControlQueue::Callback callback = nullptr);
+            ControlQueue& getControlQueue();
             // getters
             double getSamplerate() const;
             double getBandwidth() const;
@@ -54,22 +107,163 @@ namespace Csdrx {
             bool getDCOffset() const;
             bool getIQBalance() const;
             bool getBulkTransferMode() const;
+            double getStagingTime() const;
+            double getTimestampInterval() const;
+            // samples received from the SDRplay API, and samples dropped
+            // because the staging buffer was full
+            size_t getTotalSamples() const;
+            size_t getDroppedSamples() const;
+            // gaps in the hardware sample numbers, and samples lost in them
+            size_t getGaps() const;
+            size_t getLostSamples() const;
+            // scanner statistics: number of hops, hops per second since
+            // startScan(), average time from retune to rfChanged (seconds),
+            // and samples discarded while the tuner was settling
+            size_t getHops() const;
+            double getHopRate() const;
+            double getSettleTime() const;
+            size_t getSettleDiscardedSamples() const;
+            // statistics of the last block (lock-free; any thread)
+            SignalStats getSignalStats() const;
             void stream_callback(short *xi, short *xq,
                                  sdrplay_api_StreamCbParamsT *params,
-                                 unsigned int numSamples, unsigned int reset);
+                                 unsigned int numSamples, unsigned int reset,
+                                 int output = 0);
         private:
+            // the callback fills the staging buffer of each output, and a
+            // pump thread moves its samples to the output writer
+            struct Output {
+                // the pump thread holds writer_mutex while it uses the
+                // writer, so the writer can be replaced from another thread
+                Csdr::Writer<T>* writer = nullptr;
+                std::mutex writer_mutex;
+                StagingBuffer<T>* staging = nullptr;
+                std::thread* pump_thread = nullptr;
+                std::mutex pump_mutex;
+                std::condition_variable pump_cv;
+                std::atomic<bool> pumping{false};
+                std::atomic<size_t> total_samples{0};
+                std::atomic<size_t> dropped_samples{0};
+                std::atomic<size_t> gaps{0};
+                std::atomic<size_t> lost_samples{0};
+                SignalStatsMeter stats;
+                // tags from the callback to the pump thread
+                StagingBuffer<Tag>* tags = nullptr;
+                // tuned frequency, for the callback (rfHz is only read or
+                // written with device_mutex held)
+                std::atomic<double> frequency{0};
+                // callback state
+                size_t output_samples = 0;
+                unsigned int next_sample_num = 0;
+                bool sample_num_valid = false;
+                long long next_timestamp_ns = 0;
+            };
             void select_device(const char* serial, const char* antenna);
+            void release_device();
             bool select_device_rspduo(sdrplay_api_DeviceT& device_rspduo,
                                       const char* serial, const char* antenna);
-            sdrplay_api_StreamCallback_t get_unqualified_stream_callback() const;
+            sdrplay_api_StreamCallback_t get_unqualified_stream_callback(int output) const;
             void show_device_config() const;
+            void start_pump(int output);
+            void stop_pump(int output);
+            void pump(int output);
+            void queue_tag(Output& out, TagType type, size_t sample,
+                           long long timeNs, double value);
+            void scan_loop();
+            // the settings of one tuner; Tuner B passes its own tuner and
+            // channel parameters, so the shared state always refers to Tuner A
+            // (called with device_mutex held)
+            void set_frequency(sdrplay_api_TunerSelectT tuner,
+                               sdrplay_api_RxChannelParamsT* params,
+                               double frequency);
+            void set_if_gain_reduction(sdrplay_api_TunerSelectT tuner,
+                                       sdrplay_api_RxChannelParamsT* params,
+                                       int gRdB);
+            void set_rf_lna_state(sdrplay_api_TunerSelectT tuner,
+                                  sdrplay_api_RxChannelParamsT* params,
+                                  unsigned char LNAstate);
+            std::shared_ptr<SDRplayApi> api;
             sdrplay_api_DeviceT device;
             sdrplay_api_DeviceParamsT *device_params;
             sdrplay_api_RxChannelParamsT *rx_channel_params;
+            // held while reading or changing the device or channel parameters
+            // and while calling sdrplay_api_Update() (user threads, control
+            // thread and scanner)
+            mutable std::mutex device_mutex;
             double samplerate;
             int loglevel;
             bool run = false;
             bool device_selected = false;
-            size_t total_samples = 0;
+            bool dual_tuner = false;
+            double staging_time = 0.1;
+            long long timestamp_interval_ns = 0;
+            std::atomic<bool> signal_stats{false};
+            Output outputs[2];
+            // in dual tuner mode a block is either written to both outputs
+            // or dropped from both, so the outputs stay sample aligned
+            bool block_pending = false;
+            unsigned int pending_block = 0;
+            bool drop_pending_block = false;
+            SDRplayTunerBSource<T>* tuner_b = nullptr;
+            // asynchronous setters (for both tuners)
+            ControlQueue control;
+            // scanner
+            enum class ScanPhase { Idle, Retuning, Settling, Dwelling };
+            std::vector<double> scan_frequencies;
+            std::vector<size_t> scan_dwell_samples;
+            size_t scan_settle_samples = 0;
+            std::thread* scan_thread = nullptr;
+            std::mutex scan_mutex;
+            std::condition_variable scan_cv;
+            std::atomic<bool> scanning{false};
+            std::atomic<ScanPhase> scan_phase{ScanPhase::Idle};
+            std::atomic<size_t> settle_remaining{0};
+            std::atomic<size_t> dwell_remaining{0};
+            std::atomic<bool> hop_due{false};
+            std::atomic<long long> retune_time_ns{0};
+            long long scan_start_ns = 0;
+            std::atomic<size_t> hops{0};
+            std::atomic<long long> settle_time_ns{0};
+            std::atomic<size_t> settle_discarded{0};
+
+            friend class SDRplayTunerBSource<T>;
+    };
+
+    // Tuner B of an RSPduo in dual tuner mode; it is owned by the
+    // SDRplaySource, and it shares its samplerate, bandwidth and lifetime.
+    // Samples are numbered the same way on both outputs, i.e. sample N of
+    // Tuner A and sample N of Tuner B were taken at the same time
+    template <typename T>
+    class SDRplayTunerBSource: public Csdr::Source<T>, public TagEmitter {
+        public:
+            void setWriter(Csdr::Writer<T>* writer) override;
+            // detach the writer; samples are discarded until a new writer is
+            // set. It returns once the pump thread has released the writer
+            void stop();
+            // setters
+            void setFrequency(double frequency);
+            void setIFGainReduction(int gRdB);   // gRdB == 0 -> enable AGC
+            void setRFLnaState(unsigned char LNAstate);
+            // asynchronous setters (they share the control thread of Tuner A)
+            std::shared_future<void> setFrequencyAsync(double frequency,
+                                                       ControlQueue::Callback callback = nullptr);
+            std::shared_future<void> setIFGainReductionAsync(int gRdB,
+                                                             ControlQueue::Callback callback = nullptr);
+            std::shared_future<void> setRFLnaStateAsync(unsigned char LNAstate,
+                                                        ControlQueue::Callback callback = nullptr);
+            // getters
+            double getFrequency() const;
+            int getIFGainReduction() const;
+            unsigned char getRFLnaState() const;
+            size_t getTotalSamples() const;
+            size_t getDroppedSamples() const;
+            size_t getGaps() const;
+            size_t getLostSamples() const;
+            SignalStats getSignalStats() const;
+        private:
+            explicit SDRplayTunerBSource(SDRplaySource<T>* source);
+            SDRplaySource<T>* source;
+
+            friend class SDRplaySource<T>;
     };
 }
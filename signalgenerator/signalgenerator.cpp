@@ -0,0 +1,406 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "signalgenerator.hpp"
+
+#include <csdrx/kernels.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <time.h>
+
+using namespace Csdrx;
+
+typedef Csdr::complex<float> CF32;
+
+constexpr size_t SignalGenerator::BLOCK_SIZE;
+constexpr size_t SignalGenerator::NOISE_TABLE_SIZE;
+
+// in place radix-2 FFT (the size is a power of 2); only used to build the
+// tables of the SSB signals
+static void fft(std::vector<std::complex<double>>& x, bool inverse) {
+    size_t n = x.size();
+    for (size_t i = 1, j = 0; i < n; i++) {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+        if (i < j)
+            std::swap(x[i], x[j]);
+    }
+    for (size_t len = 2; len <= n; len <<= 1) {
+        double angle = 2 * M_PI / len * (inverse ? 1 : -1);
+        std::complex<double> wlen(cos(angle), sin(angle));
+        for (size_t i = 0; i < n; i += len) {
+            std::complex<double> w(1);
+            for (size_t j = 0; j < len / 2; j++) {
+                std::complex<double> u = x[i + j];
+                std::complex<double> v = x[i + j + len / 2] * w;
+                x[i + j] = u + v;
+                x[i + j + len / 2] = u - v;
+                w *= wlen;
+            }
+        }
+    }
+    if (inverse)
+        for (auto& v : x)
+            v /= (double) n;
+}
+
+// DFT of any size: the radix-2 FFT when the size is a power of 2, otherwise
+// Bluestein's algorithm (a chirp convolution done with radix-2 FFTs)
+static void dft(std::vector<std::complex<double>>& x, bool inverse) {
+    size_t n = x.size();
+    if ((n & (n - 1)) == 0) {
+        fft(x, inverse);
+        return;
+    }
+    size_t size = 1;
+    while (size < 2 * n - 1)
+        size <<= 1;
+    // w[k] = exp(-+i*pi*k^2/n); k^2 is reduced modulo 2n to keep the angle
+    // accurate for long tables
+    std::vector<std::complex<double>> w(n);
+    for (size_t k = 0; k < n; k++) {
+        double angle = M_PI * ((unsigned long long) k * k % (2 * n)) / n;
+        w[k] = std::polar(1.0, inverse ? angle : -angle);
+    }
+    std::vector<std::complex<double>> a(size), b(size);
+    for (size_t k = 0; k < n; k++)
+        a[k] = x[k] * w[k];
+    b[0] = std::conj(w[0]);
+    for (size_t k = 1; k < n; k++)
+        b[k] = b[size - k] = std::conj(w[k]);
+    fft(a, false);
+    fft(b, false);
+    for (size_t k = 0; k < size; k++)
+        a[k] *= b[k];
+    fft(a, true);
+    for (size_t k = 0; k < n; k++)
+        x[k] = a[k] * w[k] / (inverse ? (double) n : 1.0);
+}
+
+SignalGenerator::SignalGenerator(double samplerate):
+    samplerate(samplerate)
+{
+    if (samplerate <= 0)
+        throw SignalGeneratorException("invalid samplerate");
+}
+
+void SignalGenerator::addTone(double frequency, double amplitude)
+{
+    add_carrier(frequency, amplitude, std::vector<CF32>());
+}
+
+// the noise table is filled the first time (Box-Muller); each block reads
+// it from a random offset, rotated by a random phase
+void SignalGenerator::addNoise(double amplitude)
+{
+    std::lock_guard<std::mutex> lock(signals_mutex);
+    if (noise_table.empty()) {
+        noise_table.resize(NOISE_TABLE_SIZE);
+        for (auto& v : noise_table) {
+            double u1 = (random_offset() + 1.0) / 4294967297.0;
+            double u2 = random_offset() / 4294967296.0;
+            double r = sqrt(-log(u1));      // unit power: 1/2 per component
+            v = CF32(r * cos(2 * M_PI * u2), r * sin(2 * M_PI * u2));
+        }
+    }
+    noise_amplitude = sqrt(noise_amplitude * noise_amplitude + amplitude * amplitude);
+}
+
+void SignalGenerator::addModulated(Modulation modulation, double frequency, double amplitude,
+                                   const std::vector<float>& audio, double param)
+{
+    if (audio.empty())
+        throw SignalGeneratorException("empty audio");
+    add_carrier(frequency, amplitude, modulate(modulation, audio, param));
+}
+
+void SignalGenerator::addModulatedTone(Modulation modulation, double frequency, double amplitude,
+                                       double audio_frequency, double param)
+{
+    if (audio_frequency <= 0 || audio_frequency > samplerate / 2)
+        throw SignalGeneratorException("invalid audio frequency");
+    size_t period = std::max((size_t) 1, (size_t) lrint(samplerate / audio_frequency));
+    if (modulation == Modulation::USB || modulation == Modulation::LSB) {
+        // a single tone, above or below the carrier
+        double sign = modulation == Modulation::USB ? 1 : -1;
+        std::vector<CF32> table(period);
+        for (size_t k = 0; k < period; k++)
+            table[k] = CF32(cos(2 * M_PI * k / period), sign * sin(2 * M_PI * k / period));
+        add_carrier(frequency, amplitude, std::move(table));
+        return;
+    }
+    std::vector<float> audio(period);
+    for (size_t k = 0; k < period; k++)
+        audio[k] = cos(2 * M_PI * k / period);
+    add_carrier(frequency, amplitude, modulate(modulation, audio, param));
+}
+
+std::vector<CF32> SignalGenerator::modulate(Modulation modulation,
+                                            const std::vector<float>& audio,
+                                            double param) const
+{
+    size_t n = audio.size();
+    std::vector<CF32> table(n);
+    switch (modulation) {
+    case Modulation::AM:
+        for (size_t k = 0; k < n; k++)
+            table[k] = CF32(1 + param * audio[k], 0);
+        break;
+    case Modulation::FM: {
+        // the phase at the end of the table must be a multiple of 2 pi; the
+        // remainder is spread over the table as a small frequency offset
+        double step = 2 * M_PI * param / samplerate;
+        double total = 0;
+        for (size_t k = 0; k < n; k++)
+            total += step * audio[k];
+        double correction = -remainder(total, 2 * M_PI) / n;
+        double phase = 0;
+        for (size_t k = 0; k < n; k++) {
+            table[k] = CF32(cos(phase), sin(phase));
+            phase = fmod(phase + step * audio[k] + correction, 2 * M_PI);
+        }
+        break;
+    }
+    case Modulation::USB:
+    case Modulation::LSB: {
+        // analytic signal: the negative frequencies are removed in the
+        // frequency domain; the transform has the length of the table, so
+        // the result loops like the audio
+        std::vector<std::complex<double>> x(n);
+        for (size_t k = 0; k < n; k++)
+            x[k] = audio[k];
+        dft(x, false);
+        for (size_t k = 1; k < (n + 1) / 2; k++)
+            x[k] *= 2;
+        for (size_t k = n / 2 + 1; k < n; k++)
+            x[k] = 0;
+        dft(x, true);
+        double sign = modulation == Modulation::USB ? 1 : -1;
+        for (size_t k = 0; k < n; k++)
+            table[k] = CF32(x[k].real(), sign * x[k].imag());
+        break;
+    }
+    }
+    return table;
+}
+
+void SignalGenerator::add_carrier(double frequency, double amplitude, std::vector<CF32>&& table)
+{
+    Carrier carrier;
+    carrier.table = std::move(table);
+    carrier.index = 0;
+    carrier.omega = 2 * M_PI * frequency / samplerate;
+    carrier.phasors.resize(BLOCK_SIZE);
+    for (size_t k = 0; k < BLOCK_SIZE; k++)
+        carrier.phasors[k] = CF32(cos(carrier.omega * k), sin(carrier.omega * k));
+    carrier.phase = 1;
+    carrier.amplitude = amplitude;
+    std::lock_guard<std::mutex> lock(signals_mutex);
+    carriers.push_back(std::move(carrier));
+}
+
+void SignalGenerator::addBurst(const std::vector<CF32>& burst, double interval, double amplitude)
+{
+    size_t interval_samples = lrint(interval * samplerate);
+    if (burst.empty() || interval_samples < burst.size())
+        throw SignalGeneratorException("invalid burst or burst interval");
+    std::lock_guard<std::mutex> lock(signals_mutex);
+    bursts.push_back({ burst, interval_samples, (float) amplitude });
+}
+
+void SignalGenerator::addBurst(const char* filename, double interval, double amplitude)
+{
+    std::ifstream file(filename, std::ios::binary | std::ios::ate);
+    if (!file)
+        throw SignalGeneratorException("unable to open burst file");
+    std::vector<CF32> burst(file.tellg() / sizeof(CF32));
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(burst.data()), burst.size() * sizeof(CF32));
+    addBurst(burst, interval, amplitude);
+}
+
+void SignalGenerator::clear()
+{
+    std::lock_guard<std::mutex> lock(signals_mutex);
+    carriers.clear();
+    bursts.clear();
+    noise_amplitude = 0;
+}
+
+void SignalGenerator::generate(CF32* out, size_t n)
+{
+    if (n > BLOCK_SIZE)
+        throw SignalGeneratorException("block too large");
+    std::fill(out, out + n, CF32());
+    std::lock_guard<std::mutex> lock(signals_mutex);
+
+    for (auto& c : carriers) {
+        CF32 scale(c.amplitude * c.phase.real(), c.amplitude * c.phase.imag());
+        if (c.table.empty()) {
+            accumulate_scaled_cf32(c.phasors.data(), scale, out, n);
+        } else {
+            // the table wraps around; the phasors continue from 'done'
+            size_t done = 0;
+            while (done < n) {
+                size_t m = std::min(n - done, c.table.size() - c.index);
+                accumulate_product_cf32(c.table.data() + c.index, c.phasors.data() + done,
+                                        scale, out + done, m);
+                c.index = (c.index + m) % c.table.size();
+                done += m;
+            }
+        }
+        // the phase is advanced in double precision, so it doesn't drift
+        c.phase *= std::polar(1.0, c.omega * n);
+        c.phase /= std::abs(c.phase);
+    }
+
+    for (auto& b : bursts) {
+        CF32 scale(b.amplitude, 0);
+        size_t done = 0;
+        while (done < n) {
+            size_t offset = (position + done) % b.interval;
+            if (offset < b.samples.size()) {
+                size_t m = std::min(n - done, b.samples.size() - offset);
+                accumulate_scaled_cf32(b.samples.data() + offset, scale, out + done, m);
+                done += m;
+            } else {
+                done += std::min(n - done, b.interval - offset);
+            }
+        }
+    }
+
+    if (noise_amplitude > 0) {
+        size_t offset = random_offset() % (NOISE_TABLE_SIZE - BLOCK_SIZE);
+        double phase = 2 * M_PI * (random_offset() / 4294967296.0);
+        CF32 scale(noise_amplitude * cos(phase), noise_amplitude * sin(phase));
+        accumulate_scaled_cf32(noise_table.data() + offset, scale, out, n);
+    }
+
+    position += n;
+}
+
+// xorshift64*; the upper 32 bits
+size_t SignalGenerator::random_offset()
+{
+    random_state ^= random_state >> 12;
+    random_state ^= random_state << 25;
+    random_state ^= random_state >> 27;
+    return (random_state * 0x2545f4914f6cdd1dULL) >> 32;
+}
+
+double SignalGenerator::getSamplerate() const
+{
+    return samplerate;
+}
+
+// source
+template <typename T>
+SignalGeneratorSource<T>::SignalGeneratorSource(double samplerate, bool realtime):
+    SignalGenerator(samplerate),
+    realtime(realtime),
+    block(getBlockSize())
+{
+}
+
+template <typename T>
+SignalGeneratorSource<T>::~SignalGeneratorSource() {
+    stop();
+}
+
+template <typename T>
+void SignalGeneratorSource<T>::setWriter(Csdr::Writer<T>* writer) {
+    Csdr::Source<T>::setWriter(writer);
+    run = true;
+    if (thread == nullptr) {
+        thread = new std::thread( [this] () { loop(); });
+    }
+}
+
+template <typename T>
+void SignalGeneratorSource<T>::loop() {
+    long long start_ns = 0;
+    size_t paced_samples = 0;
+    bool paced = false;
+
+    while (run) {
+        size_t n = std::min(this->writer->writeable(), getBlockSize());
+        if (n == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        if (realtime) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            if (!paced) {
+                start_ns = now.tv_sec * 1000000000LL + now.tv_nsec;
+                paced_samples = 0;
+                paced = true;
+            }
+            // wait until the first sample of the block is due
+            long long due_ns = start_ns + (long long) (paced_samples * 1e9 / getSamplerate());
+            struct timespec request_time = { time_t(due_ns / 1000000000), long(due_ns % 1000000000) };
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &request_time, nullptr);
+            paced_samples += n;
+        } else {
+            paced = false;
+        }
+        write_block(n);
+        total_samples += n;
+    }
+}
+
+template<>
+void SignalGeneratorSource<CF32>::write_block(size_t n) {
+    generate(writer->getWritePointer(), n);
+    writer->advance(n);
+}
+
+template<>
+void SignalGeneratorSource<Csdr::complex<short>>::write_block(size_t n) {
+    generate(block.data(), n);
+    convert_cf32_to_cs16(block.data(), writer->getWritePointer(), n);
+    writer->advance(n);
+}
+
+template <typename T>
+void SignalGeneratorSource<T>::stop() {
+    run = false;
+    if (thread != nullptr) {
+        thread->join();
+        delete(thread);
+        thread = nullptr;
+    }
+}
+
+template <typename T>
+bool SignalGeneratorSource<T>::isRunning() const {
+    return run;
+}
+
+template <typename T>
+void SignalGeneratorSource<T>::setRealTime(bool realtime) {
+    this->realtime = realtime;
+}
+
+template <typename T>
+bool SignalGeneratorSource<T>::getRealTime() const {
+    return realtime;
+}
+
+template <typename T>
+size_t SignalGeneratorSource<T>::getTotalSamples() const {
+    return total_samples;
+}
+
+namespace Csdrx {
+    template class SignalGeneratorSource<Csdr::complex<short>>;
+    template class SignalGeneratorSource<Csdr::complex<float>>;
+}
@@ -0,0 +1,120 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <csdr/complex.hpp>
+#include <csdr/source.hpp>
+#include <atomic>
+#include <complex>
+#include <cstdint>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace Csdrx {
+
+    class SignalGeneratorException: public std::runtime_error {
+        public:
+            SignalGeneratorException(const std::string& reason): std::runtime_error(reason) {}
+    };
+
+    // synthetic complex baseband signals; the signals are sums of tones,
+    // modulated carriers, bursts, and white gaussian noise. Everything that
+    // can be is precomputed when a signal is added, so generating a block
+    // is a few vectorized multiply-accumulate passes over tables.
+    // Frequencies are offsets from the center in Hz, amplitudes are
+    // relative to full scale (1.0)
+    class SignalGenerator {
+        public:
+            enum class Modulation { AM, FM, USB, LSB };
+
+            explicit SignalGenerator(double samplerate);
+            void addTone(double frequency, double amplitude);
+            // rms amplitude of the noise
+            void addNoise(double amplitude);
+            // carrier modulated by 'audio' (looped, at the output samplerate,
+            // in [-1, 1]); 'param' is the AM modulation depth (0-1) or the FM
+            // deviation in Hz (not used for SSB). With FM the carrier is
+            // moved by less than samplerate / (2 * audio.size()) Hz, so the
+            // phase is continuous where the audio loops
+            void addModulated(Modulation modulation, double frequency, double amplitude,
+                              const std::vector<float>& audio, double param = 0);
+            // same with an audio tone (rounded to a whole number of samples
+            // per period, so the table loops seamlessly)
+            void addModulatedTone(Modulation modulation, double frequency, double amplitude,
+                                  double audio_frequency, double param = 0);
+            // a recorded burst, repeated every 'interval' seconds
+            void addBurst(const std::vector<Csdr::complex<float>>& burst, double interval,
+                          double amplitude = 1);
+            // same, reading the burst from a file of interleaved CF32 samples
+            void addBurst(const char* filename, double interval, double amplitude = 1);
+            void clear();
+            // generate the next n samples (at most getBlockSize())
+            void generate(Csdr::complex<float>* out, size_t n);
+            double getSamplerate() const;
+            static constexpr size_t getBlockSize() { return BLOCK_SIZE; }
+        private:
+            static constexpr size_t BLOCK_SIZE = 4096;
+            static constexpr size_t NOISE_TABLE_SIZE = 65536;
+            // a looped table of samples (constant 1 for tones) shifted by a
+            // carrier; the phasors e^(j w k) for k = 0..BLOCK_SIZE are
+            // precomputed, and the carrier phase is advanced once per block
+            struct Carrier {
+                std::vector<Csdr::complex<float>> table;   // empty for tones
+                size_t index;
+                std::vector<Csdr::complex<float>> phasors;
+                double omega;                              // radians per sample
+                std::complex<double> phase;
+                double amplitude;
+            };
+            struct Burst {
+                std::vector<Csdr::complex<float>> samples;
+                size_t interval;
+                float amplitude;
+            };
+            void add_carrier(double frequency, double amplitude,
+                             std::vector<Csdr::complex<float>>&& table);
+            std::vector<Csdr::complex<float>> modulate(Modulation modulation,
+                                                       const std::vector<float>& audio,
+                                                       double param) const;
+            size_t random_offset();
+            double samplerate;
+            std::mutex signals_mutex;
+            std::vector<Carrier> carriers;
+            std::vector<Burst> bursts;
+            std::vector<Csdr::complex<float>> noise_table;
+            float noise_amplitude = 0;
+            uint64_t random_state = 0x9e3779b97f4a7c15ULL;
+            size_t position = 0;
+    };
+
+    // a csdr source of synthetic signals (see SignalGenerator) for tests and
+    // benchmarks without a radio; unthrottled by default (the samples are
+    // written as fast as the pipeline takes them), or paced to real time
+    template <typename T>
+    class SignalGeneratorSource: public Csdr::Source<T>, public SignalGenerator {
+        public:
+            SignalGeneratorSource(double samplerate, bool realtime = false);
+            ~SignalGeneratorSource();
+            void setWriter(Csdr::Writer<T>* writer) override;
+            void stop();
+            bool isRunning() const;
+            void setRealTime(bool realtime);
+            bool getRealTime() const;
+            size_t getTotalSamples() const;
+        private:
+            void loop();
+            void write_block(size_t n);
+            std::atomic<bool> realtime;
+            std::atomic<bool> run{false};
+            std::thread* thread = nullptr;
+            std::atomic<size_t> total_samples{0};
+            std::vector<Csdr::complex<float>> block;
+    };
+}
@@ -0,0 +1,108 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "signalstats.hpp"
+
+#include <csdrx/kernels.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <type_traits>
+
+using namespace Csdrx;
+
+static_assert(std::is_trivially_copyable<SignalStats>::value,
+              "SignalStats is copied word by word");
+
+SignalStatsMeter::SignalStatsMeter(double clip_level):
+    clip_level(clip_level),
+    sequence(0)
+{
+    SignalStats stats;
+    uint64_t buffer[WORDS] = {};
+    memcpy(buffer, &stats, sizeof(stats));
+    for (size_t i = 0; i < WORDS; i++)
+        words[i].store(buffer[i], std::memory_order_relaxed);
+}
+
+void SignalStatsMeter::setClipLevel(double clip_level) {
+    this->clip_level = clip_level;
+}
+
+double SignalStatsMeter::getClipLevel() const {
+    return clip_level;
+}
+
+void SignalStatsMeter::measure(const short* xi, const short* xq, size_t n, long long timeNs) {
+    // planar samples: all the I values are 'even', and all the Q values 'odd'
+    SignalSums sums_i;
+    SignalSums sums_q;
+    accumulate_sums_s16(xi, n, clip_level, sums_i);
+    accumulate_sums_s16(xq, n, clip_level, sums_q);
+    SignalSums sums;
+    sums.sum_even = sums_i.sum_even + sums_i.sum_odd;
+    sums.sum_odd = sums_q.sum_even + sums_q.sum_odd;
+    sums.sum_squares = sums_i.sum_squares + sums_q.sum_squares;
+    sums.peak = std::max(sums_i.peak, sums_q.peak);
+    sums.clipped = sums_i.clipped + sums_q.clipped;
+    publish(sums, n, timeNs);
+}
+
+void SignalStatsMeter::measure(const Csdr::complex<short>* x, size_t n, long long timeNs) {
+    SignalSums sums;
+    accumulate_sums_s16(reinterpret_cast<const short*>(x), 2 * n, clip_level, sums);
+    publish(sums, n, timeNs);
+}
+
+void SignalStatsMeter::measure(const Csdr::complex<float>* x, size_t n, long long timeNs) {
+    SignalSums sums;
+    accumulate_sums_f32(reinterpret_cast<const float*>(x), 2 * n, clip_level, sums);
+    publish(sums, n, timeNs);
+}
+
+void SignalStatsMeter::publish(const SignalSums& sums, size_t n, long long timeNs) {
+    if (n == 0)
+        return;
+    blocks++;
+    total_clipped += sums.clipped;
+
+    SignalStats stats;
+    stats.blocks = blocks;
+    stats.samples = n;
+    stats.timeNs = timeNs;
+    stats.peak = sums.peak;
+    stats.rms = sqrt(sums.sum_squares / n);
+    stats.dcI = sums.sum_even / n;
+    stats.dcQ = sums.sum_odd / n;
+    stats.clipped = sums.clipped;
+    stats.totalClipped = total_clipped;
+    uint64_t buffer[WORDS] = {};
+    memcpy(buffer, &stats, sizeof(stats));
+
+    // odd sequence number -> update in progress
+    unsigned int seq = sequence.load(std::memory_order_relaxed);
+    sequence.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < WORDS; i++)
+        words[i].store(buffer[i], std::memory_order_relaxed);
+    sequence.store(seq + 2, std::memory_order_release);
+}
+
+SignalStats SignalStatsMeter::getSnapshot() const {
+    uint64_t buffer[WORDS];
+    unsigned int seq0, seq1;
+    do {
+        seq0 = sequence.load(std::memory_order_acquire);
+        for (size_t i = 0; i < WORDS; i++)
+            buffer[i] = words[i].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        seq1 = sequence.load(std::memory_order_relaxed);
+    } while ((seq0 & 1) || seq0 != seq1);
+    SignalStats stats;
+    memcpy(&stats, buffer, sizeof(stats));
+    return stats;
+}
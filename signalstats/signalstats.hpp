@@ -0,0 +1,58 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <csdr/complex.hpp>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace Csdrx {
+
+    struct SignalSums;
+
+    // statistics of the last block of raw I/Q samples; levels are relative
+    // to the full scale of the samples (1.0)
+    struct SignalStats {
+        size_t blocks = 0;          // blocks measured so far
+        size_t samples = 0;         // samples in the last block
+        long long timeNs = 0;       // CLOCK_MONOTONIC time of the last block
+        double peak = 0;            // largest |I| or |Q|
+        double rms = 0;             // sqrt(mean(I^2 + Q^2))
+        double dcI = 0;             // mean(I)
+        double dcQ = 0;             // mean(Q)
+        size_t clipped = 0;         // I or Q values at or above the clip level
+        size_t totalClipped = 0;    // (in the last block, and since the start)
+    };
+
+    // measures each block in the thread that converts the samples (so the
+    // samples are still in the cache), and publishes the results with a
+    // seqlock: the measuring thread never waits, and readers in any thread
+    // retry if they see a snapshot being updated
+    class SignalStatsMeter {
+        public:
+            explicit SignalStatsMeter(double clip_level = 0.99);
+            void setClipLevel(double clip_level);
+            double getClipLevel() const;
+            // measuring thread (only one)
+            void measure(const short* xi, const short* xq, size_t n, long long timeNs);
+            void measure(const Csdr::complex<short>* x, size_t n, long long timeNs);
+            void measure(const Csdr::complex<float>* x, size_t n, long long timeNs);
+            // any thread
+            SignalStats getSnapshot() const;
+        private:
+            void publish(const SignalSums& sums, size_t n, long long timeNs);
+
+            static constexpr size_t WORDS = (sizeof(SignalStats) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+            std::atomic<float> clip_level;
+            size_t blocks = 0;
+            size_t total_clipped = 0;
+            std::atomic<unsigned int> sequence;
+            std::atomic<uint64_t> words[WORDS];
+    };
+}
@@ -0,0 +1,600 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// A SoapySDR module with a fake receiver (driver=csdrxmock) for tests and
+// benchmarks without a radio. The samples come from a looped table made by
+// the csdrx SignalGenerator (a tone and some noise), in the native format of
+// the device, paced to the sample rate or as fast as they are read.
+// Load it with:
+//     SOAPY_SDR_PLUGIN_PATH=<build dir>/soapymock ./fm_receiver_soapy_source
+// and open it with the device arguments 'driver=csdrxmock,...':
+//   channels=N              number of RX channels (default: 1)
+//   format=CS16             native stream format: CS8, CU8, CS12, CS16, or CF32
+//   mtu=8192                samples per read
+//   buffers=8               direct access buffers (0 -> no direct access)
+//   realtime=true           pace the reads to the sample rate; when the reader
+//                           falls behind by more than 'buffer_ms' (default: 100)
+//                           the samples are lost and the read returns an overflow
+//   timestamps=true         hardware time (SOAPY_SDR_HAS_TIME) in the reads
+//   tone=<Hz>, amplitude=0.3, noise=0.01
+//                           the signal (the tone is moved to the nearest
+//                           frequency that loops seamlessly; default: fs/16)
+// and these event injections (they can also be changed with writeSetting()):
+//   overflow_interval=N     every N reads return SOAPY_SDR_OVERFLOW and skip
+//                           'overflow_samples' samples (default: one MTU)
+//   timeout_interval=N      every N reads return 'timeout_count' (default: 1)
+//                           SOAPY_SDR_TIMEOUTs in a row, each one after the
+//                           timeout of the read
+//   error_interval=N        every N reads return SOAPY_SDR_STREAM_ERROR until
+//                           the stream is re-activated
+// readSetting() also returns the counters: reads, samples, overflows,
+// timeouts, errors, and activations.
+
+#include <csdrx/signalgenerator.hpp>
+#include <SoapySDR/Device.hpp>
+#include <SoapySDR/Formats.hpp>
+#include <SoapySDR/Registry.hpp>
+#include <SoapySDR/Version.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <time.h>
+
+typedef Csdr::complex<float> CF32;
+
+static constexpr size_t TABLE_SIZE = 65536;
+
+static long long monotonic_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+static std::string arg_value(const SoapySDR::Kwargs& args, const std::string& key,
+                             const std::string& default_value) {
+    auto it = args.find(key);
+    return it != args.end() ? it->second : default_value;
+}
+
+static bool to_bool(const std::string& value) {
+    return value == "true" || value == "1" || value == "yes";
+}
+
+// the samples of the table in the native format
+static void pack_samples(const std::vector<CF32>& in, const std::string& format,
+                         std::vector<char>& out) {
+    size_t sample_size = SoapySDR::formatToSize(format);
+    out.resize(in.size() * sample_size);
+    for (size_t k = 0; k < in.size(); k++) {
+        float i = std::max(-1.0f, std::min(in[k].i(), 1.0f));
+        float q = std::max(-1.0f, std::min(in[k].q(), 1.0f));
+        char* o = out.data() + k * sample_size;
+        if (format == SOAPY_SDR_CF32) {
+            memcpy(o, &in[k], sizeof(CF32));
+        } else if (format == SOAPY_SDR_CS16) {
+            short s[2] = { (short) lrintf(i * 32767), (short) lrintf(q * 32767) };
+            memcpy(o, s, sizeof(s));
+        } else if (format == SOAPY_SDR_CS8) {
+            o[0] = (signed char) lrintf(i * 127);
+            o[1] = (signed char) lrintf(q * 127);
+        } else if (format == SOAPY_SDR_CU8) {
+            o[0] = (unsigned char) (lrintf(i * 127) + 128);
+            o[1] = (unsigned char) (lrintf(q * 127) + 128);
+        } else if (format == SOAPY_SDR_CS12) {
+            // I in the low 12 bits, Q in the high 12 bits
+            int i12 = lrintf(i * 2047);
+            int q12 = lrintf(q * 2047);
+            o[0] = i12 & 0xff;
+            o[1] = ((i12 >> 8) & 0x0f) | ((q12 & 0x0f) << 4);
+            o[2] = (q12 >> 4) & 0xff;
+        }
+    }
+}
+
+static double full_scale_of(const std::string& format) {
+    if (format == SOAPY_SDR_CS16) return 32768;
+    if (format == SOAPY_SDR_CS12) return 2048;
+    if (format == SOAPY_SDR_CS8 || format == SOAPY_SDR_CU8) return 128;
+    return 1.0;
+}
+
+namespace {
+
+    struct MockStream {
+        std::string format;
+        size_t sample_size;
+        std::vector<size_t> channels;
+        bool active = false;
+        bool error = false;
+        unsigned long reads = 0;
+        unsigned int timeouts_left = 0;
+        // sample number of the next read (the hardware time is derived
+        // from it), and the real time pacing
+        long long sample_num = 0;
+        long long pace_start_ns = 0;
+        long long pace_start_sample = 0;
+        long long deactivated_ns = 0;
+        size_t table_index = 0;
+        // direct access buffers, one per channel
+        std::vector<std::vector<std::vector<char>>> buffers;
+        size_t next_buffer = 0;
+    };
+
+    class MockDevice: public SoapySDR::Device {
+        public:
+            MockDevice(const SoapySDR::Kwargs& args);
+
+            // identification
+            std::string getDriverKey() const override { return "csdrxmock"; }
+            std::string getHardwareKey() const override { return "csdrx mock receiver"; }
+            size_t getNumChannels(const int direction) const override {
+                return direction == SOAPY_SDR_RX ? num_channels : 0;
+            }
+
+            // stream
+            std::vector<std::string> getStreamFormats(const int direction, const size_t channel) const override;
+            std::string getNativeStreamFormat(const int direction, const size_t channel,
+                                              double &fullScale) const override;
+            SoapySDR::Stream *setupStream(const int direction, const std::string &format,
+                                          const std::vector<size_t> &channels,
+                                          const SoapySDR::Kwargs &args) override;
+            void closeStream(SoapySDR::Stream *stream) override;
+            size_t getStreamMTU(SoapySDR::Stream *stream) const override { return mtu; }
+            int activateStream(SoapySDR::Stream *stream, const int flags, const long long timeNs,
+                               const size_t numElems) override;
+            int deactivateStream(SoapySDR::Stream *stream, const int flags,
+                                 const long long timeNs) override;
+            int readStream(SoapySDR::Stream *stream, void * const *buffs, const size_t numElems,
+                           int &flags, long long &timeNs, const long timeoutUs) override;
+            size_t getNumDirectAccessBuffers(SoapySDR::Stream *stream) override {
+                return reinterpret_cast<MockStream*>(stream)->buffers.size();
+            }
+            int acquireReadBuffer(SoapySDR::Stream *stream, size_t &handle, const void **buffs,
+                                  int &flags, long long &timeNs, const long timeoutUs) override;
+            void releaseReadBuffer(SoapySDR::Stream *stream, const size_t handle) override {}
+
+            // antenna, frontend corrections, gain, frequency, sample rate,
+            // bandwidth (the values are only stored)
+            std::vector<std::string> listAntennas(const int direction, const size_t channel) const override {
+                return { "RX" };
+            }
+            void setAntenna(const int direction, const size_t channel, const std::string &name) override {}
+            std::string getAntenna(const int direction, const size_t channel) const override { return "RX"; }
+            void setDCOffsetMode(const int direction, const size_t channel, const bool automatic) override {
+                dc_offset_mode = automatic;
+            }
+            bool getDCOffsetMode(const int direction, const size_t channel) const override { return dc_offset_mode; }
+            void setIQBalanceMode(const int direction, const size_t channel, const bool automatic) override {
+                iq_balance_mode = automatic;
+            }
+            bool getIQBalanceMode(const int direction, const size_t channel) const override { return iq_balance_mode; }
+            void setFrequencyCorrection(const int direction, const size_t channel, const double value) override {
+                ppm = value;
+            }
+            double getFrequencyCorrection(const int direction, const size_t channel) const override { return ppm; }
+            std::vector<std::string> listGains(const int direction, const size_t channel) const override {
+                return { "IF" };
+            }
+            void setGainMode(const int direction, const size_t channel, const bool automatic) override {
+                agc = automatic;
+            }
+            bool getGainMode(const int direction, const size_t channel) const override { return agc; }
+            void setGain(const int direction, const size_t channel, const double value) override {
+                gains.at(channel) = value;
+            }
+            void setGain(const int direction, const size_t channel, const std::string &name,
+                         const double value) override {
+                gains.at(channel) = value;
+            }
+            double getGain(const int direction, const size_t channel) const override { return gains.at(channel); }
+            double getGain(const int direction, const size_t channel, const std::string &name) const override {
+                return gains.at(channel);
+            }
+            SoapySDR::Range getGainRange(const int direction, const size_t channel) const override {
+                return SoapySDR::Range(0, 60);
+            }
+            void setFrequency(const int direction, const size_t channel, const double frequency,
+                              const SoapySDR::Kwargs &args) override {
+                frequencies.at(channel) = frequency;
+            }
+            void setFrequency(const int direction, const size_t channel, const std::string &name,
+                              const double frequency, const SoapySDR::Kwargs &args) override {
+                frequencies.at(channel) = frequency;
+            }
+            double getFrequency(const int direction, const size_t channel) const override {
+                return frequencies.at(channel);
+            }
+            double getFrequency(const int direction, const size_t channel, const std::string &name) const override {
+                return frequencies.at(channel);
+            }
+            SoapySDR::RangeList getFrequencyRange(const int direction, const size_t channel) const override {
+                return { SoapySDR::Range(1e3, 6e9) };
+            }
+            void setSampleRate(const int direction, const size_t channel, const double rate) override;
+            double getSampleRate(const int direction, const size_t channel) const override { return samplerate; }
+            std::vector<double> listSampleRates(const int direction, const size_t channel) const override {
+                return { 250e3, 500e3, 1e6, 2e6, 2.4e6, 3.2e6, 5e6, 6e6, 8e6, 10e6, 10.66e6, 20e6 };
+            }
+            void setBandwidth(const int direction, const size_t channel, const double bw) override {
+                bandwidth = bw;
+            }
+            double getBandwidth(const int direction, const size_t channel) const override { return bandwidth; }
+            std::vector<double> listBandwidths(const int direction, const size_t channel) const override {
+                return { 200e3, 300e3, 600e3, 1.536e6, 5e6, 6e6, 7e6, 8e6 };
+            }
+
+            // time
+            bool hasHardwareTime(const std::string &what) const override { return timestamps; }
+            long long getHardwareTime(const std::string &what) const override;
+
+            // settings: event injection and counters
+            void writeSetting(const std::string &key, const std::string &value) override;
+            std::string readSetting(const std::string &key) const override;
+
+        private:
+            void make_table(const std::string& format);
+            int next_event(MockStream* s, const long timeoutUs);
+            int pace(MockStream* s, size_t n);
+            void fill(MockStream* s, char* const* out, size_t n, int &flags, long long &timeNs);
+            long long sample_time_ns(long long sample_num) const;
+
+            size_t num_channels;
+            std::string native_format;
+            size_t mtu;
+            size_t num_buffers;
+            long long buffer_ns;
+            double tone;
+            double amplitude;
+            double noise;
+            std::atomic<bool> realtime;
+            std::atomic<bool> timestamps;
+            std::atomic<double> samplerate{2e6};
+            std::atomic<bool> samplerate_changed{false};
+            double bandwidth = 0;
+            double ppm = 0;
+            bool agc = false;
+            bool dc_offset_mode = false;
+            bool iq_balance_mode = false;
+            std::vector<double> gains;
+            std::vector<double> frequencies;
+
+            // the table in the format of the stream, one MTU longer than
+            // TABLE_SIZE so a read never wraps around
+            std::mutex table_mutex;
+            std::vector<char> table;
+            std::string table_format;
+            double table_samplerate = 0;
+
+            std::atomic<unsigned long> overflow_interval;
+            std::atomic<unsigned long> overflow_samples;
+            std::atomic<unsigned long> timeout_interval;
+            std::atomic<unsigned int> timeout_count;
+            std::atomic<unsigned long> error_interval;
+
+            std::atomic<unsigned long> reads{0};
+            std::atomic<unsigned long long> samples{0};
+            std::atomic<unsigned long> overflows{0};
+            std::atomic<unsigned long> timeouts{0};
+            std::atomic<unsigned long> errors{0};
+            std::atomic<unsigned long> activations{0};
+            MockStream* active_stream = nullptr;
+    };
+
+}
+
+MockDevice::MockDevice(const SoapySDR::Kwargs& args) {
+    num_channels = std::max(1, std::stoi(arg_value(args, "channels", "1")));
+    native_format = arg_value(args, "format", SOAPY_SDR_CS16);
+    if (native_format != SOAPY_SDR_CS8 && native_format != SOAPY_SDR_CU8 &&
+        native_format != SOAPY_SDR_CS12 && native_format != SOAPY_SDR_CS16 &&
+        native_format != SOAPY_SDR_CF32)
+        throw std::runtime_error("csdrxmock: unsupported format " + native_format);
+    mtu = std::max(1, std::stoi(arg_value(args, "mtu", "8192")));
+    num_buffers = std::stoi(arg_value(args, "buffers", "8"));
+    buffer_ns = std::stod(arg_value(args, "buffer_ms", "100")) * 1e6;
+    realtime = to_bool(arg_value(args, "realtime", "true"));
+    timestamps = to_bool(arg_value(args, "timestamps", "true"));
+    tone = std::stod(arg_value(args, "tone", "nan"));
+    amplitude = std::stod(arg_value(args, "amplitude", "0.3"));
+    noise = std::stod(arg_value(args, "noise", "0.01"));
+    overflow_interval = std::stoul(arg_value(args, "overflow_interval", "0"));
+    overflow_samples = std::stoul(arg_value(args, "overflow_samples", std::to_string(mtu)));
+    timeout_interval = std::stoul(arg_value(args, "timeout_interval", "0"));
+    timeout_count = std::stoul(arg_value(args, "timeout_count", "1"));
+    error_interval = std::stoul(arg_value(args, "error_interval", "0"));
+    gains.resize(num_channels, 30);
+    frequencies.resize(num_channels, 100e6);
+}
+
+std::vector<std::string> MockDevice::getStreamFormats(const int direction, const size_t channel) const {
+    // like most drivers: the native format, and the SoapySDR conversions
+    std::vector<std::string> formats = { native_format };
+    for (auto format : { SOAPY_SDR_CS16, SOAPY_SDR_CF32 })
+        if (native_format != format)
+            formats.push_back(format);
+    return formats;
+}
+
+std::string MockDevice::getNativeStreamFormat(const int direction, const size_t channel,
+                                              double &fullScale) const {
+    fullScale = full_scale_of(native_format);
+    return native_format;
+}
+
+// a tone on a frequency that loops in TABLE_SIZE samples, plus noise
+void MockDevice::make_table(const std::string& format) {
+    double rate = samplerate;
+    std::lock_guard<std::mutex> lock(table_mutex);
+    if (format == table_format && rate == table_samplerate &&
+        table.size() == (TABLE_SIZE + mtu) * SoapySDR::formatToSize(format))
+        return;
+    Csdrx::SignalGenerator generator(rate);
+    double frequency = std::isnan(tone) ? rate / 16 : tone;
+    frequency = std::round(frequency * TABLE_SIZE / rate) * rate / TABLE_SIZE;
+    if (amplitude > 0)
+        generator.addTone(frequency, amplitude);
+    if (noise > 0)
+        generator.addNoise(noise);
+    std::vector<CF32> samples(TABLE_SIZE + mtu);
+    for (size_t k = 0; k < TABLE_SIZE; k += generator.getBlockSize())
+        generator.generate(samples.data() + k, std::min(generator.getBlockSize(), TABLE_SIZE - k));
+    for (size_t k = TABLE_SIZE; k < samples.size(); k++)
+        samples[k] = samples[k % TABLE_SIZE];
+    pack_samples(samples, format, table);
+    table_format = format;
+    table_samplerate = rate;
+}
+
+SoapySDR::Stream *MockDevice::setupStream(const int direction, const std::string &format,
+                                          const std::vector<size_t> &channels,
+                                          const SoapySDR::Kwargs &args) {
+    if (direction != SOAPY_SDR_RX)
+        throw std::runtime_error("csdrxmock: RX only");
+    if (format != native_format && format != SOAPY_SDR_CS16 && format != SOAPY_SDR_CF32)
+        throw std::runtime_error("csdrxmock: unsupported stream format " + format);
+    MockStream* s = new MockStream();
+    s->format = format;
+    s->sample_size = SoapySDR::formatToSize(format);
+    s->channels = channels.empty() ? std::vector<size_t>{0} : channels;
+    for (auto channel : s->channels)
+        if (channel >= num_channels) {
+            delete s;
+            throw std::runtime_error("csdrxmock: invalid channel");
+        }
+    // direct access buffers are in the native format
+    if (format == native_format) {
+        s->buffers.resize(num_buffers);
+        for (auto& buffer : s->buffers)
+            buffer.resize(s->channels.size(), std::vector<char>(mtu * s->sample_size));
+    }
+    make_table(format);
+    return reinterpret_cast<SoapySDR::Stream*>(s);
+}
+
+void MockDevice::closeStream(SoapySDR::Stream *stream) {
+    MockStream* s = reinterpret_cast<MockStream*>(stream);
+    if (active_stream == s)
+        active_stream = nullptr;
+    delete s;
+}
+
+int MockDevice::activateStream(SoapySDR::Stream *stream, const int flags, const long long timeNs,
+                               const size_t numElems) {
+    MockStream* s = reinterpret_cast<MockStream*>(stream);
+    long long now_ns = monotonic_ns();
+    // the device clock kept running while the stream was stopped
+    if (s->deactivated_ns > 0 && realtime)
+        s->sample_num += (now_ns - s->deactivated_ns) * 1e-9 * samplerate;
+    s->pace_start_ns = now_ns;
+    s->pace_start_sample = s->sample_num;
+    s->active = true;
+    s->error = false;
+    s->timeouts_left = 0;
+    active_stream = s;
+    activations++;
+    return 0;
+}
+
+int MockDevice::deactivateStream(SoapySDR::Stream *stream, const int flags, const long long timeNs) {
+    MockStream* s = reinterpret_cast<MockStream*>(stream);
+    s->active = false;
+    s->deactivated_ns = monotonic_ns();
+    return 0;
+}
+
+// injected events
+int MockDevice::next_event(MockStream* s, const long timeoutUs) {
+    unsigned long read = ++s->reads;
+    reads++;
+    if (!s->active || s->error) {
+        errors++;
+        return SOAPY_SDR_STREAM_ERROR;
+    }
+    unsigned long interval = error_interval;
+    if (interval > 0 && read % interval == 0) {
+        s->error = true;
+        errors++;
+        return SOAPY_SDR_STREAM_ERROR;
+    }
+    interval = timeout_interval;
+    if (interval > 0 && read % interval == 0)
+        s->timeouts_left = timeout_count;
+    if (s->timeouts_left > 0) {
+        s->timeouts_left--;
+        timeouts++;
+        std::this_thread::sleep_for(std::chrono::microseconds(timeoutUs));
+        return SOAPY_SDR_TIMEOUT;
+    }
+    interval = overflow_interval;
+    if (interval > 0 && read % interval == 0) {
+        s->sample_num += overflow_samples;
+        s->table_index = (s->table_index + overflow_samples) % TABLE_SIZE;
+        overflows++;
+        return SOAPY_SDR_OVERFLOW;
+    }
+    return 0;
+}
+
+// waits until the last sample of the read has 'arrived'; when the reader is
+// too late the samples that didn't fit in the device buffers are lost
+int MockDevice::pace(MockStream* s, size_t n) {
+    double rate = samplerate;
+    long long now_ns = monotonic_ns();
+    if (samplerate_changed.exchange(false) || !realtime) {
+        s->pace_start_ns = now_ns;
+        s->pace_start_sample = s->sample_num;
+    }
+    if (!realtime)
+        return 0;
+    long long due_ns = s->pace_start_ns +
+                       (long long) ((s->sample_num + n - s->pace_start_sample) * 1e9 / rate);
+    if (now_ns - due_ns > buffer_ns) {
+        long long lost = (now_ns - due_ns) * 1e-9 * rate;
+        s->sample_num += lost;
+        s->table_index = (s->table_index + lost) % TABLE_SIZE;
+        s->pace_start_ns = now_ns;
+        s->pace_start_sample = s->sample_num;
+        overflows++;
+        return SOAPY_SDR_OVERFLOW;
+    }
+    if (due_ns > now_ns) {
+        struct timespec request_time = { time_t(due_ns / 1000000000), long(due_ns % 1000000000) };
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &request_time, nullptr);
+    }
+    return 0;
+}
+
+void MockDevice::fill(MockStream* s, char* const* out, size_t n, int &flags, long long &timeNs) {
+    {
+        std::lock_guard<std::mutex> lock(table_mutex);
+        const char* in = table.data() + s->table_index * s->sample_size;
+        for (size_t i = 0; i < s->channels.size(); i++)
+            memcpy(out[i], in, n * s->sample_size);
+    }
+    flags = 0;
+    timeNs = 0;
+    if (timestamps) {
+        flags |= SOAPY_SDR_HAS_TIME;
+        timeNs = sample_time_ns(s->sample_num);
+    }
+    s->sample_num += n;
+    s->table_index = (s->table_index + n) % TABLE_SIZE;
+    samples += n;
+}
+
+int MockDevice::readStream(SoapySDR::Stream *stream, void * const *buffs, const size_t numElems,
+                           int &flags, long long &timeNs, const long timeoutUs) {
+    MockStream* s = reinterpret_cast<MockStream*>(stream);
+    int event = next_event(s, timeoutUs);
+    if (event == 0)
+        event = pace(s, std::min(numElems, mtu));
+    if (event != 0)
+        return event;
+    size_t n = std::min(numElems, mtu);
+    fill(s, reinterpret_cast<char* const*>(buffs), n, flags, timeNs);
+    return n;
+}
+
+int MockDevice::acquireReadBuffer(SoapySDR::Stream *stream, size_t &handle, const void **buffs,
+                                  int &flags, long long &timeNs, const long timeoutUs) {
+    MockStream* s = reinterpret_cast<MockStream*>(stream);
+    if (s->buffers.empty())
+        return SOAPY_SDR_NOT_SUPPORTED;
+    int event = next_event(s, timeoutUs);
+    if (event == 0)
+        event = pace(s, mtu);
+    if (event != 0)
+        return event;
+    handle = s->next_buffer;
+    s->next_buffer = (s->next_buffer + 1) % s->buffers.size();
+    std::vector<char*> out;
+    for (auto& channel_buffer : s->buffers[handle]) {
+        out.push_back(channel_buffer.data());
+        buffs[out.size() - 1] = channel_buffer.data();
+    }
+    fill(s, out.data(), mtu, flags, timeNs);
+    return mtu;
+}
+
+void MockDevice::setSampleRate(const int direction, const size_t channel, const double rate) {
+    if (rate <= 0)
+        throw std::runtime_error("csdrxmock: invalid sample rate");
+    samplerate = rate;
+    samplerate_changed = true;
+    // the tone stays on the same fraction of the sample rate
+    std::lock_guard<std::mutex> lock(table_mutex);
+    table_samplerate = 0;
+}
+
+long long MockDevice::sample_time_ns(long long sample_num) const {
+    return llround(sample_num * 1e9 / samplerate);
+}
+
+long long MockDevice::getHardwareTime(const std::string &what) const {
+    MockStream* s = active_stream;
+    return s != nullptr ? sample_time_ns(s->sample_num) : 0;
+}
+
+void MockDevice::writeSetting(const std::string &key, const std::string &value) {
+    if (key == "overflow_interval")
+        overflow_interval = std::stoul(value);
+    else if (key == "overflow_samples")
+        overflow_samples = std::stoul(value);
+    else if (key == "timeout_interval")
+        timeout_interval = std::stoul(value);
+    else if (key == "timeout_count")
+        timeout_count = std::stoul(value);
+    else if (key == "error_interval")
+        error_interval = std::stoul(value);
+    else if (key == "realtime")
+        realtime = to_bool(value);
+    else if (key == "timestamps")
+        timestamps = to_bool(value);
+}
+
+std::string MockDevice::readSetting(const std::string &key) const {
+    if (key == "reads")        return std::to_string(reads);
+    if (key == "samples")      return std::to_string(samples);
+    if (key == "overflows")    return std::to_string(overflows);
+    if (key == "timeouts")     return std::to_string(timeouts);
+    if (key == "errors")       return std::to_string(errors);
+    if (key == "activations")  return std::to_string(activations);
+    if (key == "overflow_interval") return std::to_string(overflow_interval);
+    if (key == "overflow_samples")  return std::to_string(overflow_samples);
+    if (key == "timeout_interval")  return std::to_string(timeout_interval);
+    if (key == "timeout_count")     return std::to_string(timeout_count);
+    if (key == "error_interval")    return std::to_string(error_interval);
+    if (key == "realtime")     return realtime ? "true" : "false";
+    if (key == "timestamps")   return timestamps ? "true" : "false";
+    return "";
+}
+
+// registration
+static SoapySDR::KwargsList find_mock(const SoapySDR::Kwargs &args) {
+    // only when it is asked for, so it never replaces a real device
+    if (arg_value(args, "driver", "") != "csdrxmock")
+        return {};
+    SoapySDR::Kwargs device;
+    device["driver"] = "csdrxmock";
+    device["label"] = "csdrx mock receiver";
+    device["serial"] = "mock0";
+    return { device };
+}
+
+static SoapySDR::Device *make_mock(const SoapySDR::Kwargs &args) {
+    return new MockDevice(args);
+}
+
+static SoapySDR::Registry register_mock("csdrxmock", &find_mock, &make_mock, SOAPY_SDR_ABI_VERSION);
@@ -0,0 +1,442 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "soapymultisource.hpp"
+
+#include <SoapySDR/Formats.hpp>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+using namespace Csdrx;
+
+template <typename T>
+static std::string stream_format();
+
+template<>
+std::string stream_format<Csdr::complex<float>>() {
+    return SOAPY_SDR_CF32;
+}
+
+template<>
+std::string stream_format<Csdr::complex<short>>() {
+    return SOAPY_SDR_CS16;
+}
+
+template <typename T>
+SoapyMultiSource<T>::SoapyMultiSource(const std::string &args,
+                                      const std::vector<size_t>& channels,
+                                      double samplerate,
+                                      double frequency,
+                                      const std::string &antenna):
+    SoapyStream("SoapyMultiSource"),
+    channels(channels)
+{
+    if (channels.empty())
+        throw SoapyException("no channels");
+    device = SoapySDR::Device::make(args);
+    for (auto channel : channels) {
+        std::vector<std::string> stream_formats = device->getStreamFormats(SOAPY_SDR_RX, channel);
+        if (std::find(stream_formats.begin(), stream_formats.end(), stream_format<T>()) == stream_formats.end()) {
+            for (auto output : outputs)
+                delete output;
+            outputs.clear();
+            SoapySDR::Device::unmake(device);
+            device = nullptr;
+            throw SoapyException("invalid stream format");
+        }
+        outputs.push_back(new SoapyChannelSource<T>(this, channel));
+    }
+    setSamplerate(samplerate);
+    for (auto output : outputs) {
+        output->setBandwidth(samplerate);
+        output->setFrequency(frequency);
+        output->setAntenna(antenna);
+    }
+}
+
+template <typename T>
+SoapyMultiSource<T>::~SoapyMultiSource() {
+    control.stop();
+    stop();
+    for (auto output : outputs)
+        delete output;
+    SoapySDR::Device::unmake(device);
+    device = nullptr;
+}
+
+template <typename T>
+size_t SoapyMultiSource<T>::getNumChannels() const {
+    return channels.size();
+}
+
+template <typename T>
+SoapyChannelSource<T>* SoapyMultiSource<T>::getChannelSource(size_t index) {
+    return outputs.at(index);
+}
+
+// called by the outputs when they get a writer
+template <typename T>
+void SoapyMultiSource<T>::start() {
+    std::lock_guard<std::mutex> lock(start_mutex);
+    if (run)
+        return;
+    for (auto output : outputs)
+        if (output->output == nullptr)
+            return;
+    setup_stream();
+    device->activateStream(stream);
+    run = true;
+    thread = new std::thread( [this] () { loop(); });
+}
+
+template <typename T>
+void SoapyMultiSource<T>::setup_stream() {
+    open_stream(stream_format<T>(), channels);
+    discard.resize(stream_read_size);
+}
+
+template <typename T>
+void SoapyMultiSource<T>::loop() {
+
+    long long timeNs = 0;
+    long timeoutUs = 1e6;
+    int flags = 0;
+    std::vector<Csdr::Writer<T>*> writers(outputs.size());
+    std::vector<void*> buffs(outputs.size());
+
+    start_reading();
+    while (run) {
+        // the same number of samples for every channel, as many as the
+        // slowest pipeline can take
+        size_t how_much = stream_read_size;
+        for (size_t i = 0; i < outputs.size(); i++) {
+            writers[i] = outputs[i]->output;
+            if (writers[i] != nullptr)
+                how_much = std::min(how_much, writers[i]->writeable());
+        }
+        bool reactivate = false;
+        if (how_much == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        } else {
+            for (size_t i = 0; i < outputs.size(); i++)
+                buffs[i] = writers[i] != nullptr ? (void*) writers[i]->getWritePointer() :
+                                                   (void*) discard.data();
+            int samples = SOAPY_SDR_STREAM_ERROR;
+            if (stream != nullptr)
+                samples = device->readStream(stream, buffs.data(), how_much, flags, timeNs, timeoutUs);
+            if (samples > 0) {
+                for (auto writer : writers)
+                    if (writer != nullptr)
+                        writer->advance(samples);
+                total_samples += samples;
+                read_done();
+            } else {
+                reactivate = read_failed(samples);
+            }
+        }
+        // the writers read above are no longer used
+        {
+            std::lock_guard<std::mutex> lock(loop_mutex);
+            loop_iterations++;
+        }
+        loop_cv.notify_all();
+        if (reactivate && !recover() && !run)
+            break;
+    }
+    {
+        std::lock_guard<std::mutex> lock(loop_mutex);
+        loop_iterations++;
+    }
+    loop_cv.notify_all();
+}
+
+template <typename T>
+void SoapyMultiSource<T>::wait_for_loop() {
+    std::unique_lock<std::mutex> lock(loop_mutex);
+    size_t iteration = loop_iterations;
+    loop_cv.wait(lock, [this, iteration] () { return loop_iterations != iteration || !run; });
+}
+
+template <typename T>
+void SoapyMultiSource<T>::stop() {
+    std::lock_guard<std::mutex> lock(start_mutex);
+    if (!run)
+        return;
+
+    run = false;
+    if (thread != nullptr) {
+        thread->join();
+        delete(thread);
+        thread = nullptr;
+    }
+    if (stream != nullptr) {
+        device->deactivateStream(stream);
+        device->closeStream(stream);
+        stream = nullptr;
+    }
+    print_stats();
+}
+
+template <typename T>
+bool SoapyMultiSource<T>::isRunning() const {
+    return run;
+}
+
+// setters
+template <typename T>
+void SoapyMultiSource<T>::setSamplerate(const double samplerate)
+{
+    for (auto channel : channels)
+        device->setSampleRate(SOAPY_SDR_RX, channel, samplerate);
+}
+
+template <typename T>
+void SoapyMultiSource<T>::writeSetting(const std::string &key, const std::string &value)
+{
+    device->writeSetting(key, value);
+}
+
+template <typename T>
+void SoapyMultiSource<T>::setStreamArgs(const std::string &args)
+{
+    stream_args = args;
+}
+
+template <typename T>
+void SoapyMultiSource<T>::setReadSize(const size_t samples)
+{
+    read_size = samples;
+}
+
+template <typename T>
+void SoapyMultiSource<T>::setReactivateTimeouts(unsigned int timeouts)
+{
+    reactivate_timeouts = timeouts;
+}
+
+template <typename T>
+ControlQueue& SoapyMultiSource<T>::getControlQueue()
+{
+    return control;
+}
+
+// getters
+template <typename T>
+double SoapyMultiSource<T>::getSamplerate() const
+{
+    return device->getSampleRate(SOAPY_SDR_RX, channels[0]);
+}
+
+template <typename T>
+std::string SoapyMultiSource<T>::readSetting(const std::string &key) const
+{
+    return device->readSetting(key);
+}
+
+template <typename T>
+std::string SoapyMultiSource<T>::getStreamArgs() const
+{
+    return stream_args;
+}
+
+template <typename T>
+size_t SoapyMultiSource<T>::getReadSize() const
+{
+    return stream_read_size;
+}
+
+template <typename T>
+unsigned int SoapyMultiSource<T>::getReactivateTimeouts() const
+{
+    return reactivate_timeouts;
+}
+
+template <typename T>
+size_t SoapyMultiSource<T>::getTotalSamples() const
+{
+    return total_samples;
+}
+
+template <typename T>
+size_t SoapyMultiSource<T>::getOverflows() const
+{
+    return overflows;
+}
+
+template <typename T>
+size_t SoapyMultiSource<T>::getTimeouts() const
+{
+    return timeouts;
+}
+
+template <typename T>
+size_t SoapyMultiSource<T>::getReadErrors() const
+{
+    return read_errors;
+}
+
+template <typename T>
+size_t SoapyMultiSource<T>::getReactivations() const
+{
+    return reactivations;
+}
+
+// channel outputs
+template <typename T>
+SoapyChannelSource<T>::SoapyChannelSource(SoapyMultiSource<T>* source, size_t channel):
+    source(source),
+    channel(channel)
+{
+}
+
+template <typename T>
+void SoapyChannelSource<T>::setWriter(Csdr::Writer<T>* writer) {
+    Csdr::Source<T>::setWriter(writer);
+    output = writer;
+    source->start();
+}
+
+template <typename T>
+void SoapyChannelSource<T>::stop() {
+    output = nullptr;
+    for (auto other : source->outputs)
+        if (other->output != nullptr) {
+            // the pipeline may free the writer as soon as this returns
+            source->wait_for_loop();
+            return;
+        }
+    source->stop();
+}
+
+template <typename T>
+bool SoapyChannelSource<T>::isRunning() const {
+    return source->isRunning() && output != nullptr;
+}
+
+template <typename T>
+void SoapyChannelSource<T>::setBandwidth(const double bw)
+{
+    SoapySDR::Device* device = source->device;
+    double bwreq = 0;
+    for (auto& bandwidth : device->listBandwidths(SOAPY_SDR_RX, channel)) {
+        if (bandwidth > bw) {
+            if (bwreq == 0)
+                bwreq = bandwidth;
+            break;
+        }
+        bwreq = bandwidth;
+    }
+    device->setBandwidth(SOAPY_SDR_RX, channel, bwreq);
+}
+
+template <typename T>
+void SoapyChannelSource<T>::setFrequency(const double frequency)
+{
+    source->device->setFrequency(SOAPY_SDR_RX, channel, frequency);
+}
+
+template <typename T>
+void SoapyChannelSource<T>::setAntenna(const std::string &antenna)
+{
+    source->device->setAntenna(SOAPY_SDR_RX, channel, antenna);
+}
+
+template <typename T>
+void SoapyChannelSource<T>::setGain(const double value)
+{
+    source->device->setGain(SOAPY_SDR_RX, channel, value);
+}
+
+template <typename T>
+void SoapyChannelSource<T>::setGain(const std::string& name, const double value)
+{
+    source->device->setGain(SOAPY_SDR_RX, channel, name, value);
+}
+
+template <typename T>
+void SoapyChannelSource<T>::setAGC(bool enable)
+{
+    source->device->setGainMode(SOAPY_SDR_RX, channel, enable);
+}
+
+template <typename T>
+void SoapyChannelSource<T>::writeChannelSetting(const std::string &key, const std::string &value)
+{
+    source->device->writeSetting(SOAPY_SDR_RX, channel, key, value);
+}
+
+template <typename T>
+std::shared_future<void> SoapyChannelSource<T>::setFrequencyAsync(const double frequency,
+                                                                  ControlQueue::Callback callback)
+{
+    return source->control.submit(std::to_string(channel) + "/frequency",
+                                  [=] () { setFrequency(frequency); }, callback);
+}
+
+template <typename T>
+std::shared_future<void> SoapyChannelSource<T>::setGainAsync(const double value,
+                                                             ControlQueue::Callback callback)
+{
+    return source->control.submit(std::to_string(channel) + "/gain",
+                                  [=] () { setGain(value); }, callback);
+}
+
+template <typename T>
+size_t SoapyChannelSource<T>::getChannel() const
+{
+    return channel;
+}
+
+template <typename T>
+double SoapyChannelSource<T>::getBandwidth() const
+{
+    return source->device->getBandwidth(SOAPY_SDR_RX, channel);
+}
+
+template <typename T>
+double SoapyChannelSource<T>::getFrequency() const
+{
+    return source->device->getFrequency(SOAPY_SDR_RX, channel);
+}
+
+template <typename T>
+std::string SoapyChannelSource<T>::getAntenna() const
+{
+    return source->device->getAntenna(SOAPY_SDR_RX, channel);
+}
+
+template <typename T>
+double SoapyChannelSource<T>::getGain() const
+{
+    return source->device->getGain(SOAPY_SDR_RX, channel);
+}
+
+template <typename T>
+double SoapyChannelSource<T>::getGain(const std::string& name) const
+{
+    return source->device->getGain(SOAPY_SDR_RX, channel, name);
+}
+
+template <typename T>
+bool SoapyChannelSource<T>::getAGC() const
+{
+    return source->device->getGainMode(SOAPY_SDR_RX, channel);
+}
+
+template <typename T>
+std::string SoapyChannelSource<T>::readChannelSetting(const std::string &key) const
+{
+    return source->device->readSetting(SOAPY_SDR_RX, channel, key);
+}
+
+namespace Csdrx {
+    template class SoapyMultiSource<Csdr::complex<short>>;
+    template class SoapyMultiSource<Csdr::complex<float>>;
+    template class SoapyChannelSource<Csdr::complex<short>>;
+    template class SoapyChannelSource<Csdr::complex<float>>;
+}
@@ -0,0 +1,133 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <csdr/source.hpp>
+#include <csdrx/controlqueue.hpp>
+#include <csdrx/soapysource.hpp>
+#include <SoapySDR/Device.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Csdrx {
+
+    template <typename T>
+    class SoapyChannelSource;
+
+    // several channels of a SoapySDR device (for instance both receivers of
+    // a LimeSDR or of a USRP B210) in one stream; each channel is a separate
+    // source (see getChannelSource()) that can feed its own pipeline.
+    // All the channels are read by the same readStream() call, so sample N
+    // of every output was taken at the same time: when one of the pipelines
+    // falls behind the reads wait for it, and an overflow in the driver hits
+    // all the channels at once.
+    // Streaming starts when every output has a writer
+    template <typename T>
+    class SoapyMultiSource: private SoapyStream {
+        public:
+            SoapyMultiSource(const std::string &args,
+                             const std::vector<size_t>& channels,
+                             double samplerate = 2e6,
+                             double frequency = 100e6,
+                             const std::string &antenna = "");
+            ~SoapyMultiSource();
+            size_t getNumChannels() const;
+            // output of channels[index]
+            SoapyChannelSource<T>* getChannelSource(size_t index);
+            void stop();
+            bool isRunning() const;
+            // setters (all the channels)
+            void setSamplerate(const double samplerate);
+            void writeSetting(const std::string &key, const std::string &value);
+            // setupStream() arguments and samples per read (0 -> the stream
+            // MTU); they take effect when streaming starts
+            void setStreamArgs(const std::string &args);
+            void setReadSize(const size_t samples);
+            // the stream is re-activated after this many consecutive read
+            // timeouts (0 -> never), or after any other read error
+            void setReactivateTimeouts(unsigned int timeouts);
+            ControlQueue& getControlQueue();
+            // getters
+            double getSamplerate() const;
+            std::string readSetting(const std::string &key) const;
+            std::string getStreamArgs() const;
+            size_t getReadSize() const;          // of the running stream
+            unsigned int getReactivateTimeouts() const;
+            size_t getTotalSamples() const;      // per channel
+            size_t getOverflows() const;
+            size_t getTimeouts() const;
+            size_t getReadErrors() const;
+            size_t getReactivations() const;
+        private:
+            void start();
+            void setup_stream() override;
+            void loop();
+            // wait until the read thread no longer uses a writer it read
+            // before this call
+            void wait_for_loop();
+            std::vector<size_t> channels;
+            std::vector<SoapyChannelSource<T>*> outputs;
+            std::mutex start_mutex;
+            std::thread* thread = nullptr;
+            // samples of the outputs without a writer
+            std::vector<T> discard;
+            // iterations of the read loop (for wait_for_loop())
+            std::mutex loop_mutex;
+            std::condition_variable loop_cv;
+            size_t loop_iterations = 0;
+            ControlQueue control;
+
+            friend class SoapyChannelSource<T>;
+    };
+
+    // one channel of a SoapyMultiSource; it is owned by the SoapyMultiSource
+    template <typename T>
+    class SoapyChannelSource: public Csdr::Source<T> {
+        public:
+            void setWriter(Csdr::Writer<T>* writer) override;
+            // detach the writer (the samples of this channel are discarded);
+            // the stream is stopped when no output has a writer. When it
+            // returns the read thread no longer uses the old writer
+            void stop();
+            bool isRunning() const;
+            // setters
+            void setBandwidth(const double bw);
+            void setFrequency(const double frequency);
+            void setAntenna(const std::string &antenna);
+            void setGain(const double value);
+            void setGain(const std::string& name, const double value);
+            void setAGC(bool enable);
+            void writeChannelSetting(const std::string &key, const std::string &value);
+            // asynchronous setters (they share the control thread of the
+            // SoapyMultiSource)
+            std::shared_future<void> setFrequencyAsync(const double frequency,
+                                                       ControlQueue::Callback callback = nullptr);
+            std::shared_future<void> setGainAsync(const double value,
+                                                  ControlQueue::Callback callback = nullptr);
+            // getters
+            size_t getChannel() const;
+            double getBandwidth() const;
+            double getFrequency() const;
+            std::string getAntenna() const;
+            double getGain() const;
+            double getGain(const std::string& name) const;
+            bool getAGC() const;
+            std::string readChannelSetting(const std::string &key) const;
+        private:
+            SoapyChannelSource(SoapyMultiSource<T>* source, size_t channel);
+            SoapyMultiSource<T>* source;
+            size_t channel;
+            std::atomic<Csdr::Writer<T>*> output{nullptr};
+
+            friend class SoapyMultiSource<T>;
+    };
+}
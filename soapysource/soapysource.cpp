@@ -6,16 +6,112 @@
  */
 
 #include "soapysource.hpp"
+#include <csdrx/kernels.hpp>
 
 #include <SoapySDR/Formats.hpp>
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
 #include <iostream>
 #include <vector>
+#include <time.h>
 
 using namespace Csdrx;
 
+static long long monotonic_ns() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000LL + now.tv_nsec;
+}
+
+// SoapyStream
+void SoapyStream::open_stream(const std::string& format, const std::vector<size_t>& channels) {
+    stream = device->setupStream(SOAPY_SDR_RX, format, channels,
+                                 SoapySDR::KwargsFromString(stream_args));
+    stream_mtu = device->getStreamMTU(stream);
+    stream_read_size = read_size;
+    if (stream_read_size == 0)
+        stream_read_size = stream_mtu;
+    if (stream_read_size == 0)
+        stream_read_size = 1024;
+}
+
+bool SoapyStream::reactivate_stream() {
+    try {
+        if (stream != nullptr) {
+            device->deactivateStream(stream);
+            if (device->activateStream(stream) == 0)
+                return true;
+            device->closeStream(stream);
+            stream = nullptr;
+        }
+        setup_stream();
+        return device->activateStream(stream) == 0;
+    } catch (const std::exception& e) {
+        std::cerr << "ERROR: " << name << ": stream re-activation failed: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+void SoapyStream::start_reading() {
+    total_samples = 0;
+    consecutive_timeouts = 0;
+    backoff_ms = 100;
+}
+
+void SoapyStream::read_done() {
+    consecutive_timeouts = 0;
+    backoff_ms = 100;
+}
+
+bool SoapyStream::read_failed(int error) {
+    if (error == SOAPY_SDR_OVERFLOW) {
+        // overflows do happen, they are non-fatal
+        overflows++;
+        std::cerr << "WARNING: SoapySDR::Device::readStream overflow" << std::endl;
+        return false;
+    }
+    if (error == SOAPY_SDR_TIMEOUT) {
+        // airspyhf devices time out on sample rate changes, so only a
+        // few timeouts in a row restart the stream
+        timeouts++;
+        consecutive_timeouts++;
+        std::cerr << "WARNING: SoapySDR::Device::readStream timeout!" << std::endl;
+        return reactivate_timeouts > 0 && consecutive_timeouts >= reactivate_timeouts;
+    }
+    read_errors++;
+    std::cerr << "ERROR: SoapySDR::Device::readStream error " << error << std::endl;
+    return true;
+}
+
+bool SoapyStream::recover() {
+    // wait a little before trying, and longer after each failure
+    for (int ms = 0; run && ms < backoff_ms; ms += 10)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    if (!run)
+        return false;
+    backoff_ms = std::min(backoff_ms * 2, 5000);
+    if (!reactivate_stream())
+        return false;
+    reactivations++;
+    consecutive_timeouts = 0;
+    std::cerr << name << ": stream re-activated" << std::endl;
+    return true;
+}
+
+void SoapyStream::print_stats() const {
+    std::cerr << "total_samples: " << total_samples << std::endl;
+    if (overflows > 0 || timeouts > 0 || read_errors > 0)
+        std::cerr << "overflows: " << overflows << " - timeouts: " << timeouts
+                  << " - read errors: " << read_errors
+                  << " - re-activations: " << reactivations << std::endl;
+}
+
+// SoapySource
 template<typename T>
 SoapySource<T>::~SoapySource() {
+    control.stop();
     SoapySDR::Device::unmake(device);
     device = nullptr;
 }
@@ -26,13 +122,21 @@ SoapySource<T>::SoapySource(const std::string &args,
                             double samplerate,
                             double frequency,
                             const std::string &antenna):
+    SoapyStream("SoapySource"),
     channel(channel)
 {
     device = SoapySDR::Device::make(args);
     std::string format = get_stream_format();
     std::vector<std::string> stream_formats = device->getStreamFormats(SOAPY_SDR_RX, channel);
-    if (std::find(stream_formats.begin(), stream_formats.end(), format) == stream_formats.end())
-        throw SoapyException("invalid stream format");
+    if (std::find(stream_formats.begin(), stream_formats.end(), format) == stream_formats.end()) {
+        // the samples can still be converted by csdrx
+        double full_scale;
+        if (get_converter(device->getNativeStreamFormat(SOAPY_SDR_RX, channel, full_scale)) == nullptr)
+            throw SoapyException("invalid stream format");
+        std::cerr << "SoapySource: the driver does not offer " << format
+                  << ", reading the native format" << std::endl;
+        native_format = true;
+    }
     setSamplerate(samplerate);
     setBandwidth(samplerate);
     setFrequency(frequency);
@@ -49,11 +153,83 @@ std::string SoapySource<Csdr::complex<short>>::get_stream_format() const {
     return SOAPY_SDR_CS16;
 }
 
+template<>
+SoapySource<Csdr::complex<float>>::Converter SoapySource<Csdr::complex<float>>::get_converter(const std::string& format) {
+    if (format == SOAPY_SDR_CS8)
+        return [] (const void* in, Csdr::complex<float>* out, size_t n, float scale) {
+            convert_cs8_to_cf32(static_cast<const signed char*>(in), out, n, scale);
+        };
+    if (format == SOAPY_SDR_CU8)
+        return [] (const void* in, Csdr::complex<float>* out, size_t n, float scale) {
+            convert_cu8_to_cf32(static_cast<const unsigned char*>(in), out, n, scale);
+        };
+    if (format == SOAPY_SDR_CS12)
+        return [] (const void* in, Csdr::complex<float>* out, size_t n, float scale) {
+            convert_cs12_to_cf32(static_cast<const unsigned char*>(in), out, n, scale);
+        };
+    if (format == SOAPY_SDR_CS16)
+        return [] (const void* in, Csdr::complex<float>* out, size_t n, float scale) {
+            convert_cs16_to_cf32(static_cast<const Csdr::complex<short>*>(in), out, n, scale);
+        };
+    return nullptr;
+}
+
+// the conversions to 16 bits don't scale the samples (like the drivers)
+template<>
+SoapySource<Csdr::complex<short>>::Converter SoapySource<Csdr::complex<short>>::get_converter(const std::string& format) {
+    if (format == SOAPY_SDR_CS8)
+        return [] (const void* in, Csdr::complex<short>* out, size_t n, float scale) {
+            convert_cs8_to_cs16(static_cast<const signed char*>(in), out, n);
+        };
+    if (format == SOAPY_SDR_CU8)
+        return [] (const void* in, Csdr::complex<short>* out, size_t n, float scale) {
+            convert_cu8_to_cs16(static_cast<const unsigned char*>(in), out, n);
+        };
+    if (format == SOAPY_SDR_CS12)
+        return [] (const void* in, Csdr::complex<short>* out, size_t n, float scale) {
+            convert_cs12_to_cs16(static_cast<const unsigned char*>(in), out, n);
+        };
+    if (format == SOAPY_SDR_CF32)
+        return [] (const void* in, Csdr::complex<short>* out, size_t n, float scale) {
+            convert_cf32_to_cs16(static_cast<const Csdr::complex<float>*>(in), out, n);
+        };
+    return nullptr;
+}
+
+// floats are scaled to the full scale reported by the driver (like the
+// SoapySDR converters); the kernels left align the CS12 values to 16 bits
+template <typename T>
+float SoapySource<T>::get_conversion_scale(const std::string& format, double full_scale) {
+    if (full_scale <= 0)
+        full_scale = 1 << (SoapySDR::formatToSize(format) * 4 - 1);
+    if (format == SOAPY_SDR_CS12)
+        full_scale *= 16;
+    return 1.0 / full_scale;
+}
+
 template <typename T>
 void SoapySource<T>::setWriter(Csdr::Writer<T> *writer) {
     Csdr::Source<T>::setWriter(writer);
-    stream = device->setupStream(SOAPY_SDR_RX, get_stream_format(),
-                                 std::vector<size_t>{channel});
+    double full_scale = 0;
+    std::string native = device->getNativeStreamFormat(SOAPY_SDR_RX, channel, full_scale);
+    stream_format = get_stream_format();
+    converter = nullptr;
+    if (native_format && native != stream_format) {
+        converter = get_converter(native);
+        if (converter == nullptr)
+            throw SoapyException("unsupported native stream format " + native);
+        stream_format = native;
+        conversion_scale = get_conversion_scale(native, full_scale);
+        native_sample_size = SoapySDR::formatToSize(native);
+    }
+    converted_samples = 0;
+    conversion_ns = 0;
+    pending_gap = false;
+    pending_lost = 0;
+    pending_reset = false;
+    hw_time_valid = false;
+    next_timestamp_ns = 0;
+    setup_stream();
     //show_device_config();
     device->activateStream(stream);
     run = true;
@@ -62,35 +238,184 @@ void SoapySource<T>::setWriter(Csdr::Writer<T> *writer) {
     }
 }
 
+template <typename T>
+void SoapySource<T>::setup_stream() {
+    open_stream(stream_format, std::vector<size_t>{channel});
+    if (converter != nullptr)
+        native_buffer.resize(stream_read_size * native_sample_size);
+    // the format of the direct access buffers is the native format
+    double full_scale;
+    stream_direct_access = direct_access &&
+                           device->getNumDirectAccessBuffers(stream) > 0 &&
+                           device->getNativeStreamFormat(SOAPY_SDR_RX, channel, full_scale) == stream_format;
+    stream_samplerate = device->getSampleRate(SOAPY_SDR_RX, channel);
+}
+
 template <typename T>
 void SoapySource<T>::loop() {
 
-    size_t available;
     long long timeNs = 0;
-    long timeoutNs = 1e6;
+    long timeoutUs = 1e6;
     int flags = 0;
 
-    total_samples = 0;
+    start_reading();
+    pending_retune = false;
     while (run) {
-        available = std::min(this->writer->writeable(), (size_t) 1024);
-        void* buffs[] = {(void*) this->writer->getWritePointer()};
-        int samples = device->readStream(stream, buffs, available, flags, timeNs, timeoutNs);
+        flags = 0;
+        int samples = SOAPY_SDR_STREAM_ERROR;
+        if (stream != nullptr)
+            samples = stream_direct_access ? read_direct(flags, timeNs, timeoutUs) :
+                                             read_stream(flags, timeNs, timeoutUs);
+        bool reactivate = false;
         if (samples > 0) {
-            this->writer->advance(samples);
+            size_t first = total_samples;
             total_samples += samples;
-        } else if (samples == SOAPY_SDR_OVERFLOW) {
-            // overflows do happen, they are non-fatal. a warning should do
-            std::cerr << "WARNING: SoapySDR::Device::readStream overflow" << std::endl;
-        } else if (samples == SOAPY_SDR_TIMEOUT) {
-            // timeout should not break the read loop.
-            // TODO or should they? Jakob Ketterl tried, but airspyhf devices will end up here on sample rate changes.
-            std::cerr << "WARNING: SoapySDR::Device::readStream timeout!" << std::endl;
+            emit_tags(flags, timeNs, first, samples);
+            read_done();
+        } else if (samples == 0) {
+            // the pipeline is behind
         } else {
-            // other errors should break the read loop.
-            std::cerr << "ERROR: SoapySDR::Device::readStream error " << samples << std::endl;
-            break;
+            // the sample after an overflow is marked with a Gap tag
+            if (samples == SOAPY_SDR_OVERFLOW)
+                pending_gap = true;
+            reactivate = read_failed(samples);
+        }
+        if (reactivate) {
+            if (recover())
+                pending_reset = true;
+            else if (!run)
+                break;
+        }
+        if (read_dropped > 0) {
+            dropped_samples += read_dropped;
+            pending_lost += read_dropped;
+            pending_gap = true;
+            read_dropped = 0;
+        }
+    }
+}
+
+template <typename T>
+void SoapySource<T>::emit_tags(int flags, long long timeNs, size_t first, size_t samples) {
+    bool has_time = flags & SOAPY_SDR_HAS_TIME;
+    if (pending_reset) {
+        emitTag(TagType::Reset, first, monotonic_ns());
+        pending_reset = false;
+        pending_gap = false;
+        pending_lost = 0;
+        hw_time_valid = false;
+        next_timestamp_ns = 0;
+    }
+    if (pending_retune) {
+        std::lock_guard<std::mutex> lock(retune_mutex);
+        emitTag(TagType::Retune, std::min(retune_sample, first), monotonic_ns(),
+                retune_frequency);
+        pending_retune = false;
+    }
+    if (pending_gap) {
+        // the hardware times tell how many samples were lost (including
+        // those dropped here)
+        size_t lost = pending_lost;
+        if (has_time && hw_time_valid && timeNs > next_hw_time_ns)
+            lost = llround((timeNs - next_hw_time_ns) * 1e-9 * stream_samplerate);
+        lost_samples += lost;
+        emitTag(TagType::Gap, first, monotonic_ns(), lost);
+        pending_gap = false;
+        pending_lost = 0;
+    }
+    if (has_time) {
+        if (timeNs >= next_timestamp_ns) {
+            emitTag(TagType::HardwareTime, first, timeNs);
+            next_timestamp_ns = timeNs + timestamp_interval_ns;
+        }
+        double rate = stream_samplerate;
+        hw_time_valid = rate > 0;
+        if (hw_time_valid)
+            next_hw_time_ns = timeNs + llround(samples * 1e9 / rate);
+    } else {
+        hw_time_valid = false;
+    }
+    if (flags & SOAPY_SDR_END_BURST)
+        emitTag(TagType::EndOfBurst, first + samples - 1, monotonic_ns());
+}
+
+// the driver converts and copies the samples into the ring buffer (or, with
+// a native format, copies them to native_buffer, and csdrx converts them)
+template <typename T>
+int SoapySource<T>::read_stream(int& flags, long long& timeNs, long timeoutUs) {
+    size_t available = std::min(this->writer->writeable(), stream_read_size);
+    if (available == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        return 0;
+    }
+    T* buffer = this->writer->getWritePointer();
+    void* buffs[] = {converter != nullptr ? (void*) native_buffer.data() : (void*) buffer};
+    int samples = device->readStream(stream, buffs, available, flags, timeNs, timeoutUs);
+    if (samples > 0) {
+        if (converter != nullptr)
+            convert_samples(native_buffer.data(), buffer, samples);
+        measure(buffer, samples);
+        this->writer->advance(samples);
+    }
+    return samples;
+}
+
+// the samples are copied (or converted) once, from the driver buffer to the
+// ring buffer
+template <typename T>
+int SoapySource<T>::read_direct(int& flags, long long& timeNs, long timeoutUs) {
+    // a driver buffer must be released right away, so it is only acquired
+    // when a whole one fits (the csdr ring buffers are mirrored, so
+    // writeable() is all the free space); otherwise the driver buffers
+    // fill up and the driver reports the overflow, as with readStream()
+    if (this->writer->writeable() < stream_mtu) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        return 0;
+    }
+    size_t handle;
+    const void* buffs[1];
+    int samples = device->acquireReadBuffer(stream, handle, buffs, flags, timeNs, timeoutUs);
+    if (samples <= 0)
+        return samples;
+    const char* data = static_cast<const char*>(buffs[0]);
+    if (converter == nullptr)
+        measure(reinterpret_cast<const T*>(data), samples);
+    size_t sample_size = converter != nullptr ? native_sample_size : sizeof(T);
+    // two writes at most, when the ring buffer wraps around
+    size_t done = 0;
+    for (int i = 0; i < 2 && done < (size_t) samples; i++) {
+        size_t how_much = std::min(this->writer->writeable(), samples - done);
+        T* out = this->writer->getWritePointer();
+        if (converter != nullptr) {
+            convert_samples(data + done * sample_size, out, how_much);
+            measure(out, how_much);
+        } else {
+            memcpy(out, data + done * sample_size, how_much * sizeof(T));
         }
+        this->writer->advance(how_much);
+        done += how_much;
     }
+    device->releaseReadBuffer(stream, handle);
+    // the driver buffer must be released, so what doesn't fit is dropped
+    read_dropped = samples - done;
+    return done;
+}
+
+template <typename T>
+void SoapySource<T>::convert_samples(const void* in, T* out, size_t how_much) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    converter(in, out, how_much, conversion_scale);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    conversion_ns += (end.tv_sec - start.tv_sec) * 1000000000LL + (end.tv_nsec - start.tv_nsec);
+    converted_samples += how_much;
+}
+
+template <typename T>
+void SoapySource<T>::measure(const T* samples, size_t how_much) {
+    if (!signal_stats)
+        return;
+    stats.measure(samples, how_much, monotonic_ns());
 }
 
 template <typename T>
@@ -104,10 +429,20 @@ void SoapySource<T>::stop() {
         delete(thread);
         thread = nullptr;
     }
-    device->deactivateStream(stream);
-    device->closeStream(stream);
-    stream = nullptr;
-    std::cerr << "total_samples: " << total_samples << std::endl;
+    if (stream != nullptr) {
+        device->deactivateStream(stream);
+        device->closeStream(stream);
+        stream = nullptr;
+    }
+    print_stats();
+    if (lost_samples > 0 || dropped_samples > 0)
+        std::cerr << "lost samples: " << lost_samples
+                  << " - dropped samples: " << dropped_samples << std::endl;
+    if (converter != nullptr) {
+        ConversionStats conversion = getConversionStats();
+        std::cerr << "conversion from " << conversion.format << ": "
+                  << conversion.nsPerSample << " ns/sample" << std::endl;
+    }
 }
 
 template <typename T>
@@ -126,6 +461,8 @@ template <typename T>
 void SoapySource<T>::setSamplerate(const double samplerate)
 {
     device->setSampleRate(SOAPY_SDR_RX, channel, samplerate);
+    if (stream != nullptr)
+        stream_samplerate = device->getSampleRate(SOAPY_SDR_RX, channel);
 }
 
 template <typename T>
@@ -147,6 +484,12 @@ template <typename T>
 void SoapySource<T>::setFrequency(const double frequency)
 {
     device->setFrequency(SOAPY_SDR_RX, channel, frequency);
+    if (run) {
+        std::lock_guard<std::mutex> lock(retune_mutex);
+        retune_sample = total_samples;
+        retune_frequency = frequency;
+        pending_retune = true;
+    }
 }
 
 template <typename T>
@@ -209,6 +552,107 @@ void SoapySource<T>::writeChannelSetting(const std::string &key, const std::stri
     device->writeSetting(SOAPY_SDR_RX, channel, key, value);
 }
 
+// asynchronous setters
+template <typename T>
+std::shared_future<void> SoapySource<T>::setFrequencyAsync(const double frequency,
+                                                           ControlQueue::Callback callback)
+{
+    return control.submit("frequency", [=] () { setFrequency(frequency); }, callback);
+}
+
+template <typename T>
+std::shared_future<void> SoapySource<T>::setGainAsync(const double value,
+                                                      ControlQueue::Callback callback)
+{
+    return control.submit("gain", [=] () { setGain(value); }, callback);
+}
+
+template <typename T>
+std::shared_future<void> SoapySource<T>::setGainAsync(const std::string& name, const double value,
+                                                      ControlQueue::Callback callback)
+{
+    return control.submit("gain/" + name, [=] () { setGain(name, value); }, callback);
+}
+
+template <typename T>
+std::shared_future<void> SoapySource<T>::setAGCAsync(bool enable,
+                                                     ControlQueue::Callback callback)
+{
+    return control.submit("agc", [=] () { setAGC(enable); }, callback);
+}
+
+template <typename T>
+std::shared_future<void> SoapySource<T>::setPPMAsync(const double ppm,
+                                                     ControlQueue::Callback callback)
+{
+    return control.submit("ppm", [=] () { setPPM(ppm); }, callback);
+}
+
+template <typename T>
+std::shared_future<void> SoapySource<T>::writeSettingAsync(const std::string &key, const std::string &value,
+                                                           ControlQueue::Callback callback)
+{
+    return control.submit("setting/" + key, [=] () { writeSetting(key, value); }, callback);
+}
+
+template <typename T>
+std::shared_future<void> SoapySource<T>::writeChannelSettingAsync(const std::string &key, const std::string &value,
+                                                                  ControlQueue::Callback callback)
+{
+    return control.submit("channelsetting/" + key, [=] () { writeChannelSetting(key, value); }, callback);
+}
+
+template <typename T>
+ControlQueue& SoapySource<T>::getControlQueue()
+{
+    return control;
+}
+
+template <typename T>
+void SoapySource<T>::setSignalStats(bool enable, double clip_level)
+{
+    stats.setClipLevel(clip_level);
+    signal_stats = enable;
+}
+
+template <typename T>
+void SoapySource<T>::setStreamArgs(const std::string &args)
+{
+    stream_args = args;
+}
+
+template <typename T>
+void SoapySource<T>::setReadSize(const size_t samples)
+{
+    read_size = samples;
+}
+
+template <typename T>
+void SoapySource<T>::setDirectAccess(bool enable)
+{
+    direct_access = enable;
+}
+
+template <typename T>
+void SoapySource<T>::setNativeFormat(bool enable)
+{
+    native_format = enable;
+}
+
+template <typename T>
+void SoapySource<T>::setTimestampInterval(double seconds)
+{
+    if (seconds < 0)
+        throw SoapyException("invalid timestamp interval");
+    timestamp_interval_ns = seconds * 1e9;
+}
+
+template <typename T>
+void SoapySource<T>::setReactivateTimeouts(unsigned int timeouts)
+{
+    reactivate_timeouts = timeouts;
+}
+
 // getters
 template <typename T>
 size_t SoapySource<T>::getChannel() const
@@ -294,6 +738,109 @@ std::string SoapySource<T>::readChannelSetting(const std::string &key) const
     return device->readSetting(SOAPY_SDR_RX, channel, key);
 }
 
+template <typename T>
+std::string SoapySource<T>::getStreamArgs() const
+{
+    return stream_args;
+}
+
+template <typename T>
+size_t SoapySource<T>::getReadSize() const
+{
+    return stream_read_size;
+}
+
+template <typename T>
+bool SoapySource<T>::getDirectAccess() const
+{
+    return stream_direct_access;
+}
+
+template <typename T>
+bool SoapySource<T>::getNativeFormat() const
+{
+    return native_format;
+}
+
+template <typename T>
+std::string SoapySource<T>::getStreamFormat() const
+{
+    return stream_format;
+}
+
+template <typename T>
+ConversionStats SoapySource<T>::getConversionStats() const
+{
+    ConversionStats conversion;
+    conversion.format = stream_format;
+    conversion.samples = converted_samples;
+    long long ns = conversion_ns;
+    conversion.seconds = ns * 1e-9;
+    if (conversion.samples > 0)
+        conversion.nsPerSample = (double) ns / conversion.samples;
+    return conversion;
+}
+
+template <typename T>
+double SoapySource<T>::getTimestampInterval() const
+{
+    return timestamp_interval_ns / 1e9;
+}
+
+template <typename T>
+unsigned int SoapySource<T>::getReactivateTimeouts() const
+{
+    return reactivate_timeouts;
+}
+
+template <typename T>
+size_t SoapySource<T>::getTotalSamples() const
+{
+    return total_samples;
+}
+
+template <typename T>
+size_t SoapySource<T>::getOverflows() const
+{
+    return overflows;
+}
+
+template <typename T>
+size_t SoapySource<T>::getLostSamples() const
+{
+    return lost_samples;
+}
+
+template <typename T>
+size_t SoapySource<T>::getDroppedSamples() const
+{
+    return dropped_samples;
+}
+
+template <typename T>
+size_t SoapySource<T>::getTimeouts() const
+{
+    return timeouts;
+}
+
+template <typename T>
+size_t SoapySource<T>::getReadErrors() const
+{
+    return read_errors;
+}
+
+template <typename T>
+size_t SoapySource<T>::getReactivations() const
+{
+    return reactivations;
+}
+
+template <typename T>
+SignalStats SoapySource<T>::getSignalStats() const
+{
+    return stats.getSnapshot();
+}
+
 template <typename T>
 void SoapySource<T>::show_device_config() const
 {
@@ -305,6 +852,9 @@ void SoapySource<T>::show_device_config() const
     std::cerr << "    gain(RFGR)=" << device->getGain(SOAPY_SDR_RX, channel, "RFGR") << std::endl;
     std::cerr << "    gain(IFGR)=" << device->getGain(SOAPY_SDR_RX, channel, "IFGR") << std::endl;
     std::cerr << "    antenna=" << device->getAntenna(SOAPY_SDR_RX, channel) << std::endl;
+    std::cerr << "    read size=" << stream_read_size << std::endl;
+    std::cerr << "    direct access=" << stream_direct_access << std::endl;
+    std::cerr << "    stream format=" << stream_format << (converter != nullptr ? " (converted by csdrx)" : "") << std::endl;
     std::cerr << "--------------------------------------------------------------------------------" << std::endl;
 }
 
@@ -8,10 +8,17 @@
 #pragma once
 
 #include <csdr/source.hpp>
+#include <csdrx/controlqueue.hpp>
+#include <csdrx/signalstats.hpp>
+#include <csdrx/tags.hpp>
 #include <SoapySDR/Device.hpp>
 #include <SoapySDR/Version.hpp>
+#include <atomic>
+#include <mutex>
 #include <stdexcept>
+#include <string>
 #include <thread>
+#include <vector>
 
 namespace Csdrx {
 
@@ -20,8 +27,74 @@ namespace Csdrx {
             SoapyException(const std::string& reason): std::runtime_error(reason) {}
     };
 
+    // cost of the conversions from the native stream format done by csdrx
+    struct ConversionStats {
+        std::string format;       // format read from the device
+        size_t samples = 0;       // samples converted
+        double seconds = 0;       // time spent converting
+        double nsPerSample = 0;
+    };
+
+    // the stream handling shared by SoapySource and SoapyMultiSource: the
+    // read size, the read errors, the re-activation of the stream (with a
+    // backoff), and the statistics
+    class SoapyStream {
+        protected:
+            // 'name' is the prefix of the messages
+            SoapyStream(const char* name): name(name) {}
+            virtual ~SoapyStream() = default;
+            // sets up 'stream' and the read size of the running stream
+            void open_stream(const std::string& format, const std::vector<size_t>& channels);
+            // called by reactivate_stream() when the stream has to be set up
+            // again; it must call open_stream()
+            virtual void setup_stream() = 0;
+            // restart the stream, or set it up again if the driver can't
+            // restart it
+            bool reactivate_stream();
+            // the read thread calls start_reading() before the first read,
+            // and read_done() or read_failed() after each read;
+            // read_failed() returns true when the stream must be re-activated
+            void start_reading();
+            void read_done();
+            bool read_failed(int error);
+            // waits (longer after each failure) and re-activates the stream;
+            // false if it failed or if the source was stopped meanwhile
+            bool recover();
+            void print_stats() const;
+
+            const char* name;
+            SoapySDR::Device* device = nullptr;
+            SoapySDR::Stream* stream = nullptr;
+            std::atomic<bool> run{false};
+            std::atomic<size_t> total_samples{0};
+            std::string stream_args;
+            size_t read_size = 0;
+            // settings of the running stream
+            size_t stream_read_size = 0;
+            size_t stream_mtu = 0;
+            // read errors
+            unsigned int reactivate_timeouts = 3;
+            unsigned int consecutive_timeouts = 0;
+            int backoff_ms = 100;
+            std::atomic<size_t> overflows{0};
+            std::atomic<size_t> timeouts{0};
+            std::atomic<size_t> read_errors{0};
+            std::atomic<size_t> reactivations{0};
+    };
+
+    // HardwareTime tags (when the driver sets SOAPY_SDR_HAS_TIME),
+    // EndOfBurst tags (SOAPY_SDR_END_BURST), Gap tags (after an overflow, or
+    // samples dropped because the pipeline was too slow; the value is the
+    // number of samples lost, when known, or 0), and Reset tags (after the
+    // stream was re-activated) are emitted from the read thread after the
+    // tagged sample has been written.
+    // setFrequency() (and setFrequencyAsync()) queue a Retune tag at the
+    // number of samples read so far, and the read thread emits it with the
+    // next block.
+    // When the driver doesn't offer the pipeline format, the constructor
+    // turns on setNativeFormat() (and logs it to std::cerr)
     template <typename T>
-    class SoapySource: public Csdr::Source<T> {
+    class SoapySource: public Csdr::Source<T>, public TagEmitter, private SoapyStream {
         public:
             SoapySource(const std::string &args = "",
                         const size_t channel = 0,
@@ -48,6 +121,47 @@ namespace Csdrx {
 #endif
             void writeSetting(const std::string &key, const std::string &value);
             void writeChannelSetting(const std::string &key, const std::string &value);
+            // asynchronous setters: the change is queued to the control
+            // thread and the call returns immediately; a change still in the
+            // queue is replaced by a newer one of the same kind
+            std::shared_future<void> setFrequencyAsync(const double frequency,
+                                                       ControlQueue::Callback callback = nullptr);
+            std::shared_future<void> setGainAsync(const double value,
+                                                  ControlQueue::Callback callback = nullptr);
+            std::shared_future<void> setGainAsync(const std::string& name, const double value,
+                                                  ControlQueue::Callback callback = nullptr);
+            std::shared_future<void> setAGCAsync(bool enable,
+                                                 ControlQueue::Callback callback = nullptr);
+            std::shared_future<void> setPPMAsync(const double ppm,
+                                                 ControlQueue::Callback callback = nullptr);
+            std::shared_future<void> writeSettingAsync(const std::string &key, const std::string &value,
+                                                       ControlQueue::Callback callback = nullptr);
+            std::shared_future<void> writeChannelSettingAsync(const std::string &key, const std::string &value,
+                                                              ControlQueue::Callback callback = nullptr);
+            ControlQueue& getControlQueue();
+            // measure peak, RMS, DC and clipped samples of each block read
+            // from the device in the read thread (see getSignalStats())
+            void setSignalStats(bool enable, double clip_level = 0.99);
+            // setupStream() arguments (for instance "buffers=16,bufflen=65536");
+            // they take effect with the next setWriter()
+            void setStreamArgs(const std::string &args);
+            // samples per read (0 -> the stream MTU)
+            void setReadSize(const size_t samples);
+            // read straight from the driver buffers (acquireReadBuffer()),
+            // when the driver supports it and the stream format is its
+            // native format
+            void setDirectAccess(bool enable);
+            // read the native format of the device (getNativeStreamFormat(),
+            // for instance CS8, CU8 or CS12) and convert it with the csdrx
+            // vectorized kernels instead of the driver; it is also used when
+            // the driver doesn't offer the pipeline format. Takes effect with
+            // the next setWriter()
+            void setNativeFormat(bool enable);
+            // minimum time between HardwareTime tags (0 -> every read)
+            void setTimestampInterval(double seconds);
+            // the stream is re-activated after this many consecutive read
+            // timeouts (0 -> never), or after any other read error
+            void setReactivateTimeouts(unsigned int timeouts);
             // getters
             size_t getChannel() const;
             double getSamplerate() const;
@@ -64,16 +178,69 @@ namespace Csdrx {
 #endif
             std::string readSetting(const std::string &key) const;
             std::string readChannelSetting(const std::string &key) const;
+            std::string getStreamArgs() const;
+            size_t getReadSize() const;          // of the running stream
+            bool getDirectAccess() const;        // of the running stream
+            bool getNativeFormat() const;
+            std::string getStreamFormat() const; // of the running stream
+            ConversionStats getConversionStats() const;
+            double getTimestampInterval() const;
+            unsigned int getReactivateTimeouts() const;
+            size_t getTotalSamples() const;
+            size_t getOverflows() const;
+            size_t getLostSamples() const;       // in the gaps, when known
+            size_t getDroppedSamples() const;    // the pipeline was too slow
+            size_t getTimeouts() const;
+            size_t getReadErrors() const;
+            size_t getReactivations() const;
+            // statistics of the last block (lock-free; any thread)
+            SignalStats getSignalStats() const;
         private:
+            typedef void (*Converter)(const void* in, T* out, size_t n, float scale);
             std::string get_stream_format() const;
+            static Converter get_converter(const std::string& format);
+            static float get_conversion_scale(const std::string& format, double full_scale);
+            void setup_stream() override;
+            void emit_tags(int flags, long long timeNs, size_t first, size_t samples);
             void loop();
+            int read_stream(int& flags, long long& timeNs, long timeoutUs);
+            int read_direct(int& flags, long long& timeNs, long timeoutUs);
+            void convert_samples(const void* in, T* out, size_t how_much);
+            void measure(const T* samples, size_t how_much);
             void show_device_config() const;
-            SoapySDR::Device* device = nullptr;
-            SoapySDR::Stream* stream = nullptr;
             size_t channel = 0;
             double samplerate;
-            bool run = false;
             std::thread* thread = nullptr;
-            size_t total_samples = 0;
+            bool direct_access = true;
+            bool native_format = false;
+            // settings of the running stream
+            bool stream_direct_access = false;
+            std::string stream_format;
+            Converter converter = nullptr;
+            float conversion_scale = 1;
+            size_t native_sample_size = 0;
+            std::vector<char> native_buffer;
+            std::atomic<size_t> converted_samples{0};
+            std::atomic<long long> conversion_ns{0};
+            std::atomic<double> stream_samplerate{0};
+            // tags
+            long long timestamp_interval_ns = 0;
+            bool pending_gap = false;
+            size_t pending_lost = 0;
+            size_t read_dropped = 0;
+            bool pending_reset = false;
+            // Retune tag queued by setFrequency()
+            std::mutex retune_mutex;
+            std::atomic<bool> pending_retune{false};
+            size_t retune_sample = 0;
+            double retune_frequency = 0;
+            bool hw_time_valid = false;
+            long long next_hw_time_ns = 0;
+            long long next_timestamp_ns = 0;
+            std::atomic<size_t> lost_samples{0};
+            std::atomic<size_t> dropped_samples{0};
+            ControlQueue control;
+            std::atomic<bool> signal_stats{false};
+            SignalStatsMeter stats;
     };
 }
@@ -0,0 +1,88 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "stagingbuffer.hpp"
+
+#include <csdr/complex.hpp>
+#include <csdrx/tags.hpp>
+#include <algorithm>
+#include <cstring>
+
+using namespace Csdrx;
+
+template <typename T>
+StagingBuffer<T>::StagingBuffer(size_t size):
+    size(size),
+    written(0),
+    read(0)
+{
+    data = new T[size];
+    // touch all the pages now, so the producer never takes a page fault
+    memset((void*) data, 0, size * sizeof(T));
+}
+
+template <typename T>
+StagingBuffer<T>::~StagingBuffer() {
+    delete[] data;
+}
+
+// producer side
+template <typename T>
+size_t StagingBuffer<T>::writeable() const {
+    size_t w = written.load(std::memory_order_relaxed);
+    size_t r = read.load(std::memory_order_acquire);
+    return std::min(size - (w - r), size - w % size);
+}
+
+template <typename T>
+T* StagingBuffer<T>::getWritePointer() {
+    return data + written.load(std::memory_order_relaxed) % size;
+}
+
+template <typename T>
+void StagingBuffer<T>::advanceWrite(size_t how_much) {
+    written.store(written.load(std::memory_order_relaxed) + how_much,
+                  std::memory_order_release);
+}
+
+template <typename T>
+size_t StagingBuffer<T>::freeSpace() const {
+    return size - (written.load(std::memory_order_relaxed) -
+                   read.load(std::memory_order_acquire));
+}
+
+// consumer side
+template <typename T>
+size_t StagingBuffer<T>::available() const {
+    size_t w = written.load(std::memory_order_acquire);
+    size_t r = read.load(std::memory_order_relaxed);
+    return std::min(w - r, size - r % size);
+}
+
+template <typename T>
+const T* StagingBuffer<T>::getReadPointer() const {
+    return data + read.load(std::memory_order_relaxed) % size;
+}
+
+template <typename T>
+void StagingBuffer<T>::advanceRead(size_t how_much) {
+    read.store(read.load(std::memory_order_relaxed) + how_much,
+               std::memory_order_release);
+}
+
+template <typename T>
+size_t StagingBuffer<T>::getSize() const {
+    return size;
+}
+
+namespace Csdrx {
+    template class StagingBuffer<Csdr::complex<short>>;
+    template class StagingBuffer<Csdr::complex<float>>;
+    template class StagingBuffer<Tag>;
+    template class StagingBuffer<short>;
+    template class StagingBuffer<float>;
+}
@@ -0,0 +1,44 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+namespace Csdrx {
+
+    // lock-free single producer, single consumer ring buffer used to decouple
+    // a driver callback (producer) from the pipeline (consumer); neither side
+    // ever blocks. The read and write pointers are contiguous, so a full
+    // transfer may take two calls when the buffer wraps around
+    template <typename T>
+    class StagingBuffer {
+        public:
+            explicit StagingBuffer(size_t size);
+            ~StagingBuffer();
+            // producer side
+            size_t writeable() const;
+            T* getWritePointer();
+            void advanceWrite(size_t how_much);
+            // total free space (it may not be contiguous)
+            size_t freeSpace() const;
+            // consumer side
+            size_t available() const;
+            const T* getReadPointer() const;
+            void advanceRead(size_t how_much);
+            size_t getSize() const;
+        private:
+            T* data;
+            size_t size;
+            // total samples written and read; each counter is only modified
+            // by one side, and they are kept on separate cache lines
+            std::atomic<size_t> written;
+            char padding[64];
+            std::atomic<size_t> read;
+    };
+}
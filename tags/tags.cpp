@@ -0,0 +1,35 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "tags.hpp"
+
+#include <algorithm>
+
+using namespace Csdrx;
+
+void TagEmitter::addTagListener(TagListener* listener) {
+    std::lock_guard<std::mutex> lock(listeners_mutex);
+    if (std::find(listeners.begin(), listeners.end(), listener) == listeners.end())
+        listeners.push_back(listener);
+}
+
+void TagEmitter::removeTagListener(TagListener* listener) {
+    std::lock_guard<std::mutex> lock(listeners_mutex);
+    listeners.erase(std::remove(listeners.begin(), listeners.end(), listener),
+                    listeners.end());
+}
+
+void TagEmitter::emitTag(const Tag& tag) {
+    std::lock_guard<std::mutex> lock(listeners_mutex);
+    for (auto listener: listeners)
+        listener->onTag(tag);
+}
+
+void TagEmitter::emitTag(TagType type, size_t sample, long long timeNs,
+                         double value) {
+    emitTag(Tag{type, sample, timeNs, value});
+}
@@ -0,0 +1,68 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace Csdrx {
+
+    // stream tags are out-of-band events attached to a sample of a stream;
+    // they are delivered synchronously to the listeners, so listeners must
+    // not block
+    enum class TagType {
+        Trigger,          // capture the signal around this point
+        Timestamp,        // timeNs is the CLOCK_MONOTONIC time the sample was
+                          // received; value is the hardware sample number
+        Gap,              // samples are missing before this one; value is
+                          // the number of missing samples
+        Reset,            // the device restarted the stream (e.g. after a
+                          // samplerate change)
+        Retune,           // first sample at a new frequency; value is the
+                          // frequency in Hz
+        HardwareTime,     // timeNs is the time of the sample according to the
+                          // device clock (e.g. SoapySDR SOAPY_SDR_HAS_TIME)
+        EndOfBurst,       // last sample of a burst
+    };
+
+    struct Tag {
+        TagType type;
+        size_t sample;        // sample index (from the start of the stream)
+        long long timeNs;     // time associated with the sample (0 if unknown)
+        double value;         // tag specific value
+    };
+
+    class TagListener {
+        public:
+            virtual ~TagListener() = default;
+            virtual void onTag(const Tag& tag) = 0;
+    };
+
+    // modules that keep state across samples (filter history, partial
+    // frames, etc) implement Resettable, so Pipeline::flush() can clear it
+    // after a discontinuity in the stream
+    class Resettable {
+        public:
+            virtual ~Resettable() = default;
+            virtual void reset() = 0;
+    };
+
+    class TagEmitter {
+        public:
+            virtual ~TagEmitter() = default;
+            void addTagListener(TagListener* listener);
+            void removeTagListener(TagListener* listener);
+            void emitTag(const Tag& tag);
+            void emitTag(TagType type, size_t sample, long long timeNs = 0,
+                         double value = 0);
+        private:
+            std::mutex listeners_mutex;
+            std::vector<TagListener*> listeners;
+    };
+}
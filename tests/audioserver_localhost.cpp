@@ -0,0 +1,229 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// AudioServer on 127.0.0.1 (with port 0, so the system picks a free one):
+// the test connects as an HTTP client and as a WebSocket client and checks
+// the bytes they receive, and checks that a client that doesn't read is
+// dropped after getMaxLag() seconds of audio
+
+#include "testutil.hpp"
+#include <csdrx/audioserver.hpp>
+#include <algorithm>
+#include <arpa/inet.h>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace Csdrx;
+
+static int connect_to(unsigned short port, int receive_buffer = 0)
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    // no test waits forever for the server
+    struct timeval timeout = { 5, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (receive_buffer > 0)
+        setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &receive_buffer, sizeof(receive_buffer));
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (struct sockaddr*) &address, sizeof(address)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static bool send_string(int fd, const std::string& s)
+{
+    return send(fd, s.data(), s.size(), MSG_NOSIGNAL) == (ssize_t) s.size();
+}
+
+static std::string receive_bytes(int fd, size_t n)
+{
+    std::string result;
+    char buffer[4096];
+    while (result.size() < n) {
+        ssize_t size = recv(fd, buffer, std::min(sizeof(buffer), n - result.size()), 0);
+        if (size <= 0)
+            break;
+        result.append(buffer, size);
+    }
+    return result;
+}
+
+// the response header, up to the empty line
+static std::string receive_header(int fd)
+{
+    std::string header;
+    while (header.size() < 8192 &&
+           (header.size() < 4 || header.compare(header.size() - 4, 4, "\r\n\r\n") != 0)) {
+        std::string c = receive_bytes(fd, 1);
+        if (c.empty())
+            break;
+        header += c;
+    }
+    return header;
+}
+
+static uint32_t get_le(const std::string& s, size_t offset, int bytes)
+{
+    uint32_t v = 0;
+    for (int i = bytes - 1; i >= 0; i--)
+        v = (v << 8) | (unsigned char) s[offset + i];
+    return v;
+}
+
+template <typename T>
+static void write_samples(AudioServer<T>& server, const T* samples, size_t n)
+{
+    while (n > 0) {
+        size_t w = std::min(server.writeable(), n);
+        memcpy(server.getWritePointer(), samples, w * sizeof(T));
+        server.advance(w);
+        samples += w;
+        n -= w;
+    }
+}
+
+// the server only sends the frames encoded after the request was handled
+static void wait_for_streaming(int fd, const std::string& request, std::string& header)
+{
+    send_string(fd, request);
+    header = receive_header(fd);
+}
+
+// GET /audio.wav: the WAV header, then the float samples as S16LE
+static void test_wav()
+{
+    AudioServer<float> server(8000, 0, 1, AudioCodec::PCM, "127.0.0.1", 0.02);
+    int fd = connect_to(server.getPort());
+    check(fd >= 0, "wav: connected");
+    std::string header;
+    wait_for_streaming(fd, "GET /audio.wav HTTP/1.0\r\n\r\n", header);
+    check(header.compare(0, 15, "HTTP/1.0 200 OK") == 0, "wav: HTTP response");
+
+    std::string wav = receive_bytes(fd, 44);
+    check(wav.size() == 44 && wav.compare(0, 4, "RIFF") == 0 &&
+          wav.compare(8, 8, "WAVEfmt ") == 0 && wav.compare(36, 4, "data") == 0,
+          "wav: WAV header");
+    check(get_le(wav, 20, 2) == 1 && get_le(wav, 22, 2) == 1 &&
+          get_le(wav, 24, 4) == 8000 && get_le(wav, 28, 4) == 16000 &&
+          get_le(wav, 32, 2) == 2 && get_le(wav, 34, 2) == 16,
+          "wav: PCM format");
+
+    // one 20ms frame, with values out of range at the end
+    std::vector<float> samples(160);
+    for (size_t i = 0; i < samples.size(); i++)
+        samples[i] = (i - 80.0f) / 100.0f;
+    samples[158] = 1.5f;
+    samples[159] = -1.5f;
+    write_samples(server, samples.data(), samples.size());
+    std::string pcm = receive_bytes(fd, 2 * samples.size());
+    bool same = pcm.size() == 2 * samples.size();
+    for (size_t i = 0; i < samples.size() && same; i++) {
+        long expected = std::max(std::min(lrintf(samples[i] * 32768.0f), 32767L), -32768L);
+        same = (int16_t) get_le(pcm, 2 * i, 2) == expected;
+    }
+    check(same, "wav: PCM samples");
+
+    close(fd);
+    server.stop();
+}
+
+// WebSocket: the handshake, the format message, one binary message per frame
+static void test_websocket()
+{
+    AudioServer<short> server(8000, 0, 2, AudioCodec::PCM, "127.0.0.1", 0.02);
+    int fd = connect_to(server.getPort());
+    check(fd >= 0, "websocket: connected");
+    std::string header;
+    // the key and the accept value of the example in RFC 6455
+    wait_for_streaming(fd, "GET /audio HTTP/1.1\r\n"
+                           "Host: 127.0.0.1\r\n"
+                           "Upgrade: websocket\r\n"
+                           "Connection: Upgrade\r\n"
+                           "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                           "Sec-WebSocket-Version: 13\r\n\r\n", header);
+    check(header.compare(0, 12, "HTTP/1.1 101") == 0, "websocket: switching protocols");
+    check(header.find("Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n") != std::string::npos,
+          "websocket: Sec-WebSocket-Accept");
+
+    std::string text = receive_bytes(fd, 2);
+    std::string format = text.size() == 2 ? receive_bytes(fd, text[1] & 0x7f) : "";
+    check(text.size() == 2 && (unsigned char) text[0] == 0x81, "websocket: text message");
+    check(format.find("\"codec\":\"pcm\"") != std::string::npos &&
+          format.find("\"channels\":2") != std::string::npos &&
+          format.find("\"frameSamples\":160") != std::string::npos,
+          "websocket: format message");
+
+    // three frames of 160 stereo samples: 640 bytes each
+    std::vector<short> samples(3 * 2 * 160);
+    for (size_t i = 0; i < samples.size(); i++)
+        samples[i] = i * 7 - 3000;
+    write_samples(server, samples.data(), samples.size());
+    bool sizes = true;
+    bool same = true;
+    for (int frame = 0; frame < 3; frame++) {
+        std::string h = receive_bytes(fd, 4);
+        size_t length = h.size() == 4 && (h[1] & 0x7f) == 126 ?
+                        ((unsigned char) h[2] << 8) | (unsigned char) h[3] : 0;
+        sizes = sizes && (unsigned char) h[0] == 0x82 && length == 640;
+        std::string payload = receive_bytes(fd, length);
+        for (size_t i = 0; i < payload.size() / 2 && same; i++)
+            same = (short) get_le(payload, 2 * i, 2) == samples[frame * 320 + i];
+    }
+    check(sizes, "websocket: binary message sizes");
+    check(same, "websocket: PCM samples");
+
+    close(fd);
+    server.stop();
+}
+
+// a client that never reads: its lag grows up to getMaxLag() and then it
+// is dropped
+static void test_slow_client()
+{
+    AudioServer<short> server(8000, 0, 1, AudioCodec::PCM, "127.0.0.1", 0.02);
+    server.setMaxLag(0.5);
+    int fd = connect_to(server.getPort(), 4096);
+    std::string header;
+    wait_for_streaming(fd, "GET /audio.wav HTTP/1.0\r\n\r\n", header);
+    check(!header.empty(), "slow client: HTTP response");
+
+    std::vector<short> frame(160);
+    double max_lag = 0;
+    for (int i = 0; i < 5000 && server.getDroppedClients() == 0; i++) {
+        write_samples(server, frame.data(), frame.size());
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        for (auto& client : server.getClients())
+            max_lag = std::max(max_lag, client.lag);
+    }
+    check(server.getDroppedClients() == 1, "slow client: dropped");
+    check(max_lag > 0 && max_lag <= server.getMaxLag(), "slow client: lag");
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    check(server.getClients().empty() && server.getTotalClients() == 1,
+          "slow client: removed");
+
+    close(fd);
+    server.stop();
+}
+
+int main(int argc, char** argv)
+{
+    test_wav();
+    test_websocket();
+    test_slow_client();
+    return test_result();
+}
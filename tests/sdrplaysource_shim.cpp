@@ -0,0 +1,54 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// SDRplaySource with the SDRplay API shim (see
+// sdrplayapishim/sdrplayapishim.cpp): the shim skips sample numbers and
+// sets the reset flag every few callbacks, and the test checks that the
+// source counts the gaps and emits the Gap, Reset, and Retune tags.
+// It needs SDRPLAY_SHIM_GAP_INTERVAL and SDRPLAY_SHIM_RESET_INTERVAL (set by
+// ctest)
+
+#include "testutil.hpp"
+#include <csdrx/sdrplaysource.hpp>
+#include <chrono>
+#include <thread>
+
+using namespace Csdrx;
+
+typedef Csdr::complex<float> CF32;
+
+int main(int argc, char** argv)
+{
+    auto source = new SDRplaySource<CF32>(nullptr, 2e6, 100e6);
+    CountingWriter<CF32> writer;
+    TagRecorder recorder;
+    source->addTagListener(&recorder);
+    source->setWriter(&writer);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    source->setFrequency(101e6);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    source->stop();
+    source->removeTagListener(&recorder);
+
+    auto gaps = recorder.get(TagType::Gap);
+    auto resets = recorder.get(TagType::Reset);
+    auto retunes = recorder.get(TagType::Retune);
+    size_t lost = 0;
+    for (auto& gap : gaps)
+        lost += gap.value;
+
+    check(writer.written > 0, "samples written");
+    check(source->getDroppedSamples() == 0, "no samples dropped");
+    check(source->getGaps() > 0 && source->getGaps() == gaps.size(), "gaps and Gap tags");
+    check(source->getLostSamples() == lost && lost > 0, "lost samples in the Gap tags");
+    check(!resets.empty(), "Reset tags");
+    check(retunes.size() == 1 && retunes[0].value == 101e6, "Retune tag");
+
+    delete source;
+
+    return test_result();
+}
@@ -0,0 +1,154 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// SoapySource with the csdrxmock driver (see soapymock/soapymock.cpp): the
+// mock injects overflows, read errors, and timeouts, and the test checks
+// that the source counts them, recovers from them, and emits the matching
+// tags; it also reads every native format, with and without direct buffer
+// access, and checks the hardware times.
+// It needs SOAPY_SDR_PLUGIN_PATH=<build dir>/soapymock (set by ctest)
+
+#include "testutil.hpp"
+#include <csdrx/soapysource.hpp>
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <thread>
+
+using namespace Csdrx;
+
+typedef Csdr::complex<float> CF32;
+
+// overflows and read errors
+static void test_events()
+{
+    auto source = new SoapySource<CF32>("driver=csdrxmock,realtime=false,mtu=4096,"
+                                        "overflow_interval=10,error_interval=25",
+                                        0, 1e6, 100e6);
+    CountingWriter<CF32> writer;
+    TagRecorder recorder;
+    source->addTagListener(&recorder);
+    source->setWriter(&writer);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    source->setFrequency(101e6);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    source->stop();
+    source->removeTagListener(&recorder);
+
+    auto gaps = recorder.get(TagType::Gap);
+    auto resets = recorder.get(TagType::Reset);
+    auto retunes = recorder.get(TagType::Retune);
+    size_t lost = 0;
+    for (auto& gap : gaps)
+        lost += gap.value;
+
+    check(writer.written > 0, "samples written");
+    check(source->getTotalSamples() == writer.written, "total samples");
+    check(source->getOverflows() > 0, "overflows");
+    check(std::to_string(source->getOverflows()) == source->readSetting("overflows"),
+          "overflows match the driver");
+    check(source->getReadErrors() > 0, "read errors");
+    check(std::to_string(source->getReadErrors()) == source->readSetting("errors"),
+          "read errors match the driver");
+    check(source->getReactivations() > 0, "stream re-activated");
+    // an overflow followed by a read error is reported by the Reset tag
+    check(!gaps.empty() && gaps.size() <= source->getOverflows(), "Gap tags");
+    check(source->getLostSamples() == lost && lost > 0, "lost samples in the Gap tags");
+    check(!resets.empty() && resets.size() <= source->getReactivations(), "Reset tags");
+    check(retunes.size() == 1 && retunes[0].value == 101e6, "Retune tag");
+    check(recorder.ordered(), "tags in sample order");
+
+    delete source;
+}
+
+// the native formats converted by the csdrx kernels, optionally straight
+// from the driver buffers: the level of the tone (amplitude 0.3) must not
+// depend on the format
+static void test_native_format(const std::string& format, bool direct_access)
+{
+    std::string what = format + (direct_access ? " direct access" : "");
+    auto source = new SoapySource<CF32>("driver=csdrxmock,realtime=false,mtu=4096,"
+                                        "noise=0,format=" + format,
+                                        0, 1e6, 100e6);
+    CountingWriter<CF32> writer;
+    source->setNativeFormat(true);
+    source->setDirectAccess(direct_access);
+    source->setSignalStats(true);
+    source->setWriter(&writer);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    source->stop();
+
+    auto stats = source->getSignalStats();
+    check(source->getStreamFormat() == format, what + ": stream format");
+    check(source->getDirectAccess() == direct_access, what + ": direct access");
+    check(writer.written > 0 && source->getTotalSamples() == writer.written,
+          what + ": samples written");
+    check(source->getConversionStats().samples > 0, what + ": samples converted");
+    check(stats.blocks > 0 && fabs(stats.rms - 0.3) < 0.02, what + ": level");
+
+    delete source;
+}
+
+// HardwareTime tags: the times follow the sample numbers
+static void test_hardware_time()
+{
+    double samplerate = 1e6;
+    auto source = new SoapySource<CF32>("driver=csdrxmock,realtime=false,mtu=4096,"
+                                        "timestamps=true",
+                                        0, samplerate, 100e6);
+    CountingWriter<CF32> writer;
+    TagRecorder recorder;
+    source->setTimestampInterval(0);
+    source->addTagListener(&recorder);
+    source->setWriter(&writer);
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    source->stop();
+    source->removeTagListener(&recorder);
+
+    auto times = recorder.get(TagType::HardwareTime);
+    bool consistent = times.size() > 1;
+    for (size_t i = 1; i < times.size() && consistent; i++) {
+        double expected = (times[i].sample - times[i - 1].sample) * 1e9 / samplerate;
+        consistent = fabs((times[i].timeNs - times[i - 1].timeNs) - expected) < 1000;
+    }
+    check(consistent, "HardwareTime tags");
+
+    delete source;
+}
+
+// read timeouts: each one waits for the read timeout (1s), so there are
+// only a few
+static void test_timeouts()
+{
+    auto source = new SoapySource<CF32>("driver=csdrxmock,realtime=false,mtu=4096,"
+                                        "timeout_interval=100,timeout_count=2",
+                                        0, 1e6, 100e6);
+    CountingWriter<CF32> writer;
+    source->setReactivateTimeouts(2);
+    source->setWriter(&writer);
+    std::this_thread::sleep_for(std::chrono::milliseconds(2500));
+    source->stop();
+
+    check(writer.written > 0, "timeouts: samples written");
+    check(source->getTimeouts() >= 2, "timeouts");
+    check(std::to_string(source->getTimeouts()) == source->readSetting("timeouts"),
+          "timeouts match the driver");
+    check(source->getReactivations() > 0, "timeouts: stream re-activated");
+
+    delete source;
+}
+
+int main(int argc, char** argv)
+{
+    test_events();
+    for (auto format : { "CS8", "CU8", "CS12", "CS16" })
+        test_native_format(format, false);
+    test_native_format("CS16", true);
+    test_hardware_time();
+    test_timeouts();
+    return test_result();
+}
@@ -0,0 +1,79 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+// helpers shared by the tests: a writer that only counts the samples, a
+// listener that records the tags, and the checks
+
+#pragma once
+
+#include <csdr/writer.hpp>
+#include <csdrx/tags.hpp>
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace Csdrx {
+
+    // counts the samples and throws them away
+    template <typename T>
+    class CountingWriter: public Csdr::Writer<T> {
+        public:
+            size_t writeable() override { return buffer.size(); }
+            T* getWritePointer() override { return buffer.data(); }
+            void advance(size_t how_much) override { written += how_much; }
+            std::atomic<size_t> written{0};
+        private:
+            std::vector<T> buffer = std::vector<T>(65536);
+    };
+
+    class TagRecorder: public TagListener {
+        public:
+            void onTag(const Tag& tag) override {
+                std::lock_guard<std::mutex> lock(mutex);
+                tags.push_back(tag);
+            }
+            std::vector<Tag> get(TagType type) {
+                std::lock_guard<std::mutex> lock(mutex);
+                std::vector<Tag> result;
+                for (auto& tag : tags)
+                    if (tag.type == type)
+                        result.push_back(tag);
+                return result;
+            }
+            bool ordered() {
+                std::lock_guard<std::mutex> lock(mutex);
+                for (size_t i = 1; i < tags.size(); i++)
+                    if (tags[i].sample < tags[i - 1].sample)
+                        return false;
+                return true;
+            }
+        private:
+            std::mutex mutex;
+            std::vector<Tag> tags;
+    };
+
+    static int failures = 0;
+
+    static inline void check(bool condition, const std::string& what)
+    {
+        std::cerr << (condition ? "ok: " : "FAILED: ") << what << std::endl;
+        if (!condition)
+            failures++;
+    }
+
+    // the exit status of the test
+    static inline int test_result()
+    {
+        if (failures > 0) {
+            std::cerr << failures << " checks failed" << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+}
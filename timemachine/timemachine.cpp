@@ -0,0 +1,302 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "timemachine.hpp"
+
+#include <csdr/complex.hpp>
+#include <csdrx/filewriter.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace Csdrx;
+
+template <typename T>
+TimeMachine<T>::TimeMachine(const char* filename, double samplerate,
+                            double history, double pre, double post):
+    filename(filename == nullptr ? "" : filename),
+    samplerate(samplerate),
+    pre_samples(pre * samplerate),
+    post_samples(post * samplerate),
+    produced(0),
+    frequency(0),
+    tag_samplerate(samplerate),
+    dumps_written(0),
+    dumps_truncated(0),
+    dumping(false)
+{
+    if (this->filename.empty())
+        throw TimeMachineException("invalid filename");
+    if (samplerate <= 0 || history <= 0 || pre < 0 || post < 0)
+        throw TimeMachineException("invalid time machine parameters");
+
+    // the oldest part of the buffer is kept as a safety margin, so a dump
+    // never reads samples that are being overwritten
+    size_t history_samples = history * samplerate;
+    margin = std::max(history_samples / 8, (size_t) 65536);
+    capacity = history_samples + margin;
+    this->history = new T[capacity];
+    // touch all the pages now, so process() never takes a page fault
+    memset((void*) this->history, 0, capacity * sizeof(T));
+
+    thread = new std::thread( [this] () { loop(); });
+}
+
+template <typename T>
+TimeMachine<T>::~TimeMachine() {
+    {
+        std::lock_guard<std::mutex> lock(dumps_mutex);
+        run = false;
+    }
+    dumps_cv.notify_one();
+    thread->join();
+    delete thread;
+    delete[] history;
+}
+
+template <typename T>
+bool TimeMachine<T>::canProcess() {
+    std::lock_guard<std::mutex> lock(this->processMutex);
+    return this->reader->available() > 0 &&
+           (this->writer == nullptr || this->writer->writeable() > 0);
+}
+
+template <typename T>
+void TimeMachine<T>::process() {
+    std::lock_guard<std::mutex> lock(this->processMutex);
+    size_t available = this->reader->available();
+    if (this->writer != nullptr) {
+        available = std::min(available, this->writer->writeable());
+        memcpy(this->writer->getWritePointer(), this->reader->getReadPointer(),
+               available * sizeof(T));
+        this->writer->advance(available);
+    }
+    append(this->reader->getReadPointer(), available);
+    this->reader->advance(available);
+}
+
+template <typename T>
+void TimeMachine<T>::append(const T* samples, size_t how_much) {
+    // blocks larger than the history only keep their tail
+    if (how_much > capacity) {
+        samples += how_much - capacity;
+        write_pos = (write_pos + how_much - capacity) % capacity;
+        produced.fetch_add(how_much - capacity, std::memory_order_relaxed);
+        how_much = capacity;
+    }
+    size_t first = std::min(how_much, capacity - write_pos);
+    memcpy(history + write_pos, samples, first * sizeof(T));
+    memcpy(history, samples + first, (how_much - first) * sizeof(T));
+    write_pos = (write_pos + how_much) % capacity;
+    produced.fetch_add(how_much, std::memory_order_release);
+}
+
+template <typename T>
+void TimeMachine<T>::trigger() {
+    trigger(pre_samples / samplerate, post_samples / samplerate);
+}
+
+template <typename T>
+void TimeMachine<T>::trigger(double pre, double post) {
+    trigger_at(produced.load(std::memory_order_acquire), pre, post);
+}
+
+template <typename T>
+void TimeMachine<T>::onTag(const Tag& tag) {
+    if (tag.type == TagType::Trigger)
+        trigger_at((size_t) (tag.sample * (samplerate / tag_samplerate)),
+                   pre_samples / samplerate, post_samples / samplerate);
+}
+
+// 'sample' can be in the past (a tag delivered late) or in the future
+template <typename T>
+void TimeMachine<T>::trigger_at(size_t sample, double pre, double post) {
+    size_t now = produced.load(std::memory_order_acquire);
+    size_t before = std::min((size_t) (pre * samplerate), capacity - margin);
+    Dump dump;
+    dump.start = sample > before ? sample - before : 0;
+    dump.end = sample + (size_t) (post * samplerate);
+    // the time of the first sample, from the time of the latest one
+    clock_gettime(CLOCK_REALTIME, &dump.start_time);
+    double start_offset = ((double) now - (double) dump.start) / samplerate;
+    double start_offset_s = floor(start_offset);
+    dump.start_time.tv_sec -= (time_t) start_offset_s;
+    dump.start_time.tv_nsec -= (long) ((start_offset - start_offset_s) * 1e9);
+    if (dump.start_time.tv_nsec < 0) {
+        dump.start_time.tv_sec--;
+        dump.start_time.tv_nsec += 1000000000;
+    }
+    dump.frequency = frequency;
+
+    {
+        std::lock_guard<std::mutex> lock(dumps_mutex);
+        // overlapping triggers extend the last pending dump
+        if (!dumps.empty() && dump.start <= dumps.back().end) {
+            dumps.back().end = std::max(dumps.back().end, dump.end);
+        } else {
+            dumps.push_back(dump);
+        }
+    }
+    dumps_cv.notify_one();
+}
+
+// background thread
+template <typename T>
+void TimeMachine<T>::loop() {
+    while (true) {
+        Dump dump;
+        {
+            std::unique_lock<std::mutex> lock(dumps_mutex);
+            dumps_cv.wait(lock, [this] { return !dumps.empty() || !run; });
+            if (!run)
+                break;
+            dump = dumps.front();
+        }
+        dumping = true;
+        write_dump(dump);
+        {
+            std::lock_guard<std::mutex> lock(dumps_mutex);
+            // the dump was extended by another trigger while it was written;
+            // keep going in the same file
+            if (dumps.front().end > dump.end && run) {
+                dumps.front().start = dump.end;
+                continue;
+            }
+            dumps.pop_front();
+        }
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+            dumps_written++;
+        }
+        if (truncated)
+            dumps_truncated++;
+        truncated = false;
+        dumping = false;
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+template <typename T>
+void TimeMachine<T>::write_dump(const Dump& dump) {
+    if (fd < 0) {
+        current_filename = format_filename(filename, dump.start_time,
+                                           dump.frequency, sequence,
+                                           filename.find('%') == std::string::npos);
+        sequence++;
+        fd = open(current_filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            std::cerr << "TimeMachine: unable to open " << current_filename << " for writing: " << strerror(errno) << std::endl;
+            return;
+        }
+        bool write_meta;
+        std::string meta_description;
+        {
+            std::lock_guard<std::mutex> lock(dumps_mutex);
+            write_meta = sigmf;
+            meta_description = description;
+        }
+        if (write_meta)
+            write_sigmf_meta(current_filename, sigmf_datatype<T>(), samplerate,
+                             dump.frequency, dump.start_time,
+                             meta_description.c_str());
+    }
+
+    size_t pos = dump.start;
+    while (pos < dump.end) {
+        size_t available = produced.load(std::memory_order_acquire);
+        if (available <= pos) {
+            std::unique_lock<std::mutex> lock(dumps_mutex);
+            if (!run)
+                break;
+            dumps_cv.wait_for(lock, std::chrono::milliseconds(50));
+            continue;
+        }
+        // samples older than this may be overwritten while we write them
+        size_t oldest = available > capacity - margin ? available - (capacity - margin) : 0;
+        if (pos < oldest) {
+            truncated = true;
+            pos = oldest;
+        }
+        // small chunks, so the check above is repeated long before the
+        // producer can catch up with the samples being written
+        size_t end = std::min(available, dump.end);
+        size_t idx = pos % capacity;
+        size_t samples = std::min(std::min(end - pos, capacity - idx),
+                                  std::max(margin / 4, (size_t) 1));
+        const char* data = (const char*) (history + idx);
+        size_t bytes = samples * sizeof(T);
+        while (bytes > 0) {
+            ssize_t written = ::write(fd, data, bytes);
+            if (written < 0) {
+                if (errno == EINTR)
+                    continue;
+                std::cerr << "TimeMachine: write to " << current_filename << " failed: " << strerror(errno) << std::endl;
+                ::close(fd);
+                fd = -1;
+                return;
+            }
+            data += written;
+            bytes -= written;
+        }
+        // the write was so slow that the producer overwrote the chunk
+        if (produced.load(std::memory_order_acquire) > pos + capacity)
+            truncated = true;
+        pos += samples;
+    }
+}
+
+// setters
+template <typename T>
+void TimeMachine<T>::setSigMF(const char* description) {
+    std::lock_guard<std::mutex> lock(dumps_mutex);
+    sigmf = true;
+    this->description = description == nullptr ? "" : description;
+}
+
+template <typename T>
+void TimeMachine<T>::setFrequency(double frequency) {
+    this->frequency = frequency;
+}
+
+template <typename T>
+void TimeMachine<T>::setTagSamplerate(double samplerate) {
+    if (samplerate <= 0)
+        throw TimeMachineException("invalid tag sample rate");
+    tag_samplerate = samplerate;
+}
+
+// getters
+template <typename T>
+unsigned int TimeMachine<T>::getDumpsWritten() const {
+    return dumps_written;
+}
+
+template <typename T>
+unsigned int TimeMachine<T>::getDumpsTruncated() const {
+    return dumps_truncated;
+}
+
+template <typename T>
+bool TimeMachine<T>::isDumping() const {
+    return dumping;
+}
+
+namespace Csdrx {
+    template class TimeMachine<unsigned char>;
+    template class TimeMachine<short>;
+    template class TimeMachine<float>;
+    template class TimeMachine<Csdr::complex<short>>;
+    template class TimeMachine<Csdr::complex<float>>;
+}
@@ -0,0 +1,99 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2021 Franco Venturi.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#pragma once
+
+#include <csdr/module.hpp>
+#include <csdrx/tags.hpp>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <time.h>
+
+namespace Csdrx {
+
+    class TimeMachineException: public std::runtime_error {
+        public:
+            TimeMachineException(const std::string& reason): std::runtime_error(reason) {}
+    };
+
+    // pass-through module that keeps the last 'history' seconds of samples
+    // in memory; on a trigger the samples from 'pre' seconds before to 'post'
+    // seconds after the trigger are written to disk by a background thread.
+    // It can also be used as the last stage of a pipeline branch (i.e. with
+    // no writer)
+    template <typename T>
+    class TimeMachine: public Csdr::Module<T, T>, public TagListener {
+        public:
+            // filename can contain strftime() conversions (expanded in UTC
+            // with the time of the first sample in the dump) and '{frequency}'
+            TimeMachine(const char* filename, double samplerate,
+                        double history = 30, double pre = 10, double post = 5);
+            ~TimeMachine() override;
+            bool canProcess() override;
+            void process() override;
+            void trigger();
+            void trigger(double pre, double post);
+            // tags of type Trigger start a dump centered on the tagged sample
+            void onTag(const Tag& tag) override;
+            // setters
+            void setSigMF(const char* description = nullptr);
+            // sample rate of the Trigger tags, when the emitter is further
+            // down the chain (for instance a DsdDecoder at 48kHz); default:
+            // the sample rate of the time machine
+            void setTagSamplerate(double samplerate);
+            void setFrequency(double frequency);
+            // getters
+            unsigned int getDumpsWritten() const;
+            unsigned int getDumpsTruncated() const;
+            bool isDumping() const;
+        private:
+            struct Dump {
+                size_t start;
+                size_t end;
+                struct timespec start_time;
+                double frequency;
+            };
+            void append(const T* samples, size_t how_much);
+            void trigger_at(size_t sample, double pre, double post);
+            void loop();
+            void write_dump(const Dump& dump);
+
+            std::string filename;
+            double samplerate;
+            size_t capacity;
+            size_t margin;
+            size_t pre_samples;
+            size_t post_samples;
+            T* history;
+            size_t write_pos = 0;
+            std::atomic<size_t> produced;
+            std::atomic<double> frequency;
+            std::atomic<double> tag_samplerate;
+            // dump requests and the SigMF settings
+            std::deque<Dump> dumps;
+            bool sigmf = false;
+            std::string description;
+            std::mutex dumps_mutex;
+            std::condition_variable dumps_cv;
+            bool run = true;
+            std::thread* thread = nullptr;
+            // background thread state
+            int fd = -1;
+            std::string current_filename;
+            unsigned int sequence = 0;
+            bool truncated = false;
+            // statistics
+            std::atomic<unsigned int> dumps_written;
+            std::atomic<unsigned int> dumps_truncated;
+            std::atomic<bool> dumping;
+    };
+}